@@ -0,0 +1,28 @@
+#pragma once
+
+#include <butil/crc32c.h>
+#include <pain/base/types.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+namespace pain {
+
+// crc32c of the first n bytes of buf, extended from crc
+// the backing blocks are checksummed in place, buf is never flattened,
+// butil uses the sse4.2 crc32 instruction when the cpu has it
+inline uint32_t crc32c(const IOBuf& buf, size_t n, uint32_t crc = 0) {
+    for (size_t i = 0; i < buf.backing_block_num() && n > 0; i++) {
+        auto block = buf.backing_block(i);
+        auto len = std::min(block.size(), n);
+        crc = butil::crc32c::Extend(crc, block.data(), len);
+        n -= len;
+    }
+    return crc;
+}
+
+inline uint32_t crc32c(const IOBuf& buf) {
+    return crc32c(buf, buf.size());
+}
+
+} // namespace pain
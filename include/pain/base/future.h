@@ -1,13 +1,20 @@
 #pragma once
 
 #include <bthread/bthread.h>
-#include <bthread/condition_variable.h>
-#include <bthread/mutex.h>
+#include <bthread/countdown_event.h>
 #include <cstdlib>
 
+#include <atomic>
+#include <cstdint>
 #include <exception>
+#include <functional>
 #include <memory>
-#include <mutex>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include <boost/assert.hpp>
 
@@ -25,238 +32,381 @@ class Future;
 template <>
 class Future<void>;
 
+namespace detail {
+
+// a type-erased callable run once when the future becomes ready, it releases itself after running
+class Continuation {
+public:
+    virtual ~Continuation() = default;
+    virtual void run() = 0;
+};
+
+template <typename F>
+class ContinuationImpl : public Continuation {
+public:
+    explicit ContinuationImpl(F f) : _f(std::move(f)) {}
+    void run() override {
+        _f();
+        delete this;
+    }
+
+private:
+    F _f;
+};
+
+// wake up a thread blocked in get(), it lives on the stack of the waiting thread
+class WaitContinuation : public Continuation {
+public:
+    void run() override {
+        _event.signal();
+    }
+    void wait() {
+        _event.wait();
+    }
+
+private:
+    bthread::CountdownEvent _event{1};
+};
+
+template <typename U, typename F, typename... Args>
+Future<U> invoke_future(F& f, Args&&... args);
+
+template <typename T>
+void forward_to(Future<T> future, Promise<T> promise);
+
 template <typename T>
-struct FutureState {
-    enum class State {
+struct is_future : std::false_type {};
+
+template <typename T>
+struct is_future<Future<T>> : std::true_type {};
+
+// then() flattens a continuation returning Future<U> into Future<U>
+template <typename T>
+struct unwrap_future {
+    using type = T;
+};
+
+template <typename T>
+struct unwrap_future<Future<T>> {
+    using type = T;
+};
+
+} // namespace detail
+
+// FutureState is shared by a Promise and its Future, it is lock free:
+//   - the value is written by the promise before the state is published by an atomic exchange
+//   - at most one continuation is installed by a compare-exchange, whichever of the promise and
+//     the continuation comes second runs the continuation
+//   - get() blocks by installing a continuation on its own stack
+template <typename T>
+class FutureStateBase {
+public:
+    enum class State : uint8_t {
         kFuture,
-        kResult,
-        kException,
+        kCallback, // a continuation is installed, the value is not set yet
+        kReady,
     };
 
-    union Any {
-        Any() {}
-        ~Any() {}
-        T value;
-        std::exception_ptr ex;
-    } u;
+    FutureStateBase() = default;
+    FutureStateBase(const FutureStateBase&) = delete;
+    FutureStateBase& operator=(const FutureStateBase&) = delete;
 
-    ~FutureState() {
-        std::lock_guard guard(_mutex);
-        switch (state) {
-        case State::kFuture:
-            break;
-        case State::kResult:
-            u.value.~T();
-            break;
-        case State::kException:
-            u.ex.~exception_ptr();
-            break;
-        default:
-            abort();
-        }
+    bool available() const {
+        return _state.load(std::memory_order_acquire) == State::kReady;
     }
 
     bool failed() const {
-        std::lock_guard guard(_mutex);
-        return state == State::kException;
+        return available() && _has_exception;
     }
 
-    template <typename A>
-    void set_value(A&& value) {
-        std::lock_guard guard(_mutex);
-        BOOST_ASSERT(state == State::kFuture);
-        state = State::kResult;
-        new (&u.value) T(std::forward<A>(value));
-        _cond.notify_one();
+    std::exception_ptr exception() const {
+        return failed() ? _ex : nullptr;
     }
 
     void set_exception(std::exception_ptr ex) {
-        std::lock_guard guard(_mutex);
-        state = State::kException;
-        u.ex = std::move(ex);
-        _cond.notify_one();
+        _ex = std::move(ex);
+        _has_exception = true;
+        publish();
+    }
+
+    // f is run once the state is ready, by the thread setting the value,
+    // or right here if it is ready already
+    template <typename F>
+    void set_callback(F&& f) {
+        if (available()) {
+            f();
+            return;
+        }
+        install(new detail::ContinuationImpl<std::decay_t<F>>(std::forward<F>(f)));
     }
 
-    T get() {
-        std::unique_lock guard(_mutex);
-        while (state == State::kFuture) {
-            _cond.wait(guard);
+protected:
+    ~FutureStateBase() = default;
+
+    void publish() {
+        auto prev = _state.exchange(State::kReady, std::memory_order_acq_rel);
+        BOOST_ASSERT_MSG(prev != State::kReady, "the value is set twice");
+        if (prev == State::kCallback) {
+            _callback->run();
         }
-        if (state == State::kException) {
-            std::rethrow_exception(u.ex);
+    }
+
+    void install(detail::Continuation* callback) {
+        _callback = callback;
+        auto expected = State::kFuture;
+        if (!_state.compare_exchange_strong(expected, State::kCallback, std::memory_order_acq_rel)) {
+            // the value is set in between
+            BOOST_ASSERT(expected == State::kReady);
+            callback->run();
         }
-        return std::move(u.value);
     }
 
-    bool available() const {
-        std::lock_guard guard(_mutex);
-        return state == State::kResult || state == State::kException;
+    void wait() {
+        if (available()) {
+            return;
+        }
+        detail::WaitContinuation waiter;
+        install(&waiter);
+        waiter.wait();
     }
 
-    State state = State::kFuture;
-    Promise<T>* promise = nullptr;
+    std::exception_ptr _ex;
+    bool _has_exception = false;
 
 private:
-    mutable bthread::Mutex _mutex;
-    mutable bthread::ConditionVariable _cond;
+    std::atomic<State> _state = State::kFuture;
+    detail::Continuation* _callback = nullptr;
 };
 
-template <>
-class FutureState<void> {
+template <typename T>
+class FutureState : public FutureStateBase<T> {
 public:
-    enum class State {
-        kFuture,
-        kResult,
-        kException,
-    };
-
-    union Any {
-        Any() {}
-        ~Any() {}
-        std::exception_ptr ex;
-    } u;
-
+    FutureState() {}
     ~FutureState() {
-        std::lock_guard guard(_mutex);
-        switch (state) {
-        case State::kFuture:
-            break;
-        case State::kResult:
-            break;
-        case State::kException:
-            u.ex.~exception_ptr();
-            break;
-        default:
-            abort();
+        if (this->available() && !this->_has_exception) {
+            _value.~T();
         }
     }
 
-    bool failed() const {
-        std::lock_guard guard(_mutex);
-        return state == State::kException;
+    template <typename A>
+    void set_value(A&& value) {
+        new (&_value) T(std::forward<A>(value));
+        this->publish();
     }
 
-    void set_value() {
-        std::lock_guard guard(_mutex);
-        BOOST_ASSERT(state == State::kFuture);
-        state = State::kResult;
-        _cond.notify_one();
+    T get() {
+        this->wait();
+        if (this->_has_exception) {
+            std::rethrow_exception(this->_ex);
+        }
+        return std::move(_value);
     }
 
-    void set_exception(std::exception_ptr ex) {
-        std::lock_guard guard(_mutex);
-        state = State::kException;
-        u.ex = std::move(ex);
-        _cond.notify_one();
+private:
+    union {
+        T _value;
+    };
+};
+
+template <>
+class FutureState<void> : public FutureStateBase<void> {
+public:
+    void set_value() {
+        publish();
     }
 
     void get() {
-        std::unique_lock guard(_mutex);
-        while (state == State::kFuture) {
-            _cond.wait(guard);
-        }
-        if (state == State::kException) {
-            std::rethrow_exception(u.ex);
+        wait();
+        if (_has_exception) {
+            std::rethrow_exception(_ex);
         }
     }
-
-    bool available() const {
-        std::lock_guard guard(_mutex);
-        return state == State::kResult || state == State::kException;
-    }
-
-    State state = State::kFuture;
-    Promise<void>* promise = nullptr;
-
-private:
-    mutable bthread::Mutex _mutex;
-    mutable bthread::ConditionVariable _cond;
 };
 
+// a Future made by make_ready_future carries its value inline, nothing is allocated or synchronized
 template <typename T>
 class Future {
 public:
     Future() = default;
-    Future(Future&& rhs) {
-        _state = std::move(rhs._state);
-    }
-
-    Future(std::shared_ptr<FutureState<T>> state) : _state(state) {}
-
+    Future(Future&& rhs) noexcept : _state(std::move(rhs._state)), _value(std::exchange(rhs._value, std::nullopt)) {}
     ~Future() = default;
 
-    Future& operator=(Future&& rhs) {
+    Future& operator=(Future&& rhs) noexcept {
         if (this == &rhs) {
             return *this;
         }
         _state = std::move(rhs._state);
+        _value = std::exchange(rhs._value, std::nullopt);
         return *this;
     }
 
+    Future(std::shared_ptr<FutureState<T>> state) : _state(std::move(state)) {}
+
+    template <typename A>
+    explicit Future(std::in_place_t, A&& value) : _value(std::in_place, std::forward<A>(value)) {}
+
     T get() {
+        if (_value.has_value()) {
+            return std::move(*_value);
+        }
         return _state->get();
     }
 
+    bool valid() const {
+        return _value.has_value() || _state != nullptr;
+    }
+
+    bool is_ready() const {
+        return _value.has_value() || _state->available();
+    }
+
+    // f(T) is called once the value is ready, on the thread which sets the value,
+    // the future returned holds the result of f. An exception skips f and is passed on.
+    // this future is consumed, it can't be used any more.
+    template <typename F>
+    auto then(F&& f) -> Future<typename detail::unwrap_future<std::invoke_result_t<F, T>>::type> {
+        using U = typename detail::unwrap_future<std::invoke_result_t<F, T>>::type;
+        if (_value.has_value()) {
+            // ready fast path, f runs right here
+            auto value = std::move(*_value);
+            _value.reset();
+            return detail::invoke_future<U>(f, std::move(value));
+        }
+        Promise<U> promise;
+        auto future = promise.get_future();
+        on_ready([promise = std::move(promise), f = std::forward<F>(f)](Future<T> ready) mutable {
+            if (auto ex = ready._state->exception()) {
+                promise.set_exception(ex);
+                return;
+            }
+            detail::forward_to(detail::invoke_future<U>(f, ready.get()), std::move(promise));
+        });
+        return future;
+    }
+
 private:
+    template <typename U>
+    friend Future<std::vector<U>> when_all(std::vector<Future<U>> futures);
+    template <typename U>
+    friend Future<std::pair<size_t, U>> when_any(std::vector<Future<U>> futures);
+    template <typename U>
+    friend void detail::forward_to(Future<U> future, Promise<U> promise);
+
+    // f(Future<T>) is called with this future once it is ready, get() on it never blocks
+    template <typename F>
+    void on_ready(F&& f) {
+        if (_value.has_value()) {
+            f(std::move(*this));
+            return;
+        }
+        auto state = std::move(_state);
+        auto raw = state.get();
+        raw->set_callback([state = std::move(state), f = std::forward<F>(f)]() mutable {
+            f(Future<T>(std::move(state)));
+        });
+    }
+
     std::shared_ptr<FutureState<T>> _state;
+    std::optional<T> _value;
 };
 
 template <>
 class Future<void> {
 public:
     Future() = default;
-    Future(Future&& rhs) {
-        _state = std::move(rhs._state);
-    }
-
-    Future(std::shared_ptr<FutureState<void>> state) : _state(state) {}
-
+    Future(Future&& rhs) noexcept : _state(std::move(rhs._state)), _ready(std::exchange(rhs._ready, false)) {}
     ~Future() = default;
 
-    Future& operator=(Future&& rhs) {
+    Future& operator=(Future&& rhs) noexcept {
         if (this == &rhs) {
             return *this;
         }
         _state = std::move(rhs._state);
+        _ready = std::exchange(rhs._ready, false);
         return *this;
     }
 
+    Future(std::shared_ptr<FutureState<void>> state) : _state(std::move(state)) {}
+
+    explicit Future(std::in_place_t) : _ready(true) {}
+
     void get() {
+        if (_ready) {
+            return;
+        }
         _state->get();
     }
 
+    bool valid() const {
+        return _ready || _state != nullptr;
+    }
+
+    bool is_ready() const {
+        return _ready || _state->available();
+    }
+
+    // f() is called once the future is ready, see Future<T>::then
+    template <typename F>
+    auto then(F&& f) -> Future<typename detail::unwrap_future<std::invoke_result_t<F>>::type> {
+        using U = typename detail::unwrap_future<std::invoke_result_t<F>>::type;
+        if (_ready) {
+            _ready = false;
+            return detail::invoke_future<U>(f);
+        }
+        Promise<U> promise;
+        auto future = promise.get_future();
+        on_ready([promise = std::move(promise), f = std::forward<F>(f)](Future<void> ready) mutable {
+            if (auto ex = ready._state->exception()) {
+                promise.set_exception(ex);
+                return;
+            }
+            detail::forward_to(detail::invoke_future<U>(f), std::move(promise));
+        });
+        return future;
+    }
+
 private:
+    friend Future<void> when_all(std::vector<Future<void>> futures);
+    friend Future<size_t> when_any(std::vector<Future<void>> futures);
+    template <typename U>
+    friend void detail::forward_to(Future<U> future, Promise<U> promise);
+
+    template <typename F>
+    void on_ready(F&& f) {
+        if (_ready) {
+            f(std::move(*this));
+            return;
+        }
+        auto state = std::move(_state);
+        auto raw = state.get();
+        raw->set_callback([state = std::move(state), f = std::forward<F>(f)]() mutable {
+            f(Future<void>(std::move(state)));
+        });
+    }
+
     std::shared_ptr<FutureState<void>> _state;
+    bool _ready = false;
 };
 
 template <typename T>
 class Promise {
 public:
     Promise(const Promise&) = delete;
-    Promise() : _state(std::make_shared<FutureState<T>>()) {
-        _state->promise = this;
-    }
+    Promise() : _state(std::make_shared<FutureState<T>>()) {}
 
     ~Promise() {
         if (_state && !_state->available()) {
             _state->set_exception(std::make_exception_ptr(std::runtime_error("Broken Promise")));
         }
-        if (_state) {
-            _state->promise = nullptr;
-        }
     }
 
-    Promise(Promise&& other) noexcept {
-        _state = std::exchange(other._state, nullptr);
-        _state->promise = this;
-    }
+    Promise(Promise&& other) noexcept : _state(std::exchange(other._state, nullptr)) {}
 
     Promise& operator=(Promise&& other) noexcept {
         if (this == &other) {
             return *this;
         }
-        _state = std::move(other._state);
-        _state->promise = this;
+        _state = std::exchange(other._state, nullptr);
         return *this;
     }
 
@@ -286,30 +436,21 @@ template <>
 class Promise<void> {
 public:
     Promise(const Promise&) = delete;
-    Promise() : _state(std::make_shared<FutureState<void>>()) {
-        _state->promise = this;
-    }
+    Promise() : _state(std::make_shared<FutureState<void>>()) {}
 
     ~Promise() {
         if (_state && !_state->available()) {
             _state->set_exception(std::make_exception_ptr(std::runtime_error("Broken Promise")));
         }
-        if (_state) {
-            _state->promise = nullptr;
-        }
     }
 
-    Promise(Promise&& other) noexcept {
-        _state = std::exchange(other._state, nullptr);
-        _state->promise = this;
-    }
+    Promise(Promise&& other) noexcept : _state(std::exchange(other._state, nullptr)) {}
 
     Promise& operator=(Promise&& other) noexcept {
         if (this == &other) {
             return *this;
         }
-        _state = std::move(other._state);
-        _state->promise = this;
+        _state = std::exchange(other._state, nullptr);
         return *this;
     }
 
@@ -326,21 +467,197 @@ public:
         _state->set_exception(std::move(ex));
     }
 
+    bool is_ready() const {
+        return _state->available();
+    }
+
 private:
     std::shared_ptr<FutureState<void>> _state;
 };
 
 template <typename T>
-Future<T> make_ready_future(T&& value) {
-    Promise<T> p;
-    p.set_value(std::forward<T>(value));
-    return p.get_future();
+Future<std::decay_t<T>> make_ready_future(T&& value) {
+    return Future<std::decay_t<T>>(std::in_place, std::forward<T>(value));
 }
 
 inline Future<void> make_ready_future() {
-    Promise<void> p;
-    p.set_value();
+    return Future<void>(std::in_place);
+}
+
+template <typename T>
+Future<T> make_exception_future(std::exception_ptr ex) {
+    Promise<T> p;
+    p.set_exception(std::move(ex));
     return p.get_future();
 }
 
+namespace detail {
+
+// the result of f(args...) as a future, the exception thrown by f included
+template <typename U, typename F, typename... Args>
+Future<U> invoke_future(F& f, Args&&... args) {
+    using R = std::invoke_result_t<F&, Args...>;
+    try {
+        if constexpr (is_future<R>::value) {
+            return std::invoke(f, std::forward<Args>(args)...);
+        } else if constexpr (std::is_void_v<R>) {
+            std::invoke(f, std::forward<Args>(args)...);
+            return make_ready_future();
+        } else {
+            return make_ready_future(std::invoke(f, std::forward<Args>(args)...));
+        }
+    } catch (...) {
+        return make_exception_future<U>(std::current_exception());
+    }
+}
+
+// complete promise with the result of future once it is ready
+template <typename T>
+void forward_to(Future<T> future, Promise<T> promise) {
+    future.on_ready([promise = std::move(promise)](Future<T> ready) mutable {
+        try {
+            if constexpr (std::is_void_v<T>) {
+                ready.get();
+                promise.set_value();
+            } else {
+                promise.set_value(ready.get());
+            }
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+        }
+    });
+}
+
+} // namespace detail
+
+// the future returned is ready when all futures are ready, with their values in the same order,
+// or the first exception if any of them failed
+template <typename T>
+Future<std::vector<T>> when_all(std::vector<Future<T>> futures) {
+    struct Context {
+        explicit Context(size_t n) : values(n), remaining(n) {}
+        std::vector<std::optional<T>> values;
+        std::atomic<size_t> remaining;
+        std::atomic<bool> failed = false;
+        std::exception_ptr ex;
+        Promise<std::vector<T>> promise;
+    };
+    if (futures.empty()) {
+        return make_ready_future(std::vector<T>());
+    }
+    auto ctx = std::make_shared<Context>(futures.size());
+    auto result = ctx->promise.get_future();
+    for (size_t i = 0; i < futures.size(); i++) {
+        futures[i].on_ready([ctx, i](Future<T> ready) {
+            try {
+                ctx->values[i].emplace(ready.get());
+            } catch (...) {
+                if (!ctx->failed.exchange(true, std::memory_order_relaxed)) {
+                    ctx->ex = std::current_exception();
+                }
+            }
+            // the last one completes the promise, acq_rel makes all values visible to it
+            if (ctx->remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+                return;
+            }
+            if (ctx->failed.load(std::memory_order_relaxed)) {
+                ctx->promise.set_exception(ctx->ex);
+                return;
+            }
+            std::vector<T> values;
+            values.reserve(ctx->values.size());
+            for (auto& value : ctx->values) {
+                values.emplace_back(std::move(*value));
+            }
+            ctx->promise.set_value(std::move(values));
+        });
+    }
+    return result;
+}
+
+inline Future<void> when_all(std::vector<Future<void>> futures) {
+    struct Context {
+        explicit Context(size_t n) : remaining(n) {}
+        std::atomic<size_t> remaining;
+        std::atomic<bool> failed = false;
+        std::exception_ptr ex;
+        Promise<void> promise;
+    };
+    if (futures.empty()) {
+        return make_ready_future();
+    }
+    auto ctx = std::make_shared<Context>(futures.size());
+    auto result = ctx->promise.get_future();
+    for (auto& future : futures) {
+        future.on_ready([ctx](Future<void> ready) {
+            try {
+                ready.get();
+            } catch (...) {
+                if (!ctx->failed.exchange(true, std::memory_order_relaxed)) {
+                    ctx->ex = std::current_exception();
+                }
+            }
+            if (ctx->remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+                return;
+            }
+            if (ctx->failed.load(std::memory_order_relaxed)) {
+                ctx->promise.set_exception(ctx->ex);
+                return;
+            }
+            ctx->promise.set_value();
+        });
+    }
+    return result;
+}
+
+// the future returned is ready when the first of futures is ready, with its index and value,
+// the others are still waited but their results are dropped. futures must not be empty
+template <typename T>
+Future<std::pair<size_t, T>> when_any(std::vector<Future<T>> futures) {
+    struct Context {
+        std::atomic<bool> done = false;
+        Promise<std::pair<size_t, T>> promise;
+    };
+    BOOST_ASSERT_MSG(!futures.empty(), "when_any on no future");
+    auto ctx = std::make_shared<Context>();
+    auto result = ctx->promise.get_future();
+    for (size_t i = 0; i < futures.size(); i++) {
+        futures[i].on_ready([ctx, i](Future<T> ready) {
+            if (ctx->done.exchange(true, std::memory_order_acq_rel)) {
+                return;
+            }
+            try {
+                ctx->promise.set_value(std::pair<size_t, T>(i, ready.get()));
+            } catch (...) {
+                ctx->promise.set_exception(std::current_exception());
+            }
+        });
+    }
+    return result;
+}
+
+inline Future<size_t> when_any(std::vector<Future<void>> futures) {
+    struct Context {
+        std::atomic<bool> done = false;
+        Promise<size_t> promise;
+    };
+    BOOST_ASSERT_MSG(!futures.empty(), "when_any on no future");
+    auto ctx = std::make_shared<Context>();
+    auto result = ctx->promise.get_future();
+    for (size_t i = 0; i < futures.size(); i++) {
+        futures[i].on_ready([ctx, i](Future<void> ready) {
+            if (ctx->done.exchange(true, std::memory_order_acq_rel)) {
+                return;
+            }
+            try {
+                ready.get();
+                ctx->promise.set_value(i);
+            } catch (...) {
+                ctx->promise.set_exception(std::current_exception());
+            }
+        });
+    }
+    return result;
+}
+
 } // namespace pain
@@ -15,6 +15,7 @@ public:
     std::string ErrorText() const override;
     void StartCancel() override;
     void SetFailed(const std::string& reason) override;
+    void SetFailed(uint32_t error_code, const std::string& reason);
     bool IsCanceled() const override;
     void NotifyOnCancel(google::protobuf::Closure* callback) override;
     uint32_t error_code() const;
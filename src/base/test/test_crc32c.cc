@@ -0,0 +1,46 @@
+#include <gtest/gtest.h>
+#include <pain/base/crc32c.h>
+#include <string>
+
+// NOLINTBEGIN(readability-magic-numbers)
+namespace {
+using namespace pain;
+
+TEST(Crc32c, KnownValue) {
+    IOBuf buf;
+    buf.append("123456789");
+    ASSERT_EQ(crc32c(buf), 0xE3069283);
+    ASSERT_EQ(crc32c(IOBuf()), 0);
+}
+
+TEST(Crc32c, MultipleBlocks) {
+    // 多个 backing block 的结果与连续内存一致
+    std::string data;
+    IOBuf buf;
+    for (int i = 0; i < 100; i++) {
+        std::string piece(1000 + i, static_cast<char>('a' + i % 26));
+        IOBuf block;
+        block.append(piece);
+        buf.append(block);
+        data += piece;
+    }
+    ASSERT_GT(buf.backing_block_num(), 1);
+    ASSERT_EQ(crc32c(buf), butil::crc32c::Value(data.data(), data.size()));
+}
+
+TEST(Crc32c, Prefix) {
+    IOBuf buf;
+    buf.append("hello, ");
+    IOBuf world;
+    world.append("world");
+    buf.append(world);
+    ASSERT_EQ(crc32c(buf, 5), butil::crc32c::Value("hello", 5));
+    ASSERT_EQ(crc32c(buf, 9), butil::crc32c::Value("hello, wo", 9));
+    // 从已有的 crc 继续计算
+    IOBuf tail;
+    tail.append("world");
+    ASSERT_EQ(crc32c(tail, 5, butil::crc32c::Value("hello, ", 7)), crc32c(buf));
+}
+
+} // namespace
+// NOLINTEND(readability-magic-numbers)
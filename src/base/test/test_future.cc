@@ -0,0 +1,285 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <pain/base/future.h>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// NOLINTBEGIN(readability-magic-numbers)
+namespace {
+using namespace pain;
+
+TEST(TestFuture, ReadyFuture) {
+    auto future = make_ready_future(42);
+    ASSERT_TRUE(future.is_ready());
+    ASSERT_EQ(future.get(), 42);
+}
+
+TEST(TestFuture, SetValueFromAnotherThread) {
+    Promise<std::string> promise;
+    auto future = promise.get_future();
+    ASSERT_FALSE(future.is_ready());
+    std::thread t([&promise]() {
+        promise.set_value(std::string("hello"));
+    });
+    ASSERT_EQ(future.get(), "hello");
+    t.join();
+}
+
+TEST(TestFuture, BrokenPromise) {
+    Future<int> future;
+    {
+        Promise<int> promise;
+        future = promise.get_future();
+    }
+    ASSERT_THROW(future.get(), std::runtime_error);
+}
+
+TEST(TestFuture, ThenOnReadyFuture) {
+    auto future = make_ready_future(1).then([](int v) {
+        return v + 1;
+    });
+    ASSERT_EQ(future.get(), 2);
+}
+
+TEST(TestFuture, ThenRunsOnCompletion) {
+    Promise<int> promise;
+    std::atomic<bool> called = false;
+    auto future = promise.get_future().then([&called](int v) {
+        called = true;
+        return std::to_string(v);
+    });
+    ASSERT_FALSE(called);
+    promise.set_value(7);
+    ASSERT_TRUE(called);
+    ASSERT_EQ(future.get(), "7");
+}
+
+TEST(TestFuture, ThenChain) {
+    Promise<int> promise;
+    auto future = promise.get_future()
+                      .then([](int v) {
+                          return v * 2;
+                      })
+                      .then([](int v) {
+                          return v + 1;
+                      })
+                      .then([](int v) {
+                          ASSERT_EQ(v, 21);
+                      });
+    promise.set_value(10);
+    future.get();
+}
+
+TEST(TestFuture, ThenReturningFuture) {
+    Promise<int> outer;
+    Promise<int> inner;
+    auto inner_future = inner.get_future();
+    auto future = outer.get_future().then([&inner_future](int v) mutable {
+        return std::move(inner_future).then([v](int w) {
+            return v + w;
+        });
+    });
+    outer.set_value(1);
+    ASSERT_FALSE(future.is_ready());
+    inner.set_value(2);
+    ASSERT_EQ(future.get(), 3);
+}
+
+TEST(TestFuture, ThenPropagatesException) {
+    Promise<int> promise;
+    bool called = false;
+    auto future = promise.get_future().then([&called](int v) {
+        called = true;
+        return v;
+    });
+    promise.set_exception(std::make_exception_ptr(std::runtime_error("failed")));
+    ASSERT_THROW(future.get(), std::runtime_error);
+    ASSERT_FALSE(called);
+}
+
+TEST(TestFuture, ThenCatchesException) {
+    auto future = make_ready_future(1).then([](int) -> int {
+        throw std::runtime_error("failed");
+    });
+    ASSERT_THROW(future.get(), std::runtime_error);
+}
+
+TEST(TestFuture, ThenOnVoidFuture) {
+    Promise<void> promise;
+    auto future = promise.get_future().then([]() {
+        return 5;
+    });
+    promise.set_value();
+    ASSERT_EQ(future.get(), 5);
+}
+
+TEST(TestFuture, ThenMoveOnlyValue) {
+    auto future = make_ready_future(std::make_unique<int>(3)).then([](std::unique_ptr<int> v) {
+        return *v;
+    });
+    ASSERT_EQ(future.get(), 3);
+}
+
+TEST(TestFuture, WhenAll) {
+    std::vector<Promise<int>> promises(10);
+    std::vector<Future<int>> futures;
+    for (auto& promise : promises) {
+        futures.emplace_back(promise.get_future());
+    }
+    auto all = when_all(std::move(futures));
+    std::vector<std::thread> threads;
+    for (int i = 9; i >= 0; --i) {
+        threads.emplace_back([&promises, i]() {
+            promises[i].set_value(i);
+        });
+    }
+    auto values = all.get();
+    for (auto& t : threads) {
+        t.join();
+    }
+    ASSERT_EQ(values.size(), 10);
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_EQ(values[i], i);
+    }
+}
+
+TEST(TestFuture, WhenAllEmpty) {
+    auto all = when_all(std::vector<Future<int>>());
+    ASSERT_TRUE(all.get().empty());
+}
+
+TEST(TestFuture, WhenAllException) {
+    Promise<int> p1;
+    Promise<int> p2;
+    std::vector<Future<int>> futures;
+    futures.emplace_back(p1.get_future());
+    futures.emplace_back(p2.get_future());
+    auto all = when_all(std::move(futures));
+    p1.set_exception(std::make_exception_ptr(std::runtime_error("failed")));
+    ASSERT_FALSE(all.is_ready());
+    p2.set_value(2);
+    ASSERT_THROW(all.get(), std::runtime_error);
+}
+
+TEST(TestFuture, WhenAllVoid) {
+    Promise<void> p1;
+    Promise<void> p2;
+    std::vector<Future<void>> futures;
+    futures.emplace_back(p1.get_future());
+    futures.emplace_back(p2.get_future());
+    auto all = when_all(std::move(futures));
+    p1.set_value();
+    ASSERT_FALSE(all.is_ready());
+    p2.set_value();
+    all.get();
+}
+
+TEST(TestFuture, ReadyFutureIsInline) {
+    // a ready future doesn't share any state
+    auto future = make_ready_future(std::string("hello"));
+    ASSERT_TRUE(future.valid());
+    ASSERT_TRUE(future.is_ready());
+    auto moved = std::move(future);
+    ASSERT_FALSE(future.valid());
+    ASSERT_EQ(moved.get(), "hello");
+}
+
+TEST(TestFuture, ThenOnReadyFutureRunsInline) {
+    bool called = false;
+    auto future = make_ready_future().then([&called]() {
+        called = true;
+    });
+    ASSERT_TRUE(called);
+    ASSERT_TRUE(future.is_ready());
+    future.get();
+}
+
+TEST(TestFuture, ExceptionFuture) {
+    auto future = make_exception_future<int>(std::make_exception_ptr(std::runtime_error("failed")));
+    ASSERT_TRUE(future.is_ready());
+    ASSERT_THROW(future.get(), std::runtime_error);
+}
+
+TEST(TestFuture, GetBlocksUntilSet) {
+    for (int i = 0; i < 1000; ++i) {
+        Promise<int> promise;
+        auto future = promise.get_future();
+        std::thread t([&promise, i]() {
+            promise.set_value(i);
+        });
+        ASSERT_EQ(future.get(), i);
+        t.join();
+    }
+}
+
+TEST(TestFuture, ThenRacesWithSetValue) {
+    for (int i = 0; i < 1000; ++i) {
+        Promise<int> promise;
+        auto future = promise.get_future();
+        std::thread t([&promise, i]() {
+            promise.set_value(i);
+        });
+        auto result = future.then([](int v) {
+            return v + 1;
+        });
+        ASSERT_EQ(result.get(), i + 1);
+        t.join();
+    }
+}
+
+TEST(TestFuture, WhenAllWithReadyFutures) {
+    Promise<int> promise;
+    std::vector<Future<int>> futures;
+    futures.emplace_back(make_ready_future(1));
+    futures.emplace_back(promise.get_future());
+    auto all = when_all(std::move(futures));
+    ASSERT_FALSE(all.is_ready());
+    promise.set_value(2);
+    ASSERT_THAT(all.get(), ::testing::ElementsAre(1, 2));
+}
+
+TEST(TestFuture, WhenAny) {
+    std::vector<Promise<int>> promises(3);
+    std::vector<Future<int>> futures;
+    for (auto& promise : promises) {
+        futures.emplace_back(promise.get_future());
+    }
+    auto any = when_any(std::move(futures));
+    ASSERT_FALSE(any.is_ready());
+    promises[1].set_value(10);
+    auto [index, value] = any.get();
+    ASSERT_EQ(index, 1);
+    ASSERT_EQ(value, 10);
+    // the others are dropped
+    promises[0].set_value(0);
+    promises[2].set_value(2);
+}
+
+TEST(TestFuture, WhenAnyException) {
+    Promise<int> p1;
+    Promise<int> p2;
+    std::vector<Future<int>> futures;
+    futures.emplace_back(p1.get_future());
+    futures.emplace_back(p2.get_future());
+    auto any = when_any(std::move(futures));
+    p2.set_exception(std::make_exception_ptr(std::runtime_error("failed")));
+    ASSERT_THROW(any.get(), std::runtime_error);
+    p1.set_value(1);
+}
+
+TEST(TestFuture, WhenAnyVoid) {
+    Promise<void> p1;
+    std::vector<Future<void>> futures;
+    futures.emplace_back(p1.get_future());
+    futures.emplace_back(make_ready_future());
+    auto any = when_any(std::move(futures));
+    ASSERT_EQ(any.get(), 1);
+    p1.set_value();
+}
+
+} // namespace
+// NOLINTEND(readability-magic-numbers)
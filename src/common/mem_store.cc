@@ -0,0 +1,135 @@
+#include "common/mem_store.h"
+#include <algorithm>
+#include <format>
+#include <mutex>
+
+namespace pain::common {
+
+namespace {
+
+// iterates over a copy of the keys with the prefix, so that the writes after it's created are not visible
+class MemStoreIterator : public Store::Iterator {
+public:
+    explicit MemStoreIterator(std::vector<std::pair<std::string, std::string>> items) : _items(std::move(items)) {}
+
+    bool valid() override {
+        return _pos < _items.size();
+    }
+
+    std::string_view key() override {
+        return _items[_pos].first;
+    }
+
+    std::string_view value() override {
+        return _items[_pos].second;
+    }
+
+    void next() override {
+        _pos++;
+    }
+
+private:
+    std::vector<std::pair<std::string, std::string>> _items;
+    size_t _pos = 0;
+};
+
+template <typename Map>
+std::shared_ptr<Store::Iterator> scan(const Map& map, std::string_view prefix, std::string_view from = {}) {
+    std::vector<std::pair<std::string, std::string>> items;
+    for (auto it = map.lower_bound(std::max(prefix, from)); it != map.end() && it->first.starts_with(prefix); ++it) {
+        items.emplace_back(it->first, it->second);
+    }
+    return std::make_shared<MemStoreIterator>(std::move(items));
+}
+
+template <typename Map>
+class MemStoreSnapshot : public Store::Snapshot {
+public:
+    explicit MemStoreSnapshot(Map map) : _map(std::move(map)) {}
+
+    std::shared_ptr<Store::Iterator> hgetall(std::string_view key) override {
+        return scan(_map, key);
+    }
+
+private:
+    Map _map;
+};
+
+} // namespace
+
+std::string MemStore::make_key(std::string_view key, std::string_view field) {
+    return std::format("{}_{}", key, field);
+}
+
+Status MemStore::hset(std::string_view key, std::string_view field, std::string_view value) {
+    std::unique_lock lock(_mutex);
+    _map.insert_or_assign(make_key(key, field), std::string(value));
+    return Status::OK();
+}
+
+Status MemStore::hget(std::string_view key, std::string_view field, std::string* value) {
+    std::unique_lock lock(_mutex);
+    auto it = _map.find(make_key(key, field));
+    if (it == _map.end()) {
+        return Status(ENOENT, "not found");
+    }
+    *value = it->second;
+    return Status::OK();
+}
+
+Status MemStore::hdel(std::string_view key, std::string_view field) {
+    std::unique_lock lock(_mutex);
+    _map.erase(make_key(key, field));
+    return Status::OK();
+}
+
+Status MemStore::hlen(std::string_view key, size_t* len) {
+    auto it = hgetall(key);
+    size_t size = 0;
+    while (it->valid()) {
+        it->next();
+        ++size;
+    }
+    *len = size;
+    return Status::OK();
+}
+
+std::shared_ptr<Store::Iterator> MemStore::hgetall(std::string_view key) {
+    std::unique_lock lock(_mutex);
+    return scan(_map, key);
+}
+
+std::shared_ptr<Store::Iterator> MemStore::hscan(std::string_view key, std::string_view from_field) {
+    std::unique_lock lock(_mutex);
+    return scan(_map, key, make_key(key, from_field));
+}
+
+bool MemStore::hexists(std::string_view key, std::string_view field) {
+    std::unique_lock lock(_mutex);
+    return _map.contains(make_key(key, field));
+}
+
+Status MemStore::write(const WriteBatch& batch) {
+    std::unique_lock lock(_mutex);
+    for (const auto& write : batch.writes()) {
+        if (write.value.has_value()) {
+            _map.insert_or_assign(make_key(write.key, write.field), *write.value);
+        } else {
+            _map.erase(make_key(write.key, write.field));
+        }
+    }
+    return Status::OK();
+}
+
+Status MemStore::clear() {
+    std::unique_lock lock(_mutex);
+    _map.clear();
+    return Status::OK();
+}
+
+std::shared_ptr<Store::Snapshot> MemStore::snapshot() {
+    std::unique_lock lock(_mutex);
+    return std::make_shared<MemStoreSnapshot<Map>>(_map);
+}
+
+} // namespace pain::common
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <bthread/mutex.h>
+#include <map>
+#include <memory>
+#include <string>
+#include "common/store.h"
+
+namespace pain::common {
+class MemStore;
+using MemStorePtr = boost::intrusive_ptr<MemStore>;
+// MemStore keeps the keys in memory, a snapshot of it is a copy of the keys
+class MemStore : public Store {
+public:
+    Status hset(std::string_view key, std::string_view field, std::string_view value) override;
+    Status hget(std::string_view key, std::string_view field, std::string* value) override;
+    Status hdel(std::string_view key, std::string_view field) override;
+    Status hlen(std::string_view key, size_t* len) override;
+    std::shared_ptr<Iterator> hgetall(std::string_view key) override;
+    std::shared_ptr<Iterator> hscan(std::string_view key, std::string_view from_field) override;
+    bool hexists(std::string_view key, std::string_view field) override;
+    Status write(const WriteBatch& batch) override;
+    Status clear() override;
+    std::shared_ptr<Snapshot> snapshot() override;
+
+private:
+    using Map = std::map<std::string, std::string, std::less<>>;
+    static std::string make_key(std::string_view key, std::string_view field);
+
+    Map _map;
+    mutable bthread::Mutex _mutex;
+};
+
+} // namespace pain::common
@@ -5,6 +5,7 @@
 #include <pain/base/types.h>
 #include <rocksdb/db.h>
 #include <rocksdb/utilities/checkpoint.h>
+#include <rocksdb/write_batch.h>
 #include <string>
 #include <boost/assert.hpp>
 
@@ -236,6 +237,9 @@ Status RocksdbStore::hset(std::string_view key, std::string_view field, std::str
 Status RocksdbStore::hget(std::string_view key, std::string_view field, std::string* value) {
     rocksdb::ReadOptions options;
     rocksdb::Status status = _db->Get(options, make_key(key, field), value);
+    if (status.IsNotFound()) {
+        return Status(ENOENT, "not found");
+    }
     if (!status.ok()) {
         PLOG_ERROR(("desc", "hget failed") //
                    ("key", key)("field", field)("error", status.ToString()));
@@ -303,10 +307,92 @@ std::shared_ptr<RocksdbStore::Iterator> RocksdbStore::hgetall(std::string_view k
     return std::make_shared<RocksdbStoreIterator>(iter, key);
 }
 
+std::shared_ptr<RocksdbStore::Iterator> RocksdbStore::hscan(std::string_view key, std::string_view from_field) {
+    rocksdb::ReadOptions options;
+    rocksdb::Iterator* iter = _db->NewIterator(options);
+    iter->Seek(make_key(key, from_field));
+    return std::make_shared<RocksdbStoreIterator>(iter, key);
+}
+
 bool RocksdbStore::hexists(std::string_view key, std::string_view field) {
     std::string value;
     auto status = hget(key, field, &value);
     return status.ok();
 }
 
+Status RocksdbStore::write(const WriteBatch& batch) {
+    rocksdb::WriteBatch write_batch;
+    for (const auto& write : batch.writes()) {
+        auto key = make_key(write.key, write.field);
+        auto status = write.value.has_value() ? write_batch.Put(key, *write.value) : write_batch.Delete(key);
+        if (!status.ok()) {
+            return Status(EIO, status.ToString());
+        }
+    }
+    rocksdb::WriteOptions options;
+    options.disableWAL = true;
+    options.sync = false;
+    rocksdb::Status status = _db->Write(options, &write_batch);
+    if (!status.ok()) {
+        PLOG_ERROR(("desc", "write batch failed") //
+                   ("count", batch.writes().size())("error", status.ToString()));
+        return Status(EIO, status.ToString());
+    }
+    return Status::OK();
+}
+
+Status RocksdbStore::clear() {
+    std::string last_key;
+    {
+        std::unique_ptr<rocksdb::Iterator> iter(_db->NewIterator(rocksdb::ReadOptions()));
+        iter->SeekToLast();
+        if (!iter->Valid()) {
+            return Status::OK();
+        }
+        last_key = iter->key().ToString();
+    }
+    // the end of the range is exclusive
+    last_key.push_back('\0');
+    rocksdb::WriteOptions options;
+    options.disableWAL = true;
+    options.sync = false;
+    rocksdb::Status status = _db->DeleteRange(options, _db->DefaultColumnFamily(), "", last_key);
+    if (!status.ok()) {
+        PLOG_ERROR(("desc", "clear failed") //
+                   ("error", status.ToString()));
+        return Status(EIO, status.ToString());
+    }
+    return Status::OK();
+}
+
+class RocksdbStoreSnapshot : public RocksdbStore::Snapshot {
+public:
+    RocksdbStoreSnapshot(RocksdbStorePtr store, rocksdb::DB* db) :
+        _store(std::move(store)),
+        _db(db),
+        _snapshot(db->GetSnapshot()) {}
+    ~RocksdbStoreSnapshot() override {
+        _db->ReleaseSnapshot(_snapshot);
+    }
+
+    std::shared_ptr<RocksdbStore::Iterator> hgetall(std::string_view key) override {
+        rocksdb::ReadOptions options;
+        options.snapshot = _snapshot;
+        // a scan over a snapshot is usually a full one, keep it out of the block cache
+        options.fill_cache = false;
+        rocksdb::Iterator* iter = _db->NewIterator(options);
+        iter->Seek(key);
+        return std::make_shared<RocksdbStoreIterator>(iter, key);
+    }
+
+private:
+    RocksdbStorePtr _store;
+    rocksdb::DB* _db;
+    const rocksdb::Snapshot* _snapshot;
+};
+
+std::shared_ptr<RocksdbStore::Snapshot> RocksdbStore::snapshot() {
+    return std::make_shared<RocksdbStoreSnapshot>(RocksdbStorePtr(this), _db);
+}
+
 } // namespace pain::common
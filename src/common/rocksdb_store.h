@@ -22,7 +22,11 @@ public:
     Status hdel(std::string_view key, std::string_view field) override;
     Status hlen(std::string_view key, size_t* len) override;
     std::shared_ptr<Iterator> hgetall(std::string_view key) override;
+    std::shared_ptr<Iterator> hscan(std::string_view key, std::string_view from_field) override;
     bool hexists(std::string_view key, std::string_view field) override;
+    Status write(const WriteBatch& batch) override;
+    Status clear() override;
+    std::shared_ptr<Snapshot> snapshot() override;
 
 private:
     std::string make_key(std::string_view key, std::string_view field) const;
@@ -3,7 +3,10 @@
 #include <pain/base/types.h>
 #include <atomic>
 #include <memory>
+#include <optional>
+#include <string>
 #include <string_view>
+#include <vector>
 #include <boost/intrusive_ptr.hpp>
 
 namespace pain::common {
@@ -21,13 +24,57 @@ public:
         virtual void next() = 0;
     };
 
+    // the writes committed atomically by write
+    class WriteBatch {
+    public:
+        struct Write {
+            std::string key;
+            std::string field;
+            // the field is deleted if there's no value
+            std::optional<std::string> value;
+        };
+
+        void hset(std::string_view key, std::string_view field, std::string_view value) {
+            _writes.push_back({std::string(key), std::string(field), std::string(value)});
+        }
+        void hdel(std::string_view key, std::string_view field) {
+            _writes.push_back({std::string(key), std::string(field), std::nullopt});
+        }
+        const std::vector<Write>& writes() const {
+            return _writes;
+        }
+        bool empty() const {
+            return _writes.empty();
+        }
+        void clear() {
+            _writes.clear();
+        }
+
+    private:
+        std::vector<Write> _writes;
+    };
+
+    // a consistent view of the store at the time it's taken, the later writes are not visible to it
+    class Snapshot {
+    public:
+        virtual ~Snapshot() = default;
+        virtual std::shared_ptr<Iterator> hgetall(std::string_view key) = 0;
+    };
+
     virtual ~Store() = default;
     virtual Status hset(std::string_view key, std::string_view field, std::string_view value) = 0;
+    // ENOENT if the field doesn't exist
     virtual Status hget(std::string_view key, std::string_view field, std::string* value) = 0;
     virtual Status hdel(std::string_view key, std::string_view field) = 0;
     virtual Status hlen(std::string_view key, size_t* len) = 0;
     virtual std::shared_ptr<Iterator> hgetall(std::string_view key) = 0;
+    // the fields of key from from_field on, in the order of the fields
+    virtual std::shared_ptr<Iterator> hscan(std::string_view key, std::string_view from_field) = 0;
     virtual bool hexists(std::string_view key, std::string_view field) = 0;
+    virtual Status write(const WriteBatch& batch) = 0;
+    // remove all the keys
+    virtual Status clear() = 0;
+    virtual std::shared_ptr<Snapshot> snapshot() = 0;
 
 private:
     std::atomic<int> _use_count;
@@ -156,3 +156,53 @@ TEST_F(RocksdbStoreTest, check_point) {
 
     store->close();
 }
+
+TEST_F(RocksdbStoreTest, write_batch) {
+    RocksdbStorePtr store;
+    auto status = RocksdbStore::open("./test_rocksdb", &store);
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    create_data(store);
+
+    Store::WriteBatch batch;
+    batch.hset("pain", "name", "nami");
+    batch.hdel("pain", "age");
+    batch.hset("sad", "name", "sanji");
+    status = store->write(batch);
+    ASSERT_TRUE(status.ok()) << status.error_str();
+
+    std::string value;
+    status = store->hget("pain", "name", &value);
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(value, "nami");
+    status = store->hget("pain", "age", &value);
+    ASSERT_EQ(status.error_code(), ENOENT);
+    ASSERT_TRUE(store->hexists("sad", "name"));
+    store->close();
+}
+
+TEST_F(RocksdbStoreTest, snapshot_and_clear) {
+    RocksdbStorePtr store;
+    auto status = RocksdbStore::open("./test_rocksdb", &store);
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    create_data(store);
+
+    auto snapshot = store->snapshot();
+    status = store->hset("pain", "bounty", "3000000000");
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    status = store->clear();
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    size_t len = 0;
+    status = store->hlen("pain", &len);
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(len, 0);
+
+    // the snapshot sees the keys before it's taken only
+    size_t count = 0;
+    for (auto it = snapshot->hgetall("pain"); it->valid(); it->next()) {
+        ASSERT_NE(it->key(), "pain_bounty");
+        count++;
+    }
+    ASSERT_EQ(count, 4);
+    snapshot.reset();
+    store->close();
+}
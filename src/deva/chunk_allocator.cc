@@ -0,0 +1,143 @@
+#include "deva/chunk_allocator.h"
+
+#include <brpc/callback.h>
+#include <brpc/channel.h>
+#include <brpc/controller.h>
+#include <gflags/gflags.h>
+#include <pain/base/plog.h>
+#include <pain/base/tracer.h>
+#include <format>
+#include <mutex>
+#include "pain/proto/manusya.pb.h"
+
+DEFINE_string(deva_manusya_locations, "", "The comma separated addresses of the manusyas chunks are placed on");
+DEFINE_uint32(deva_chunk_replica_count, 3, "The number of replicas of a chunk");
+DEFINE_int32(deva_manusya_timeout_ms, 10000, "The timeout of the chunk requests to manusya");
+DEFINE_int32(deva_manusya_connect_timeout_ms, 2000, "The connect timeout of the chunk requests to manusya");
+
+namespace pain::deva {
+
+namespace {
+
+// the state of a create request, deleted when the call is done
+struct CreateCall {
+    brpc::Controller cntl;
+    proto::manusya::CreateChunkRequest request;
+    proto::manusya::CreateChunkResponse response;
+    std::shared_ptr<brpc::Channel> channel;
+    Promise<Status> promise;
+};
+
+void on_create_done(CreateCall* call) {
+    std::unique_ptr<CreateCall> guard(call);
+    if (call->cntl.Failed()) {
+        call->promise.set_value(Status(call->cntl.ErrorCode(), call->cntl.ErrorText()));
+        return;
+    }
+    if (call->response.header().status() != 0) {
+        call->promise.set_value(
+            Status(static_cast<int>(call->response.header().status()), call->response.header().message()));
+        return;
+    }
+    call->promise.set_value(Status::OK());
+}
+
+std::vector<std::string> split_locations(const std::string& locations) {
+    std::vector<std::string> result;
+    size_t begin = 0;
+    while (begin <= locations.size()) {
+        auto end = locations.find(',', begin);
+        if (end == std::string::npos) {
+            end = locations.size();
+        }
+        if (end > begin) {
+            result.emplace_back(locations, begin, end - begin);
+        }
+        begin = end + 1;
+    }
+    return result;
+}
+
+} // namespace
+
+ChunkAllocator& ChunkAllocator::instance() {
+    static ChunkAllocator s_allocator;
+    return s_allocator;
+}
+
+Status ChunkAllocator::allocate(uint32_t replica_count, UUID* chunk_id, std::vector<std::string>* locations) {
+    auto manusyas = split_locations(FLAGS_deva_manusya_locations);
+    if (replica_count == 0) {
+        replica_count = FLAGS_deva_chunk_replica_count;
+    }
+    if (replica_count == 0 || manusyas.size() < replica_count) {
+        return Status(ENOSPC,
+                      std::format("{} manusyas for {} replicas of a chunk", manusyas.size(), replica_count));
+    }
+    auto uuid = UUID::generate();
+    auto first = _next.fetch_add(1, std::memory_order_relaxed);
+    std::vector<std::string> picked;
+    std::vector<Future<Status>> futures;
+    for (size_t i = 0; i < replica_count; i++) {
+        picked.push_back(manusyas[(first + i) % manusyas.size()]);
+        futures.emplace_back(create_replica(picked.back(), uuid));
+    }
+    // the replicas already created are left behind as empty chunks if any other fails
+    Status status;
+    for (size_t i = 0; i < futures.size(); i++) {
+        auto replica_status = futures[i].get();
+        if (!replica_status.ok()) {
+            PLOG_ERROR(("desc", "failed to create replica")("chunk", uuid.str())("location", picked[i])(
+                "error", replica_status.error_str()));
+            if (status.ok()) {
+                status = std::move(replica_status);
+            }
+        }
+    }
+    if (!status.ok()) {
+        return status;
+    }
+    *chunk_id = uuid;
+    *locations = std::move(picked);
+    return Status::OK();
+}
+
+Status ChunkAllocator::channel(const std::string& location, std::shared_ptr<brpc::Channel>* channel) {
+    std::unique_lock lock(_mutex);
+    auto it = _channels.find(location);
+    if (it != _channels.end()) {
+        *channel = it->second;
+        return Status::OK();
+    }
+    brpc::ChannelOptions options;
+    options.timeout_ms = FLAGS_deva_manusya_timeout_ms;
+    options.connect_timeout_ms = FLAGS_deva_manusya_connect_timeout_ms;
+    // a retried create fails with EEXIST if the first one has reached manusya
+    options.max_retry = 0;
+    auto new_channel = std::make_shared<brpc::Channel>();
+    if (new_channel->Init(location.c_str(), &options) != 0) {
+        return Status(EINVAL, std::format("failed to init channel to {}", location));
+    }
+    _channels.emplace(location, new_channel);
+    *channel = std::move(new_channel);
+    return Status::OK();
+}
+
+Future<Status> ChunkAllocator::create_replica(const std::string& location, const UUID& chunk_id) {
+    auto* call = new CreateCall();
+    auto status = channel(location, &call->channel);
+    if (!status.ok()) {
+        delete call;
+        return make_ready_future(std::move(status));
+    }
+    call->request.mutable_chunk_id()->set_low(chunk_id.low());
+    call->request.mutable_chunk_id()->set_high(chunk_id.high());
+    inject_tracer(&call->cntl);
+
+    auto future = call->promise.get_future();
+    proto::manusya::ManusyaService_Stub stub(call->channel.get());
+    stub.CreateChunk(&call->cntl, &call->request, &call->response, brpc::NewCallback(on_create_done, call));
+    return future;
+}
+
+} // namespace pain::deva
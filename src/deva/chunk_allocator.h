@@ -0,0 +1,48 @@
+#pragma once
+
+#include <bthread/mutex.h>
+#include <pain/base/future.h>
+#include <pain/base/types.h>
+#include <pain/base/uuid.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace brpc {
+class Channel;
+}
+
+namespace pain::deva {
+
+// ChunkAllocator places the replicas of a new chunk on the manusyas of deva_manusya_locations, round robin,
+// and creates a replica on each of them under the uuid of the chunk, so the sdk appends to all the replicas
+// by that uuid. The create requests are virtual so that tests can replace manusya.
+class ChunkAllocator {
+public:
+    ChunkAllocator() = default;
+    virtual ~ChunkAllocator() = default;
+
+    ChunkAllocator(const ChunkAllocator&) = delete;
+    ChunkAllocator& operator=(const ChunkAllocator&) = delete;
+
+    static ChunkAllocator& instance();
+
+    // the chunk is allocated only if all of its replicas are created, locations are where they are,
+    // deva_chunk_replica_count replicas if replica_count is 0
+    Status allocate(uint32_t replica_count, UUID* chunk_id, std::vector<std::string>* locations);
+
+protected:
+    // the future is ready when manusya has created the replica
+    virtual Future<Status> create_replica(const std::string& location, const UUID& chunk_id);
+
+private:
+    Status channel(const std::string& location, std::shared_ptr<brpc::Channel>* channel);
+
+    std::atomic<uint64_t> _next = {};
+    bthread::Mutex _mutex;
+    std::unordered_map<std::string, std::shared_ptr<brpc::Channel>> _channels;
+};
+
+} // namespace pain::deva
@@ -2,17 +2,27 @@
 
 #include <pain/base/types.h>
 #include <atomic>
+#include <functional>
 #include <string>
 #include <string_view>
+#include <vector>
 #include <boost/intrusive_ptr.hpp>
 
 namespace pain::deva {
 
 class Container {
 public:
+    // writes the files of a snapshot into the directory path and returns their names in files
+    using SnapshotSaver = std::move_only_function<Status(const std::string& path, std::vector<std::string>* files)>;
+
     virtual ~Container() = default;
-    virtual Status save_snapshot(std::string_view path, std::vector<std::string>* files) = 0;
+    // called on the apply thread, the saver holds a view of the state as of the last applied op
+    // and is run on a background bthread, so the applies go on while the snapshot is written
+    virtual SnapshotSaver save_snapshot() = 0;
     virtual Status load_snapshot(std::string_view path) = 0;
+    // called on the apply thread after a batch of log entries is applied,
+    // the changes made by the batch are written to the storage together
+    virtual Status commit() = 0;
 
 private:
     std::atomic<int> _use_count = 0;
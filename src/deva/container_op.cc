@@ -26,6 +26,7 @@ OpPtr decode(OpType op_type, IOBuf* buf, RsmPtr rsm) {
     auto op = [](OpType op_type, IOBuf* buf, RsmPtr rsm) -> OpPtr {
         switch (op_type) {
             BRANCH(CreateFile)
+            BRANCH(CreateDir)
             BRANCH(RemoveFile)
             BRANCH(SealFile)
             BRANCH(CreateChunk)
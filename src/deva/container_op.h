@@ -4,24 +4,37 @@
 #include <pain/base/plog.h>
 #include <pain/base/types.h>
 #include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
 #include "deva/macro.h"
 #include "deva/op.h"
 #include "deva/rsm.h"
 
 namespace pain::deva {
 
+// OpClosure completes the ops of a log entry in their order, a single op or a batch of them
 class OpClosure : public braft::Closure {
 public:
-    OpClosure(OpPtr op, std::shared_ptr<opentelemetry::trace::Span> span) : _op(op), _span(span) {}
+    OpClosure() = default;
+    OpClosure(OpPtr op, std::shared_ptr<opentelemetry::trace::Span> span) {
+        add(std::move(op), std::move(span));
+    }
+
+    void add(OpPtr op, std::shared_ptr<opentelemetry::trace::Span> span) {
+        _ops.emplace_back(std::move(op), std::move(span));
+    }
 
     void Run() override {
-        opentelemetry::trace::Scope scope(_span);
         std::unique_ptr<OpClosure> guard(this);
-        if (status().ok()) {
-            _op->on_apply(_index);
-            return;
+        for (auto& [op, span] : _ops) {
+            opentelemetry::trace::Scope scope(span);
+            if (status().ok()) {
+                op->on_apply(_index);
+                continue;
+            }
+            op->on_finish(status());
         }
-        _op->on_finish(status());
     }
 
     void set_index(int64_t index) {
@@ -30,8 +43,7 @@ public:
 
 private:
     int64_t _index = 0;
-    OpPtr _op;
-    std::shared_ptr<opentelemetry::trace::Span> _span;
+    std::vector<std::pair<OpPtr, std::shared_ptr<opentelemetry::trace::Span>>> _ops;
 };
 
 OpPtr decode(OpType op_type, IOBuf* buf, RsmPtr rsm);
@@ -57,14 +69,7 @@ public:
 
     void apply() override {
         SPAN(span);
-        braft::Task task;
-        IOBuf buf;
-        OpPtr self(this);
-        pain::deva::encode(self, &buf);
-        task.data = &buf;
-        task.done = new OpClosure(self, span);
-        task.expected_term = -1;
-        _rsm->apply(task);
+        _rsm->propose(OpPtr(this), span);
         PLOG_DEBUG(("desc", "apply op")("type", _type));
     }
 
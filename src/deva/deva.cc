@@ -1,7 +1,9 @@
 #include "deva/deva.h"
 #include <pain/base/plog.h>
 #include <pain/base/uuid.h>
+#include "common/rocksdb_store.h"
 #include "deva/macro.h"
+#include "deva/snapshot_file.h"
 
 #define DEVA_METHOD(name)                                                                                              \
     Status Deva::name([[maybe_unused]] const pain::proto::deva::store::name##Request* request,                         \
@@ -10,6 +12,80 @@
 
 namespace pain::deva {
 
+namespace {
+
+constexpr const char* kNamespaceFile = "namespace";
+constexpr const char* kFileInfosFile = "file_infos";
+
+// a record is a file info: uuid (high, low), size of the message, the serialized message
+Status save_file_infos(const FileInfos& file_infos, const std::string& path) {
+    SnapshotFileWriter writer;
+    auto status = writer.open(path);
+    if (!status.ok()) {
+        return status;
+    }
+    for (const auto& [uuid, file_info] : file_infos) {
+        auto* record = writer.record();
+        put_fixed(record, uuid.high());
+        put_fixed(record, uuid.low());
+        put_fixed(record, static_cast<uint32_t>(file_info->ByteSizeLong()));
+        file_info->AppendToString(record);
+        writer.end_record();
+    }
+    return writer.finish();
+}
+
+Status decode_file_infos(const SnapshotRecords& records, FileInfos* file_infos) {
+    SnapshotRecordReader reader(records.data);
+    std::string message;
+    file_infos->reserve(records.count);
+    for (uint32_t i = 0; i < records.count; i++) {
+        uint64_t high = 0;
+        uint64_t low = 0;
+        uint32_t size = 0;
+        if (!reader.get_fixed(&high) || !reader.get_fixed(&low) || !reader.get_fixed(&size) ||
+            !reader.read(&message, size)) {
+            return Status(EIO, "truncated file info record");
+        }
+        auto file_info = std::make_shared<proto::FileInfo>();
+        if (!file_info->ParseFromString(message)) {
+            return Status(EIO, "invalid file info record");
+        }
+        file_infos->emplace(UUID(high, low), std::move(file_info));
+    }
+    if (!reader.empty()) {
+        return Status(EIO, "trailing bytes in file info section");
+    }
+    return Status::OK();
+}
+
+Status load_file_infos(const std::string& path, FileInfos* file_infos) {
+    std::vector<SnapshotRecords> sections;
+    auto status = read_snapshot_file(path, &sections);
+    if (!status.ok()) {
+        return status;
+    }
+    std::vector<FileInfos> parts(sections.size());
+    status = parallel_run(sections.size(), [&sections, &parts](size_t i) {
+        return decode_file_infos(sections[i], &parts[i]);
+    });
+    if (!status.ok()) {
+        return status;
+    }
+    size_t count = 0;
+    for (const auto& part : parts) {
+        count += part.size();
+    }
+    file_infos->clear();
+    file_infos->reserve(count);
+    for (auto& part : parts) {
+        file_infos->merge(part);
+    }
+    return Status::OK();
+}
+
+} // namespace
+
 Status Deva::create(const std::string& path, const UUID& id, FileType type) {
     SPAN(span);
     PLOG_DEBUG(("desc", "create")("path", path)("id", id.str())("type", type));
@@ -37,6 +113,55 @@ Status Deva::create(const std::string& path, const UUID& id, FileType type) {
     return Status::OK();
 }
 
+Status Deva::append_chunk(const proto::UUID& file_id,
+                          const proto::UUID* sealed,
+                          uint64_t length,
+                          proto::ChunkInfo* chunk) {
+    UUID file_uuid(file_id.high(), file_id.low());
+    auto file_info = _file_infos.get(file_uuid);
+    if (file_info == nullptr) {
+        return Status(ENOENT, fmt::format("file {} not found", file_uuid.str()));
+    }
+    if (file_info->type() != proto::FileType::FILE_TYPE_FILE) {
+        return Status(EINVAL, fmt::format("{} is not a file", file_uuid.str()));
+    }
+    // a file info is replaced rather than modified, the views of the snapshots share the old one
+    auto updated = std::make_shared<proto::FileInfo>(*file_info);
+    auto* chunks = updated->mutable_chunk_infos();
+    uint64_t offset = 0;
+    if (!chunks->empty()) {
+        auto* last = chunks->Mutable(chunks->size() - 1);
+        if (sealed == nullptr) {
+            if (last->state() != proto::CHUNK_STATE_SEALED) {
+                return Status(EBUSY, fmt::format("the last chunk of {} is not sealed", file_uuid.str()));
+            }
+        } else {
+            UUID sealed_uuid(sealed->high(), sealed->low());
+            if (last->uuid().high() != sealed->high() || last->uuid().low() != sealed->low()) {
+                return Status(EINVAL,
+                              fmt::format("{} is not the last chunk of {}", sealed_uuid.str(), file_uuid.str()));
+            }
+            // a chunk sealed already, e.g. the last one of a file opened again, is sealed again at its length
+            if (last->state() == proto::CHUNK_STATE_SEALED && last->length() != length) {
+                return Status(EINVAL,
+                              fmt::format("{} is sealed at {}, not {}", sealed_uuid.str(), last->length(), length));
+            }
+            last->set_length(length);
+            last->set_state(proto::CHUNK_STATE_SEALED);
+        }
+        offset = last->offset() + last->length();
+    } else if (sealed != nullptr) {
+        return Status(EINVAL, fmt::format("{} has no chunk to seal", file_uuid.str()));
+    }
+    chunk->set_index(chunks->size());
+    chunk->set_offset(offset);
+    chunk->set_length(0);
+    *chunks->Add() = *chunk;
+    updated->set_size(offset);
+    _file_infos.set(file_uuid, std::move(updated));
+    return Status::OK();
+}
+
 DEVA_METHOD(CreateFile) {
     SPAN(span);
     PLOG_DEBUG(("desc", "create_file")("index", index)("request", request->DebugString()));
@@ -58,7 +183,7 @@ DEVA_METHOD(CreateFile) {
     file_info->set_mode(request->mode());
     file_info->set_uid(request->uid());
     file_info->set_gid(request->gid());
-    _file_infos[file_uuid] = *file_info;
+    _file_infos.set(file_uuid, std::make_shared<const proto::FileInfo>(*file_info));
     return Status::OK();
 }
 
@@ -83,7 +208,7 @@ DEVA_METHOD(CreateDir) {
     file_info->set_mode(request->mode());
     file_info->set_uid(request->uid());
     file_info->set_gid(request->gid());
-    _file_infos[dir_uuid] = *file_info;
+    _file_infos.set(dir_uuid, std::make_shared<const proto::FileInfo>(*file_info));
     return Status::OK();
 }
 
@@ -101,8 +226,9 @@ DEVA_METHOD(SealFile) {
 
 DEVA_METHOD(CreateChunk) {
     SPAN(span);
-    PLOG_INFO(("desc", "remove")("index", index));
-    return Status::OK();
+    PLOG_DEBUG(("desc", "create_chunk")("index", index)("request", request->DebugString()));
+    *response->mutable_chunk_info() = request->chunk_info();
+    return append_chunk(request->file_id(), nullptr, 0, response->mutable_chunk_info());
 }
 
 DEVA_METHOD(CheckInChunk) {
@@ -119,19 +245,68 @@ DEVA_METHOD(SealChunk) {
 
 DEVA_METHOD(SealAndNewChunk) {
     SPAN(span);
-    PLOG_INFO(("desc", "remove_chunk")("index", index));
-    return Status::OK();
+    PLOG_DEBUG(("desc", "seal_and_new_chunk")("index", index)("request", request->DebugString()));
+    *response->mutable_chunk_info() = request->chunk_info();
+    return append_chunk(request->file_id(), &request->chunk_id(), request->length(), response->mutable_chunk_info());
 }
 
-Status Deva::save_snapshot(std::string_view path, std::vector<std::string>* files) {
-    std::ignore = path;
-    std::ignore = files;
-    return Status::OK();
+Status Deva::open(const std::string& data_path) {
+    common::RocksdbStorePtr store;
+    auto status = common::RocksdbStore::open(data_path.c_str(), &store);
+    if (!status.ok()) {
+        return status;
+    }
+    return _namespace.open(store);
+}
+
+Container::SnapshotSaver Deva::save_snapshot() {
+    // the namespace is read from a snapshot of its store, and the file infos from a view of their layers,
+    // both are taken in O(1), the file infos are merged on the bthread writing the snapshot
+    auto namespace_snapshot = _namespace.snapshot();
+    auto file_infos_view = _file_infos.view();
+    return [namespace_snapshot, file_infos_view](const std::string& path, std::vector<std::string>* files) {
+        SPAN(span);
+        auto file_infos = file_infos_view.merge();
+        // the two files are written in parallel
+        auto status = parallel_run(2, [&](size_t i) {
+            if (i == 0) {
+                return Namespace::save(namespace_snapshot, path + "/" + kNamespaceFile);
+            }
+            return save_file_infos(*file_infos, path + "/" + kFileInfosFile);
+        });
+        if (!status.ok()) {
+            PLOG_ERROR(("desc", "failed to save snapshot")("path", path)("error", status.error_str()));
+            return status;
+        }
+        files->push_back(kNamespaceFile);
+        files->push_back(kFileInfosFile);
+        PLOG_INFO(("desc", "snapshot saved")("path", path)("files", file_infos->size()));
+        return Status::OK();
+    };
 }
 
 Status Deva::load_snapshot(std::string_view path) {
-    std::ignore = path;
+    SPAN(span);
+    std::string dir(path);
+    FileInfos file_infos;
+    // the two files are loaded in parallel, and so are the sections of each file
+    auto status = parallel_run(2, [&](size_t i) {
+        if (i == 0) {
+            return _namespace.load(dir + "/" + kNamespaceFile);
+        }
+        return load_file_infos(dir + "/" + kFileInfosFile, &file_infos);
+    });
+    if (!status.ok()) {
+        PLOG_ERROR(("desc", "failed to load snapshot")("path", dir)("error", status.error_str()));
+        return status;
+    }
+    PLOG_INFO(("desc", "snapshot loaded")("path", dir)("files", file_infos.size()));
+    _file_infos.reset(std::move(file_infos));
     return Status::OK();
 }
 
+Status Deva::commit() {
+    return _namespace.commit();
+}
+
 } // namespace pain::deva
@@ -1,9 +1,12 @@
 #pragma once
 
 #include <pain/base/types.h>
+#include <memory>
+#include <unordered_map>
 #include <boost/intrusive_ptr.hpp>
 #include "pain/proto/deva_store.pb.h"
 #include "deva/container.h"
+#include "deva/file_info_table.h"
 #include "deva/namespace.h"
 
 #define DEVA_ENTRY(name)                                                                                               \
@@ -31,16 +34,27 @@ public:
     DEVA_ENTRY(SealChunk);
     DEVA_ENTRY(SealAndNewChunk);
 
-    Status save_snapshot(std::string_view path, std::vector<std::string>* files) override;
+    // keep the namespace in a rocksdb under data_path instead of the memory,
+    // what the rocksdb holds is dropped, raft replays the snapshot and the log into it
+    Status open(const std::string& data_path);
+
+    SnapshotSaver save_snapshot() override;
     Status load_snapshot(std::string_view path) override;
+    Status commit() override;
 
 private:
     Status create(const std::string& path, const UUID& id, FileType type);
+    // seal the last chunk of the file at length if sealed is set, then append chunk to the file,
+    // chunk is set to the chunk recorded
+    Status append_chunk(const proto::UUID& file_id,
+                        const proto::UUID* sealed,
+                        uint64_t length,
+                        proto::ChunkInfo* chunk);
 
 private:
     std::atomic<int> _use_count = {};
     Namespace _namespace;
-    std::unordered_map<UUID, proto::FileInfo> _file_infos;
+    FileInfoTable _file_infos;
 
     friend void intrusive_ptr_add_ref(Deva* deva) {
         ++deva->_use_count;
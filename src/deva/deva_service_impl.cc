@@ -4,6 +4,7 @@
 #include <pain/base/uuid.h>
 #include "pain/proto/deva_store.pb.h"
 #include "deva/bridge.h"
+#include "deva/chunk_allocator.h"
 #include "deva/deva.h"
 #include "deva/macro.h"
 
@@ -15,6 +16,61 @@
 
 namespace pain::deva {
 
+namespace {
+
+// an EC chunk has a replica for each of its data and parity fragments
+template <typename Request>
+Status allocate_chunk(const Request* request, pain::proto::ChunkInfo* chunk) {
+    auto replica_count = request->config().replica_count();
+    if (request->type() == pain::proto::CHUNK_TYPE_EC) {
+        replica_count += request->config().parity_count();
+    }
+    UUID chunk_id;
+    std::vector<std::string> locations;
+    auto status = ChunkAllocator::instance().allocate(replica_count, &chunk_id, &locations);
+    if (!status.ok()) {
+        return status;
+    }
+    chunk->mutable_uuid()->set_high(chunk_id.high());
+    chunk->mutable_uuid()->set_low(chunk_id.low());
+    chunk->set_state(pain::proto::CHUNK_STATE_INIT);
+    chunk->set_type(request->type());
+    *chunk->mutable_config() = request->config();
+    if (request->type() != pain::proto::CHUNK_TYPE_EC) {
+        chunk->mutable_config()->set_replica_count(locations.size());
+    }
+    for (auto& location : locations) {
+        auto* replica = chunk->add_replicas();
+        *replica->mutable_chunk_id() = chunk->uuid();
+        replica->mutable_location()->set_uri(std::move(location));
+    }
+    return Status::OK();
+}
+
+// the chunk is handed out only once it's recorded in the file, the replicas of a chunk failed to be recorded
+// are left behind as empty chunks
+template <OpType OpType, typename StoreRequest, typename StoreResponse, typename Response>
+void record_chunk(Status status, const StoreRequest& store_request, StoreResponse* store_response, Response* response) {
+    if (status.ok()) {
+        status = bridge<Deva, OpType>(store_request, store_response).get();
+    }
+    if (!status.ok()) {
+        PLOG_ERROR(("desc", "failed to allocate chunk")("error", status.error_str()));
+        response->mutable_header()->set_status(status.error_code());
+        response->mutable_header()->set_message(status.error_str());
+        return;
+    }
+    const auto& chunk = store_response->chunk_info();
+    response->set_chunk_id(UUID(chunk.uuid().high(), chunk.uuid().low()).str());
+    for (const auto& replica : chunk.replicas()) {
+        *response->add_locations() = replica.location();
+    }
+    response->mutable_header()->set_status(0);
+    response->mutable_header()->set_message("ok");
+}
+
+} // namespace
+
 DevaServiceImpl::DevaServiceImpl() {}
 
 DEVA_SERVICE_METHOD(OpenFile) {
@@ -98,6 +154,11 @@ DEVA_SERVICE_METHOD(SealFile) {
 DEVA_SERVICE_METHOD(NewChunk) {
     brpc::ClosureGuard done_guard(done);
     DEFINE_SPAN(span, controller);
+    pain::proto::deva::store::CreateChunkRequest create_request;
+    pain::proto::deva::store::CreateChunkResponse create_response;
+    *create_request.mutable_file_id() = request->file_id();
+    auto status = allocate_chunk(request, create_request.mutable_chunk_info());
+    record_chunk<OpType::kCreateChunk>(std::move(status), create_request, &create_response, response);
 }
 
 DEVA_SERVICE_METHOD(CheckInChunk) {
@@ -113,6 +174,14 @@ DEVA_SERVICE_METHOD(SealChunk) {
 DEVA_SERVICE_METHOD(SealAndNewChunk) {
     brpc::ClosureGuard done_guard(done);
     DEFINE_SPAN(span, controller);
+    // the chunk is sealed at the bytes acked to the sdk, and the new one is recorded after it in the same op
+    pain::proto::deva::store::SealAndNewChunkRequest seal_request;
+    pain::proto::deva::store::SealAndNewChunkResponse seal_response;
+    *seal_request.mutable_file_id() = request->file_id();
+    *seal_request.mutable_chunk_id() = request->chunk_id();
+    seal_request.set_length(request->length());
+    auto status = allocate_chunk(request, seal_request.mutable_chunk_info());
+    record_chunk<OpType::kSealAndNewChunk>(std::move(status), seal_request, &seal_response, response);
 }
 
 } // namespace pain::deva
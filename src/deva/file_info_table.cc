@@ -0,0 +1,101 @@
+#include "deva/file_info_table.h"
+
+#include <bthread/bthread.h>
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <mutex>
+#include <utility>
+
+namespace pain::deva {
+
+std::shared_ptr<const FileInfos> FileInfoTable::View::merge() const {
+    if (_layers.deltas.empty()) {
+        return _layers.base != nullptr ? _layers.base : std::make_shared<const FileInfos>();
+    }
+    auto merged = _layers.base != nullptr ? std::make_shared<FileInfos>(*_layers.base) : std::make_shared<FileInfos>();
+    for (const auto& delta : _layers.deltas) {
+        for (const auto& [uuid, file_info] : *delta) {
+            (*merged)[uuid] = file_info;
+        }
+    }
+    std::unique_lock lock(_merged->mutex);
+    _merged->from = _layers;
+    _merged->map = merged;
+    return merged;
+}
+
+std::shared_ptr<const proto::FileInfo> FileInfoTable::get(const UUID& uuid) const {
+    if (auto it = _active.find(uuid); it != _active.end()) {
+        return it->second;
+    }
+    for (auto delta = _layers.deltas.rbegin(); delta != _layers.deltas.rend(); ++delta) {
+        if (auto it = (*delta)->find(uuid); it != (*delta)->end()) {
+            return it->second;
+        }
+    }
+    if (_layers.base != nullptr) {
+        if (auto it = _layers.base->find(uuid); it != _layers.base->end()) {
+            return it->second;
+        }
+    }
+    return nullptr;
+}
+
+FileInfoTable::View FileInfoTable::view() {
+    install_merged();
+    if (!_active.empty()) {
+        // moving the map only takes over its buckets
+        _layers.deltas.push_back(std::make_shared<const FileInfos>(std::move(_active)));
+        _active = FileInfos();
+    }
+    return View(_layers, _merged);
+}
+
+void FileInfoTable::reset(FileInfos file_infos) {
+    {
+        std::unique_lock lock(_merged->mutex);
+        _merged->from = {};
+        _merged->map = nullptr;
+    }
+    _layers.base = std::make_shared<const FileInfos>(std::move(file_infos));
+    _layers.deltas.clear();
+    _active.clear();
+}
+
+void FileInfoTable::install_merged() {
+    Layers from;
+    std::shared_ptr<const FileInfos> map;
+    {
+        std::unique_lock lock(_merged->mutex);
+        if (_merged->map == nullptr) {
+            return;
+        }
+        from = std::move(_merged->from);
+        map = std::move(_merged->map);
+        _merged->from = {};
+    }
+    // the layers merged are the oldest ones of the table, unless it has been reset since
+    auto& deltas = _layers.deltas;
+    if (from.base != _layers.base || from.deltas.size() > deltas.size() ||
+        !std::equal(from.deltas.begin(), from.deltas.end(), deltas.begin())) {
+        return;
+    }
+    auto* retired = new Layers{std::exchange(_layers.base, std::move(map)), {}};
+    retired->deltas.assign(std::make_move_iterator(deltas.begin()),
+                           std::make_move_iterator(deltas.begin() + static_cast<ptrdiff_t>(from.deltas.size())));
+    deltas.erase(deltas.begin(), deltas.begin() + static_cast<ptrdiff_t>(from.deltas.size()));
+    // the old base is likely freed with its last reference here, which takes as long as copying it,
+    // so it's released on a bthread rather than the apply thread
+    from = {};
+    bthread_t tid = 0;
+    auto release = [](void* arg) -> void* {
+        delete static_cast<Layers*>(arg);
+        return nullptr;
+    };
+    if (bthread_start_background(&tid, nullptr, release, retired) != 0) {
+        release(retired);
+    }
+}
+
+} // namespace pain::deva
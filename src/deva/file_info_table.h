@@ -0,0 +1,73 @@
+#pragma once
+
+#include <bthread/mutex.h>
+#include <pain/base/uuid.h>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "pain/proto/deva_store.pb.h"
+
+namespace pain::deva {
+
+// a file info is never modified in place but replaced, so the maps of file infos share them
+using FileInfos = std::unordered_map<UUID, std::shared_ptr<const proto::FileInfo>>;
+
+// FileInfoTable keeps the file infos in layers, so that a view of them is taken on the apply thread in O(1):
+// the writes go to the active layer, and view freezes it into a read-only layer shared with the view.
+// The writer of a snapshot merges the layers of its view into one map on its own bthread, and the merged map
+// replaces those layers at the next view, so the layers never pile up.
+class FileInfoTable {
+private:
+    struct Layers {
+        std::shared_ptr<const FileInfos> base;
+        // from the oldest to the newest
+        std::vector<std::shared_ptr<const FileInfos>> deltas;
+    };
+
+    // the last map merged by a view, handed back to the table
+    struct Merged {
+        bthread::Mutex mutex;
+        Layers from;
+        std::shared_ptr<const FileInfos> map;
+    };
+
+public:
+    class View {
+    public:
+        // the file infos of the view in one map, newer layers win
+        std::shared_ptr<const FileInfos> merge() const;
+
+    private:
+        friend class FileInfoTable;
+        View(Layers layers, std::shared_ptr<Merged> merged) : _layers(std::move(layers)), _merged(std::move(merged)) {}
+
+        Layers _layers;
+        std::shared_ptr<Merged> _merged;
+    };
+
+    FileInfoTable() : _merged(std::make_shared<Merged>()) {}
+
+    void set(const UUID& uuid, std::shared_ptr<const proto::FileInfo> file_info) {
+        _active[uuid] = std::move(file_info);
+    }
+
+    // the latest file info of uuid, null if there is none
+    std::shared_ptr<const proto::FileInfo> get(const UUID& uuid) const;
+
+    // the file infos as of now, the later writes are not seen by the view
+    View view();
+
+    // replace all the file infos, e.g. by the ones loaded from a snapshot
+    void reset(FileInfos file_infos);
+
+private:
+    // replace the layers merged by the last view with the map merged from them
+    void install_merged();
+
+    Layers _layers;
+    FileInfos _active;
+    std::shared_ptr<Merged> _merged;
+};
+
+} // namespace pain::deva
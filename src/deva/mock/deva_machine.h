@@ -29,7 +29,12 @@ public:
         node_options.raft_meta_uri = fmt::format("{}/{}/raft_meta", prefix, group);
         node_options.snapshot_uri = fmt::format("{}/{}/snapshot", prefix, group);
 
-        _rsm = new Rsm(addr, group, node_options, new Deva());
+        auto* deva = new Deva();
+        ContainerPtr container(deva);
+        if (!deva->open(fmt::format("{}/{}/namespace", data_path, group)).ok()) {
+            BOOST_ASSERT_MSG(false, "Fail to open deva");
+        }
+        _rsm = new Rsm(addr, group, node_options, container);
     }
 
     Status start() {
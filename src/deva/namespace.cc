@@ -1,54 +1,428 @@
 #include "deva/namespace.h"
+#include <gflags/gflags.h>
+#include <pain/base/plog.h>
+#include <cstdint>
+#include <cstring>
+#include <boost/assert.hpp>
+#include "common/mem_store.h"
+
+DEFINE_uint64(deva_namespace_cache_entries, 1024UL * 1024, "The max number of directory entries cached in memory");
+DEFINE_uint64(deva_path_cache_entries, 1024UL * 1024, "The max number of paths cached for lookups, 0 to disable");
+DECLARE_uint32(deva_snapshot_load_concurrency);
 
 namespace pain::deva {
 
+namespace {
+
+// the writes to the store are committed every so many entries while loading a snapshot
+constexpr size_t kLoadBatchSize = 4096;
+// the paths resolved by lookups are added to the path cache every so many paths, or at the next commit
+constexpr size_t kPathCacheFlushSize = 64;
+
+std::string encode_dentry(const UUID& inode, FileType type) {
+    std::string value;
+    put_fixed(&value, inode.high());
+    put_fixed(&value, inode.low());
+    put_fixed(&value, static_cast<uint8_t>(type));
+    return value;
+}
+
+bool decode_dentry(std::string_view value, UUID* inode, FileType* type) {
+    SnapshotRecordReader reader(value);
+    uint64_t high = 0;
+    uint64_t low = 0;
+    uint8_t t = 0;
+    if (!reader.get_fixed(&high) || !reader.get_fixed(&low) || !reader.get_fixed(&t) || !reader.empty() ||
+        t > static_cast<uint8_t>(FileType::kDirectory)) {
+        return false;
+    }
+    *inode = UUID(high, low);
+    *type = static_cast<FileType>(t);
+    return true;
+}
+
+// the keys of the store are the uuid string of the parent, '_' and the name
+bool split_key(std::string_view key, std::string_view* parent, std::string_view* name) {
+    constexpr size_t uuid_size = 36;
+    if (key.size() <= uuid_size || key[uuid_size] != '_') {
+        return false;
+    }
+    *parent = key.substr(0, uuid_size);
+    *name = key.substr(uuid_size + 1);
+    return true;
+}
+
+// a record is a directory and some of its entries, a large directory is split into several records:
+//   parent uuid (high, low), entry count, then for each entry
+//   inode uuid (high, low), type, name length, name
+class DirRecordWriter {
+public:
+    DirRecordWriter(SnapshotFileWriter* writer, size_t max_record_bytes) :
+        _writer(writer),
+        _max_record_bytes(max_record_bytes) {}
+
+    void add(const UUID& parent, std::string_view name, const UUID& inode, FileType type) {
+        if (_record == nullptr || parent != _parent || _record->size() - _start >= _max_record_bytes) {
+            begin(parent);
+        }
+        put_fixed(_record, inode.high());
+        put_fixed(_record, inode.low());
+        put_fixed(_record, static_cast<uint8_t>(type));
+        put_fixed(_record, static_cast<uint32_t>(name.size()));
+        _record->append(name);
+        _count++;
+    }
+
+    // a directory without entries
+    void add_dir(const UUID& dir) {
+        if (_record == nullptr || dir != _parent) {
+            begin(dir);
+        }
+    }
+
+    void finish() {
+        if (_record == nullptr) {
+            return;
+        }
+        std::memcpy(_record->data() + _start + sizeof(uint64_t) * 2, &_count, sizeof(_count));
+        _writer->end_record();
+        _record = nullptr;
+    }
+
+private:
+    void begin(const UUID& parent) {
+        finish();
+        _parent = parent;
+        _record = _writer->record();
+        _start = _record->size();
+        _count = 0;
+        put_fixed(_record, parent.high());
+        put_fixed(_record, parent.low());
+        put_fixed(_record, _count);
+    }
+
+    SnapshotFileWriter* _writer;
+    size_t _max_record_bytes;
+    std::string* _record = nullptr;
+    size_t _start = 0;
+    UUID _parent;
+    uint32_t _count = 0;
+};
+
+Status load_dirs(const SnapshotRecords& records, common::Store* store) {
+    SnapshotRecordReader reader(records.data);
+    common::Store::WriteBatch batch;
+    for (uint32_t i = 0; i < records.count; i++) {
+        uint64_t high = 0;
+        uint64_t low = 0;
+        uint32_t count = 0;
+        if (!reader.get_fixed(&high) || !reader.get_fixed(&low) || !reader.get_fixed(&count)) {
+            return Status(EIO, "truncated namespace record");
+        }
+        UUID parent(high, low);
+        auto key = parent.str();
+        batch.hset(key, "", encode_dentry(parent, FileType::kDirectory));
+        for (uint32_t j = 0; j < count; j++) {
+            uint8_t type = 0;
+            uint32_t name_size = 0;
+            std::string name;
+            if (!reader.get_fixed(&high) || !reader.get_fixed(&low) || !reader.get_fixed(&type) ||
+                !reader.get_fixed(&name_size) || !reader.read(&name, name_size)) {
+                return Status(EIO, "truncated namespace record");
+            }
+            if (type > static_cast<uint8_t>(FileType::kDirectory) || name.empty()) {
+                return Status(EIO, "invalid entry in namespace record");
+            }
+            batch.hset(key, name, encode_dentry(UUID(high, low), static_cast<FileType>(type)));
+        }
+        if (batch.writes().size() >= kLoadBatchSize) {
+            auto status = store->write(batch);
+            if (!status.ok()) {
+                return status;
+            }
+            batch.clear();
+        }
+    }
+    if (!reader.empty()) {
+        return Status(EIO, "trailing bytes in namespace section");
+    }
+    return store->write(batch);
+}
+
+} // namespace
+
 Namespace& Namespace::instance() {
     static Namespace s_namespace;
     return s_namespace;
 }
 
-Namespace::Namespace() {
-    _root = UUID::from_str_or_die("00000000-0000-0000-0000-000000000000");
-    _entries[_root] = {};
+Namespace::Namespace() :
+    _root(UUID::from_str_or_die("00000000-0000-0000-0000-000000000000")),
+    _cache_capacity(FLAGS_deva_namespace_cache_entries),
+    _path_cache(_root, FLAGS_deva_path_cache_entries) {
+    auto status = open(new common::MemStore());
+    BOOST_ASSERT_MSG(status.ok(), "open namespace in memory failed");
+}
+
+Status Namespace::open(common::StorePtr store) {
+    std::unique_lock guard(_mutex);
+    _store = std::move(store);
+    _pending.clear();
+    _cache.clear();
+    _lru.clear();
+    _path_cache.clear();
+    // the store doesn't know the raft index it was written at, the entries left by the last run are dropped
+    // and raft rebuilds the namespace from the snapshot and the log, as it does the file infos of deva
+    auto status = _store->clear();
+    if (!status.ok()) {
+        PLOG_ERROR(("desc", "failed to clear namespace store")("error", status.error_str()));
+        return status;
+    }
+    return _store->hset(_root.str(), "", encode_dentry(_root, FileType::kDirectory));
 }
 
-Status Namespace::load() {
+Status Namespace::get(const UUID& parent, std::string_view name, Dentry* dentry) const {
+    KeyView key(parent, name);
+    if (auto it = _pending.find(key); it != _pending.end()) {
+        if (!it->second.has_value()) {
+            return Status(ENOENT, "No such file or directory");
+        }
+        *dentry = *it->second;
+        return Status::OK();
+    }
+    if (auto it = _cache.find(key); it != _cache.end()) {
+        _lru.splice(_lru.begin(), _lru, it->second.second);
+        *dentry = it->second.first;
+        return Status::OK();
+    }
+    std::string value;
+    auto status = _store->hget(parent.str(), name, &value);
+    if (!status.ok()) {
+        return status;
+    }
+    if (!decode_dentry(value, &dentry->inode, &dentry->type)) {
+        PLOG_ERROR(("desc", "invalid dentry")("parent", parent.str())("name", name));
+        return Status(EIO, "invalid dentry");
+    }
+    cache(key, *dentry);
+    return Status::OK();
+}
+
+bool Namespace::is_dir(const UUID& inode) const {
+    Dentry dentry;
+    return get(inode, "", &dentry).ok();
+}
+
+void Namespace::cache(const KeyView& key, const Dentry& dentry) const {
+    if (_cache_capacity == 0) {
+        return;
+    }
+    if (auto it = _cache.find(key); it != _cache.end()) {
+        it->second.first = dentry;
+        _lru.splice(_lru.begin(), _lru, it->second.second);
+        return;
+    }
+    while (_cache.size() >= _cache_capacity) {
+        _cache.erase(_lru.back());
+        _lru.pop_back();
+    }
+    _lru.emplace_front(key.first, key.second);
+    _cache.emplace(_lru.front(), std::make_pair(dentry, _lru.begin()));
+}
+
+Status Namespace::commit() {
+    std::unique_lock guard(_mutex);
+    _path_cache.flush();
+    if (_pending.empty()) {
+        return Status::OK();
+    }
+    common::Store::WriteBatch batch;
+    for (const auto& [key, dentry] : _pending) {
+        if (dentry.has_value()) {
+            batch.hset(key.first.str(), key.second, encode_dentry(dentry->inode, dentry->type));
+        } else {
+            batch.hdel(key.first.str(), key.second);
+        }
+    }
+    auto status = _store->write(batch);
+    if (!status.ok()) {
+        PLOG_ERROR(("desc", "commit namespace failed")("count", _pending.size())("error", status.error_str()));
+        return status;
+    }
+    // the entries just written are likely to be read soon
+    for (const auto& [key, dentry] : _pending) {
+        if (dentry.has_value()) {
+            cache(KeyView(key.first, key.second), *dentry);
+        } else if (auto it = _cache.find(key); it != _cache.end()) {
+            _lru.erase(it->second.second);
+            _cache.erase(it);
+        }
+    }
+    _pending.clear();
+    return Status::OK();
+}
+
+std::shared_ptr<common::Store::Snapshot> Namespace::snapshot() {
+    auto status = commit();
+    BOOST_ASSERT_MSG(status.ok(), "commit namespace failed");
+    std::unique_lock guard(_mutex);
+    return _store->snapshot();
+}
+
+Status Namespace::save(const std::shared_ptr<common::Store::Snapshot>& snapshot,
+                       const std::string& path,
+                       size_t section_bytes) {
+    SnapshotFileWriter writer(section_bytes);
+    auto status = writer.open(path);
+    if (!status.ok()) {
+        return status;
+    }
+    DirRecordWriter dirs(&writer, section_bytes);
+    // the entries of a directory are next to each other in the store, with the directory itself first
+    for (auto it = snapshot->hgetall(""); it->valid(); it->next()) {
+        std::string_view parent_str;
+        std::string_view name;
+        UUID inode;
+        FileType type = FileType::kFile;
+        if (!split_key(it->key(), &parent_str, &name) || !decode_dentry(it->value(), &inode, &type)) {
+            PLOG_ERROR(("desc", "invalid dentry in namespace")("key", it->key()));
+            return Status(EIO, "invalid dentry in namespace");
+        }
+        auto parent = UUID::from_str(std::string(parent_str));
+        if (!parent.has_value()) {
+            return Status(EIO, "invalid dentry in namespace");
+        }
+        if (name.empty()) {
+            dirs.add_dir(*parent);
+        } else {
+            dirs.add(*parent, name, inode, type);
+        }
+    }
+    dirs.finish();
+    return writer.finish();
+}
+
+Status Namespace::load(const std::string& path) {
+    SnapshotFileReader reader;
+    auto status = reader.open(path);
+    if (!status.ok()) {
+        return status;
+    }
+    std::unique_lock guard(_mutex);
+    _pending.clear();
+    _cache.clear();
+    _lru.clear();
+    _path_cache.clear();
+    status = _store->clear();
+    if (!status.ok()) {
+        return status;
+    }
+    // each section is read, decoded and written to the store on its own, so only a few are in memory at a time
+    status = parallel_run(
+        reader.section_count(),
+        [this, &reader](size_t i) {
+            SnapshotRecords records;
+            auto status = reader.read_section(i, &records);
+            if (!status.ok()) {
+                return status;
+            }
+            return load_dirs(records, _store.get());
+        },
+        FLAGS_deva_snapshot_load_concurrency);
+    if (!status.ok()) {
+        PLOG_ERROR(("desc", "failed to load namespace")("path", path)("error", status.error_str()));
+        return status;
+    }
+    if (!_store->hexists(_root.str(), "")) {
+        return Status(EIO, "no root in namespace snapshot");
+    }
     return Status::OK();
 }
 
 Status Namespace::create(const UUID& parent, const std::string& name, FileType type, const UUID& inode) {
     std::unique_lock guard(_mutex);
-    auto it = _entries.find(parent);
-    if (it == _entries.end()) {
+    if (!is_dir(parent)) {
         return Status(ENOENT, "No such file or directory");
     }
-    _entries[parent].push_back({inode, name, type});
+    Dentry dentry;
+    auto status = get(parent, name, &dentry);
+    if (status.ok()) {
+        return Status(EEXIST, "File exists");
+    }
+    if (status.error_code() != ENOENT) {
+        return status;
+    }
+    _pending[Key(parent, name)] = Dentry{inode, type};
     if (type == FileType::kDirectory) {
-        _entries[inode] = {};
+        _pending[Key(inode, "")] = Dentry{inode, FileType::kDirectory};
     }
     return Status::OK();
 }
 
 Status Namespace::remove(const UUID& parent, const std::string& name) {
     std::unique_lock guard(_mutex);
-    auto it = _entries.find(parent);
-    if (it == _entries.end()) {
+    if (!is_dir(parent)) {
         return Status(ENOENT, "No such file or directory");
     }
-    auto& entries = it->second;
-    entries.remove_if([&name](const DirEntry& entry) {
-        return entry.name == name;
-    });
+    _path_cache.invalidate(parent, name);
+    _pending[Key(parent, name)] = std::nullopt;
     return Status::OK();
 }
 
 void Namespace::list(const UUID& parent, std::list<DirEntry>* entries) const {
+    list(parent, {}, SIZE_MAX, entries);
+}
+
+void Namespace::list(const UUID& parent,
+                     std::string_view start_after,
+                     size_t limit,
+                     std::list<DirEntry>* entries) const {
     std::unique_lock guard(_mutex);
-    auto it = _entries.find(parent);
-    if (it == _entries.end()) {
+    entries->clear();
+    if (!is_dir(parent)) {
         return;
     }
-    *entries = it->second;
+    // merge the entries in the store with the changes not committed yet, both are ordered by name,
+    // the empty name of the directory itself sorts first and is skipped
+    auto it = _store->hscan(parent.str(), start_after);
+    auto pending = _pending.upper_bound(KeyView(parent, start_after));
+    auto next_stored = [&](std::string_view* name) {
+        for (; it->valid(); it->next()) {
+            std::string_view parent_str;
+            if (split_key(it->key(), &parent_str, name) && *name > start_after) {
+                return true;
+            }
+        }
+        return false;
+    };
+    std::string_view stored_name;
+    bool has_stored = next_stored(&stored_name);
+    while (entries->size() < limit) {
+        bool has_pending = pending != _pending.end() && pending->first.first == parent;
+        if (!has_stored && !has_pending) {
+            break;
+        }
+        if (has_pending && (!has_stored || std::string_view(pending->first.second) <= stored_name)) {
+            // a pending change replaces the stored entry of the same name
+            if (has_stored && pending->first.second == stored_name) {
+                it->next();
+                has_stored = next_stored(&stored_name);
+            }
+            const auto& dentry = pending->second;
+            if (dentry.has_value()) {
+                entries->push_back(DirEntry{dentry->inode, pending->first.second, dentry->type});
+            }
+            ++pending;
+            continue;
+        }
+        DirEntry entry;
+        entry.name = stored_name;
+        if (decode_dentry(it->value(), &entry.inode, &entry.type)) {
+            entries->push_back(std::move(entry));
+        }
+        it->next();
+        has_stored = next_stored(&stored_name);
+    }
 }
 
 // parse path such as /a/b/c to ["a", "b", "c"]
@@ -74,6 +448,18 @@ Status Namespace::parse_path(const char* path, std::list<std::string_view>* comp
 }
 
 Status Namespace::lookup(const char* path, UUID* inode, FileType* file_type) const {
+    std::string normalized;
+    if (PathCache::normalize(path, &normalized)) {
+        if (normalized.empty()) {
+            *inode = _root;
+            *file_type = FileType::kDirectory;
+            return Status::OK();
+        }
+        if (_path_cache.get(normalized, inode, file_type)) {
+            return Status::OK();
+        }
+    }
+
     std::list<std::string_view> components;
     auto status = parse_path(path, &components);
     if (!status.ok()) {
@@ -83,25 +469,32 @@ Status Namespace::lookup(const char* path, UUID* inode, FileType* file_type) con
     std::unique_lock guard(_mutex);
     UUID parent = _root;
     *file_type = FileType::kDirectory;
+    std::string prefix;
     for (const auto& component : components) {
-        auto it = _entries.find(parent);
-        if (it == _entries.end()) {
-            return Status(ENOENT, "No such file or directory");
-        }
-
-        const auto& entries = it->second;
-        auto entry = std::find_if(entries.begin(), entries.end(), [&component](const DirEntry& entry) {
-            return entry.name == component;
-        });
-        if (entry == entries.end()) {
-            return Status(ENOENT, "No such file or directory");
+        if (*file_type != FileType::kDirectory) {
+            status = Status(ENOENT, "Not a directory");
+            break;
         }
-
-        if (entry->type == FileType::kFile && &component != &components.back()) {
-            return Status(ENOENT, "Not a directory");
+        Dentry dentry;
+        status = get(parent, component, &dentry);
+        if (!status.ok()) {
+            if (status.error_code() == ENOENT) {
+                status = Status(ENOENT, "No such file or directory");
+            }
+            break;
         }
-        parent = entry->inode;
-        *file_type = entry->type;
+        parent = dentry.inode;
+        *file_type = dentry.type;
+        // every prefix resolved is cached, so the parent directories of a cached path are cached too
+        prefix.push_back('/');
+        prefix.append(component);
+        _path_cache.add(prefix, parent, *file_type);
+    }
+    if (_path_cache.pending() >= kPathCacheFlushSize) {
+        _path_cache.flush();
+    }
+    if (!status.ok()) {
+        return status;
     }
     *inode = parent;
     return Status::OK();
@@ -3,10 +3,18 @@
 #include <bthread/mutex.h>
 #include <list>
 #include <map>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
 #include <fmt/format.h>
 
 #include <pain/base/types.h>
 #include <pain/base/uuid.h>
+#include "common/store.h"
+#include "deva/path_cache.h"
+#include "deva/snapshot_file.h"
 
 namespace pain::deva {
 
@@ -21,23 +29,92 @@ struct DirEntry {
     FileType type;
 };
 
+// Namespace keeps the directory entries in a common::Store, keyed by the uuid of the parent and the name,
+// a directory has an entry with an empty name in itself. The changes are committed to the store in one batch
+// by commit, and the hot entries read from the store are cached, so the memory is bounded by the cache.
+// The store only spills the namespace of the running process, it's emptied by open and refilled by raft
+// from the snapshot and the log, so it needs neither the WAL nor the index it was written at.
+// The paths resolved by lookup are cached by a PathCache, which is read without the lock.
 class Namespace {
 public:
     static Namespace& instance();
+    // an empty namespace in memory
     Namespace();
-    Status load();
+    // switch to the store, the entries in it are dropped and an empty root is created
+    Status open(common::StorePtr store);
     const UUID& root() const {
         return _root;
     }
     Status create(const UUID& parent, const std::string& name, FileType type, const UUID& inode);
     Status remove(const UUID& parent, const std::string& name);
+    // all the entries of parent in the order of their names
     void list(const UUID& parent, std::list<DirEntry>* entries) const;
+    // a page of at most limit entries of parent whose names are after start_after in order,
+    // the name of the last entry is the start_after of the next page
+    void list(const UUID& parent, std::string_view start_after, size_t limit, std::list<DirEntry>* entries) const;
     Status lookup(const char* path, UUID* inode, FileType* file_type) const;
 
+    // write the changes since the last commit into the store in one batch,
+    // they are visible to the reads of the namespace before that
+    Status commit();
+    // a versioned view of the namespace, the changes are committed first
+    std::shared_ptr<common::Store::Snapshot> snapshot();
+    // write the view into the snapshot file at path, in sections of about section_bytes
+    static Status save(const std::shared_ptr<common::Store::Snapshot>& snapshot,
+                       const std::string& path,
+                       size_t section_bytes = kSnapshotSectionBytes);
+    // replace the entries with the ones in the snapshot file at path, its sections are loaded in parallel
+    Status load(const std::string& path);
+
 private:
+    struct Dentry {
+        UUID inode;
+        FileType type;
+    };
+    using Key = std::pair<UUID, std::string>;
+    // the maps of keys are looked up with a view of the name, so the name is not copied
+    using KeyView = std::pair<UUID, std::string_view>;
+    struct KeyHash {
+        using is_transparent = void;
+        template <typename K>
+        size_t operator()(const K& key) const {
+            return std::hash<UUID>{}(key.first) ^ (std::hash<std::string_view>{}(key.second) << 1);
+        }
+    };
+    struct KeyEqual {
+        using is_transparent = void;
+        template <typename K1, typename K2>
+        bool operator()(const K1& a, const K2& b) const {
+            return a.first == b.first && std::string_view(a.second) == std::string_view(b.second);
+        }
+    };
+    struct KeyLess {
+        using is_transparent = void;
+        template <typename K1, typename K2>
+        bool operator()(const K1& a, const K2& b) const {
+            if (a.first < b.first || b.first < a.first) {
+                return a.first < b.first;
+            }
+            return std::string_view(a.second) < std::string_view(b.second);
+        }
+    };
+
     Status parse_path(const char* path, std::list<std::string_view>* components) const;
+    // the lock is held by the callers of the methods below
+    Status get(const UUID& parent, std::string_view name, Dentry* dentry) const;
+    bool is_dir(const UUID& inode) const;
+    void cache(const KeyView& key, const Dentry& dentry) const;
+
     UUID _root;
-    std::map<UUID, std::list<DirEntry>> _entries;
+    common::StorePtr _store;
+    // the changes not committed yet, nullopt for a removed entry
+    std::map<Key, std::optional<Dentry>, KeyLess> _pending;
+    // the entries read from the store, the least recently used ones are evicted
+    size_t _cache_capacity;
+    mutable std::list<Key> _lru;
+    mutable std::unordered_map<Key, std::pair<Dentry, std::list<Key>::iterator>, KeyHash, KeyEqual> _cache;
+    // the paths resolved by lookup, read without the lock
+    mutable PathCache _path_cache;
     mutable bthread::Mutex _mutex;
 };
 
@@ -30,4 +30,38 @@ OpPtr decode(IOBuf* buf, std::move_only_function<OpPtr(OpType, IOBuf*)> decode)
     return op;
 }
 
+void encode_batch(const std::vector<IOBuf>& ops, IOBuf* buf) {
+    OpMeta op_meta = {};
+    op_meta.version = 1;
+    op_meta.type = OpType::kBatch;
+    op_meta.timestamp = butil::gettimeofday_us();
+    for (const auto& op : ops) {
+        op_meta.size += op.size();
+    }
+    buf->append(&op_meta, sizeof(op_meta));
+    for (const auto& op : ops) {
+        buf->append(op);
+    }
+}
+
+std::vector<OpPtr> decode_batch(IOBuf* buf, std::move_only_function<OpPtr(OpType, IOBuf*)> decode) {
+    OpMeta op_meta = {};
+    buf->copy_to(&op_meta, sizeof(op_meta));
+    if (op_meta.type != OpType::kBatch) {
+        return {pain::deva::decode(buf, std::move(decode))};
+    }
+    buf->pop_front(sizeof(op_meta));
+    butil::IOBuf ops;
+    buf->cutn(&ops, op_meta.size);
+    std::vector<OpPtr> result;
+    while (!ops.empty()) {
+        OpMeta meta = {};
+        ops.cutn(&meta, sizeof(meta));
+        butil::IOBuf data;
+        ops.cutn(&data, meta.size);
+        result.push_back(decode(meta.type, &data));
+    }
+    return result;
+}
+
 } // namespace pain::deva
@@ -2,6 +2,8 @@
 #include <pain/base/types.h>
 #include <atomic>
 #include <cstdint>
+#include <functional>
+#include <vector>
 #include <fmt/format.h>
 #include <boost/intrusive_ptr.hpp>
 #include <magic_enum/magic_enum.hpp>
@@ -19,6 +21,8 @@ enum class OpType {
     kCheckInChunk = 6,
     kSealChunk = 7,
     kSealAndNewChunk = 8,
+    // a log entry of several ops, see ProposalBatcher
+    kBatch = 101,
 };
 
 struct OpMeta {
@@ -61,6 +65,10 @@ using RsmPtr = boost::intrusive_ptr<Rsm>;
 
 void encode(OpPtr op, IOBuf* buf);
 OpPtr decode(IOBuf* buf, std::move_only_function<OpPtr(OpType, IOBuf*)> decode);
+// ops is the ops encoded by encode, they are put into one entry behind an OpMeta of kBatch
+void encode_batch(const std::vector<IOBuf>& ops, IOBuf* buf);
+// decode the ops of an entry in their order, an entry of a single op is decoded as a batch of one
+std::vector<OpPtr> decode_batch(IOBuf* buf, std::move_only_function<OpPtr(OpType, IOBuf*)> decode);
 
 } // namespace pain::deva
 
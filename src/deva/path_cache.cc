@@ -0,0 +1,128 @@
+#include "deva/path_cache.h"
+#include "deva/namespace.h"
+
+namespace pain::deva {
+
+PathCache::PathCache(const UUID& root, size_t capacity) : _root(root), _capacity(capacity) {}
+
+bool PathCache::normalize(std::string_view path, std::string* normalized) {
+    if (path.empty() || path.front() != '/') {
+        return false;
+    }
+    normalized->clear();
+    size_t i = 0;
+    while (i < path.size()) {
+        if (path[i] == '/') {
+            i++;
+            continue;
+        }
+        auto j = std::min(path.find('/', i), path.size());
+        normalized->push_back('/');
+        normalized->append(path.substr(i, j - i));
+        i = j;
+    }
+    return true;
+}
+
+bool PathCache::get(std::string_view path, UUID* inode, FileType* type) const {
+    if (_capacity == 0) {
+        return false;
+    }
+    butil::DoublyBufferedData<Map>::ScopedPtr map;
+    if (_data.Read(&map) != 0) {
+        return false;
+    }
+    auto it = map->paths.find(path);
+    if (it == map->paths.end()) {
+        return false;
+    }
+    *inode = it->second.inode;
+    *type = it->second.type;
+    return true;
+}
+
+void PathCache::add(std::string path, const UUID& inode, FileType type) {
+    if (_capacity == 0) {
+        return;
+    }
+    _adds.push_back(Add{std::move(path), Entry{inode, type}});
+}
+
+void PathCache::flush() {
+    if (_adds.empty()) {
+        return;
+    }
+    modify(_adds, nullptr, {});
+    _adds.clear();
+}
+
+void PathCache::invalidate(const UUID& parent, std::string_view name) {
+    if (_capacity == 0) {
+        return;
+    }
+    // the paths added before are resolved before the entry is removed, so they go first
+    modify(_adds, &parent, name);
+    _adds.clear();
+}
+
+void PathCache::clear() {
+    _adds.clear();
+    auto fn = [](Map& map) -> size_t {
+        map.paths.clear();
+        map.dirs.clear();
+        return 1;
+    };
+    _data.Modify(fn);
+}
+
+// fn is applied to both copies of the map, so it only depends on the map and the arguments
+void PathCache::modify(const std::vector<Add>& adds, const UUID* parent, std::string_view name) {
+    auto fn = [this, &adds, parent, name](Map& map) -> size_t {
+        // start over when full rather than evicting, so a cached path never loses its parent directories
+        if (map.paths.size() + adds.size() > _capacity) {
+            map.paths.clear();
+            map.dirs.clear();
+        }
+        for (const auto& add : adds) {
+            map.paths.insert_or_assign(add.path, add.entry);
+            if (add.entry.type == FileType::kDirectory) {
+                map.dirs[add.entry.inode] = add.path;
+            }
+        }
+        if (parent == nullptr) {
+            return 1;
+        }
+        std::string path;
+        if (*parent != _root) {
+            auto it = map.dirs.find(*parent);
+            if (it == map.dirs.end()) {
+                return 1;
+            }
+            path = it->second;
+        }
+        path.push_back('/');
+        path.append(name);
+        auto erase = [&map](auto first, auto last) {
+            for (auto it = first; it != last; ++it) {
+                if (it->second.type == FileType::kDirectory) {
+                    map.dirs.erase(it->second.inode);
+                }
+            }
+            map.paths.erase(first, last);
+        };
+        if (auto it = map.paths.find(path); it != map.paths.end()) {
+            erase(it, std::next(it));
+        }
+        path.push_back('/');
+        auto first = map.paths.lower_bound(path);
+        auto last = first;
+        while (last != map.paths.end() && last->first.starts_with(path)) {
+            ++last;
+        }
+        erase(first, last);
+        return 1;
+    };
+    _data.Modify(fn);
+}
+
+} // namespace pain::deva
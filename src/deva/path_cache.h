@@ -0,0 +1,67 @@
+#pragma once
+
+#include <butil/containers/doubly_buffered_data.h>
+#include <pain/base/uuid.h>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace pain::deva {
+
+enum class FileType; // namespace.h
+
+// PathCache maps the paths to the inodes they resolve to. The lookups read it through butil::DoublyBufferedData,
+// which takes a lock local to the reading thread only, so the lookups from many threads never contend with each
+// other. The changes are made by the namespace with its lock held: the paths resolved by lookups are added in
+// batches by flush, and the paths under an entry are dropped by invalidate as soon as the entry is removed.
+// The directories above a cached path are always cached as well, so a removed entry not found in the cache has
+// nothing cached under it.
+class PathCache {
+public:
+    PathCache(const UUID& root, size_t capacity);
+
+    // path is normalized by normalize
+    bool get(std::string_view path, UUID* inode, FileType* type) const;
+
+    // the methods below are called with the lock of the namespace held
+
+    // path is added at the next flush, its parent directories are added before it
+    void add(std::string path, const UUID& inode, FileType type);
+    size_t pending() const {
+        return _adds.size();
+    }
+    void flush();
+    // drop the entry named name in parent and the paths under it
+    void invalidate(const UUID& parent, std::string_view name);
+    void clear();
+
+    // the path without empty components, such as /a/b for /a//b/, return false if it's not absolute
+    static bool normalize(std::string_view path, std::string* normalized);
+
+private:
+    struct Entry {
+        UUID inode;
+        FileType type;
+    };
+    struct Map {
+        std::map<std::string, Entry, std::less<>> paths;
+        // the paths of the cached directories
+        std::unordered_map<UUID, std::string> dirs;
+    };
+    struct Add {
+        std::string path;
+        Entry entry;
+    };
+
+    void modify(const std::vector<Add>& adds, const UUID* parent, std::string_view name);
+
+    UUID _root;
+    size_t _capacity;
+    std::vector<Add> _adds;
+    mutable butil::DoublyBufferedData<Map> _data;
+};
+
+} // namespace pain::deva
@@ -0,0 +1,127 @@
+#include "deva/proposal_batcher.h"
+
+#include <butil/time.h>
+#include <pain/base/plog.h>
+#include <algorithm>
+#include <iterator>
+#include "deva/container_op.h"
+
+namespace pain::deva {
+
+ProposalBatcher::ProposalBatcher(
+    Apply apply, uint32_t max_delay_us, uint32_t max_ops, uint64_t max_bytes, const std::string& prefix) :
+    _apply(std::move(apply)),
+    _max_delay_us(max_delay_us),
+    _max_ops(std::max(max_ops, 1U)),
+    _max_bytes(max_bytes),
+    _batch_size(prefix + "_batch_size"),
+    _batch_bytes(prefix + "_batch_bytes") {
+    if (bthread_start_background(&_tid, nullptr, run, this) != 0) {
+        PLOG_ERROR(("desc", "failed to start proposal batcher bthread"));
+        _tid = 0;
+    }
+}
+
+ProposalBatcher::~ProposalBatcher() {
+    {
+        std::unique_lock lock(_mutex);
+        _stopped = true;
+        _cond.notify_all();
+    }
+    // the loop proposes all pending ops before exiting
+    if (_tid != 0) {
+        bthread_join(_tid, nullptr);
+    }
+}
+
+void ProposalBatcher::propose(OpPtr op, std::shared_ptr<opentelemetry::trace::Span> span) {
+    Proposal proposal{std::move(op), std::move(span), {}};
+    encode(proposal.op, &proposal.data);
+    std::unique_lock lock(_mutex);
+    if (_stopped || _tid == 0) {
+        lock.unlock();
+        std::vector<Proposal> batch;
+        batch.push_back(std::move(proposal));
+        commit(&batch);
+        return;
+    }
+    _pending_bytes += proposal.data.size();
+    _pending.push_back(std::move(proposal));
+    // wake up the loop when a batch starts or is full, ops in between just join the batch
+    if (_pending.size() == 1 || _pending.size() >= _max_ops || _pending_bytes >= _max_bytes) {
+        _cond.notify_one();
+    }
+}
+
+void* ProposalBatcher::run(void* arg) {
+    static_cast<ProposalBatcher*>(arg)->loop();
+    return nullptr;
+}
+
+void ProposalBatcher::loop() {
+    std::vector<Proposal> batch;
+    while (true) {
+        {
+            std::unique_lock lock(_mutex);
+            while (_pending.empty() && !_stopped) {
+                _cond.wait(lock);
+            }
+            if (_pending.empty()) {
+                return;
+            }
+            // give the followers a chance to join the batch
+            auto deadline = butil::gettimeofday_us() + _max_delay_us;
+            while (_pending.size() < _max_ops && _pending_bytes < _max_bytes && !_stopped) {
+                auto now = butil::gettimeofday_us();
+                if (now >= deadline) {
+                    break;
+                }
+                _cond.wait_for(lock, deadline - now);
+            }
+            // a batch takes one op at least, even if it's larger than max_bytes
+            size_t n = 0;
+            uint64_t bytes = 0;
+            while (n < _pending.size() && n < _max_ops && (n == 0 || bytes + _pending[n].data.size() <= _max_bytes)) {
+                bytes += _pending[n].data.size();
+                n++;
+            }
+            batch.assign(std::make_move_iterator(_pending.begin()), std::make_move_iterator(_pending.begin() + n));
+            _pending.erase(_pending.begin(), _pending.begin() + n);
+            _pending_bytes -= bytes;
+        }
+        commit(&batch);
+        batch.clear();
+    }
+}
+
+void ProposalBatcher::commit(std::vector<Proposal>* batch) {
+    if (batch->empty()) {
+        return;
+    }
+    braft::Task task;
+    IOBuf data;
+    auto* done = new OpClosure();
+    if (batch->size() == 1) {
+        // a single op keeps the entry format of an op
+        data.swap(batch->front().data);
+    } else {
+        std::vector<IOBuf> ops;
+        ops.reserve(batch->size());
+        for (auto& proposal : *batch) {
+            ops.push_back(std::move(proposal.data));
+        }
+        encode_batch(ops, &data);
+    }
+    for (auto& proposal : *batch) {
+        done->add(std::move(proposal.op), std::move(proposal.span));
+    }
+    _batch_size << static_cast<int64_t>(batch->size());
+    _batch_bytes << static_cast<int64_t>(data.size());
+
+    task.data = &data;
+    task.done = done;
+    task.expected_term = -1;
+    _apply(task);
+}
+
+} // namespace pain::deva
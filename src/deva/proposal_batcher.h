@@ -0,0 +1,67 @@
+#pragma once
+
+#include <braft/raft.h>
+#include <bthread/bthread.h>
+#include <bthread/condition_variable.h>
+#include <bthread/mutex.h>
+#include <bvar/bvar.h>
+#include <pain/base/tracer.h>
+#include <pain/base/types.h>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "deva/op.h"
+
+namespace pain::deva {
+
+// ProposalBatcher puts the ops proposed within max_delay_us (or until max_ops ops or max_bytes bytes are pending)
+// into one raft log entry, see encode_batch, so a batch of small metadata ops costs one log append and one round
+// of replication. The ops are applied and completed in the order they are proposed.
+class ProposalBatcher {
+public:
+    using Apply = std::function<void(const braft::Task& task)>;
+
+    // the bvars of the batcher are exposed with the prefix
+    ProposalBatcher(Apply apply,
+                    uint32_t max_delay_us,
+                    uint32_t max_ops,
+                    uint64_t max_bytes,
+                    const std::string& prefix = "deva_proposal");
+    ~ProposalBatcher();
+
+    ProposalBatcher(const ProposalBatcher&) = delete;
+    ProposalBatcher& operator=(const ProposalBatcher&) = delete;
+
+    void propose(OpPtr op, std::shared_ptr<opentelemetry::trace::Span> span);
+
+private:
+    struct Proposal {
+        OpPtr op;
+        std::shared_ptr<opentelemetry::trace::Span> span;
+        // the op encoded by encode
+        IOBuf data;
+    };
+
+    static void* run(void* arg);
+    void loop();
+    void commit(std::vector<Proposal>* batch);
+
+    Apply _apply;
+    uint32_t _max_delay_us;
+    uint32_t _max_ops;
+    uint64_t _max_bytes;
+
+    std::vector<Proposal> _pending;
+    uint64_t _pending_bytes = 0;
+    bool _stopped = false;
+    bthread::Mutex _mutex;
+    bthread::ConditionVariable _cond;
+    bthread_t _tid = 0;
+
+    bvar::IntRecorder _batch_size;
+    bvar::IntRecorder _batch_bytes;
+};
+
+} // namespace pain::deva
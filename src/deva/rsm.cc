@@ -2,7 +2,7 @@
 
 #include <braft/raft.h>          // braft::Node braft::StateMachine
 #include <braft/storage.h>       // braft::SnapshotWriter
-#include <braft/util.h>          // braft::AsyncClosureGuard
+#include <brpc/closure_guard.h>  // brpc::ClosureGuard
 #include <brpc/controller.h>     // brpc::Controller
 #include <brpc/server.h>         // brpc::Server
 #include <butil/sys_byteorder.h> // butil::NetToHost32
@@ -22,6 +22,9 @@ DEFINE_int32(rsm_snapshot_interval, 30, "Interval between each snapshot");
 DEFINE_string(rsm_conf, "", "Initial configuration of the replication group");
 DEFINE_string(rsm_data_path, "./data", "Path of data stored on");
 DEFINE_string(rsm_listen_address, "127.0.0.1:8001", "Listen address of deva");
+DEFINE_uint32(rsm_batch_max_delay_us, 100, "The max time an op waits for the others to share its log entry");
+DEFINE_uint32(rsm_batch_max_ops, 256, "The max number of ops in a log entry");
+DEFINE_uint64(rsm_batch_max_bytes, 1024UL * 1024, "The max bytes of the ops in a log entry");
 
 namespace pain::deva {
 
@@ -36,8 +39,17 @@ Rsm::Rsm(const butil::EndPoint& address,
     _leader_term(-1),
     _container(container) {
     _node_options.fsm = this;
+    _batcher = std::make_unique<ProposalBatcher>(
+        [this](const braft::Task& task) {
+            apply(task);
+        },
+        FLAGS_rsm_batch_max_delay_us,
+        FLAGS_rsm_batch_max_ops,
+        FLAGS_rsm_batch_max_bytes);
 }
 Rsm::~Rsm() {
+    // the pending proposals go to the node before it's gone
+    _batcher.reset();
     delete _node;
 }
 
@@ -77,9 +89,15 @@ void Rsm::apply(const braft::Task& task) {
     }
 }
 
+void Rsm::propose(OpPtr op, std::shared_ptr<opentelemetry::trace::Span> span) {
+    _batcher->propose(std::move(op), std::move(span));
+}
+
 void Rsm::on_apply(braft::Iterator& iter) {
     for (; iter.valid(); iter.next()) {
-        braft::AsyncClosureGuard closure_guard(iter.done());
+        // the ops of the leader are applied before the next entry as well, so that a snapshot taken
+        // on this thread holds every entry applied before it
+        brpc::ClosureGuard closure_guard(iter.done());
         butil::IOBuf data;
         off_t offset = 0;
         if (iter.done() != nullptr) {
@@ -89,43 +107,60 @@ void Rsm::on_apply(braft::Iterator& iter) {
         } else {
             butil::IOBuf saved_log = iter.data();
             // clang-format off
-            auto op = decode(&saved_log, [rsm = RsmPtr(this)](OpType op_type, IOBuf* buf) {
+            auto ops = decode_batch(&saved_log, [rsm = RsmPtr(this)](OpType op_type, IOBuf* buf) {
                 return decode(op_type, buf, rsm);
             });
             // clang-format on
-            op->on_apply(iter.index());
+            for (auto& op : ops) {
+                op->on_apply(iter.index());
+            }
         }
 
         LOG(INFO) << "Write " << data.size() << " bytes"
                   << " from offset=" << offset << " at log_index=" << iter.index();
     }
+    // the changes of the entries applied above go to the storage in one batch
+    auto status = _container->commit();
+    if (!status.ok()) {
+        PLOG_ERROR(("desc", "commit applied entries failed")("error", status.error_str()));
+        BOOST_ASSERT_MSG(false, "commit applied entries failed");
+    }
 }
 
-struct SnapshotArg {
-    braft::SnapshotWriter* writer;
-    braft::Closure* done;
-};
-
 void* Rsm::save_snapshot(void* arg) {
-    SnapshotArg* sa = (SnapshotArg*)arg;
-    std::unique_ptr<SnapshotArg> arg_guard(sa);
+    std::unique_ptr<SnapshotArg> sa(static_cast<SnapshotArg*>(arg));
     brpc::ClosureGuard done_guard(sa->done);
-    std::string snapshot_path = sa->writer->get_path() + "/data";
+    std::vector<std::string> files;
+    auto status = sa->saver(sa->writer->get_path(), &files);
+    if (!status.ok()) {
+        sa->done->status().set_error(status.error_code(), "%s", status.error_cstr());
+        return nullptr;
+    }
+    for (const auto& file : files) {
+        if (sa->writer->add_file(file) != 0) {
+            sa->done->status().set_error(EIO, "Fail to add file %s to writer", file.c_str());
+            return nullptr;
+        }
+    }
     return nullptr;
 }
 
 void Rsm::on_snapshot_save(braft::SnapshotWriter* writer, braft::Closure* done) {
-    SnapshotArg* arg = new SnapshotArg;
-    arg->writer = writer;
-    arg->done = done;
+    // the view is taken here, between two applies, and written on a bthread
+    auto* arg = new SnapshotArg{.writer = writer, .done = done, .saver = _container->save_snapshot()};
     bthread_t tid = 0;
-    bthread_start_urgent(&tid, nullptr, save_snapshot, arg);
+    if (bthread_start_background(&tid, nullptr, save_snapshot, arg) != 0) {
+        save_snapshot(arg);
+    }
 }
 
-// NOLINTNEXTLINE
 int Rsm::on_snapshot_load(braft::SnapshotReader* reader) {
-    std::ignore = reader;
     CHECK(!is_leader()) << "Leader is not supposed to load snapshot";
+    auto status = _container->load_snapshot(reader->get_path());
+    if (!status.ok()) {
+        LOG(ERROR) << "Fail to load snapshot from " << reader->get_path() << ": " << status;
+        return -1;
+    }
     return 0;
 }
 
@@ -177,7 +212,17 @@ RsmPtr default_rsm() {
     node_options.snapshot_uri = fmt::format("{}/{}/snapshot", prefix, group);
     node_options.disable_cli = FLAGS_rsm_disable_cli;
 
-    static RsmPtr s_rsm = new Rsm(addr, group, node_options, new Deva());
+    // the rsm and its deva are created once
+    static RsmPtr s_rsm = [&]() {
+        auto* deva = new Deva();
+        ContainerPtr container(deva);
+        auto status = deva->open(fmt::format("{}/{}/namespace", FLAGS_rsm_data_path, group));
+        if (!status.ok()) {
+            PLOG_ERROR(("desc", "open deva failed")("error", status.error_str()));
+            BOOST_ASSERT_MSG(false, "open deva failed");
+        }
+        return RsmPtr(new Rsm(addr, group, node_options, container));
+    }();
     return s_rsm;
 }
 
@@ -2,8 +2,12 @@
 
 #include <braft/raft.h>    // braft::Node braft::StateMachine
 #include <braft/storage.h> // braft::SnapshotWriter
+#include <pain/base/tracer.h>
+#include <memory>
 #include <boost/intrusive_ptr.hpp>
 #include "deva/container.h"
+#include "deva/op.h"
+#include "deva/proposal_batcher.h"
 
 namespace pain::deva {
 
@@ -26,11 +30,14 @@ public:
     void join();
 
     void apply(const braft::Task& task);
+    // apply op through the proposal batcher, it may share a log entry with other ops
+    void propose(OpPtr op, std::shared_ptr<opentelemetry::trace::Span> span);
     void on_apply(braft::Iterator& iter) override;
 
     struct SnapshotArg {
         braft::SnapshotWriter* writer;
         braft::Closure* done;
+        Container::SnapshotSaver saver;
     };
 
     static void* save_snapshot(void* arg);
@@ -58,6 +65,7 @@ private:
     braft::NodeOptions _node_options;
     braft::Node* volatile _node;
     butil::atomic<int64_t> _leader_term;
+    std::unique_ptr<ProposalBatcher> _batcher;
     std::atomic<int> _use_count = {0};
 
     friend void intrusive_ptr_add_ref(Rsm* rsm) {
@@ -0,0 +1,285 @@
+#include "deva/snapshot_file.h"
+
+#include <bthread/bthread.h>
+#include <bthread/mutex.h>
+#include <butil/crc32c.h>
+#include <fcntl.h>
+#include <gflags/gflags.h>
+#include <pain/base/plog.h>
+#include <pain/base/scope_exit.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+
+DEFINE_uint32(deva_snapshot_load_concurrency, 8, "The max number of sections of a snapshot file loaded at a time");
+
+namespace pain::deva {
+
+namespace {
+
+template <typename T>
+uint32_t crc_of(const T& t) {
+    return butil::crc32c::Value(reinterpret_cast<const char*>(&t), offsetof(T, crc));
+}
+
+Status write_all(int fd, std::vector<iovec> iov) {
+    size_t first = 0;
+    while (first < iov.size()) {
+        auto n = std::min<size_t>(iov.size() - first, IOV_MAX);
+        auto nw = ::writev(fd, &iov[first], static_cast<int>(n));
+        if (nw < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return Status(errno, "failed to write snapshot file");
+        }
+        // skip the bytes written
+        auto left = static_cast<size_t>(nw);
+        while (left > 0) {
+            auto k = std::min(left, iov[first].iov_len);
+            iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + k;
+            iov[first].iov_len -= k;
+            left -= k;
+            if (iov[first].iov_len == 0) {
+                first++;
+            }
+        }
+        while (first < iov.size() && iov[first].iov_len == 0) {
+            first++;
+        }
+    }
+    return Status::OK();
+}
+
+Status read_at(int fd, uint64_t offset, void* buf, size_t n) {
+    auto* p = static_cast<char*>(buf);
+    while (n > 0) {
+        auto nr = ::pread(fd, p, n, static_cast<off_t>(offset));
+        if (nr < 0 && errno == EINTR) {
+            continue;
+        }
+        if (nr <= 0) {
+            return Status(nr < 0 ? errno : EIO, "failed to read snapshot file");
+        }
+        p += nr;
+        n -= nr;
+        offset += nr;
+    }
+    return Status::OK();
+}
+
+// the workers of parallel_run take the next call until all are done or one fails
+struct RunContext {
+    const std::function<Status(size_t)>* fn;
+    size_t n;
+    std::atomic<size_t> next = 0;
+    bthread::Mutex mutex;
+    Status status;
+};
+
+void* run(void* arg) {
+    auto* ctx = static_cast<RunContext*>(arg);
+    for (auto i = ctx->next++; i < ctx->n; i = ctx->next++) {
+        auto status = (*ctx->fn)(i);
+        if (!status.ok()) {
+            std::unique_lock lock(ctx->mutex);
+            if (ctx->status.ok()) {
+                ctx->status = std::move(status);
+            }
+            ctx->next = ctx->n;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace
+
+SnapshotFileWriter::~SnapshotFileWriter() {
+    if (_fd >= 0) {
+        ::close(_fd);
+    }
+}
+
+Status SnapshotFileWriter::open(const std::string& path) {
+    _path = path;
+    _fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644); // NOLINT(readability-magic-numbers)
+    if (_fd < 0) {
+        PLOG_ERROR(("desc", "failed to open snapshot file")("path", path)("errno", errno));
+        _status = Status(errno, "failed to open snapshot file");
+        return _status;
+    }
+    // the header is patched by finish, once the number of sections is known
+    SnapshotFileHeader header;
+    _status = write_all(_fd, {{&header, sizeof(header)}});
+    if (!_status.ok()) {
+        PLOG_ERROR(("desc", "failed to write snapshot file")("path", path)("error", _status.error_str()));
+    }
+    return _status;
+}
+
+void SnapshotFileWriter::write_section() {
+    if (_status.ok()) {
+        SnapshotSection section;
+        section.length = _records.data.size();
+        section.record_count = _records.count;
+        section.crc = butil::crc32c::Value(_records.data.data(), _records.data.size());
+        _status = write_all(_fd, {{&section, sizeof(section)}, {_records.data.data(), _records.data.size()}});
+        if (!_status.ok()) {
+            PLOG_ERROR(("desc", "failed to write snapshot file")("path", _path)("error", _status.error_str()));
+        }
+        _section_count++;
+    }
+    // the records are dropped after a failure as well, so that the memory stays bounded
+    _records.data.clear();
+    _records.count = 0;
+}
+
+Status SnapshotFileWriter::finish() {
+    if (_fd < 0) {
+        return _status.ok() ? Status(EBADF, "snapshot file is not opened") : _status;
+    }
+    if (_records.count > 0) {
+        write_section();
+    }
+    if (!_status.ok()) {
+        return _status;
+    }
+    SnapshotFileHeader header;
+    header.section_count = _section_count;
+    header.crc = crc_of(header);
+    auto nw = ::pwrite(_fd, &header, sizeof(header), 0);
+    if (nw != static_cast<ssize_t>(sizeof(header))) {
+        int err = nw < 0 ? errno : EIO;
+        PLOG_ERROR(("desc", "failed to write snapshot file header")("path", _path)("errno", err));
+        return Status(err, "failed to write snapshot file header");
+    }
+    if (::fsync(_fd) != 0) {
+        PLOG_ERROR(("desc", "failed to sync snapshot file")("path", _path)("errno", errno));
+        return Status(errno, "failed to sync snapshot file");
+    }
+    ::close(_fd);
+    _fd = -1;
+    return Status::OK();
+}
+
+SnapshotFileReader::~SnapshotFileReader() {
+    if (_fd >= 0) {
+        ::close(_fd);
+    }
+}
+
+Status SnapshotFileReader::open(const std::string& path) {
+    _path = path;
+    _fd = ::open(path.c_str(), O_RDONLY);
+    if (_fd < 0) {
+        PLOG_ERROR(("desc", "failed to open snapshot file")("path", path)("errno", errno));
+        return Status(errno, "failed to open snapshot file");
+    }
+    struct stat st = {};
+    if (::fstat(_fd, &st) != 0) {
+        return Status(errno, "failed to stat snapshot file");
+    }
+    auto file_size = static_cast<uint64_t>(st.st_size);
+
+    SnapshotFileHeader header;
+    auto status = read_at(_fd, 0, &header, sizeof(header));
+    if (!status.ok() || header.magic != kSnapshotMagic || header.crc != crc_of(header)) {
+        PLOG_ERROR(("desc", "invalid snapshot file header")("path", path));
+        return Status(EIO, "invalid snapshot file header");
+    }
+    if (header.version != kSnapshotFormatVersion) {
+        PLOG_ERROR(("desc", "unknown snapshot file version")("path", path)("version", header.version));
+        return Status(EIO, "unknown snapshot file version");
+    }
+    uint64_t offset = sizeof(header);
+    _sections.resize(header.section_count);
+    for (auto& index : _sections) {
+        status = read_at(_fd, offset, &index.section, sizeof(SnapshotSection));
+        offset += sizeof(SnapshotSection);
+        if (!status.ok() || index.section.length > file_size - std::min(offset, file_size)) {
+            PLOG_ERROR(("desc", "truncated snapshot file")("path", path));
+            return Status(EIO, "truncated snapshot file");
+        }
+        index.offset = offset;
+        offset += index.section.length;
+    }
+    if (offset != file_size) {
+        PLOG_ERROR(("desc", "trailing bytes in snapshot file")("path", path));
+        return Status(EIO, "trailing bytes in snapshot file");
+    }
+    return Status::OK();
+}
+
+Status SnapshotFileReader::read_section(size_t i, SnapshotRecords* records) const {
+    const auto& index = _sections[i];
+    records->data.resize(index.section.length);
+    records->count = index.section.record_count;
+    auto status = read_at(_fd, index.offset, records->data.data(), records->data.size());
+    if (!status.ok() || butil::crc32c::Value(records->data.data(), records->data.size()) != index.section.crc) {
+        PLOG_ERROR(("desc", "corrupted snapshot section")("path", _path)("section", i));
+        return Status(EIO, "corrupted snapshot section");
+    }
+    return Status::OK();
+}
+
+Status read_snapshot_file(const std::string& path, std::vector<SnapshotRecords>* sections) {
+    SnapshotFileReader reader;
+    auto status = reader.open(path);
+    if (!status.ok()) {
+        return status;
+    }
+    sections->resize(reader.section_count());
+    for (size_t i = 0; i < sections->size(); i++) {
+        status = reader.read_section(i, &(*sections)[i]);
+        if (!status.ok()) {
+            return status;
+        }
+    }
+    return Status::OK();
+}
+
+bool SnapshotRecordReader::read(void* buf, size_t n) {
+    if (_data.size() < n) {
+        return false;
+    }
+    std::memcpy(buf, _data.data(), n);
+    _data.remove_prefix(n);
+    return true;
+}
+
+bool SnapshotRecordReader::read(std::string* str, size_t n) {
+    if (_data.size() < n) {
+        return false;
+    }
+    str->assign(_data.data(), n);
+    _data.remove_prefix(n);
+    return true;
+}
+
+Status parallel_run(size_t n, const std::function<Status(size_t)>& fn, size_t max_concurrency) {
+    RunContext ctx;
+    ctx.fn = &fn;
+    ctx.n = n;
+    std::vector<bthread_t> tids(std::min(n, std::max<size_t>(max_concurrency, 1)), 0);
+    for (auto& tid : tids) {
+        if (bthread_start_background(&tid, nullptr, run, &ctx) != 0) {
+            tid = 0;
+            run(&ctx);
+        }
+    }
+    for (auto tid : tids) {
+        if (tid != 0) {
+            bthread_join(tid, nullptr);
+        }
+    }
+    return ctx.status;
+}
+
+} // namespace pain::deva
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <pain/base/types.h>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace pain::deva {
+
+// The layout of a snapshot file of deva:
+//
+//   +----------------------+ 0
+//   | SnapshotFileHeader   |
+//   +----------------------+
+//   | SnapshotSection      |
+//   | records              |
+//   +----------------------+
+//   | ...                  |
+//   +----------------------+ file size
+//
+// The records are split into sections of about the same size, each section is checksummed and parsed on its own,
+// so that the sections of a file are loaded in parallel. The format of the records is up to the owner of the file.
+// Integers are stored in little endian.
+
+constexpr uint64_t kSnapshotMagic = 0x50414e53'41564544; // "DEVASNAP"
+constexpr uint32_t kSnapshotFormatVersion = 1;
+constexpr size_t kSnapshotSectionBytes = 4UL * 1024 * 1024;
+
+struct SnapshotFileHeader {
+    uint64_t magic = kSnapshotMagic;
+    uint32_t version = kSnapshotFormatVersion;
+    uint32_t section_count = 0;
+    uint64_t reserved = 0;
+    uint32_t padding = 0;
+    // crc32c of the fields above
+    uint32_t crc = 0;
+};
+
+struct SnapshotSection {
+    uint64_t length = 0;
+    uint32_t record_count = 0;
+    // crc32c of the records
+    uint32_t crc = 0;
+};
+
+static_assert(sizeof(SnapshotFileHeader) == 32);
+static_assert(sizeof(SnapshotSection) == 16);
+
+// the records of a section
+struct SnapshotRecords {
+    uint32_t count = 0;
+    std::string data;
+};
+
+// SnapshotFileWriter writes the records of a file section by section: a new section is started once the current
+// one is larger than section_bytes, and the full one is written to the file right away, so the memory held is
+// about one section. A record is never split across sections. The header is written last by finish.
+class SnapshotFileWriter {
+public:
+    explicit SnapshotFileWriter(size_t section_bytes = kSnapshotSectionBytes) : _section_bytes(section_bytes) {}
+    ~SnapshotFileWriter();
+
+    SnapshotFileWriter(const SnapshotFileWriter&) = delete;
+    SnapshotFileWriter& operator=(const SnapshotFileWriter&) = delete;
+
+    // create the file at path
+    Status open(const std::string& path);
+
+    // the buffer of the current record, the bytes appended belong to the record until end_record.
+    // A failure to write a full section is returned by finish
+    std::string* record() {
+        if (_records.data.size() >= _section_bytes) {
+            write_section();
+        }
+        return &_records.data;
+    }
+
+    void end_record() {
+        _records.count++;
+    }
+
+    // write the last section and the header, then sync the file
+    Status finish();
+
+private:
+    void write_section();
+
+    size_t _section_bytes;
+    std::string _path;
+    int _fd = -1;
+    Status _status;
+    uint32_t _section_count = 0;
+    // the records of the current section
+    SnapshotRecords _records;
+};
+
+// append the bytes of a fixed size field to a record
+template <typename T>
+void put_fixed(std::string* record, const T& value) {
+    record->append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// SnapshotFileReader reads the sections of a file one at a time, so that a large file is loaded with bounded memory
+class SnapshotFileReader {
+public:
+    SnapshotFileReader() = default;
+    ~SnapshotFileReader();
+
+    SnapshotFileReader(const SnapshotFileReader&) = delete;
+    SnapshotFileReader& operator=(const SnapshotFileReader&) = delete;
+
+    // open the file at path and walk the headers of its sections
+    Status open(const std::string& path);
+    size_t section_count() const {
+        return _sections.size();
+    }
+    // read the records of the i-th section and verify them, the sections can be read concurrently
+    Status read_section(size_t i, SnapshotRecords* records) const;
+
+private:
+    struct SectionIndex {
+        uint64_t offset;
+        SnapshotSection section;
+    };
+
+    std::string _path;
+    int _fd = -1;
+    std::vector<SectionIndex> _sections;
+};
+
+// read all the sections of the file at path
+Status read_snapshot_file(const std::string& path, std::vector<SnapshotRecords>* sections);
+
+// a little endian decoder over the records of a section
+class SnapshotRecordReader {
+public:
+    explicit SnapshotRecordReader(std::string_view data) : _data(data) {}
+
+    bool read(void* buf, size_t n);
+    bool read(std::string* str, size_t n);
+    template <typename T>
+    bool get_fixed(T* value) {
+        return read(value, sizeof(T));
+    }
+    bool empty() const {
+        return _data.empty();
+    }
+
+private:
+    std::string_view _data;
+};
+
+// run fn(0) .. fn(n - 1) on at most max_concurrency bthreads and wait for them,
+// the first error is returned and the calls not started yet are skipped
+Status parallel_run(size_t n, const std::function<Status(size_t)>& fn, size_t max_concurrency = SIZE_MAX);
+
+} // namespace pain::deva
@@ -0,0 +1,94 @@
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+#include <set>
+#include "deva/chunk_allocator.h"
+
+DECLARE_string(deva_manusya_locations);
+DECLARE_uint32(deva_chunk_replica_count);
+
+using namespace pain;
+using namespace pain::deva;
+
+namespace {
+
+// 记录 create 请求的 allocator, 代替 manusya
+class FakeAllocator : public ChunkAllocator {
+public:
+    Future<Status> create_replica(const std::string& location, const UUID& chunk_id) override {
+        created.emplace_back(location, chunk_id.str());
+        if (location == failed_location) {
+            return make_ready_future(Status(EIO, "create failed"));
+        }
+        return make_ready_future(Status::OK());
+    }
+
+    std::vector<std::pair<std::string, std::string>> created;
+    std::string failed_location;
+};
+
+class ChunkAllocatorTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        FLAGS_deva_manusya_locations = "m1:8003,m2:8003,m3:8003,m4:8003";
+        FLAGS_deva_chunk_replica_count = 3;
+    }
+
+    void TearDown() override {
+        FLAGS_deva_manusya_locations = "";
+        FLAGS_deva_chunk_replica_count = 3;
+    }
+};
+
+} // namespace
+
+// 每个副本在不同的 manusya 上以同一个 uuid 创建, 依次轮转
+TEST_F(ChunkAllocatorTest, allocate) {
+    FakeAllocator allocator;
+    UUID chunk_id;
+    std::vector<std::string> locations;
+    auto status = allocator.allocate(0, &chunk_id, &locations);
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(locations, (std::vector<std::string>{"m1:8003", "m2:8003", "m3:8003"}));
+    ASSERT_EQ(allocator.created.size(), 3);
+    for (const auto& [location, uuid] : allocator.created) {
+        ASSERT_EQ(uuid, chunk_id.str());
+    }
+
+    UUID next_id;
+    status = allocator.allocate(0, &next_id, &locations);
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_NE(next_id.str(), chunk_id.str());
+    ASSERT_EQ(locations, (std::vector<std::string>{"m2:8003", "m3:8003", "m4:8003"}));
+
+    // EC chunk 的数据和校验分片各占一个 manusya
+    status = allocator.allocate(4, &next_id, &locations);
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(locations, (std::vector<std::string>{"m3:8003", "m4:8003", "m1:8003", "m2:8003"}));
+}
+
+// manusya 不够副本数时不分配
+TEST_F(ChunkAllocatorTest, not_enough_manusyas) {
+    FakeAllocator allocator;
+    FLAGS_deva_manusya_locations = "m1:8003,m2:8003";
+    UUID chunk_id;
+    std::vector<std::string> locations;
+    auto status = allocator.allocate(0, &chunk_id, &locations);
+    ASSERT_EQ(status.error_code(), ENOSPC);
+    ASSERT_TRUE(allocator.created.empty());
+
+    FLAGS_deva_manusya_locations = "";
+    status = allocator.allocate(0, &chunk_id, &locations);
+    ASSERT_EQ(status.error_code(), ENOSPC);
+}
+
+// 任一副本创建失败则分配失败
+TEST_F(ChunkAllocatorTest, replica_failed) {
+    FakeAllocator allocator;
+    allocator.failed_location = "m2:8003";
+    UUID chunk_id;
+    std::vector<std::string> locations;
+    auto status = allocator.allocate(0, &chunk_id, &locations);
+    ASSERT_EQ(status.error_code(), EIO);
+    ASSERT_TRUE(locations.empty());
+    ASSERT_EQ(allocator.created.size(), 3);
+}
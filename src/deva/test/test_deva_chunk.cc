@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+#include "deva/deva.h"
+
+using namespace pain;
+using namespace pain::deva;
+
+namespace {
+
+proto::UUID to_proto(const UUID& uuid) {
+    proto::UUID result;
+    result.set_high(uuid.high());
+    result.set_low(uuid.low());
+    return result;
+}
+
+class DevaChunkTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        proto::deva::store::CreateFileRequest request;
+        proto::deva::store::CreateFileResponse response;
+        request.set_path("/file");
+        *request.mutable_file_id() = to_proto(_file_id);
+        auto status = _deva.CreateFile(&request, &response, _index++);
+        ASSERT_TRUE(status.ok()) << status.error_str();
+    }
+
+    Status create_chunk(const UUID& chunk_id, proto::ChunkInfo* chunk = nullptr) {
+        proto::deva::store::CreateChunkRequest request;
+        proto::deva::store::CreateChunkResponse response;
+        *request.mutable_file_id() = to_proto(_file_id);
+        *request.mutable_chunk_info()->mutable_uuid() = to_proto(chunk_id);
+        auto status = _deva.CreateChunk(&request, &response, _index++);
+        if (chunk != nullptr) {
+            *chunk = response.chunk_info();
+        }
+        return status;
+    }
+
+    Status seal_and_new_chunk(const UUID& sealed, uint64_t length, const UUID& chunk_id, proto::ChunkInfo* chunk) {
+        proto::deva::store::SealAndNewChunkRequest request;
+        proto::deva::store::SealAndNewChunkResponse response;
+        *request.mutable_file_id() = to_proto(_file_id);
+        *request.mutable_chunk_id() = to_proto(sealed);
+        request.set_length(length);
+        *request.mutable_chunk_info()->mutable_uuid() = to_proto(chunk_id);
+        auto status = _deva.SealAndNewChunk(&request, &response, _index++);
+        *chunk = response.chunk_info();
+        return status;
+    }
+
+    Deva _deva;
+    UUID _file_id = UUID::generate();
+    int64_t _index = 1;
+};
+
+} // namespace
+
+// 新 chunk 追加到文件末尾, seal 的长度记录在文件里
+TEST_F(DevaChunkTest, seal_and_new_chunk) {
+    auto first = UUID::generate();
+    proto::ChunkInfo chunk;
+    auto status = create_chunk(first, &chunk);
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(chunk.index(), 0);
+    ASSERT_EQ(chunk.offset(), 0);
+
+    auto second = UUID::generate();
+    status = seal_and_new_chunk(first, 100, second, &chunk);
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(chunk.index(), 1);
+    ASSERT_EQ(chunk.offset(), 100);
+
+    auto third = UUID::generate();
+    status = seal_and_new_chunk(second, 50, third, &chunk);
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(chunk.offset(), 150);
+
+    auto file_info = _deva._file_infos.get(_file_id);
+    ASSERT_EQ(file_info->size(), 150);
+    ASSERT_EQ(file_info->chunk_infos_size(), 3);
+    ASSERT_EQ(file_info->chunk_infos(0).state(), proto::CHUNK_STATE_SEALED);
+    ASSERT_EQ(file_info->chunk_infos(0).length(), 100);
+    ASSERT_EQ(file_info->chunk_infos(1).length(), 50);
+    ASSERT_EQ(file_info->chunk_infos(2).uuid().low(), third.low());
+}
+
+// 只能 seal 文件的最后一个 chunk, 且不能改变已经 seal 的长度
+TEST_F(DevaChunkTest, seal_last_chunk_only) {
+    auto first = UUID::generate();
+    ASSERT_TRUE(create_chunk(first).ok());
+    // 最后一个 chunk 没有 seal 时不能直接追加
+    ASSERT_EQ(create_chunk(UUID::generate()).error_code(), EBUSY);
+
+    auto second = UUID::generate();
+    proto::ChunkInfo chunk;
+    ASSERT_TRUE(seal_and_new_chunk(first, 100, second, &chunk).ok());
+    ASSERT_EQ(seal_and_new_chunk(first, 100, UUID::generate(), &chunk).error_code(), EINVAL);
+
+    auto third = UUID::generate();
+    ASSERT_TRUE(seal_and_new_chunk(second, 10, third, &chunk).ok());
+    ASSERT_EQ(_deva._file_infos.get(_file_id)->chunk_infos_size(), 3);
+}
+
+// 文件不存在时不记录 chunk
+TEST_F(DevaChunkTest, file_not_found) {
+    _file_id = UUID::generate();
+    ASSERT_EQ(create_chunk(UUID::generate()).error_code(), ENOENT);
+    proto::ChunkInfo chunk;
+    ASSERT_EQ(seal_and_new_chunk(UUID::generate(), 0, UUID::generate(), &chunk).error_code(), ENOENT);
+}
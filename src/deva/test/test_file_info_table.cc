@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+#include "deva/file_info_table.h"
+
+using namespace pain;
+using namespace pain::deva;
+
+namespace {
+
+std::shared_ptr<const proto::FileInfo> make_file_info(uint64_t size) {
+    auto file_info = std::make_shared<proto::FileInfo>();
+    file_info->set_size(size);
+    return file_info;
+}
+
+} // namespace
+
+// view 之后的修改对 view 不可见
+TEST(FileInfoTable, view) {
+    FileInfoTable table;
+    auto a = UUID::generate();
+    auto b = UUID::generate();
+    table.set(a, make_file_info(1));
+    auto view1 = table.view();
+    table.set(a, make_file_info(2));
+    table.set(b, make_file_info(3));
+    auto view2 = table.view();
+    auto view3 = table.view();
+
+    auto infos1 = view1.merge();
+    ASSERT_EQ(infos1->size(), 1);
+    ASSERT_EQ(infos1->at(a)->size(), 1);
+    auto infos2 = view2.merge();
+    ASSERT_EQ(infos2->size(), 2);
+    ASSERT_EQ(infos2->at(a)->size(), 2);
+    ASSERT_EQ(infos2->at(b)->size(), 3);
+    ASSERT_EQ(view3.merge()->size(), 2);
+}
+
+// 合并好的 map 在下一次 view 时替换掉被合并的层, 层数不会一直增长
+TEST(FileInfoTable, install_merged) {
+    FileInfoTable table;
+    std::vector<UUID> uuids;
+    for (int i = 0; i < 10; i++) {
+        uuids.push_back(UUID::generate());
+        table.set(uuids.back(), make_file_info(i));
+        auto view = table.view();
+        ASSERT_LE(table._layers.deltas.size(), 2);
+        auto infos = view.merge();
+        ASSERT_EQ(infos->size(), uuids.size());
+    }
+    auto infos = table.view().merge();
+    for (int i = 0; i < 10; i++) {
+        ASSERT_EQ(infos->at(uuids[i])->size(), i);
+    }
+
+    // reset 之前合并的 map 不会替换 reset 之后的层
+    table.set(UUID::generate(), make_file_info(100));
+    auto view = table.view();
+    FileInfos loaded;
+    loaded[uuids[0]] = make_file_info(200);
+    table.reset(std::move(loaded));
+    ASSERT_EQ(view.merge()->size(), 11);
+    infos = table.view().merge();
+    ASSERT_EQ(infos->size(), 1);
+    ASSERT_EQ(infos->at(uuids[0])->size(), 200);
+}
+
+// get 按从新到旧的顺序查找各层
+TEST(FileInfoTable, get) {
+    FileInfoTable table;
+    auto a = UUID::generate();
+    auto b = UUID::generate();
+    ASSERT_EQ(table.get(a), nullptr);
+    table.set(a, make_file_info(1));
+    table.set(b, make_file_info(2));
+    auto view = table.view();
+    ASSERT_EQ(table.get(a)->size(), 1);
+    table.set(a, make_file_info(3));
+    ASSERT_EQ(table.get(a)->size(), 3);
+    table.view().merge();
+    table.view();
+    ASSERT_EQ(table.get(a)->size(), 3);
+    ASSERT_EQ(table.get(b)->size(), 2);
+
+    FileInfos loaded;
+    loaded[b] = make_file_info(4);
+    table.reset(std::move(loaded));
+    ASSERT_EQ(table.get(a), nullptr);
+    ASSERT_EQ(table.get(b)->size(), 4);
+}
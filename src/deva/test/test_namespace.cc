@@ -1,8 +1,11 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <filesystem>
 #include <fmt/format.h>
 #include <fmt/ranges.h>
 #include <fmt/std.h>
 
+#include "common/mem_store.h"
 #include "deva/namespace.h"
 
 using namespace pain;
@@ -227,3 +230,294 @@ TEST(Namespace, lookup_and_list) {
         }
     }
 }
+
+// 快照写入文件后加载到另一个 namespace, 内容一致
+TEST(Namespace, snapshot) {
+    Namespace ns;
+    std::vector<UUID> dirs;
+    for (int i = 0; i < 100; i++) {
+        auto dir = UUID::generate();
+        ASSERT_TRUE(ns.create(ns.root(), fmt::format("dir{}", i), FileType::kDirectory, dir).ok());
+        for (int j = 0; j < 10; j++) {
+            ASSERT_TRUE(ns.create(dir, fmt::format("file{}", j), FileType::kFile, UUID::generate()).ok());
+        }
+        dirs.push_back(dir);
+    }
+    // 一个大目录会拆成多个 record
+    for (int j = 0; j < 100; j++) {
+        ASSERT_TRUE(ns.create(dirs[1], fmt::format("large{}", j), FileType::kFile, UUID::generate()).ok());
+    }
+    auto snapshot = ns.snapshot();
+    // 快照之后的修改不影响快照
+    ns.remove(ns.root(), "dir0");
+    ASSERT_TRUE(ns.commit().ok());
+
+    std::string path = "./test_namespace_snapshot";
+    // 每个 section 只放几个目录, 加载时并行解析
+    ASSERT_TRUE(Namespace::save(snapshot, path, 512).ok());
+
+    Namespace loaded;
+    auto status = loaded.load(path);
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    std::list<DirEntry> list;
+    loaded.list(loaded.root(), &list);
+    ASSERT_EQ(list.size(), 100);
+    UUID inode;
+    FileType type = FileType::kDirectory;
+    ASSERT_TRUE(loaded.lookup("/dir0/file9", &inode, &type).ok());
+    ASSERT_EQ(type, FileType::kFile);
+    loaded.list(dirs[99], &list);
+    ASSERT_EQ(list.size(), 10);
+    loaded.list(dirs[1], &list);
+    ASSERT_EQ(list.size(), 110);
+
+    // 损坏的快照加载失败
+    {
+        std::FILE* file = std::fopen(path.c_str(), "r+");
+        ASSERT_NE(file, nullptr);
+        std::fseek(file, 100, SEEK_SET);
+        std::fputc('x', file);
+        std::fclose(file);
+    }
+    ASSERT_FALSE(loaded.load(path).ok());
+    std::remove(path.c_str());
+}
+
+// 写满的 section 马上写入文件, 内存里只留当前的 section
+TEST(Namespace, snapshot_file_writer) {
+    std::string path = "./test_snapshot_file_writer";
+    SnapshotFileWriter writer(64);
+    ASSERT_TRUE(writer.open(path).ok());
+    for (uint32_t i = 0; i < 100; i++) {
+        auto* record = writer.record();
+        put_fixed(record, i);
+        record->append(60, 'x');
+        writer.end_record();
+        ASSERT_LE(writer._records.data.size(), 128);
+    }
+    ASSERT_EQ(std::filesystem::file_size(path),
+              sizeof(SnapshotFileHeader) + 99 * (sizeof(SnapshotSection) + 64));
+    ASSERT_TRUE(writer.finish().ok());
+
+    std::vector<SnapshotRecords> sections;
+    ASSERT_TRUE(read_snapshot_file(path, &sections).ok());
+    ASSERT_EQ(sections.size(), 100);
+    for (uint32_t i = 0; i < sections.size(); i++) {
+        ASSERT_EQ(sections[i].count, 1);
+        SnapshotRecordReader reader(sections[i].data);
+        uint32_t value = 0;
+        ASSERT_TRUE(reader.get_fixed(&value));
+        ASSERT_EQ(value, i);
+    }
+    std::remove(path.c_str());
+}
+
+// 未提交的修改对读可见, 提交后写入 store, 缓存只保留最近用到的条目
+TEST(Namespace, commit) {
+    common::StorePtr store = new common::MemStore();
+    Namespace ns;
+    ASSERT_TRUE(ns.open(store).ok());
+    ns._cache_capacity = 4;
+    UUID a = UUID::generate();
+    ASSERT_TRUE(ns.create(ns.root(), "a", FileType::kDirectory, a).ok());
+    for (int i = 0; i < 10; i++) {
+        ASSERT_TRUE(ns.create(a, fmt::format("f{}", i), FileType::kFile, UUID::generate()).ok());
+    }
+    size_t len = 0;
+    ASSERT_TRUE(store->hlen(a.str(), &len).ok());
+    ASSERT_EQ(len, 0);
+    UUID inode;
+    FileType type = FileType::kDirectory;
+    ASSERT_TRUE(ns.lookup("/a/f3", &inode, &type).ok());
+    ASSERT_EQ(type, FileType::kFile);
+
+    ASSERT_TRUE(ns.commit().ok());
+    ASSERT_TRUE(ns._pending.empty());
+    ASSERT_LE(ns._cache.size(), 4);
+    // 目录自身加上 10 个文件
+    ASSERT_TRUE(store->hlen(a.str(), &len).ok());
+    ASSERT_EQ(len, 11);
+    for (int i = 0; i < 10; i++) {
+        ASSERT_TRUE(ns.lookup(fmt::format("/a/f{}", i).c_str(), &inode, &type).ok());
+    }
+    ASSERT_LE(ns._cache.size(), 4);
+
+    // 删除在提交前就生效
+    ASSERT_TRUE(ns.remove(a, "f3").ok());
+    ASSERT_FALSE(ns.lookup("/a/f3", &inode, &type).ok());
+    std::list<DirEntry> list;
+    ns.list(a, &list);
+    ASSERT_EQ(list.size(), 9);
+    ASSERT_TRUE(ns.commit().ok());
+    ASSERT_FALSE(ns.lookup("/a/f3", &inode, &type).ok());
+    ASSERT_FALSE(store->hexists(a.str(), "f3"));
+
+}
+
+// 重启时 store 里的内容被清掉, 由 raft 回放日志重建, 回放的创建不会因为重名失败
+TEST(Namespace, reopen_and_replay) {
+    common::StorePtr store = new common::MemStore();
+    UUID a = UUID::generate();
+    UUID f = UUID::generate();
+    auto replay = [&](Namespace* ns) {
+        ASSERT_TRUE(ns->create(ns->root(), "a", FileType::kDirectory, a).ok());
+        ASSERT_TRUE(ns->create(a, "f", FileType::kFile, f).ok());
+        ASSERT_TRUE(ns->commit().ok());
+        ASSERT_TRUE(ns->create(a, "g", FileType::kFile, UUID::generate()).ok());
+        ASSERT_TRUE(ns->remove(a, "g").ok());
+        ASSERT_TRUE(ns->commit().ok());
+    };
+    {
+        Namespace ns;
+        ASSERT_TRUE(ns.open(store).ok());
+        replay(&ns);
+    }
+
+    Namespace reopened;
+    ASSERT_TRUE(reopened.open(store).ok());
+    UUID inode;
+    FileType type = FileType::kDirectory;
+    ASSERT_FALSE(reopened.lookup("/a", &inode, &type).ok());
+    std::list<DirEntry> list;
+    reopened.list(reopened.root(), &list);
+    ASSERT_TRUE(list.empty());
+
+    replay(&reopened);
+    ASSERT_TRUE(reopened.lookup("/a/f", &inode, &type).ok());
+    ASSERT_EQ(inode, f);
+    reopened.list(a, &list);
+    ASSERT_EQ(list.size(), 1);
+    size_t len = 0;
+    ASSERT_TRUE(store->hlen(a.str(), &len).ok());
+    ASSERT_EQ(len, 2);
+}
+
+// 同一个目录下不能有同名的条目
+TEST(Namespace, duplicate) {
+    Namespace ns;
+    UUID a = UUID::generate();
+    ASSERT_TRUE(ns.create(ns.root(), "a", FileType::kDirectory, a).ok());
+    ASSERT_EQ(ns.create(ns.root(), "a", FileType::kFile, UUID::generate()).error_code(), EEXIST);
+    ASSERT_TRUE(ns.commit().ok());
+    ASSERT_EQ(ns.create(ns.root(), "a", FileType::kDirectory, UUID::generate()).error_code(), EEXIST);
+    // 删除之后可以重新创建
+    ASSERT_TRUE(ns.remove(ns.root(), "a").ok());
+    ASSERT_TRUE(ns.create(ns.root(), "a", FileType::kFile, UUID::generate()).ok());
+    ASSERT_TRUE(ns.create(a, "a", FileType::kFile, UUID::generate()).ok());
+}
+
+// 分页 list 按名字排序, 合并已提交和未提交的修改
+TEST(Namespace, list_pages) {
+    Namespace ns;
+    UUID dir = UUID::generate();
+    ASSERT_TRUE(ns.create(ns.root(), "dir", FileType::kDirectory, dir).ok());
+    for (int i = 0; i < 100; i += 2) {
+        ASSERT_TRUE(ns.create(dir, fmt::format("f{:03}", i), FileType::kFile, UUID::generate()).ok());
+    }
+    ASSERT_TRUE(ns.commit().ok());
+    for (int i = 1; i < 100; i += 2) {
+        ASSERT_TRUE(ns.create(dir, fmt::format("f{:03}", i), FileType::kFile, UUID::generate()).ok());
+    }
+    ASSERT_TRUE(ns.remove(dir, "f010").ok());
+    ASSERT_TRUE(ns.remove(dir, "f011").ok());
+
+    std::vector<std::string> names;
+    std::string start_after;
+    std::list<DirEntry> page;
+    while (true) {
+        ns.list(dir, start_after, 7, &page);
+        if (page.empty()) {
+            break;
+        }
+        ASSERT_LE(page.size(), 7);
+        for (const auto& entry : page) {
+            names.push_back(entry.name);
+        }
+        start_after = page.back().name;
+    }
+    ASSERT_EQ(names.size(), 98);
+    ASSERT_TRUE(std::is_sorted(names.begin(), names.end()));
+    ASSERT_EQ(std::count(names.begin(), names.end(), "f010"), 0);
+    ASSERT_EQ(std::count(names.begin(), names.end(), "f011"), 0);
+    ASSERT_EQ(names.front(), "f000");
+    ASSERT_EQ(names.back(), "f099");
+}
+
+TEST(Namespace, normalize_path) {
+    std::string normalized;
+    ASSERT_TRUE(PathCache::normalize("/", &normalized));
+    ASSERT_EQ(normalized, "");
+    ASSERT_TRUE(PathCache::normalize("//a//b/", &normalized));
+    ASSERT_EQ(normalized, "/a/b");
+    ASSERT_TRUE(PathCache::normalize("/a/b", &normalized));
+    ASSERT_EQ(normalized, "/a/b");
+    ASSERT_FALSE(PathCache::normalize("a/b", &normalized));
+    ASSERT_FALSE(PathCache::normalize("", &normalized));
+}
+
+// 解析过的路径在提交后进入路径缓存, 删除目录时它下面的路径马上失效
+TEST(Namespace, path_cache) {
+    Namespace ns;
+    UUID a = UUID::generate();
+    UUID b = UUID::generate();
+    UUID f = UUID::generate();
+    ASSERT_TRUE(ns.create(ns.root(), "a", FileType::kDirectory, a).ok());
+    ASSERT_TRUE(ns.create(a, "b", FileType::kDirectory, b).ok());
+    ASSERT_TRUE(ns.create(b, "f", FileType::kFile, f).ok());
+    UUID inode;
+    FileType type = FileType::kDirectory;
+    ASSERT_TRUE(ns.lookup("/a/b/f", &inode, &type).ok());
+    ASSERT_EQ(inode, f);
+    ASSERT_EQ(ns._path_cache.pending(), 3);
+    ASSERT_FALSE(ns._path_cache.get("/a/b/f", &inode, &type));
+    ASSERT_TRUE(ns.commit().ok());
+    ASSERT_TRUE(ns._path_cache.get("/a/b/f", &inode, &type));
+    ASSERT_EQ(inode, f);
+    ASSERT_EQ(type, FileType::kFile);
+    ASSERT_TRUE(ns._path_cache.get("/a", &inode, &type));
+    ASSERT_EQ(inode, a);
+    ASSERT_EQ(type, FileType::kDirectory);
+    ASSERT_TRUE(ns.lookup("//a/b//f/", &inode, &type).ok());
+    ASSERT_EQ(inode, f);
+
+    // 删除 /a/b 之后 /a/b 和 /a/b/f 都失效, /a 还在
+    ASSERT_TRUE(ns.remove(a, "b").ok());
+    ASSERT_FALSE(ns._path_cache.get("/a/b", &inode, &type));
+    ASSERT_FALSE(ns._path_cache.get("/a/b/f", &inode, &type));
+    ASSERT_TRUE(ns._path_cache.get("/a", &inode, &type));
+    ASSERT_FALSE(ns.lookup("/a/b/f", &inode, &type).ok());
+    // 重新创建的同名目录解析到新的 inode
+    UUID b2 = UUID::generate();
+    ASSERT_TRUE(ns.create(a, "b", FileType::kDirectory, b2).ok());
+    ASSERT_TRUE(ns.lookup("/a/b", &inode, &type).ok());
+    ASSERT_EQ(inode, b2);
+    ASSERT_FALSE(ns.lookup("/a/b/f", &inode, &type).ok());
+
+    // 删除根目录下的条目
+    ASSERT_TRUE(ns.commit().ok());
+    ASSERT_TRUE(ns._path_cache.get("/a/b", &inode, &type));
+    ASSERT_TRUE(ns.remove(ns.root(), "a").ok());
+    ASSERT_FALSE(ns._path_cache.get("/a", &inode, &type));
+    ASSERT_FALSE(ns._path_cache.get("/a/b", &inode, &type));
+}
+
+// 缓存满了就整体清空, 缓存的路径总是带着它的父目录
+TEST(Namespace, path_cache_full) {
+    Namespace ns;
+    ns._path_cache._capacity = 4;
+    UUID a = UUID::generate();
+    ASSERT_TRUE(ns.create(ns.root(), "a", FileType::kDirectory, a).ok());
+    for (int i = 0; i < 10; i++) {
+        ASSERT_TRUE(ns.create(a, fmt::format("f{}", i), FileType::kFile, UUID::generate()).ok());
+    }
+    UUID inode;
+    FileType type = FileType::kDirectory;
+    for (int i = 0; i < 10; i++) {
+        ASSERT_TRUE(ns.lookup(fmt::format("/a/f{}", i).c_str(), &inode, &type).ok());
+        ASSERT_TRUE(ns.commit().ok());
+        ASSERT_TRUE(ns._path_cache.get("/a", &inode, &type));
+        ASSERT_TRUE(ns._path_cache.get(fmt::format("/a/f{}", i), &inode, &type));
+    }
+    ASSERT_TRUE(ns.remove(ns.root(), "a").ok());
+    ASSERT_FALSE(ns._path_cache.get("/a/f9", &inode, &type));
+}
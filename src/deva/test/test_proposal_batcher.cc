@@ -0,0 +1,155 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "deva/container_op.h"
+#include "deva/op.h"
+#include "deva/proposal_batcher.h"
+
+using namespace pain;
+using namespace pain::deva;
+
+namespace {
+
+struct Applied {
+    std::vector<std::string> ops;
+    std::vector<int64_t> indexes;
+    std::vector<int> errors;
+};
+
+// 只记录 apply 结果的 op, 内容是一个字符串
+class FakeOp : public Op {
+public:
+    FakeOp(std::string data, Applied* applied) : _data(std::move(data)), _applied(applied) {}
+
+    OpType type() const override {
+        return OpType::kCreateFile;
+    }
+    void apply() override {}
+    void on_apply(int64_t index) override {
+        _applied->ops.push_back(_data);
+        _applied->indexes.push_back(index);
+    }
+    void on_finish(Status status) override {
+        _applied->ops.push_back(_data);
+        _applied->errors.push_back(status.error_code());
+    }
+    void encode(IOBuf* buf) override {
+        buf->append(_data);
+    }
+    void decode(IOBuf* buf) override {
+        _data = buf->to_string();
+    }
+
+private:
+    std::string _data;
+    Applied* _applied;
+};
+
+struct Entry {
+    IOBuf data;
+    braft::Closure* done;
+};
+
+class TestProposalBatcher : public ::testing::Test {
+protected:
+    void open(uint32_t max_delay_us, uint32_t max_ops, uint64_t max_bytes) {
+        _batcher = std::make_unique<ProposalBatcher>(
+            [this](const braft::Task& task) {
+                std::unique_lock lock(_mutex);
+                _entries.push_back(Entry{*task.data, task.done});
+            },
+            max_delay_us,
+            max_ops,
+            max_bytes);
+    }
+
+    void propose(const std::string& data) {
+        _batcher->propose(OpPtr(new FakeOp(data, &_applied)), nullptr);
+    }
+
+    std::vector<std::string> decode_entry(size_t i) {
+        auto data = _entries[i].data;
+        auto ops = decode_batch(&data, [this](OpType type, IOBuf* buf) -> OpPtr {
+            EXPECT_EQ(type, OpType::kCreateFile);
+            OpPtr op(new FakeOp("", &_decoded));
+            op->decode(buf);
+            return op;
+        });
+        std::vector<std::string> result;
+        for (auto& op : ops) {
+            op->on_apply(0);
+        }
+        result.swap(_decoded.ops);
+        return result;
+    }
+
+    bthread::Mutex _mutex;
+    std::vector<Entry> _entries;
+    Applied _applied;
+    Applied _decoded;
+    std::unique_ptr<ProposalBatcher> _batcher;
+};
+
+// 同一个窗口内的 op 合并成一条日志, 按提交顺序 apply
+TEST_F(TestProposalBatcher, BatchByOps) {
+    open(1000 * 1000, 4, 1024 * 1024);
+    for (int i = 0; i < 8; i++) {
+        propose("op" + std::to_string(i));
+    }
+    _batcher.reset();
+
+    ASSERT_EQ(_entries.size(), 2);
+    ASSERT_EQ(decode_entry(0), (std::vector<std::string>{"op0", "op1", "op2", "op3"}));
+    ASSERT_EQ(decode_entry(1), (std::vector<std::string>{"op4", "op5", "op6", "op7"}));
+
+    auto* done = static_cast<OpClosure*>(_entries[0].done);
+    done->set_index(7);
+    done->Run();
+    ASSERT_EQ(_applied.ops, (std::vector<std::string>{"op0", "op1", "op2", "op3"}));
+    ASSERT_EQ(_applied.indexes, (std::vector<int64_t>{7, 7, 7, 7}));
+
+    // 日志失败时每个 op 都收到错误
+    _entries[1].done->status().set_error(EPERM, "not leader");
+    _entries[1].done->Run();
+    ASSERT_EQ(_applied.errors, (std::vector<int>{EPERM, EPERM, EPERM, EPERM}));
+}
+
+TEST_F(TestProposalBatcher, BatchByBytes) {
+    open(1000 * 1000, 100, 200);
+    for (int i = 0; i < 3; i++) {
+        propose(std::string(100, static_cast<char>('a' + i)));
+    }
+    _batcher.reset();
+
+    // 每个 op 加上 OpMeta 超过 100 字节, 所以每条日志只有一个 op
+    ASSERT_EQ(_entries.size(), 3);
+    for (size_t i = 0; i < _entries.size(); i++) {
+        ASSERT_EQ(decode_entry(i), (std::vector<std::string>{std::string(100, static_cast<char>('a' + i))}));
+        OpMeta meta = {};
+        _entries[i].data.copy_to(&meta, sizeof(meta));
+        ASSERT_EQ(meta.type, OpType::kCreateFile);
+        _entries[i].done->Run();
+    }
+}
+
+// 单个 op 的日志格式不变
+TEST_F(TestProposalBatcher, SingleOp) {
+    open(0, 100, 1024 * 1024);
+    propose("hello");
+    _batcher.reset();
+
+    ASSERT_EQ(_entries.size(), 1);
+    auto data = _entries[0].data;
+    auto op = decode(&data, [this](OpType type, IOBuf* buf) -> OpPtr {
+        EXPECT_EQ(type, OpType::kCreateFile);
+        OpPtr op(new FakeOp("", &_decoded));
+        op->decode(buf);
+        return op;
+    });
+    op->on_apply(1);
+    ASSERT_EQ(_decoded.ops, (std::vector<std::string>{"hello"}));
+    _entries[0].done->Run();
+}
+
+} // namespace
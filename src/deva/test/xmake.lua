@@ -6,7 +6,53 @@ target("test_deva_namespace")
     set_kind("binary")
     add_files("test_namespace.cc")
     add_files("../namespace.cc")
+    add_files("../path_cache.cc")
+    add_files("../snapshot_file.cc")
     add_tests("deva")
     add_deps("pain_base")
+    add_deps("pain_common")
     add_deps("pain_proto")
     add_packages("uuid_v4")
+
+target("test_deva_file_info_table")
+    set_kind("binary")
+    add_files("test_file_info_table.cc")
+    add_files("../file_info_table.cc")
+    add_tests("deva")
+    add_deps("pain_base")
+    add_deps("pain_proto")
+    add_packages("uuid_v4")
+
+target("test_deva_proposal_batcher")
+    set_kind("binary")
+    add_files("test_proposal_batcher.cc")
+    add_files("../proposal_batcher.cc")
+    add_files("../op.cc")
+    add_tests("deva")
+    add_deps("pain_base")
+    add_deps("pain_proto")
+    add_packages("braft")
+
+target("test_deva_chunk_allocator")
+    set_kind("binary")
+    add_files("test_chunk_allocator.cc")
+    add_files("../chunk_allocator.cc")
+    add_tests("deva")
+    add_deps("pain_base")
+    add_deps("pain_proto")
+    add_packages("uuid_v4")
+
+target("test_deva_chunk")
+    set_kind("binary")
+    add_files("test_deva_chunk.cc")
+    add_files("../deva.cc")
+    add_files("../namespace.cc")
+    add_files("../path_cache.cc")
+    add_files("../snapshot_file.cc")
+    add_files("../file_info_table.cc")
+    add_tests("deva")
+    add_deps("pain_base")
+    add_deps("pain_common")
+    add_deps("pain_proto")
+    add_packages("uuid_v4")
+    add_packages("rocksdb")
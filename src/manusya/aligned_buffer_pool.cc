@@ -0,0 +1,70 @@
+#include "manusya/aligned_buffer_pool.h"
+
+#include <gflags/gflags.h>
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <boost/assert.hpp>
+
+DEFINE_uint64(manusya_direct_io_buffer_size,
+              64 * 1024,
+              "The size of the aligned buffers of direct io, a multiple of 4096");
+DEFINE_uint64(manusya_direct_io_free_buffers, 1024, "The max number of idle aligned buffers kept for direct io");
+
+namespace pain::manusya {
+
+AlignedBufferPool& AlignedBufferPool::instance() {
+    static AlignedBufferPool pool(align_up(std::max<uint64_t>(FLAGS_manusya_direct_io_buffer_size, 1)),
+                                  FLAGS_manusya_direct_io_free_buffers);
+    return pool;
+}
+
+AlignedBufferPool::AlignedBufferPool(size_t buffer_size, size_t max_free_buffers) :
+    _buffer_size(buffer_size),
+    _max_free_buffers(max_free_buffers) {
+    BOOST_ASSERT_MSG(buffer_size != 0 && buffer_size % kDirectIOAlignment == 0, "buffer size is not aligned");
+}
+
+AlignedBufferPool::~AlignedBufferPool() {
+    for (auto* buffer : _free) {
+        free(buffer);
+    }
+}
+
+void* AlignedBufferPool::acquire() {
+    {
+        std::unique_lock lock(_mutex);
+        if (!_free.empty()) {
+            auto* buffer = _free.back();
+            _free.pop_back();
+            return buffer;
+        }
+    }
+    void* buffer = nullptr;
+    if (posix_memalign(&buffer, kDirectIOAlignment, _buffer_size) != 0) {
+        return nullptr;
+    }
+    return buffer;
+}
+
+void AlignedBufferPool::release(void* buffer) {
+    if (buffer == nullptr) {
+        return;
+    }
+    {
+        std::unique_lock lock(_mutex);
+        if (_free.size() < _max_free_buffers) {
+            _free.push_back(buffer);
+            return;
+        }
+    }
+    free(buffer);
+}
+
+void AlignedBufferPool::append_to(void* buffer, size_t size, IOBuf* buf) {
+    buf->append_user_data(buffer, size, [](void* buffer) {
+        instance().release(buffer);
+    });
+}
+
+} // namespace pain::manusya
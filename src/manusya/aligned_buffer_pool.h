@@ -0,0 +1,58 @@
+#pragma once
+
+#include <bthread/mutex.h>
+#include <pain/base/types.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace pain::manusya {
+
+// the alignment of the memory, the file offset and the length of O_DIRECT io
+constexpr uint64_t kDirectIOAlignment = 4096;
+
+constexpr uint64_t align_down(uint64_t n) {
+    return n & ~(kDirectIOAlignment - 1);
+}
+
+constexpr uint64_t align_up(uint64_t n) {
+    return align_down(n + kDirectIOAlignment - 1);
+}
+
+// AlignedBufferPool recycles the fixed size, kDirectIOAlignment aligned buffers of O_DIRECT io.
+// The buffers of a direct read are handed over to the IOBuf of the caller without copying,
+// they go back to the pool when the last reference of the IOBuf is dropped.
+class AlignedBufferPool {
+public:
+    static AlignedBufferPool& instance();
+
+    AlignedBufferPool(size_t buffer_size, size_t max_free_buffers);
+    ~AlignedBufferPool();
+
+    AlignedBufferPool(const AlignedBufferPool&) = delete;
+    AlignedBufferPool& operator=(const AlignedBufferPool&) = delete;
+
+    size_t buffer_size() const {
+        return _buffer_size;
+    }
+
+    // nullptr if out of memory
+    void* acquire();
+    void release(void* buffer);
+
+    // append the first size bytes of a buffer of the instance to buf, the buffer is owned by buf from now on
+    static void append_to(void* buffer, size_t size, IOBuf* buf);
+
+    size_t free_buffers() const {
+        std::unique_lock lock(_mutex);
+        return _free.size();
+    }
+
+private:
+    size_t _buffer_size;
+    size_t _max_free_buffers;
+    mutable bthread::Mutex _mutex;
+    std::vector<void*> _free;
+};
+
+} // namespace pain::manusya
@@ -1,74 +1,394 @@
 #include "manusya/bank.h"
+#include <bthread/bthread.h>
+#include <butil/fast_rand.h>
+#include <butil/time.h>
+#include <gflags/gflags.h>
 #include <pain/base/plog.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <boost/assert.hpp>
 
-DEFINE_string(manusya_store, "memory://", "The path to store the data of manusya");
+DEFINE_string(manusya_store,
+              "memory://",
+              "The comma separated uris of the stores of manusya, one per disk, e.g. local:///data0,local:///data1");
+DEFINE_uint32(manusya_bank_shards, 64, "The number of shards of the chunk table in bank");
+DEFINE_bool(manusya_group_commit, false, "Ack append only after the data is synced, syncs are batched");
+DEFINE_uint32(manusya_group_commit_max_delay_us, 200, "The max time a sync waits for others to join its batch");
+DEFINE_uint32(manusya_group_commit_max_batch, 128, "The max number of syncs in a batch");
+DEFINE_uint32(manusya_load_concurrency, 16, "The number of bthreads opening chunks when manusya starts");
+DEFINE_bool(manusya_lazy_load, false, "Only register chunks by uuid when manusya starts, open them on first access");
+DEFINE_uint64(manusya_disk_reserved_bytes, 1UL << 30, "No new chunk is placed on a disk with less free bytes");
+DEFINE_uint32(manusya_disk_space_refresh_ms, 1000, "The interval the free space of a disk is refreshed at");
+DECLARE_uint32(manusya_timer_wheel_tick_us);
+DECLARE_uint32(manusya_timer_wheel_slots);
 
 namespace pain::manusya {
 
+Bank::Bank(StorePtr store, const std::string& prefix) : Bank(std::vector<StorePtr>{store}, prefix) {}
+
+Bank::Bank(std::vector<StorePtr> stores, const std::string& prefix) :
+    _timer_wheel(std::make_shared<TimerWheel>(FLAGS_manusya_timer_wheel_tick_us, FLAGS_manusya_timer_wheel_slots)),
+    _shards(std::max(FLAGS_manusya_bank_shards, 1U)),
+    _load_time_ms(prefix + "_load_time_ms", 0),
+    _load_chunks(prefix + "_load_chunks"),
+    _load_failed_chunks(prefix + "_load_failed_chunks"),
+    _open_latency(prefix + "_open_chunk") {
+    BOOST_ASSERT_MSG(!stores.empty(), "bank has no store");
+    for (auto& store : stores) {
+        BOOST_ASSERT_MSG(store != nullptr, "bank has a null store");
+        auto disk = std::make_unique<Disk>();
+        disk->index = static_cast<int>(_disks.size());
+        disk->store = std::move(store);
+        if (FLAGS_manusya_group_commit) {
+            auto committer_prefix = std::format("{}_disk{}_group_commit", prefix, disk->index);
+            disk->committer = std::make_unique<GroupCommitter>(
+                FLAGS_manusya_group_commit_max_delay_us, FLAGS_manusya_group_commit_max_batch, committer_prefix);
+        }
+        _disks.push_back(std::move(disk));
+    }
+}
+
 Bank& Bank::instance() {
-    static Bank s_bank(Store::create(FLAGS_manusya_store.c_str()));
+    static Bank s_bank([]() {
+        std::vector<StorePtr> stores;
+        std::stringstream uris(FLAGS_manusya_store);
+        std::string uri;
+        while (std::getline(uris, uri, ',')) {
+            if (uri.empty()) {
+                continue;
+            }
+            auto store = Store::create(uri.c_str());
+            // an unknown uri or a store failed to start, manusya can't serve without one of its disks
+            if (store == nullptr) {
+                PLOG_ERROR(("desc", "failed to create store")("uri", uri));
+                std::exit(1);
+            }
+            stores.push_back(std::move(store));
+        }
+        return stores;
+    }());
     return s_bank;
 }
 
+void Bank::add_chunk(ChunkPtr chunk, Disk* disk) {
+    auto uuid = chunk->uuid();
+    {
+        auto& s = shard(uuid);
+        std::unique_lock lock(s.mutex);
+        s.chunks[uuid] = Entry{chunk, disk};
+    }
+    std::unique_lock lock(_chunk_ids_mutex);
+    _chunk_ids.insert(uuid);
+}
+
 Status Bank::load() {
-    std::unique_lock lock(_mutex);
-    _store->for_each([this](const char* path) mutable {
-        PLOG_TRACE(("desc", "load chunk")("path", path));
-        auto uuid = UUID::from_str_or_die(path);
-        ChunkPtr chunk;
-        auto status = Chunk::create({}, _store, uuid, &chunk);
-        if (!status.ok()) {
-            PLOG_ERROR(("desc", "failed to create chunk")("error", status.error_str()));
-            return;
+    auto start = butil::gettimeofday_us();
+    std::vector<std::pair<UUID, Disk*>> chunks;
+    for (auto& disk : _disks) {
+        disk->store->for_each([&chunks, &disk](const char* path) {
+            auto uuid = UUID::from_str(path);
+            if (!uuid.has_value()) {
+                PLOG_WARN(("desc", "skip unknown file")("path", path)("disk", disk->index));
+                return;
+            }
+            chunks.emplace_back(*uuid, disk.get());
+        });
+    }
+
+    // a uuid is unique, a chunk found on two disks is a leftover of a failed remove or a copied disk,
+    // the one found first wins
+    std::unordered_set<UUID> seen;
+    std::erase_if(chunks, [&seen](const auto& chunk) {
+        if (seen.insert(chunk.first).second) {
+            return false;
         }
-        uint64_t size = 0;
-        // chunk should be sealed when loaded
-        chunk->query_and_seal(&size);
-        _chunks[uuid] = chunk;
+        PLOG_WARN(("desc", "skip duplicated chunk")("uuid", chunk.first.str())("disk", chunk.second->index));
+        return true;
     });
+
+    if (FLAGS_manusya_lazy_load) {
+        for (const auto& [uuid, disk] : chunks) {
+            auto& s = shard(uuid);
+            std::unique_lock lock(s.mutex);
+            s.chunks.emplace(uuid, Entry{nullptr, disk});
+        }
+    } else {
+        load_chunks(chunks);
+    }
+    {
+        std::unique_lock lock(_chunk_ids_mutex);
+        for (const auto& [uuid, _] : chunks) {
+            auto& s = shard(uuid);
+            std::unique_lock shard_lock(s.mutex);
+            if (s.chunks.contains(uuid)) {
+                _chunk_ids.insert(uuid);
+            }
+        }
+    }
+
+    auto elapsed_ms = (butil::gettimeofday_us() - start) / 1000;
+    _load_time_ms.set_value(elapsed_ms);
+    PLOG_INFO(("desc", "bank loaded")                        //
+              ("disks", _disks.size())                       //
+              ("chunks", chunks.size())                      //
+              ("failed", _load_failed_chunks.get_value())   //
+              ("lazy", FLAGS_manusya_lazy_load)              //
+              ("elapsed_ms", elapsed_ms));
     return Status::OK();
 }
 
+// open the chunks by a pool of bthreads, each of them takes the next chunk until all are opened
+void Bank::load_chunks(const std::vector<std::pair<UUID, Disk*>>& chunks) {
+    struct LoadContext {
+        Bank* bank;
+        const std::vector<std::pair<UUID, Disk*>>* chunks;
+        std::atomic<size_t> next = 0;
+    };
+    LoadContext ctx{this, &chunks};
+    auto worker = [](void* arg) -> void* {
+        auto* ctx = static_cast<LoadContext*>(arg);
+        auto* bank = ctx->bank;
+        for (size_t i = ctx->next.fetch_add(1); i < ctx->chunks->size(); i = ctx->next.fetch_add(1)) {
+            const auto& [uuid, disk] = (*ctx->chunks)[i];
+            ChunkPtr chunk;
+            auto status = bank->open_chunk(disk, uuid, &chunk);
+            if (!status.ok()) {
+                PLOG_ERROR(("desc", "failed to load chunk")("uuid", uuid.str())("error", status.error_str()));
+                bank->_load_failed_chunks << 1;
+                continue;
+            }
+            auto& s = bank->shard(uuid);
+            std::unique_lock lock(s.mutex);
+            s.chunks[uuid] = Entry{chunk, disk};
+        }
+        return nullptr;
+    };
+
+    size_t concurrency = std::clamp<size_t>(FLAGS_manusya_load_concurrency, 1, std::max<size_t>(chunks.size(), 1));
+    std::vector<bthread_t> tids;
+    for (size_t i = 1; i < concurrency; i++) {
+        bthread_t tid = 0;
+        if (bthread_start_background(&tid, nullptr, worker, &ctx) != 0) {
+            PLOG_WARN(("desc", "failed to start load bthread"));
+            break;
+        }
+        tids.push_back(tid);
+    }
+    // the caller is a worker too
+    worker(&ctx);
+    for (auto tid : tids) {
+        bthread_join(tid, nullptr);
+    }
+}
+
+// the chunk can't be appended after a restart, the client has moved to a new one,
+// so an unsealed chunk is sealed when it is opened
+Status Bank::open_chunk(Disk* disk, const UUID& uuid, ChunkPtr* chunk) {
+    auto start = butil::gettimeofday_us();
+    ChunkOptions options;
+    options.timer_wheel = _timer_wheel;
+    auto status = Chunk::open(options, disk->store, uuid, chunk);
+    if (!status.ok()) {
+        return status;
+    }
+    if ((*chunk)->state() != ChunkState::kSealed) {
+        uint64_t size = 0;
+        status = (*chunk)->query_and_seal(&size);
+        if (!status.ok()) {
+            // an unsealed chunk must not be served, it would take appends
+            PLOG_ERROR(("desc", "failed to seal chunk")("uuid", uuid.str())("error", status.error_str()));
+            chunk->reset();
+            return status;
+        }
+    }
+    _open_latency << butil::gettimeofday_us() - start;
+    _load_chunks << 1;
+    return Status::OK();
+}
+
+// open a chunk registered by a lazy load
+Status Bank::open_lazy_chunk(Shard* s, const UUID& uuid, ChunkPtr* chunk) {
+    std::unique_lock open_lock(s->open_mutex);
+    Disk* disk = nullptr;
+    {
+        // opened by another caller while this one was waiting
+        std::unique_lock lock(s->mutex);
+        auto it = s->chunks.find(uuid);
+        if (it == s->chunks.end()) {
+            return Status(ENOENT, "Chunk not found");
+        }
+        if (it->second.chunk != nullptr) {
+            *chunk = it->second.chunk;
+            return Status::OK();
+        }
+        disk = it->second.disk;
+    }
+    ChunkPtr opened;
+    auto status = open_chunk(disk, uuid, &opened);
+    if (!status.ok()) {
+        PLOG_ERROR(("desc", "failed to open chunk")("uuid", uuid.str())("error", status.error_str()));
+        return status;
+    }
+    std::unique_lock lock(s->mutex);
+    auto it = s->chunks.find(uuid);
+    if (it == s->chunks.end()) {
+        return Status(ENOENT, "Chunk not found");
+    }
+    it->second.chunk = opened;
+    *chunk = opened;
+    return Status::OK();
+}
+
+uint64_t Bank::available(Disk* disk) {
+    auto now = butil::gettimeofday_us();
+    if (now - disk->space_time_us.load(std::memory_order_relaxed) < FLAGS_manusya_disk_space_refresh_ms * 1000L) {
+        return disk->available.load(std::memory_order_relaxed);
+    }
+    // a racing refresh is harmless, both of them store the same value
+    disk->space_time_us.store(now, std::memory_order_relaxed);
+    uint64_t capacity = 0;
+    uint64_t available = 0;
+    auto status = disk->store->space(&capacity, &available).get();
+    if (!status.ok()) {
+        PLOG_ERROR(("desc", "failed to get free space")("disk", disk->index)("error", status.error_str()));
+        available = 0;
+    }
+    disk->available.store(available, std::memory_order_relaxed);
+    return available;
+}
+
+// two disks are sampled with a probability proportional to their free space, the one with the shorter
+// queue wins, so the disks fill up evenly while a busy disk gets fewer new chunks
+Bank::Disk* Bank::pick_disk() {
+    if (_disks.size() == 1) {
+        return _disks[0].get();
+    }
+    std::vector<double> weights;
+    weights.reserve(_disks.size());
+    double total = 0;
+    for (auto& disk : _disks) {
+        auto free_bytes = available(disk.get());
+        double weight = free_bytes > FLAGS_manusya_disk_reserved_bytes
+                            ? static_cast<double>(free_bytes - FLAGS_manusya_disk_reserved_bytes)
+                            : 0;
+        weights.push_back(weight);
+        total += weight;
+    }
+    if (total <= 0) {
+        return nullptr;
+    }
+    auto sample = [&]() {
+        double r = butil::fast_rand_double() * total;
+        for (size_t i = 0; i < weights.size(); i++) {
+            if (weights[i] > 0 && r < weights[i]) {
+                return _disks[i].get();
+            }
+            r -= weights[i];
+        }
+        // rounding, the last disk with free space
+        for (size_t i = weights.size(); i > 0; i--) {
+            if (weights[i - 1] > 0) {
+                return _disks[i - 1].get();
+            }
+        }
+        return _disks[0].get();
+    };
+    auto* a = sample();
+    auto* b = sample();
+    auto depth_a = a->store->queue_depth();
+    auto depth_b = b->store->queue_depth();
+    if (depth_a != depth_b) {
+        return depth_a < depth_b ? a : b;
+    }
+    return weights[a->index] >= weights[b->index] ? a : b;
+}
+
 Status Bank::create_chunk(ChunkOptions options, ChunkPtr* chunk) {
     if (chunk == nullptr) {
         return Status(EINVAL, "chunk is nullptr");
     }
-    std::unique_lock lock(_mutex);
-    auto status = Chunk::create(options, _store, chunk);
+    auto* disk = pick_disk();
+    if (disk == nullptr) {
+        return Status(ENOSPC, "no disk has free space");
+    }
+    options.timer_wheel = _timer_wheel;
+    auto status = Chunk::create(options, disk->store, chunk);
     if (!status.ok()) {
         return status;
     }
-    _chunks[(*chunk)->uuid()] = *chunk;
+    add_chunk(*chunk, disk);
     return Status::OK();
 }
 
 Status Bank::get_chunk(UUID uuid, ChunkPtr* chunk) {
-    std::unique_lock lock(_mutex);
-    auto it = _chunks.find(uuid);
-    if (it == _chunks.end()) {
-        return Status(ENOENT, "Chunk not found");
+    auto& s = shard(uuid);
+    {
+        std::unique_lock lock(s.mutex);
+        auto it = s.chunks.find(uuid);
+        if (it == s.chunks.end()) {
+            return Status(ENOENT, "Chunk not found");
+        }
+        if (it->second.chunk != nullptr) {
+            *chunk = it->second.chunk;
+            return Status::OK();
+        }
     }
-    *chunk = it->second;
-    return Status::OK();
+    return open_lazy_chunk(&s, uuid, chunk);
+}
+
+int Bank::disk_of(const UUID& uuid) {
+    auto& s = shard(uuid);
+    std::unique_lock lock(s.mutex);
+    auto it = s.chunks.find(uuid);
+    if (it == s.chunks.end()) {
+        return -1;
+    }
+    return it->second.disk->index;
 }
 
 Status Bank::remove_chunk(UUID uuid) {
-    std::unique_lock lock(_mutex);
-    auto it = _chunks.find(uuid);
-    if (it == _chunks.end()) {
-        return Status(ENOENT, "Chunk not found");
+    Disk* disk = nullptr;
+    {
+        auto& s = shard(uuid);
+        std::unique_lock lock(s.mutex);
+        auto it = s.chunks.find(uuid);
+        if (it == s.chunks.end()) {
+            return Status(ENOENT, "Chunk not found");
+        }
+        disk = it->second.disk;
+        s.chunks.erase(it);
+    }
+    {
+        std::unique_lock lock(_chunk_ids_mutex);
+        _chunk_ids.erase(uuid);
     }
-    _chunks.erase(it);
-    _store->remove(uuid.str().c_str()).get();
+    disk->store->remove(uuid.str().c_str()).get();
     return Status::OK();
 }
 
+Future<Status> Bank::sync_chunk(ChunkPtr chunk) {
+    // the chunk holds its store, which is enough to find its disk without a lookup
+    for (auto& disk : _disks) {
+        if (disk->store == chunk->store() && disk->committer != nullptr) {
+            return disk->committer->sync(chunk);
+        }
+    }
+    return make_ready_future(Status::OK());
+}
+
 void Bank::list_chunk(UUID start, uint32_t limit, std::function<void(UUID uuid)> cb) {
-    std::unique_lock lock(_mutex);
-    auto it = _chunks.lower_bound(start);
-    for (uint32_t i = 0; i < limit && it != _chunks.end(); i++, it++) {
+    std::unique_lock lock(_chunk_ids_mutex);
+    auto it = _chunk_ids.lower_bound(start);
+    for (uint32_t i = 0; i < limit && it != _chunk_ids.end(); i++, it++) {
         try {
-            cb(it->first);
+            cb(*it);
         } catch (const std::exception& e) {
             PLOG_ERROR(("desc", "failed to list chunk")("error", e.what()));
         }
@@ -1,17 +1,35 @@
 #pragma once
 
+#include <bthread/mutex.h>
+#include <bvar/bvar.h>
+#include <atomic>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include "manusya/chunk.h"
+#include "manusya/group_commit.h"
+#include "manusya/timer_wheel.h"
 #include "manusya/store.h"
 
 namespace pain::manusya {
 
+// Bank manages the chunks of a manusya on a set of disks, one store per disk.
+// A new chunk is placed on a disk by free space and queue depth, every chunk is routed to its disk
+// afterwards. Each disk has its own group committer, the syncs of one disk never wait for another.
 class Bank {
 public:
-    Bank(StorePtr store) : _store(store){};
+    // the bvars of the bank are exposed with the prefix
+    Bank(StorePtr store, const std::string& prefix = "manusya_bank");
+    Bank(std::vector<StorePtr> stores, const std::string& prefix = "manusya_bank");
     ~Bank() = default;
 
+    // the stores are created from the comma separated uris of manusya_store
     static Bank& instance();
 
+    // register the chunks in the stores, they are opened by manusya_load_concurrency bthreads,
+    // or on first access if manusya_lazy_load is set
     Status load();
 
     Status create_chunk(ChunkOptions options, ChunkPtr* chunk);
@@ -22,10 +40,64 @@ public:
 
     void list_chunk(UUID start, uint32_t limit, std::function<void(UUID uuid)> cb);
 
+    // complete after the data appended to the chunk is durable,
+    // completed immediately if group commit is disabled
+    Future<Status> sync_chunk(ChunkPtr chunk);
+
+    size_t disk_count() const {
+        return _disks.size();
+    }
+
+    // the index of the disk the chunk is on, -1 if the chunk is not found
+    int disk_of(const UUID& uuid);
+
 private:
-    StorePtr _store;
-    std::map<UUID, ChunkPtr> _chunks;
-    mutable bthread::Mutex _mutex;
+    struct Disk {
+        int index = 0;
+        StorePtr store;
+        std::unique_ptr<GroupCommitter> committer;
+        // the free bytes of the store, refreshed every manusya_disk_space_refresh_ms
+        std::atomic<uint64_t> available = 0;
+        std::atomic<int64_t> space_time_us = 0;
+    };
+
+    struct Entry {
+        // nullptr if the chunk is registered by a lazy load and not opened yet
+        ChunkPtr chunk;
+        Disk* disk = nullptr;
+    };
+
+    // chunks are sharded by uuid hash, get_chunk on different shards never contend
+    struct alignas(64) Shard { // NOLINT(readability-magic-numbers)
+        std::unordered_map<UUID, Entry> chunks;
+        mutable bthread::Mutex mutex;
+        // serializes the opens of lazily loaded chunks, so that a chunk is opened once
+        bthread::Mutex open_mutex;
+    };
+
+    Shard& shard(const UUID& uuid) {
+        return _shards[std::hash<UUID>{}(uuid) % _shards.size()];
+    }
+
+    void add_chunk(ChunkPtr chunk, Disk* disk);
+    Status open_chunk(Disk* disk, const UUID& uuid, ChunkPtr* chunk);
+    Status open_lazy_chunk(Shard* s, const UUID& uuid, ChunkPtr* chunk);
+    void load_chunks(const std::vector<std::pair<UUID, Disk*>>& chunks);
+    Disk* pick_disk();
+    uint64_t available(Disk* disk);
+
+    std::vector<std::unique_ptr<Disk>> _disks;
+    // expires out-of-order appends of all chunks in the bank
+    TimerWheelPtr _timer_wheel;
+    std::vector<Shard> _shards;
+    // ordered view of chunk ids, only used by list_chunk paging
+    std::set<UUID> _chunk_ids;
+    mutable bthread::Mutex _chunk_ids_mutex;
+
+    bvar::Status<int64_t> _load_time_ms;
+    bvar::Adder<int64_t> _load_chunks;
+    bvar::Adder<int64_t> _load_failed_chunks;
+    bvar::LatencyRecorder _open_latency;
 };
 
 }; // namespace pain::manusya
@@ -0,0 +1,301 @@
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+#include "manusya/bank.h"
+#include "manusya/chunk.h"
+#include "manusya/file_handle.h"
+#include "manusya/store.h"
+
+// Results are printed as json by default, so that runs of different builds can be compared with
+// tools/compare.py of google benchmark, e.g.
+//   bench_manusya --benchmark_out=base.json
+//   bench_manusya --benchmark_filter=BM_ChunkAppend --benchmark_repetitions=5
+
+// NOLINTBEGIN(readability-magic-numbers)
+namespace {
+using namespace pain;
+using namespace pain::manusya;
+
+constexpr int64_t k4K = 4 * 1024;
+constexpr int64_t k64K = 64 * 1024;
+constexpr int64_t k1M = 1024 * 1024;
+
+class TempDir {
+public:
+    TempDir() {
+        _path = std::filesystem::temp_directory_path() / ("bench_manusya_" + std::to_string(::getpid()));
+        std::filesystem::create_directories(_path);
+    }
+    ~TempDir() {
+        std::filesystem::remove_all(_path);
+    }
+    std::string uri() const {
+        return "local://" + _path.string();
+    }
+    const std::filesystem::path& path() const {
+        return _path;
+    }
+
+private:
+    std::filesystem::path _path;
+};
+
+IOBuf make_payload(int64_t size) {
+    IOBuf buf;
+    buf.resize(size, 'x');
+    return buf;
+}
+
+// the chunks of the append benchmarks are replaced once they reach this size, so the memory store doesn't
+// grow for the whole run
+constexpr uint64_t kMaxChunkSize = 256 * k1M;
+
+// replace the chunk with an empty one, the caller pauses the timing
+bool renew_chunk(const StorePtr& store, ChunkPtr* chunk) {
+    auto uuid = (*chunk)->uuid().str();
+    chunk->reset();
+    store->remove(uuid.c_str()).get();
+    return Chunk::create({}, store, chunk).ok();
+}
+
+void BM_ChunkAppendInOrder(benchmark::State& state) {
+    auto store = Store::create("memory://");
+    ChunkPtr chunk;
+    if (!Chunk::create({}, store, &chunk).ok()) {
+        state.SkipWithError("failed to create chunk");
+        return;
+    }
+    auto payload = make_payload(state.range(0));
+    uint64_t offset = 0;
+    for (auto _ : state) {
+        auto status = chunk->append(payload, offset);
+        if (!status.ok()) {
+            state.SkipWithError(status.error_cstr());
+            break;
+        }
+        offset += payload.size();
+        if (offset >= kMaxChunkSize) {
+            state.PauseTiming();
+            if (!renew_chunk(store, &chunk)) {
+                state.SkipWithError("failed to create chunk");
+                break;
+            }
+            offset = 0;
+            state.ResumeTiming();
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ChunkAppendInOrder)->Arg(k4K)->Arg(k64K);
+
+// every batch arrives in reverse order, all but the last wait in the reorder window
+void BM_ChunkAppendOutOfOrder(benchmark::State& state) {
+    auto store = Store::create("memory://");
+    ChunkPtr chunk;
+    if (!Chunk::create({}, store, &chunk).ok()) {
+        state.SkipWithError("failed to create chunk");
+        return;
+    }
+    auto payload = make_payload(k4K);
+    auto batch = state.range(0);
+    uint64_t offset = 0;
+    std::vector<Future<Status>> futures;
+    for (auto _ : state) {
+        futures.clear();
+        for (int64_t i = batch - 1; i >= 0; i--) {
+            futures.emplace_back(chunk->async_append(payload, offset + i * payload.size()));
+        }
+        for (auto& future : futures) {
+            auto status = future.get();
+            if (!status.ok()) {
+                state.SkipWithError(status.error_cstr());
+                return;
+            }
+        }
+        offset += batch * payload.size();
+        if (offset >= kMaxChunkSize) {
+            state.PauseTiming();
+            if (!renew_chunk(store, &chunk)) {
+                state.SkipWithError("failed to create chunk");
+                return;
+            }
+            offset = 0;
+            state.ResumeTiming();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * batch);
+    state.SetBytesProcessed(state.iterations() * batch * k4K);
+}
+BENCHMARK(BM_ChunkAppendOutOfOrder)->Arg(2)->Arg(16)->Arg(128);
+
+// read the same range again and again, the data is in page cache
+void BM_ChunkReadHot(benchmark::State& state) {
+    TempDir dir;
+    auto store = Store::create(dir.uri().c_str());
+    ChunkPtr chunk;
+    if (!Chunk::create({}, store, &chunk).ok() || !chunk->append(make_payload(k1M), 0).ok()) {
+        state.SkipWithError("failed to prepare chunk");
+        return;
+    }
+    auto size = state.range(0);
+    for (auto _ : state) {
+        IOBuf buf;
+        auto status = chunk->read(0, size, &buf);
+        if (!status.ok()) {
+            state.SkipWithError(status.error_cstr());
+            break;
+        }
+        benchmark::DoNotOptimize(buf);
+    }
+    state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_ChunkReadHot)->Arg(k4K)->Arg(k64K)->Arg(k1M);
+
+// drop the page cache of the chunk before every read, so the read goes to the disk
+void BM_ChunkReadCold(benchmark::State& state) {
+    TempDir dir;
+    auto store = Store::create(dir.uri().c_str());
+    ChunkPtr chunk;
+    if (!Chunk::create({}, store, &chunk).ok() || !chunk->append(make_payload(k1M), 0).ok() ||
+        !chunk->sync().get().ok()) {
+        state.SkipWithError("failed to prepare chunk");
+        return;
+    }
+    int fd = ::open((dir.path() / chunk->uuid().str()).c_str(), O_RDONLY);
+    if (fd < 0) {
+        state.SkipWithError("failed to open chunk file");
+        return;
+    }
+    auto size = state.range(0);
+    for (auto _ : state) {
+        state.PauseTiming();
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        state.ResumeTiming();
+        IOBuf buf;
+        auto status = chunk->read(0, size, &buf);
+        if (!status.ok()) {
+            state.SkipWithError(status.error_cstr());
+            break;
+        }
+        benchmark::DoNotOptimize(buf);
+    }
+    ::close(fd);
+    state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_ChunkReadCold)->Arg(k4K)->Arg(k64K)->Arg(k1M)->UseRealTime();
+
+// lookups from many threads over a bank shared by all of them
+void BM_BankGetChunk(benchmark::State& state) {
+    static Bank* s_bank = nullptr;
+    static std::vector<UUID> s_uuids;
+    if (state.thread_index() == 0) {
+        s_bank = new Bank(Store::create("memory://"));
+        s_uuids.clear();
+        for (int i = 0; i < 1024; i++) {
+            ChunkPtr chunk;
+            if (s_bank->create_chunk({}, &chunk).ok()) {
+                s_uuids.push_back(chunk->uuid());
+            }
+        }
+    }
+    // the setup of thread 0 is visible to every thread once the timing starts
+    std::mt19937 rng(state.thread_index());
+    for (auto _ : state) {
+        ChunkPtr chunk;
+        auto status = s_bank->get_chunk(s_uuids[rng() % s_uuids.size()], &chunk);
+        benchmark::DoNotOptimize(status);
+    }
+    state.SetItemsProcessed(state.iterations());
+    if (state.thread_index() == 0) {
+        delete s_bank;
+        s_bank = nullptr;
+    }
+}
+BENCHMARK(BM_BankGetChunk)->ThreadRange(1, 32)->UseRealTime();
+
+// the store itself, without the chunk on top of it
+void BM_StoreAppend(benchmark::State& state, const char* uri, bool direct_io) {
+    TempDir dir;
+    auto store = Store::create(uri[0] == '\0' ? dir.uri().c_str() : uri);
+    FileHandlePtr fh;
+    if (!store->open("bench", O_CREAT | O_RDWR, &fh).get().ok()) {
+        state.SkipWithError("failed to open file");
+        return;
+    }
+    auto payload = make_payload(state.range(0));
+    uint64_t offset = 0;
+    for (auto _ : state) {
+        auto status = store->append(fh, offset, payload, direct_io).get();
+        if (!status.ok()) {
+            state.SkipWithError(status.error_cstr());
+            break;
+        }
+        offset += payload.size();
+        // keep the file small, a 1M payload would fill the disk otherwise
+        if (offset >= 256 * k1M) {
+            state.PauseTiming();
+            fh.reset();
+            store->remove("bench").get();
+            store->open("bench", O_CREAT | O_RDWR, &fh).get();
+            offset = 0;
+            state.ResumeTiming();
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_CAPTURE(BM_StoreAppend, memory, "memory://", false)->Arg(k4K)->Arg(k64K)->Arg(k1M);
+BENCHMARK_CAPTURE(BM_StoreAppend, local, "", false)->Arg(k4K)->Arg(k64K)->Arg(k1M);
+BENCHMARK_CAPTURE(BM_StoreAppend, local_direct, "", true)->Arg(k4K)->Arg(k64K)->Arg(k1M);
+
+void BM_StoreRead(benchmark::State& state, const char* uri, bool direct_io) {
+    TempDir dir;
+    auto store = Store::create(uri[0] == '\0' ? dir.uri().c_str() : uri);
+    FileHandlePtr fh;
+    if (!store->open("bench", O_CREAT | O_RDWR, &fh).get().ok() || !store->append(fh, 0, make_payload(k1M)).get().ok()) {
+        state.SkipWithError("failed to prepare file");
+        return;
+    }
+    auto size = state.range(0);
+    for (auto _ : state) {
+        IOBuf buf;
+        auto status = store->read(fh, 0, size, &buf, direct_io).get();
+        if (!status.ok()) {
+            state.SkipWithError(status.error_cstr());
+            break;
+        }
+        benchmark::DoNotOptimize(buf);
+    }
+    state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK_CAPTURE(BM_StoreRead, memory, "memory://", false)->Arg(k4K)->Arg(k64K)->Arg(k1M);
+BENCHMARK_CAPTURE(BM_StoreRead, local, "", false)->Arg(k4K)->Arg(k64K)->Arg(k1M);
+// every read goes to the disk, there is no page cache in between
+BENCHMARK_CAPTURE(BM_StoreRead, local_direct, "", true)->Arg(k4K)->Arg(k64K)->Arg(k1M)->UseRealTime();
+
+} // namespace
+// NOLINTEND(readability-magic-numbers)
+
+int main(int argc, char** argv) {
+    // json unless asked otherwise, the console output is not meant to be parsed
+    std::vector<char*> args(argv, argv + argc);
+    std::string format = "--benchmark_format=json";
+    bool has_format = false;
+    for (int i = 1; i < argc; i++) {
+        has_format |= std::string(argv[i]).starts_with("--benchmark_format");
+    }
+    if (!has_format) {
+        args.push_back(format.data());
+    }
+    int n = static_cast<int>(args.size());
+    benchmark::Initialize(&n, args.data());
+    if (benchmark::ReportUnrecognizedArguments(n, args.data())) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <pain/base/future.h>
+#include <pain/base/types.h>
+#include <cstdint>
+#include <memory>
+
+namespace pain::manusya {
+
+// BlockDevice is a raw device addressed by bytes, the offset and the size of every request are
+// multiples of block_size(). The futures may be completed on a thread owned by the device.
+class BlockDevice {
+public:
+    BlockDevice() = default;
+    virtual ~BlockDevice() = default;
+
+    BlockDevice(const BlockDevice&) = delete;
+    BlockDevice& operator=(const BlockDevice&) = delete;
+
+    virtual uint32_t block_size() const = 0;
+    virtual uint64_t capacity() const = 0;
+    virtual Future<Status> write(uint64_t offset, IOBuf buf) = 0;
+    // buf is replaced by the data read
+    virtual Future<Status> read(uint64_t offset, uint64_t size, IOBuf* buf) = 0;
+    // make the completed writes durable
+    virtual Future<Status> flush() = 0;
+    // the number of requests in flight
+    virtual uint64_t queue_depth() const {
+        return 0;
+    }
+};
+
+using BlockDevicePtr = std::unique_ptr<BlockDevice>;
+
+} // namespace pain::manusya
@@ -1,98 +1,276 @@
 #include "manusya/chunk.h"
 #include <fcntl.h>
+#include <butil/time.h>
+#include <gflags/gflags.h>
+#include <pain/base/crc32c.h>
 #include <pain/base/plog.h>
+#include <algorithm>
 #include <cerrno>
 #include <format>
+#include <memory>
 #include <mutex>
+#include <tuple>
+#include <vector>
+#include "manusya/chunk_format.h"
 #include "manusya/file_handle.h"
 #include "manusya/macro.h"
 
+DEFINE_uint32(manusya_append_reorder_timeout_ms, 5000, "The max time an out-of-order append waits for its turn");
+DEFINE_uint64(manusya_append_reorder_window_bytes,
+              64UL * 1024 * 1024,
+              "The max distance from the chunk size an out-of-order append can reach");
+DEFINE_uint32(manusya_append_reorder_window_requests, 1024, "The max number of out-of-order appends of a chunk");
+DEFINE_uint32(manusya_checksum_block_size, 64 * 1024, "The number of bytes covered by one checksum of a chunk");
+DEFINE_bool(manusya_verify_checksum, true, "Verify the data read from the store against the chunk checksums");
+
 namespace pain::manusya {
 
+namespace {
+
+// the tail read when a chunk is loaded, it holds the footer and the index of chunks up to 256M
+constexpr uint64_t kChunkTailReadSize = 64 * 1024;
+
+// extend the checksum of the partial block which data starts at with data,
+// the checksums of the blocks filled up are appended to checksums, return the checksum of the new partial block
+uint32_t extend_checksums(uint64_t offset,
+                          const IOBuf& data,
+                          uint64_t block_size,
+                          uint32_t tail_checksum,
+                          std::vector<uint32_t>* checksums) {
+    IOBuf rest = data; // shares the blocks
+    while (!rest.empty()) {
+        uint64_t n = std::min<uint64_t>(block_size - offset % block_size, rest.size());
+        tail_checksum = crc32c(rest, n, tail_checksum);
+        rest.pop_front(n);
+        offset += n;
+        if (offset % block_size == 0) {
+            checksums->push_back(tail_checksum);
+            tail_checksum = 0;
+        }
+    }
+    return tail_checksum;
+}
+
+// data starts at a block boundary, the first `size` bytes of it are covered by checksums
+Status verify_checksums(const IOBuf& data,
+                        uint64_t offset,
+                        uint64_t size,
+                        uint64_t block_size,
+                        const std::vector<uint32_t>& checksums) {
+    IOBuf rest = data;
+    for (auto expected : checksums) {
+        uint64_t n = std::min(block_size, size);
+        auto actual = crc32c(rest, n);
+        if (actual != expected) {
+            return Status(EIO,
+                          std::format("checksum mismatch at {}@{}, expected:{:08x}, actual:{:08x}",
+                                      offset,
+                                      n,
+                                      expected,
+                                      actual));
+        }
+        rest.pop_front(n);
+        offset += n;
+        size -= n;
+    }
+    return Status::OK();
+}
+
+} // namespace
+
 Status Chunk::append(const IOBuf& buf, uint64_t offset) {
+    return async_append(buf, offset).get();
+}
+
+Future<Status> Chunk::async_append(const IOBuf& buf, uint64_t offset, bool direct_io) {
     SPAN(span);
     std::unique_lock lock(_mutex);
     if (_state == ChunkState::kSealed) {
-        return Status(EPERM, "chunk is sealed");
-    }
-
-    if (offset < _size) {
-        return Status(EINVAL, std::format("invalid offset at {}@{}, current size:{}", offset, buf.size(), _size));
-    }
-
-    if (offset != _size) {
-        AppendRequestPtr rq(new AppendRequest());
-        rq->offset = offset;
-        rq->buf = buf;
-        rq->chunk = this;
-        rq->start = butil::cpuwide_time_ns();
-        rq->span = span;
-        constexpr uint64_t timeout_us = 5 * 1000 * 1000; // 5s
-        auto abstime = butil::microseconds_from_now(timeout_us);
-
-        // add ref to prevent rq from being destroyed before the timer callback is called
-        intrusive_ptr_add_ref(rq.get());
-        bthread_timer_add(
-            &rq->timer,
-            abstime,
-            [](void* arg) {
-                auto rq = static_cast<AppendRequest*>(arg);
-                auto root_scope = Tracer::WithActiveSpan(rq->span);
-                SPAN(span, "timeout");
-                std::unique_lock lock(rq->chunk->_mutex);
-                if (rq->promise.is_ready()) {
-                    PLOG_DEBUG(("desc", "append request is ready"));
-                    return;
-                }
-                rq->unlink();
-                rq->promise.set_value(Status(
-                    EINVAL,
-                    std::format(
-                        "invalid offset at {}@{}, current size:{}", rq->offset, rq->buf.size(), rq->chunk->_size)));
-                intrusive_ptr_release(rq);
-            },
-            rq.get());
-
-        _append_request_queue.insert(*rq);
-        lock.unlock();
-        auto status = rq->promise.get_future().get();
-        rq->end = butil::cpuwide_time_ns();
+        return make_ready_future(Status(EPERM, "chunk is sealed"));
+    }
 
-        return status;
+    // _size is only modified under _mutex, the atomic is for the lockless readers
+    uint64_t size = _size.load(std::memory_order_relaxed);
+    if (offset < _write_end) {
+        return make_ready_future(
+            Status(EINVAL, std::format("invalid offset at {}@{}, current size:{}", offset, buf.size(), size)));
     }
 
-    auto status = _fh->append(offset, buf).get();
+    // an append right at the end is written at once, the others wait in the window for their turn
+    bool in_order = !_writing && offset == _write_end;
+    if (!in_order) {
+        // the window is bounded, an append too far ahead can't be a reordered one
+        uint64_t gap = offset - _write_end;
+        uint64_t window_bytes = FLAGS_manusya_append_reorder_window_bytes;
+        if (gap >= window_bytes || buf.size() > window_bytes - gap) {
+            return make_ready_future(
+                Status(EINVAL, std::format("invalid offset at {}@{}, current size:{}", offset, buf.size(), size)));
+        }
+        if (_append_request_queue.size() >= FLAGS_manusya_append_reorder_window_requests) {
+            return make_ready_future(Status(EAGAIN, "reorder window is full"));
+        }
+    }
 
-    if (!status.ok()) {
-        return status;
+    auto rq = std::make_unique<AppendRequest>();
+    rq->offset = offset;
+    rq->buf = buf;
+    rq->direct_io = direct_io;
+    rq->deadline_us = butil::gettimeofday_us() + FLAGS_manusya_append_reorder_timeout_ms * 1000L;
+    if (!_append_request_queue.insert(*rq).second) {
+        return make_ready_future(Status(EINVAL, std::format("duplicated append at {}@{}", offset, buf.size())));
+    }
+    auto future = rq->promise.get_future();
+    if (!in_order) {
+        schedule_expire(rq->deadline_us);
     }
+    // owned by the window from now on
+    std::ignore = rq.release();
+    start_write(std::move(lock));
+    return future;
+}
 
-    _size += buf.size();
+// must be called with _mutex held
+// take the appends in the window which are contiguous from end off the window, return the end of the run
+uint64_t Chunk::take_append_requests(uint64_t end, IOBuf* run, bool* direct_io, std::vector<AppendRequest*>* batch) {
+    while (!_append_request_queue.empty() && _append_request_queue.begin()->offset == end) {
+        auto& rq = *_append_request_queue.begin();
+        _append_request_queue.erase(_append_request_queue.begin());
+        run->append(rq.buf);
+        *direct_io = *direct_io && rq.direct_io;
+        end += rq.buf.size();
+        batch->push_back(&rq);
+    }
+    return end;
+}
 
-    while (!_append_request_queue.empty()) {
-        auto it = _append_request_queue.begin();
-        auto rq = &*it;
-        if (rq->offset < _size) {
-            rq->unlink();
-            if (!rq->promise.is_ready()) {
-                rq->promise.set_value(
-                    Status(EINVAL,
-                           std::format("invalid offset at {}@{}, current size:{}", rq->offset, rq->buf.size(), _size)));
-            }
-        } else if (rq->offset == _size) {
-            auto status = _fh->append(rq->offset, rq->buf).get();
-            if (status.ok()) {
-                _size += rq->buf.size();
-            }
-            rq->unlink();
-            if (!rq->promise.is_ready()) {
-                rq->promise.set_value(status);
+// must be called with _mutex held, the lock is released when it returns
+// write the contiguous run at the head of the window by one store call if no write is in flight
+void Chunk::start_write(std::unique_lock<bthread::Mutex> lock) {
+    if (_writing || _append_request_queue.empty()) {
+        return;
+    }
+    uint64_t size = _size.load(std::memory_order_relaxed);
+    std::vector<Completion> completions;
+    // the stale requests overlap with the written data
+    while (!_append_request_queue.empty() && _append_request_queue.begin()->offset < size) {
+        auto& rq = *_append_request_queue.begin();
+        _append_request_queue.erase(_append_request_queue.begin());
+        completions.emplace_back(
+            &rq, Status(EINVAL, std::format("invalid offset at {}@{}, current size:{}", rq.offset, rq.buf.size(), size)));
+    }
+
+    IOBuf run;
+    bool direct_io = true;
+    std::vector<AppendRequest*> batch;
+    uint64_t end = take_append_requests(size, &run, &direct_io, &batch);
+    if (!batch.empty()) {
+        _writing = true;
+        _write_end = end;
+    }
+    uint32_t tail_checksum = _tail_checksum;
+    bool write_header = !_header_written;
+    lock.unlock();
+    complete(&completions);
+    if (batch.empty()) {
+        return;
+    }
+
+    // checksummed while no lock is held, the tail checksum is only updated by the write in flight
+    std::vector<uint32_t> checksums;
+    if (_checksum_block_size != 0) {
+        tail_checksum = extend_checksums(size, run, _checksum_block_size, tail_checksum, &checksums);
+    }
+    uint64_t file_offset = _data_offset + size;
+    if (write_header) {
+        // the header goes with the first data, creating a chunk costs no write
+        IOBuf header = encode_chunk_header(_uuid, _checksum_block_size);
+        header.append(run);
+        run.swap(header);
+        file_offset = 0;
+    }
+    ChunkPtr self(this);
+    _fh->append(file_offset, std::move(run), direct_io)
+        .then([self, batch = std::move(batch), end, checksums = std::move(checksums), tail_checksum](
+                  Status status) mutable {
+            self->finish_write(std::move(batch), end, std::move(checksums), tail_checksum, std::move(status));
+        });
+}
+
+void Chunk::finish_write(std::vector<AppendRequest*> batch,
+                         uint64_t end,
+                         std::vector<uint32_t> checksums,
+                         uint32_t tail_checksum,
+                         Status status) {
+    std::unique_lock lock(_mutex);
+    if (status.ok()) {
+        _checksums.insert(_checksums.end(), checksums.begin(), checksums.end());
+        _tail_checksum = tail_checksum;
+        _header_written = true;
+        // publish the new size after the data is written, readers never see unwritten data
+        _size.store(end, std::memory_order_release);
+    } else {
+        _write_end = _size.load(std::memory_order_relaxed);
+    }
+    _writing = false;
+    _write_cond.notify_all();
+    // the next run goes to the store before the waiters of this one are completed
+    start_write(std::move(lock));
+
+    std::vector<Completion> completions;
+    completions.reserve(batch.size());
+    for (auto rq : batch) {
+        completions.emplace_back(rq, status);
+    }
+    complete(&completions);
+}
+
+// complete the requests taken off the window, without _mutex held as the continuations run inline
+void Chunk::complete(std::vector<Completion>* completions) {
+    for (auto& [rq, status] : *completions) {
+        rq->promise.set_value(std::move(status));
+        delete rq;
+    }
+    completions->clear();
+}
+
+// must be called with _mutex held
+void Chunk::schedule_expire(int64_t deadline_us) {
+    // deadlines are almost monotonic, a scheduled earlier expiration reschedules for the rest
+    if (_expire_deadline_us != 0 && _expire_deadline_us <= deadline_us) {
+        return;
+    }
+    _expire_deadline_us = deadline_us;
+    ChunkPtr self(this);
+    _timer_wheel->schedule(deadline_us, [self]() {
+        self->expire_append_requests();
+    });
+}
+
+void Chunk::expire_append_requests() {
+    std::unique_lock lock(_mutex);
+    _expire_deadline_us = 0;
+    auto now = butil::gettimeofday_us();
+    uint64_t size = _size.load(std::memory_order_relaxed);
+    int64_t next_deadline_us = 0;
+    std::vector<Completion> completions;
+    for (auto it = _append_request_queue.begin(); it != _append_request_queue.end();) {
+        auto& rq = *it;
+        if (rq.deadline_us > now) {
+            if (next_deadline_us == 0 || rq.deadline_us < next_deadline_us) {
+                next_deadline_us = rq.deadline_us;
             }
-        } else {
-            break;
+            it++;
+            continue;
         }
+        it = _append_request_queue.erase(it);
+        completions.emplace_back(
+            &rq, Status(EINVAL, std::format("invalid offset at {}@{}, current size:{}", rq.offset, rq.buf.size(), size)));
     }
-    return Status::OK();
+    if (next_deadline_us != 0) {
+        schedule_expire(next_deadline_us);
+    }
+    lock.unlock();
+    complete(&completions);
 }
 
 Status Chunk::query_and_seal(uint64_t* length) {
@@ -100,36 +278,196 @@ Status Chunk::query_and_seal(uint64_t* length) {
     if (length == nullptr) {
         return Status(EINVAL, "length is nullptr");
     }
-    std::lock_guard lock(_mutex);
-    auto status = _fh->seal().get();
+    std::unique_lock lock(_mutex);
+    if (_state == ChunkState::kSealed) {
+        *length = _size.load(std::memory_order_relaxed);
+        return Status::OK();
+    }
+    // the size must cover the write in flight
+    while (_writing) {
+        _write_cond.wait(lock);
+    }
+    uint64_t size = _size.load(std::memory_order_relaxed);
+    // the checksums of the whole chunk, the partial block at the end included
+    auto checksums = _checksums;
+    if (_checksum_block_size != 0 && checksums.size() * _checksum_block_size < size) {
+        checksums.push_back(_tail_checksum);
+    }
+    IOBuf trailer;
+    uint64_t file_offset = _data_offset + size;
+    if (!_header_written) {
+        trailer = encode_chunk_header(_uuid, _checksum_block_size);
+        file_offset = 0;
+    }
+    trailer.append(encode_chunk_trailer(size, _checksum_block_size, checksums));
+    auto status = _fh->append(file_offset, std::move(trailer)).get();
     if (!status.ok()) {
+        PLOG_ERROR(("desc", "failed to write chunk footer")("uuid", _uuid.str())("error", status.error_str()));
         return status;
     }
-    status = _fh->size(length).get();
+    _header_written = true;
+    status = _fh->seal().get();
     if (!status.ok()) {
         return status;
     }
+    *length = size;
     _state = ChunkState::kSealed;
+    _checksums = std::move(checksums);
+    // nothing can be appended any more
+    std::vector<Completion> completions;
+    while (!_append_request_queue.empty()) {
+        auto& rq = *_append_request_queue.begin();
+        _append_request_queue.erase(_append_request_queue.begin());
+        completions.emplace_back(&rq, Status(EPERM, "chunk is sealed"));
+    }
+    lock.unlock();
+    complete(&completions);
     return status;
 }
 
+// must be called before the chunk is shared
+// a sealed chunk is validated and sized by one read of its tail, the other ones by the header
+Status Chunk::load() {
+    uint64_t file_size = 0;
+    auto status = _fh->size(&file_size).get();
+    if (!status.ok()) {
+        return status;
+    }
+    if (file_size == 0) {
+        // nothing is written yet
+        _checksum_block_size = FLAGS_manusya_checksum_block_size;
+        _state = ChunkState::kOpen;
+        return Status::OK();
+    }
+    uint64_t tail_size = std::min(file_size, kChunkTailReadSize);
+    IOBuf tail;
+    status = _fh->read(file_size - tail_size, tail_size, &tail).get();
+    if (!status.ok()) {
+        return status;
+    }
+    ChunkFooter footer;
+    std::vector<uint32_t> checksums;
+    uint64_t trailer_size = 0;
+    status = decode_chunk_trailer(tail, file_size, &footer, &checksums, &trailer_size);
+    if (status.error_code() == EAGAIN) {
+        // a large chunk, the index doesn't fit in the tail read
+        tail.clear();
+        status = _fh->read(file_size - trailer_size, trailer_size, &tail).get();
+        if (status.ok()) {
+            status = decode_chunk_trailer(tail, file_size, &footer, &checksums, &trailer_size);
+        }
+    }
+    if (status.ok()) {
+        _size = footer.data_size;
+        _write_end = footer.data_size;
+        _checksum_block_size = footer.checksum_block_size;
+        _checksums = std::move(checksums);
+        _header_written = true;
+        _data_offset = file_size - trailer_size - footer.data_size;
+        _state = ChunkState::kSealed;
+        return Status::OK();
+    }
+    if (status.error_code() != ENOENT) {
+        PLOG_ERROR(("desc", "invalid chunk footer")("uuid", _uuid.str())("error", status.error_str()));
+        return status;
+    }
+
+    // not sealed, the server stopped while it was written
+    IOBuf buf;
+    status = _fh->read(0, std::min<uint64_t>(file_size, sizeof(ChunkHeader)), &buf).get();
+    if (!status.ok()) {
+        return status;
+    }
+    ChunkHeader header;
+    status = decode_chunk_header(buf, _uuid, &header);
+    if (!status.ok() && (buf.size() < sizeof(ChunkHeader) || header.magic != kChunkMagic)) {
+        // written before the header was added, the data starts at 0, see chunk_format.h
+        PLOG_WARN(("desc", "load legacy chunk without header")("uuid", _uuid.str())("size", file_size));
+        _data_offset = 0;
+    } else if (!status.ok()) {
+        PLOG_ERROR(("desc", "invalid chunk header")("uuid", _uuid.str())("error", status.error_str()));
+        return status;
+    } else if (file_size < kChunkHeaderSize) {
+        return Status(EIO, std::format("chunk file is truncated, size:{}", file_size));
+    }
+    _size = file_size - _data_offset;
+    _write_end = file_size - _data_offset;
+    // the checksums of an unsealed chunk are not persisted, its data is not verified
+    _checksum_block_size = 0;
+    _header_written = true;
+    _state = ChunkState::kOpen;
+    return Status::OK();
+}
+
 Status Chunk::read(uint64_t offset, uint64_t size, IOBuf* buf) const {
+    return async_read(offset, size, buf).get();
+}
+
+Future<Status> Chunk::async_read(uint64_t offset, uint64_t size, IOBuf* buf, bool direct_io) const {
     SPAN(span);
     if (buf == nullptr) {
-        return Status(EINVAL, "buf is nullptr");
+        return make_ready_future(Status(EINVAL, "buf is nullptr"));
     }
-    std::lock_guard lock(_mutex);
-    if (offset + size > _size) {
-        return Status(EINVAL,
-                      std::format("read out of range, offset:{}, size:{}, current size:{}", offset, size, _size));
+    // data below _size is immutable, so reads can run in parallel with each other and with appends,
+    // the lock below only guards the copy of the checksums
+    uint64_t chunk_size = _size.load(std::memory_order_acquire);
+    if (offset + size > chunk_size) {
+        return make_ready_future(Status(
+            EINVAL, std::format("read out of range, offset:{}, size:{}, current size:{}", offset, size, chunk_size)));
     }
-    FileHandlePtr fh;
-    auto status = _store->open(_uuid.str().c_str(), O_RDONLY, &fh).get();
-    if (!status.ok()) {
-        return status;
+    // the store reads by offset, so the handle opened at create is shared by all readers
+    // instead of opening the file on every read
+    if (!FLAGS_manusya_verify_checksum || size == 0) {
+        return _fh->read(_data_offset + offset, size, buf, direct_io);
     }
-    status = fh->read(offset, size, buf).get();
-    return status;
+
+    // the whole checksum blocks the range overlaps are read and verified, the partial block at the end
+    // of an open chunk has no checksum yet and is read as is
+    uint64_t block_size = 0;
+    uint64_t begin = 0;
+    uint64_t end = 0;
+    std::vector<uint32_t> checksums;
+    {
+        std::unique_lock lock(_mutex);
+        block_size = _checksum_block_size;
+        if (block_size != 0) {
+            uint64_t first = offset / block_size;
+            uint64_t last = std::min<uint64_t>((offset + size + block_size - 1) / block_size, _checksums.size());
+            if (first < last) {
+                checksums.assign(_checksums.begin() + first, _checksums.begin() + last);
+                begin = first * block_size;
+                end = std::min(last * block_size, _size.load(std::memory_order_relaxed));
+            }
+        }
+    }
+    if (checksums.empty()) {
+        return _fh->read(_data_offset + offset, size, buf, direct_io);
+    }
+
+    auto data = std::make_unique<IOBuf>();
+    auto* raw = data.get();
+    return _fh->read(_data_offset + begin, std::max(end, offset + size) - begin, raw, direct_io)
+        .then([uuid = _uuid,
+               data = std::move(data),
+               checksums = std::move(checksums),
+               block_size,
+               begin,
+               end,
+               offset,
+               size,
+               buf](Status status) {
+            if (!status.ok()) {
+                return status;
+            }
+            status = verify_checksums(*data, begin, end - begin, block_size, checksums);
+            if (!status.ok()) {
+                PLOG_ERROR(("desc", "chunk is corrupted")("uuid", uuid.str())("error", status.error_str()));
+                return status;
+            }
+            data->pop_front(offset - begin);
+            data->cutn(buf, size);
+            return Status::OK();
+        });
 }
 
 Status Chunk::create(const ChunkOptions& options, StorePtr store, ChunkPtr* chunk) {
@@ -141,10 +479,12 @@ Status Chunk::create(const ChunkOptions& options, StorePtr store, ChunkPtr* chun
         return Status(EINVAL, "store is nullptr");
     }
     auto c = ChunkPtr(new Chunk());
-    c->_uuid = UUID::generate();
+    c->_uuid = options.uuid.has_value() ? *options.uuid : UUID::generate();
     c->_options = options;
     c->_store = store;
+    c->_timer_wheel = options.timer_wheel != nullptr ? options.timer_wheel : TimerWheel::default_instance();
     c->_size = 0;
+    c->_checksum_block_size = FLAGS_manusya_checksum_block_size;
     auto status = store->open(c->_uuid.str().c_str(), O_CREAT | O_RDWR | O_EXCL, &c->_fh).get();
 
     if (!status.ok()) {
@@ -167,14 +507,43 @@ Status Chunk::create(const ChunkOptions& options, StorePtr store, const UUID& uu
     c->_uuid = uuid;
     c->_options = options;
     c->_store = store;
+    c->_timer_wheel = options.timer_wheel != nullptr ? options.timer_wheel : TimerWheel::default_instance();
     auto status = store->open(c->_uuid.str().c_str(), O_CREAT | O_RDWR | O_EXCL, &c->_fh).get();
 
     if (!status.ok()) {
         return status;
     }
-    c->_state = ChunkState::kOpen;
-    status = c->_fh->size(&c->_size).get();
+    status = c->load();
+    if (!status.ok()) {
+        return status;
+    }
 
+    *chunk = c;
+    return Status::OK();
+}
+
+Status Chunk::open(const ChunkOptions& options, StorePtr store, const UUID& uuid, ChunkPtr* chunk) {
+    SPAN(span);
+    if (chunk == nullptr) {
+        return Status(EINVAL, "chunk is nullptr");
+    }
+    if (store == nullptr) {
+        return Status(EINVAL, "store is nullptr");
+    }
+    auto c = ChunkPtr(new Chunk());
+    c->_uuid = uuid;
+    c->_options = options;
+    c->_store = store;
+    c->_timer_wheel = options.timer_wheel != nullptr ? options.timer_wheel : TimerWheel::default_instance();
+    auto status = store->open(c->_uuid.str().c_str(), O_RDWR, &c->_fh).get();
+    if (status.error_code() == EACCES) {
+        // the file of a sealed chunk is read only
+        status = store->open(c->_uuid.str().c_str(), O_RDONLY, &c->_fh).get();
+    }
+    if (!status.ok()) {
+        return status;
+    }
+    status = c->load();
     if (!status.ok()) {
         return status;
     }
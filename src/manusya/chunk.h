@@ -1,22 +1,32 @@
 #pragma once
 
+#include <bthread/condition_variable.h>
 #include <bthread/mutex.h>
-#include <bthread/unstable.h>
 #include <pain/base/future.h>
 #include <pain/base/tracer.h>
 #include <pain/base/types.h>
 #include <pain/base/uuid.h>
 #include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
 #include <boost/intrusive/set.hpp>
 #include <boost/intrusive_ptr.hpp>
+#include "manusya/chunk_format.h"
 #include "manusya/file_handle.h"
+#include "manusya/timer_wheel.h"
 
 namespace pain::manusya {
 
 class Chunk;
 using ChunkPtr = boost::intrusive_ptr<Chunk>;
 
-struct ChunkOptions {};
+struct ChunkOptions {
+    // the wheel expiring out-of-order appends, TimerWheel::default_instance() if not set
+    TimerWheelPtr timer_wheel;
+    // the uuid of a new chunk, generated if not set
+    std::optional<UUID> uuid;
+};
 
 enum class ChunkState {
     kInit = 0,
@@ -24,17 +34,15 @@ enum class ChunkState {
     kSealed = 2,
 };
 
-struct AppendRequest
-    : public boost::intrusive::set_base_hook<boost::intrusive::link_mode<boost::intrusive::auto_unlink>> {
+// an append waiting in the reorder window of a chunk,
+// it is owned by the chunk until its promise is set
+struct AppendRequest : public boost::intrusive::set_base_hook<> {
     uint64_t offset = 0;
     IOBuf buf;
-    uint64_t start = 0;
-    uint64_t end = 0;
-    ChunkPtr chunk;
+    // bypass the page cache of the store, see Store::append
+    bool direct_io = false;
+    int64_t deadline_us = 0;
     Promise<Status> promise;
-    bthread_timer_t timer;
-    std::shared_ptr<opentelemetry::trace::Span> span;
-    int use_count = 0;
 
     friend bool operator<(const AppendRequest& a, const AppendRequest& b) {
         return a.offset < b.offset;
@@ -45,18 +53,9 @@ struct AppendRequest
     friend bool operator==(const AppendRequest& a, const AppendRequest& b) {
         return a.offset == b.offset;
     }
-    friend void intrusive_ptr_add_ref(AppendRequest* rq) {
-        rq->use_count++;
-    }
-    friend void intrusive_ptr_release(AppendRequest* rq) {
-        if (--rq->use_count == 0) {
-            delete rq;
-        }
-    }
 };
 
-using AppendRequestPtr = boost::intrusive_ptr<AppendRequest>;
-using AppendRequestQueue = boost::intrusive::set<AppendRequest, boost::intrusive::constant_time_size<false>>;
+using AppendRequestQueue = boost::intrusive::set<AppendRequest>;
 
 class Chunk {
 public:
@@ -65,15 +64,28 @@ public:
 
     static Status create(const ChunkOptions& options, StorePtr store, ChunkPtr* chunk);
     static Status create(const ChunkOptions& options, StorePtr store, const UUID& uuid, ChunkPtr* chunk);
+    // open a chunk which is in the store already, e.g. after a restart
+    static Status open(const ChunkOptions& options, StorePtr store, const UUID& uuid, ChunkPtr* chunk);
 
     const UUID& uuid() const {
         return _uuid;
     }
+    const StorePtr& store() const {
+        return _store;
+    }
     Status append(const IOBuf& buf, uint64_t offset);
+    // the future is completed by the store completion, nothing blocks on the write.
+    // appends coalesced into one write go to the store with direct io only if all of them ask for it
+    Future<Status> async_append(const IOBuf& buf, uint64_t offset, bool direct_io = false);
     Status query_and_seal(uint64_t* length);
     Status read(uint64_t offset, uint64_t size, IOBuf* buf) const;
+    Future<Status> async_read(uint64_t offset, uint64_t size, IOBuf* buf, bool direct_io = false) const;
+    // flush the appended data to durable storage, see GroupCommitter
+    Future<Status> sync() const {
+        return _fh->sync();
+    }
     uint64_t size() const {
-        return _size;
+        return _size.load(std::memory_order_acquire);
     }
 
     ChunkState state() const {
@@ -84,11 +96,31 @@ public:
         return _options;
     }
 
+    // the number of out-of-order appends waiting in the reorder window
+    size_t pending_append_count() const {
+        std::unique_lock lock(_mutex);
+        return _append_request_queue.size();
+    }
+
     int use_count() const {
         return _use_count;
     }
 
 private:
+    using Completion = std::pair<AppendRequest*, Status>;
+
+    uint64_t take_append_requests(uint64_t end, IOBuf* run, bool* direct_io, std::vector<AppendRequest*>* batch);
+    void start_write(std::unique_lock<bthread::Mutex> lock);
+    void finish_write(std::vector<AppendRequest*> batch,
+                      uint64_t end,
+                      std::vector<uint32_t> checksums,
+                      uint32_t tail_checksum,
+                      Status status);
+    Status load();
+    void schedule_expire(int64_t deadline_us);
+    void expire_append_requests();
+    static void complete(std::vector<Completion>* completions);
+
     friend void intrusive_ptr_add_ref(Chunk* chunk) {
         chunk->_use_count++;
     }
@@ -100,13 +132,32 @@ private:
     }
 
     UUID _uuid;
-    uint64_t _size = 0;
+    std::atomic<uint64_t> _size = 0;
     ChunkState _state = ChunkState::kInit;
     std::atomic<int> _use_count = 0;
     ChunkOptions _options;
 
     FileHandlePtr _fh;
+    // reorder window, indexed by offset
     AppendRequestQueue _append_request_queue;
+    // at most one write is in flight, it covers [_size, _write_end)
+    bool _writing = false;
+    uint64_t _write_end = 0;
+    bthread::ConditionVariable _write_cond;
+    // crc32c of every _checksum_block_size bytes of data, the partial block at the end is added when sealed,
+    // they are kept in the index of the chunk file.
+    // 0 block size if the chunk has no checksums, e.g. it was not sealed before a restart
+    uint64_t _checksum_block_size = 0;
+    std::vector<uint32_t> _checksums;
+    // crc32c of the partial block at the end, updated by the write in flight
+    uint32_t _tail_checksum = 0;
+    // the header of the chunk file is written with the first data, see chunk_format.h
+    bool _header_written = false;
+    // where the data starts in the chunk file, 0 for a legacy chunk which has no header
+    uint64_t _data_offset = kChunkHeaderSize;
+    // the earliest deadline an expiration is scheduled at, 0 if none
+    int64_t _expire_deadline_us = 0;
+    TimerWheelPtr _timer_wheel;
     StorePtr _store;
     mutable bthread::Mutex _mutex;
 };
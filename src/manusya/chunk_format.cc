@@ -0,0 +1,134 @@
+#include "manusya/chunk_format.h"
+#include <pain/base/crc32c.h>
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstddef>
+#include <format>
+#include <string>
+
+namespace pain::manusya {
+
+// the structs are written as they are in memory
+static_assert(std::endian::native == std::endian::little);
+
+namespace {
+
+template <typename T>
+uint32_t crc_of(const T& t) {
+    // the crc field is at the end of the struct, before the padding if any
+    return butil::crc32c::Value(reinterpret_cast<const char*>(&t), offsetof(T, crc));
+}
+
+} // namespace
+
+IOBuf encode_chunk_header(const UUID& uuid, uint32_t checksum_block_size) {
+    ChunkHeader header;
+    header.checksum_block_size = checksum_block_size;
+    header.uuid_high = uuid.high();
+    header.uuid_low = uuid.low();
+    header.crc = crc_of(header);
+    IOBuf buf;
+    buf.append(&header, sizeof(header));
+    buf.resize(kChunkHeaderSize, '\0');
+    return buf;
+}
+
+Status decode_chunk_header(const IOBuf& buf, const UUID& uuid, ChunkHeader* header) {
+    if (buf.size() < sizeof(ChunkHeader)) {
+        return Status(EINVAL, std::format("chunk header is too short, size:{}", buf.size()));
+    }
+    buf.copy_to(header, sizeof(ChunkHeader));
+    if (header->magic != kChunkMagic) {
+        return Status(EINVAL, std::format("invalid chunk magic {:x}", header->magic));
+    }
+    if (header->crc != crc_of(*header)) {
+        return Status(EIO, "chunk header is corrupted");
+    }
+    if (header->version > kChunkFormatVersion) {
+        return Status(ENOTSUP, std::format("unsupported chunk version {}", header->version));
+    }
+    if (header->uuid_high != uuid.high() || header->uuid_low != uuid.low()) {
+        return Status(EINVAL, "chunk uuid mismatch");
+    }
+    return Status::OK();
+}
+
+IOBuf encode_chunk_trailer(uint64_t data_size, uint32_t checksum_block_size, const std::vector<uint32_t>& checksums) {
+    std::vector<ChunkIndexEntry> index(checksums.size());
+    for (size_t i = 0; i < checksums.size(); i++) {
+        index[i].offset = i * checksum_block_size;
+        index[i].length = std::min<uint64_t>(checksum_block_size, data_size - index[i].offset);
+        index[i].crc = checksums[i];
+    }
+    ChunkFooter footer;
+    footer.checksum_block_size = checksum_block_size;
+    footer.data_size = data_size;
+    footer.index_count = index.size();
+    footer.index_crc = butil::crc32c::Value(reinterpret_cast<const char*>(index.data()),
+                                            index.size() * sizeof(ChunkIndexEntry));
+    footer.crc = crc_of(footer);
+
+    IOBuf buf;
+    buf.append(index.data(), index.size() * sizeof(ChunkIndexEntry));
+    buf.append(&footer, sizeof(footer));
+    return buf;
+}
+
+Status decode_chunk_trailer(const IOBuf& buf,
+                            uint64_t file_size,
+                            ChunkFooter* footer,
+                            std::vector<uint32_t>* checksums,
+                            uint64_t* trailer_size) {
+    if (buf.size() < kChunkFooterSize || file_size < kChunkFooterSize) {
+        return Status(ENOENT, "chunk is not sealed");
+    }
+    buf.copy_to(footer, kChunkFooterSize, buf.size() - kChunkFooterSize);
+    // the tail of an unsealed chunk is data, which may happen to start with the magic
+    if (footer->magic != kChunkMagic || footer->crc != crc_of(*footer)) {
+        return Status(ENOENT, "chunk is not sealed");
+    }
+    if (footer->version > kChunkFormatVersion) {
+        return Status(ENOTSUP, std::format("unsupported chunk version {}", footer->version));
+    }
+    uint64_t block_size = footer->checksum_block_size;
+    uint64_t block_count = block_size == 0 ? 0 : (footer->data_size + block_size - 1) / block_size;
+    if (footer->index_count != block_count) {
+        return Status(EIO, std::format("invalid chunk index count {}", footer->index_count));
+    }
+    uint64_t index_size = uint64_t(footer->index_count) * sizeof(ChunkIndexEntry);
+    // a legacy chunk has no header, see chunk_format.h
+    uint64_t size = footer->data_size + index_size + kChunkFooterSize;
+    if (size != file_size && kChunkHeaderSize + size != file_size) {
+        return Status(EIO,
+                      std::format("chunk size mismatch, data size:{}, index count:{}, file size:{}",
+                                  footer->data_size,
+                                  footer->index_count,
+                                  file_size));
+    }
+    *trailer_size = index_size + kChunkFooterSize;
+    if (buf.size() < *trailer_size) {
+        return Status(EAGAIN, "chunk index is not read");
+    }
+
+    std::vector<ChunkIndexEntry> index(footer->index_count);
+    if (!index.empty()) {
+        buf.copy_to(index.data(), index_size, buf.size() - *trailer_size);
+    }
+    if (footer->index_crc !=
+        butil::crc32c::Value(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(ChunkIndexEntry))) {
+        return Status(EIO, "chunk index is corrupted");
+    }
+    checksums->clear();
+    checksums->reserve(index.size());
+    for (size_t i = 0; i < index.size(); i++) {
+        auto& entry = index[i];
+        if (entry.offset != i * block_size) {
+            return Status(EIO, std::format("invalid chunk index entry {}", i));
+        }
+        checksums->push_back(entry.crc);
+    }
+    return Status::OK();
+}
+
+} // namespace pain::manusya
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <pain/base/types.h>
+#include <pain/base/uuid.h>
+#include <cstdint>
+#include <vector>
+
+namespace pain::manusya {
+
+// The layout of a chunk file:
+//
+//   +-----------------+ 0
+//   | ChunkHeader     |
+//   | (zero padded)   |
+//   +-----------------+ kChunkHeaderSize
+//   | data            |
+//   +-----------------+ kChunkHeaderSize + data_size, only written by query_and_seal
+//   | ChunkIndexEntry |
+//   | ...             |
+//   +-----------------+
+//   | ChunkFooter     |
+//   +-----------------+ file size
+//
+// The header is padded to 4K so that the data is aligned on disk as it is in the chunk.
+// A file without a valid footer is a chunk which was not sealed, its size is the file size minus the header.
+// A file without a valid header is a legacy chunk written before the header was added, its data starts at 0
+// and it has no checksums, it gets a footer but never a header when sealed.
+// Integers are stored in little endian.
+
+constexpr uint64_t kChunkMagic = 0x4b4e4843'4e494150; // "PAINCHNK"
+constexpr uint32_t kChunkFormatVersion = 1;
+constexpr uint64_t kChunkHeaderSize = 4096;
+
+struct ChunkHeader {
+    uint64_t magic = kChunkMagic;
+    uint32_t version = kChunkFormatVersion;
+    uint32_t checksum_block_size = 0;
+    uint64_t uuid_high = 0;
+    uint64_t uuid_low = 0;
+    uint32_t reserved = 0;
+    // crc32c of the fields above
+    uint32_t crc = 0;
+};
+
+// one checksum block of data, offset is relative to the start of the data
+struct ChunkIndexEntry {
+    uint64_t offset = 0;
+    uint32_t length = 0;
+    uint32_t crc = 0;
+};
+
+struct ChunkFooter {
+    uint64_t magic = kChunkMagic;
+    uint32_t version = kChunkFormatVersion;
+    uint32_t checksum_block_size = 0;
+    uint64_t data_size = 0;
+    uint32_t index_count = 0;
+    // crc32c of the index entries
+    uint32_t index_crc = 0;
+    uint64_t reserved = 0;
+    // crc32c of the fields above
+    uint32_t crc = 0;
+    uint32_t padding = 0;
+};
+
+static_assert(sizeof(ChunkHeader) == 40);
+static_assert(sizeof(ChunkIndexEntry) == 16);
+static_assert(sizeof(ChunkFooter) == 48);
+
+constexpr uint64_t kChunkFooterSize = sizeof(ChunkFooter);
+
+// the header padded to kChunkHeaderSize
+IOBuf encode_chunk_header(const UUID& uuid, uint32_t checksum_block_size);
+Status decode_chunk_header(const IOBuf& buf, const UUID& uuid, ChunkHeader* header);
+
+// the index and the footer appended to the data when the chunk is sealed
+IOBuf encode_chunk_trailer(uint64_t data_size, uint32_t checksum_block_size, const std::vector<uint32_t>& checksums);
+// buf holds the last bytes of a chunk file, which is file_size long,
+// return ENOENT if the chunk is not sealed, or EAGAIN if buf is too short to hold the index,
+// in which case trailer_size is set to the number of bytes needed,
+// the data starts at file_size - trailer_size - footer->data_size, which is 0 for a legacy chunk
+Status decode_chunk_trailer(const IOBuf& buf,
+                            uint64_t file_size,
+                            ChunkFooter* footer,
+                            std::vector<uint32_t>* checksums,
+                            uint64_t* trailer_size);
+
+} // namespace pain::manusya
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 
 #include <boost/intrusive_ptr.hpp>
@@ -23,15 +24,18 @@ public:
         return static_cast<T*>(this);
     }
 
-    Future<Status> append(uint64_t offset, IOBuf buf) {
-        return _store->append(this, offset, buf);
+    Future<Status> append(uint64_t offset, IOBuf buf, bool direct_io = false) {
+        return _store->append(this, offset, buf, direct_io);
     }
-    Future<Status> read(uint64_t offset, uint64_t size, IOBuf* buf) {
-        return _store->read(this, offset, size, buf);
+    Future<Status> read(uint64_t offset, uint64_t size, IOBuf* buf, bool direct_io = false) {
+        return _store->read(this, offset, size, buf, direct_io);
     }
     Future<Status> seal() {
         return _store->seal(this);
     }
+    Future<Status> sync() {
+        return _store->sync(this);
+    }
     Future<Status> size(uint64_t* size) {
         return _store->size(this, size);
     }
@@ -60,12 +64,12 @@ private:
     }
 
     friend void intrusive_ptr_release(FileHandle* file_handle) {
-        if (--file_handle->_use_count == 0) {
+        if (file_handle->_use_count.fetch_sub(1) == 1) {
             delete file_handle;
         }
     }
 
-    int _use_count = 0;
+    std::atomic<int> _use_count = 0;
 };
 
 } // namespace pain::manusya
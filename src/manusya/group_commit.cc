@@ -0,0 +1,139 @@
+#include "manusya/group_commit.h"
+
+#include <butil/time.h>
+#include <pain/base/plog.h>
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <unordered_map>
+#include <utility>
+
+namespace pain::manusya {
+
+GroupCommitter::GroupCommitter(uint32_t max_delay_us, uint32_t max_batch, const std::string& prefix) :
+    _max_delay_us(max_delay_us),
+    _max_batch(std::max(max_batch, 1U)),
+    _batch_size(prefix + "_batch_size"),
+    _sync_latency(prefix + "_sync") {
+    if (bthread_start_background(&_tid, nullptr, run, this) != 0) {
+        PLOG_ERROR(("desc", "failed to start group commit bthread"));
+        _tid = 0;
+    }
+}
+
+GroupCommitter::~GroupCommitter() {
+    {
+        std::unique_lock lock(_mutex);
+        _stopped = true;
+        _cond.notify_all();
+    }
+    // the loop drains all pending requests before exiting
+    if (_tid != 0) {
+        bthread_join(_tid, nullptr);
+    }
+}
+
+Future<Status> GroupCommitter::sync(ChunkPtr chunk) {
+    Request request{chunk, {}};
+    auto future = request.promise.get_future();
+    std::unique_lock lock(_mutex);
+    if (_stopped || _tid == 0) {
+        lock.unlock();
+        return chunk->sync();
+    }
+    _pending.emplace_back(std::move(request));
+    // wake up the loop when a batch starts or is full, requests in between just join the batch
+    if (_pending.size() == 1 || _pending.size() >= _max_batch) {
+        _cond.notify_one();
+    }
+    return future;
+}
+
+void* GroupCommitter::run(void* arg) {
+    static_cast<GroupCommitter*>(arg)->loop();
+    return nullptr;
+}
+
+void GroupCommitter::loop() {
+    std::vector<Request> batch;
+    while (true) {
+        {
+            std::unique_lock lock(_mutex);
+            while (_pending.empty() && !_stopped) {
+                _cond.wait(lock);
+            }
+            if (_pending.empty()) {
+                return;
+            }
+            // give the followers a chance to join the batch
+            auto deadline = butil::gettimeofday_us() + _max_delay_us;
+            while (_pending.size() < _max_batch && !_stopped) {
+                auto now = butil::gettimeofday_us();
+                if (now >= deadline) {
+                    break;
+                }
+                _cond.wait_for(lock, deadline - now);
+            }
+            auto n = std::min<size_t>(_pending.size(), _max_batch);
+            batch.assign(std::make_move_iterator(_pending.begin()), std::make_move_iterator(_pending.begin() + n));
+            _pending.erase(_pending.begin(), _pending.begin() + n);
+        }
+        commit(&batch);
+        batch.clear();
+    }
+}
+
+void GroupCommitter::commit(std::vector<Request>* batch) {
+    if (batch->empty()) {
+        return;
+    }
+    auto start = butil::gettimeofday_us();
+    // sync every distinct chunk once, a sync of LocalStore is a blocking fdatasync,
+    // so the chunks are synced by a bthread each to keep all of them in flight at the same time
+    struct SyncContext {
+        std::vector<std::pair<ChunkPtr, Status>> chunks;
+        std::atomic<size_t> next = 0;
+    };
+    SyncContext ctx;
+    std::unordered_map<Chunk*, size_t> indexes;
+    for (auto& request : *batch) {
+        if (indexes.emplace(request.chunk.get(), ctx.chunks.size()).second) {
+            ctx.chunks.emplace_back(request.chunk, Status::OK());
+        }
+    }
+    auto worker = [](void* arg) -> void* {
+        auto* ctx = static_cast<SyncContext*>(arg);
+        for (size_t i = ctx->next.fetch_add(1); i < ctx->chunks.size(); i = ctx->next.fetch_add(1)) {
+            auto& [chunk, status] = ctx->chunks[i];
+            status = chunk->sync().get();
+        }
+        return nullptr;
+    };
+    std::vector<bthread_t> tids;
+    for (size_t i = 1; i < ctx.chunks.size(); i++) {
+        bthread_t tid = 0;
+        if (bthread_start_background(&tid, nullptr, worker, &ctx) != 0) {
+            PLOG_WARN(("desc", "failed to start sync bthread"));
+            break;
+        }
+        tids.push_back(tid);
+    }
+    // the committer is a worker too
+    worker(&ctx);
+    for (auto tid : tids) {
+        bthread_join(tid, nullptr);
+    }
+    for (const auto& [chunk, status] : ctx.chunks) {
+        if (!status.ok()) {
+            PLOG_ERROR(("desc", "failed to sync chunk")("uuid", chunk->uuid().str())("error", status.error_str()));
+        }
+    }
+    _sync_latency << butil::gettimeofday_us() - start;
+    _batch_size << static_cast<int64_t>(batch->size());
+
+    for (auto& request : *batch) {
+        request.promise.set_value(ctx.chunks[indexes[request.chunk.get()]].second);
+    }
+}
+
+} // namespace pain::manusya
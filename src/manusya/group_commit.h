@@ -0,0 +1,55 @@
+#pragma once
+
+#include <bthread/bthread.h>
+#include <bthread/condition_variable.h>
+#include <bthread/mutex.h>
+#include <bvar/bvar.h>
+#include <pain/base/future.h>
+#include <pain/base/types.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "manusya/chunk.h"
+
+namespace pain::manusya {
+
+// GroupCommitter makes appended data durable in batches: sync requests of all chunks on one store
+// are collected for at most max_delay_us (or until max_batch requests are pending), then every
+// distinct chunk of the batch is synced once and all requests of the batch are completed together.
+// An fdatasync covers every write issued before it, so N acks cost one sync per chunk instead of N.
+class GroupCommitter {
+public:
+    // the bvars of the committer are exposed with the prefix
+    GroupCommitter(uint32_t max_delay_us, uint32_t max_batch, const std::string& prefix = "manusya_group_commit");
+    ~GroupCommitter();
+
+    GroupCommitter(const GroupCommitter&) = delete;
+    GroupCommitter& operator=(const GroupCommitter&) = delete;
+
+    // the future is completed after all data appended to the chunk before this call is durable
+    Future<Status> sync(ChunkPtr chunk);
+
+private:
+    struct Request {
+        ChunkPtr chunk;
+        Promise<Status> promise;
+    };
+
+    static void* run(void* arg);
+    void loop();
+    void commit(std::vector<Request>* batch);
+
+    uint32_t _max_delay_us;
+    uint32_t _max_batch;
+
+    std::vector<Request> _pending;
+    bool _stopped = false;
+    bthread::Mutex _mutex;
+    bthread::ConditionVariable _cond;
+    bthread_t _tid = 0;
+
+    bvar::IntRecorder _batch_size;
+    bvar::LatencyRecorder _sync_latency;
+};
+
+} // namespace pain::manusya
@@ -2,37 +2,122 @@
 
 #include <dirent.h>
 #include <fcntl.h>
+#include <gflags/gflags.h>
 #include <pain/base/future.h>
 #include <pain/base/plog.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/xattr.h>
 #include <unistd.h>
+#include <algorithm>
+#include <climits>
 #include <format>
+#include <vector>
 #include <boost/assert.hpp>
 #include "butil/iobuf.h"
+#include "manusya/aligned_buffer_pool.h"
 #include "manusya/file_handle.h"
 #include "manusya/store.h"
 
+DEFINE_bool(manusya_direct_io,
+            true,
+            "Open the files of local store with O_DIRECT as well on the first request asking for direct io, "
+            "so that such requests bypass the page cache");
+
 namespace pain::manusya {
 
-class LocalFileHandle : public FileHandle {
+namespace {
+
+// write at the given offset instead of the file position, so that the fd can be shared.
+// a coalesced append carries one block per request at least, so every backing block
+// up to IOV_MAX goes to a single pwritev rather than IOBuf's 256 per call
+Status write_at(int fd, uint64_t offset, IOBuf buf) {
+    auto buf_size = buf.size();
+    std::vector<iovec> iov;
+    while (!buf.empty()) {
+        auto n = std::min<size_t>(buf.backing_block_num(), IOV_MAX);
+        iov.clear();
+        for (size_t i = 0; i < n; i++) {
+            auto block = buf.backing_block(i);
+            iov.push_back({const_cast<char*>(block.data()), block.size()});
+        }
+        auto nw = ::pwritev(fd, iov.data(), static_cast<int>(iov.size()), static_cast<off_t>(offset));
+        PLOG_DEBUG(("desc", "append to file")("fd", fd)("offset", offset)("nw", nw)("buf_size", buf_size));
+        if (nw < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return Status(errno, "failed to write to file");
+        }
+        buf.pop_front(static_cast<size_t>(nw));
+        offset += nw;
+    }
+    return Status::OK();
+}
+
+// skip the first n bytes of iov
+void advance(std::vector<iovec>* iov, size_t* first, size_t n) {
+    while (n > 0) {
+        auto& v = (*iov)[*first];
+        auto k = std::min(n, v.iov_len);
+        v.iov_base = static_cast<char*>(v.iov_base) + k;
+        v.iov_len -= k;
+        n -= k;
+        if (v.iov_len == 0) {
+            (*first)++;
+        }
+    }
+}
+
+// the buffers of a direct io, they go back to the pool unless handed over to an IOBuf
+class AlignedBuffers {
 public:
-    LocalFileHandle(int fd, StorePtr store) : FileHandle(store), _fd(fd) {}
+    AlignedBuffers() : _pool(AlignedBufferPool::instance()) {}
+    ~AlignedBuffers() {
+        for (auto* buffer : _buffers) {
+            _pool.release(buffer);
+        }
+    }
 
-    ~LocalFileHandle() override {
-        BOOST_ASSERT(_fd > 0);
-        close(_fd);
-    };
+    AlignedBuffers(const AlignedBuffers&) = delete;
+    AlignedBuffers& operator=(const AlignedBuffers&) = delete;
 
-    int64_t handle() const {
-        return _fd;
+    // a buffer for the n bytes at the end of iov, false if out of memory
+    bool add(size_t n, std::vector<iovec>* iov) {
+        auto* buffer = _pool.acquire();
+        if (buffer == nullptr) {
+            return false;
+        }
+        _buffers.push_back(buffer);
+        iov->push_back({buffer, n});
+        return true;
+    }
+
+    size_t buffer_size() const {
+        return _pool.buffer_size();
+    }
+
+    // append the first n bytes of the data read into buf, the buffers are owned by buf from now on
+    void hand_over(size_t n, IOBuf* buf) {
+        for (auto*& buffer : _buffers) {
+            auto k = std::min(n, _pool.buffer_size());
+            if (k == 0) {
+                break;
+            }
+            AlignedBufferPool::append_to(std::exchange(buffer, nullptr), k, buf);
+            n -= k;
+        }
     }
 
 private:
-    int64_t _fd = 0;
+    AlignedBufferPool& _pool;
+    std::vector<void*> _buffers;
 };
 
+} // namespace
+
 LocalStore::LocalStore(const char* data_path) : _data_path(data_path) {
     BOOST_ASSERT(data_path != nullptr);
     constexpr mode_t mode = 0774;
@@ -56,31 +141,110 @@ Future<Status> LocalStore::open(const char* path, int flags, FileHandlePtr* fh)
     if (fd < 0) {
         return make_ready_future(Status(errno, "failed to open file"));
     }
-    *fh = FileHandlePtr(new LocalFileHandle(fd, this));
+    if (!FLAGS_manusya_direct_io) {
+        *fh = FileHandlePtr(new LocalFileHandle(fd, this));
+        return make_ready_future(Status::OK());
+    }
+    // the file exists by now, the second open must not create or truncate it again
+    *fh = FileHandlePtr(new LocalFileHandle(fd, std::move(data_path), flags & ~(O_CREAT | O_EXCL | O_TRUNC), this));
     return make_ready_future(Status::OK());
 }
 
-Future<Status> LocalStore::append(FileHandlePtr fh, uint64_t offset, IOBuf buf) {
-    std::ignore = offset;
+int64_t LocalFileHandle::direct_handle() const {
+    auto direct_fd = _direct_fd.load(std::memory_order_acquire);
+    if (direct_fd != kDirectUnopened) {
+        return direct_fd;
+    }
+    int64_t fd = ::open(_direct_path.c_str(), _direct_flags | O_DIRECT);
+    if (fd < 0) {
+        // e.g. tmpfs, the requests asking for direct io are buffered from now on,
+        // other errors such as EMFILE are retried by the next request
+        PLOG_DEBUG(("desc", "failed to open file with O_DIRECT")("path", _direct_path)("errno", errno));
+        if (errno != EINVAL) {
+            return -1;
+        }
+    }
+    // the loser of a racing open closes its fd
+    if (!_direct_fd.compare_exchange_strong(direct_fd, fd, std::memory_order_acq_rel)) {
+        if (fd >= 0) {
+            ::close(static_cast<int>(fd));
+        }
+        return direct_fd;
+    }
+    return fd;
+}
+
+Future<Status> LocalStore::append(FileHandlePtr fh, uint64_t offset, IOBuf buf, bool direct_io) {
+    InflightGuard inflight(this);
     if (fh == nullptr) {
         return make_ready_future(Status(EINVAL, "fh is nullptr"));
     }
 
-    int fd = fh->as<LocalFileHandle>()->handle();
-
-    auto buf_size = buf.size();
-    auto nw = buf.cut_into_file_descriptor(fd, buf_size);
-    PLOG_DEBUG(("desc", "append to file")("fd", fd)("nw", nw)("buf_size", buf_size));
-    if (nw < 0) {
-        return make_ready_future(Status(errno, "failed to write to file"));
+    auto* local_fh = fh->as<LocalFileHandle>();
+    if (direct_io && local_fh->direct_handle() >= 0) {
+        return make_ready_future(direct_append(local_fh, offset, std::move(buf)));
     }
+    return make_ready_future(write_at(local_fh->handle(), offset, std::move(buf)));
+}
 
-    BOOST_ASSERT(nw == buf_size);
+Status LocalStore::direct_append(LocalFileHandle* fh, uint64_t offset, IOBuf buf) {
+    uint64_t begin = align_up(offset);
+    uint64_t end = align_down(offset + buf.size());
+    if (begin >= end) {
+        // no whole aligned block, e.g. a small append
+        return write_at(fh->handle(), offset, std::move(buf));
+    }
+
+    // the head completes the block the previous append ended in
+    IOBuf head;
+    buf.cutn(&head, begin - offset);
+    auto status = write_at(fh->handle(), offset, std::move(head));
+    if (!status.ok()) {
+        return status;
+    }
+
+    // O_DIRECT wants aligned memory, the data is copied into the pooled buffers IOV_MAX at a time
+    int direct_fd = static_cast<int>(fh->direct_handle());
+    uint64_t pos = begin;
+    while (pos < end) {
+        AlignedBuffers buffers;
+        std::vector<iovec> iov;
+        uint64_t batch_end = pos;
+        while (batch_end < end && iov.size() < IOV_MAX) {
+            auto n = std::min<uint64_t>(buffers.buffer_size(), end - batch_end);
+            if (!buffers.add(n, &iov)) {
+                return Status(ENOMEM, "failed to allocate aligned buffer");
+            }
+            buf.cutn(iov.back().iov_base, n);
+            batch_end += n;
+        }
+        size_t first = 0;
+        while (pos < batch_end) {
+            auto nw = ::pwritev(direct_fd,
+                                iov.data() + first,
+                                static_cast<int>(iov.size() - first),
+                                static_cast<off_t>(pos));
+            PLOG_DEBUG(("desc", "direct append to file")("fd", direct_fd)("offset", pos)("nw", nw));
+            if (nw < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return Status(errno, "failed to write to file");
+            }
+            if (nw % kDirectIOAlignment != 0) {
+                return Status(EIO, "unaligned direct write");
+            }
+            advance(&iov, &first, nw);
+            pos += nw;
+        }
+    }
 
-    return make_ready_future(Status::OK());
+    // the tail is staged in the page cache until the next append completes its block
+    return write_at(fh->handle(), end, std::move(buf));
 }
 
-Future<Status> LocalStore::read(FileHandlePtr fh, uint64_t offset, uint64_t size, IOBuf* buf) {
+Future<Status> LocalStore::read(FileHandlePtr fh, uint64_t offset, uint64_t size, IOBuf* buf, bool direct_io) {
+    InflightGuard inflight(this);
     if (fh == nullptr) {
         return make_ready_future(Status(EINVAL, "fh is nullptr"));
     }
@@ -88,22 +252,29 @@ Future<Status> LocalStore::read(FileHandlePtr fh, uint64_t offset, uint64_t size
         return make_ready_future(Status(EINVAL, "buf is nullptr"));
     }
 
-    int fd = fh->as<LocalFileHandle>()->handle();
-
-    butil::IOPortal iop;
-
-    auto r = lseek(fd, offset, SEEK_SET);
-    if (r < 0) {
-        return make_ready_future(Status(errno, "failed to lseek"));
+    auto* local_fh = fh->as<LocalFileHandle>();
+    if (direct_io && local_fh->direct_handle() >= 0 && size != 0) {
+        return make_ready_future(direct_read(local_fh, offset, size, buf));
     }
+    int fd = static_cast<int>(local_fh->handle());
 
-    auto nr = iop.append_from_file_descriptor(fd, size);
-    if (nr < 0) {
-        PLOG_ERROR(("desc", "failed to read from file")("error", errno)("fd", fd));
-        return make_ready_future(Status(errno, "failed to read from file"));
+    // read by pread, readers of the same fd do not race on the file position
+    butil::IOPortal iop;
+    while (iop.size() < size) {
+        auto nr = iop.pappend_from_file_descriptor(fd, offset + iop.size(), size - iop.size());
+        if (nr < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            PLOG_ERROR(("desc", "failed to read from file")("error", errno)("fd", fd));
+            return make_ready_future(Status(errno, "failed to read from file"));
+        }
+        if (nr == 0) {
+            break;
+        }
     }
 
-    if (nr != size) {
+    if (iop.size() != size) {
         return make_ready_future(Status(EINVAL, "invalid size"));
     }
 
@@ -112,6 +283,55 @@ Future<Status> LocalStore::read(FileHandlePtr fh, uint64_t offset, uint64_t size
     return make_ready_future(Status::OK());
 }
 
+Status LocalStore::direct_read(LocalFileHandle* fh, uint64_t offset, uint64_t size, IOBuf* buf) {
+    uint64_t begin = align_down(offset);
+    uint64_t end = align_up(offset + size);
+    int direct_fd = static_cast<int>(fh->direct_handle());
+
+    AlignedBuffers buffers;
+    std::vector<iovec> iov;
+    for (uint64_t pos = begin; pos < end; pos += buffers.buffer_size()) {
+        if (!buffers.add(std::min<uint64_t>(buffers.buffer_size(), end - pos), &iov)) {
+            return Status(ENOMEM, "failed to allocate aligned buffer");
+        }
+    }
+
+    // the aligned range may go beyond the end of the file, which ends the read with a short count
+    uint64_t nread = 0;
+    size_t first = 0;
+    while (begin + nread < offset + size) {
+        auto n = std::min<size_t>(iov.size() - first, IOV_MAX);
+        auto nr = ::preadv(direct_fd, iov.data() + first, static_cast<int>(n), static_cast<off_t>(begin + nread));
+        if (nr < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            PLOG_ERROR(("desc", "failed to read from file")("error", errno)("fd", direct_fd));
+            return Status(errno, "failed to read from file");
+        }
+        if (nr == 0) {
+            break;
+        }
+        advance(&iov, &first, nr);
+        nread += nr;
+        if (nr % kDirectIOAlignment != 0) {
+            break;
+        }
+    }
+
+    if (begin + nread < offset + size) {
+        return Status(EINVAL, "invalid size");
+    }
+
+    // the data stays in the aligned buffers, only the range asked for is referenced by buf
+    IOBuf data;
+    buffers.hand_over(nread, &data);
+    data.pop_front(offset - begin);
+    buf->clear();
+    data.cutn(buf, size);
+    return Status::OK();
+}
+
 Future<Status> LocalStore::seal(FileHandlePtr fh) {
     if (fh == nullptr) {
         return make_ready_future(Status(EINVAL, "fh is nullptr"));
@@ -126,6 +346,19 @@ Future<Status> LocalStore::seal(FileHandlePtr fh) {
     return make_ready_future(Status::OK());
 }
 
+Future<Status> LocalStore::sync(FileHandlePtr fh) {
+    InflightGuard inflight(this);
+    if (fh == nullptr) {
+        return make_ready_future(Status(EINVAL, "fh is nullptr"));
+    }
+
+    int fd = fh->as<LocalFileHandle>()->handle();
+    if (::fdatasync(fd) < 0) {
+        return make_ready_future(Status(errno, "failed to fdatasync"));
+    }
+    return make_ready_future(Status::OK());
+}
+
 Future<Status> LocalStore::size(FileHandlePtr fh, uint64_t* size) {
     if (fh == nullptr) {
         return make_ready_future(Status(EINVAL, "fh is nullptr"));
@@ -233,6 +466,23 @@ Future<Status> LocalStore::list_attrs(FileHandlePtr fh, std::map<std::string, st
     return make_ready_future(Status::OK());
 }
 
+Future<Status> LocalStore::space(uint64_t* capacity, uint64_t* available) {
+    if (capacity == nullptr) {
+        return make_ready_future(Status(EINVAL, "capacity is nullptr"));
+    }
+    if (available == nullptr) {
+        return make_ready_future(Status(EINVAL, "available is nullptr"));
+    }
+
+    struct statvfs st;
+    if (::statvfs(_data_path.c_str(), &st) < 0) {
+        return make_ready_future(Status(errno, "failed to statvfs"));
+    }
+    *capacity = static_cast<uint64_t>(st.f_blocks) * st.f_frsize;
+    *available = static_cast<uint64_t>(st.f_bavail) * st.f_frsize;
+    return make_ready_future(Status::OK());
+}
+
 void LocalStore::for_each(std::function<void(const char* path)> cb) {
     DIR* dir = opendir(_data_path.c_str());
     if (dir == nullptr) {
@@ -1,28 +1,102 @@
 #pragma once
 
+#include <unistd.h>
+#include <atomic>
 #include <cstdint>
+#include <string>
+#include <utility>
+#include <boost/assert.hpp>
+#include "manusya/file_handle.h"
 #include "manusya/store.h"
 
 namespace pain::manusya {
 
+// The O_DIRECT fd of a file is opened on the first request asking for direct io,
+// so that a file only read and written through the page cache costs a single fd.
+class LocalFileHandle : public FileHandle {
+public:
+    LocalFileHandle(int fd, StorePtr store) : FileHandle(store), _fd(fd) {}
+    // direct_path is opened with direct_flags | O_DIRECT by direct_handle
+    LocalFileHandle(int fd, std::string direct_path, int direct_flags, StorePtr store) :
+        FileHandle(store),
+        _fd(fd),
+        _direct_path(std::move(direct_path)),
+        _direct_flags(direct_flags),
+        _direct_fd(kDirectUnopened) {}
+
+    ~LocalFileHandle() override {
+        BOOST_ASSERT(_fd > 0);
+        close(_fd);
+        auto direct_fd = _direct_fd.load(std::memory_order_relaxed);
+        if (direct_fd >= 0) {
+            close(direct_fd);
+        }
+    };
+
+    int64_t handle() const {
+        return _fd;
+    }
+
+    // the same file opened with O_DIRECT, -1 if direct io is disabled or unsupported by the file system
+    int64_t direct_handle() const;
+
+private:
+    static constexpr int64_t kDirectUnopened = -2;
+
+    int64_t _fd = 0;
+    std::string _direct_path;
+    int _direct_flags = 0;
+    mutable std::atomic<int64_t> _direct_fd = -1;
+};
+
 class LocalStore : public Store {
 public:
     LocalStore(const char* data_path);
     ~LocalStore() override = default;
 
     Future<Status> open(const char* path, int flags, FileHandlePtr* fh) override;
-    Future<Status> append(FileHandlePtr fh, uint64_t offset, IOBuf buf) override;
-    Future<Status> read(FileHandlePtr fh, uint64_t offset, uint64_t size, IOBuf* buf) override;
+    Future<Status> append(FileHandlePtr fh, uint64_t offset, IOBuf buf, bool direct_io = false) override;
+    Future<Status> read(FileHandlePtr fh, uint64_t offset, uint64_t size, IOBuf* buf, bool direct_io = false) override;
     Future<Status> seal(FileHandlePtr fh) override;
+    Future<Status> sync(FileHandlePtr fh) override;
     Future<Status> size(FileHandlePtr fh, uint64_t* size) override;
     Future<Status> remove(const char* path) override;
     Future<Status> set_attr(FileHandlePtr fh, const char* key, const char* value) override;
     Future<Status> get_attr(FileHandlePtr fh, const char* key, std::string* value) override;
     Future<Status> list_attrs(FileHandlePtr fh, std::map<std::string, std::string>* attrs) override;
     void for_each(std::function<void(const char* path)> cb) override;
+    Future<Status> space(uint64_t* capacity, uint64_t* available) override;
+    uint64_t queue_depth() const override {
+        return _inflight.load(std::memory_order_relaxed);
+    }
+
+protected:
+    // the aligned middle of the data bypasses the page cache,
+    // the unaligned head and tail are staged in the page cache by the buffered fd
+    Status direct_append(LocalFileHandle* fh, uint64_t offset, IOBuf buf);
+    // read the aligned range covering [offset, offset + size) into pooled buffers, see AlignedBufferPool
+    Status direct_read(LocalFileHandle* fh, uint64_t offset, uint64_t size, IOBuf* buf);
+
+    // counts a data request of the store while it is in flight
+    class InflightGuard {
+    public:
+        InflightGuard(const LocalStore* store) : _store(store) {
+            _store->_inflight.fetch_add(1, std::memory_order_relaxed);
+        }
+        ~InflightGuard() {
+            _store->_inflight.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        InflightGuard(const InflightGuard&) = delete;
+        InflightGuard& operator=(const InflightGuard&) = delete;
+
+    private:
+        const LocalStore* _store;
+    };
 
 private:
     std::string _data_path;
+    mutable std::atomic<uint64_t> _inflight = 0;
 };
 
 } // namespace pain::manusya
@@ -0,0 +1,976 @@
+#include "manusya/log_store.h"
+
+#include <fcntl.h>
+#include <pain/base/crc32c.h>
+#include <pain/base/plog.h>
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstring>
+#include <format>
+#include <limits>
+#include <memory>
+#include <string_view>
+#include <boost/assert.hpp>
+#include "manusya/macro.h"
+
+namespace pain::manusya {
+
+namespace {
+
+constexpr uint64_t kLogSuperMagic = 0x53474f4c'4e494150; // "PAINLOGS"
+constexpr uint64_t kLogBatchMagic = 0x42474f4c'4e494150; // "PAINLOGB"
+constexpr uint32_t kLogFormatVersion = 1;
+constexpr size_t kMaxNameLength = 4096;
+
+struct LogSuperblock {
+    uint64_t magic = kLogSuperMagic;
+    uint32_t version = kLogFormatVersion;
+    uint32_t block_size = 0;
+    uint64_t segment_size = 0;
+    uint64_t meta_size = 0;
+    uint32_t reserved = 0;
+    // crc32c of the fields above
+    uint32_t crc = 0;
+};
+
+// a batch of records is padded to the block size, the first batch of a half is a snapshot
+struct LogBatchHeader {
+    uint64_t magic = kLogBatchMagic;
+    uint64_t generation = 0;
+    uint64_t seq = 0;
+    // the bytes of the records following the header
+    uint32_t length = 0;
+    // crc32c of the fields above and the records
+    uint32_t crc = 0;
+};
+
+static_assert(sizeof(LogSuperblock) == 40);
+static_assert(sizeof(LogBatchHeader) == 32);
+
+enum class LogRecordType : uint8_t {
+    kCreate = 1, // id, name
+    kExtend = 2, // id, index, segment
+    kSize = 3,   // id, size
+    kSeal = 4,   // id, size
+    kRemove = 5, // id
+    kAttr = 6,   // id, key, value
+};
+
+uint64_t round_down(uint64_t n, uint64_t align) {
+    return n / align * align;
+}
+
+uint64_t round_up(uint64_t n, uint64_t align) {
+    return round_down(n + align - 1, align);
+}
+
+class RecordWriter {
+public:
+    RecordWriter(LogRecordType type) {
+        put(static_cast<uint8_t>(type));
+    }
+
+    template <std::integral T>
+    RecordWriter& put(T value) {
+        _record.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        return *this;
+    }
+
+    RecordWriter& put(std::string_view s) {
+        put(static_cast<uint32_t>(s.size()));
+        _record.append(s);
+        return *this;
+    }
+
+    std::string release() {
+        return std::move(_record);
+    }
+
+private:
+    std::string _record;
+};
+
+class RecordReader {
+public:
+    RecordReader(std::string_view* records) : _records(records) {}
+
+    template <std::integral T>
+    bool get(T* value) {
+        if (_records->size() < sizeof(T)) {
+            return false;
+        }
+        memcpy(value, _records->data(), sizeof(T));
+        _records->remove_prefix(sizeof(T));
+        return true;
+    }
+
+    bool get(std::string* s) {
+        uint32_t n = 0;
+        if (!get(&n) || _records->size() < n) {
+            return false;
+        }
+        s->assign(_records->data(), n);
+        _records->remove_prefix(n);
+        return true;
+    }
+
+private:
+    std::string_view* _records;
+};
+
+std::string create_record(uint64_t id, std::string_view name) {
+    return RecordWriter(LogRecordType::kCreate).put(id).put(name).release();
+}
+
+std::string extend_record(uint64_t id, uint32_t index, uint32_t segment) {
+    return RecordWriter(LogRecordType::kExtend).put(id).put(index).put(segment).release();
+}
+
+std::string size_record(bool seal, uint64_t id, uint64_t size) {
+    return RecordWriter(seal ? LogRecordType::kSeal : LogRecordType::kSize).put(id).put(size).release();
+}
+
+std::string remove_record(uint64_t id) {
+    return RecordWriter(LogRecordType::kRemove).put(id).release();
+}
+
+std::string attr_record(uint64_t id, std::string_view key, std::string_view value) {
+    return RecordWriter(LogRecordType::kAttr).put(id).put(key).put(value).release();
+}
+
+uint32_t superblock_crc(const LogSuperblock& superblock) {
+    return butil::crc32c::Value(reinterpret_cast<const char*>(&superblock), offsetof(LogSuperblock, crc));
+}
+
+uint32_t batch_crc(const LogBatchHeader& header, std::string_view records) {
+    auto crc = butil::crc32c::Value(reinterpret_cast<const char*>(&header), offsetof(LogBatchHeader, crc));
+    return butil::crc32c::Extend(crc, records.data(), records.size());
+}
+
+IOBuf encode_batch(uint64_t generation, uint64_t seq, const std::string& records, uint32_t block_size) {
+    LogBatchHeader header;
+    header.generation = generation;
+    header.seq = seq;
+    header.length = static_cast<uint32_t>(records.size());
+    header.crc = batch_crc(header, records);
+    IOBuf buf;
+    buf.append(&header, sizeof(header));
+    buf.append(records);
+    buf.resize(round_up(buf.size(), block_size), '\0');
+    return buf;
+}
+
+Status first_error(const std::vector<Status>& statuses) {
+    for (const auto& status : statuses) {
+        if (!status.ok()) {
+            return status;
+        }
+    }
+    return Status::OK();
+}
+
+Future<Status> all_ok(std::vector<Future<Status>> futures) {
+    return when_all(std::move(futures)).then([](std::vector<Status> statuses) {
+        return first_error(statuses);
+    });
+}
+
+void cancel(std::deque<LogFile::Append>* appends, const Status& status) {
+    for (auto& append : *appends) {
+        append.promise.set_value(status);
+    }
+    appends->clear();
+}
+
+// apply the first record of records to files
+Status apply_record(std::string_view* records, uint32_t segment_count, std::map<uint64_t, LogFilePtr>* files) {
+    RecordReader reader(records);
+    uint8_t type = 0;
+    uint64_t id = 0;
+    if (!reader.get(&type) || !reader.get(&id)) {
+        return Status(EIO, "truncated record");
+    }
+    if (static_cast<LogRecordType>(type) == LogRecordType::kCreate) {
+        LogFilePtr file(new LogFile());
+        file->id = id;
+        if (!reader.get(&file->name)) {
+            return Status(EIO, "truncated create record");
+        }
+        (*files)[id] = std::move(file);
+        return Status::OK();
+    }
+    auto it = files->find(id);
+    if (it == files->end()) {
+        return Status(EIO, std::format("record {} of unknown file {}", type, id));
+    }
+    auto& file = it->second;
+    switch (static_cast<LogRecordType>(type)) {
+    case LogRecordType::kExtend: {
+        uint32_t index = 0;
+        uint32_t segment = 0;
+        if (!reader.get(&index) || !reader.get(&segment)) {
+            return Status(EIO, "truncated extend record");
+        }
+        if (segment >= segment_count) {
+            return Status(EIO, std::format("invalid segment {} of file {}", segment, id));
+        }
+        if (file->segments.size() <= index) {
+            file->segments.resize(index + 1, std::numeric_limits<uint32_t>::max());
+        }
+        file->segments[index] = segment;
+        return Status::OK();
+    }
+    case LogRecordType::kSize:
+    case LogRecordType::kSeal:
+        if (!reader.get(&file->size)) {
+            return Status(EIO, "truncated size record");
+        }
+        file->sealed = file->sealed || static_cast<LogRecordType>(type) == LogRecordType::kSeal;
+        return Status::OK();
+    case LogRecordType::kRemove:
+        files->erase(it);
+        return Status::OK();
+    case LogRecordType::kAttr: {
+        std::string key;
+        std::string value;
+        if (!reader.get(&key) || !reader.get(&value)) {
+            return Status(EIO, "truncated attr record");
+        }
+        file->attrs[key] = std::move(value);
+        return Status::OK();
+    }
+    default:
+        return Status(EIO, std::format("unknown record type {}", type));
+    }
+}
+
+} // namespace
+
+LogStore::LogStore(BlockDevicePtr device, LogStoreOptions options) :
+    _device(std::move(device)),
+    _options(options) {
+    BOOST_ASSERT_MSG(_device != nullptr, "device is nullptr");
+}
+
+Status LogStore::set_layout(uint64_t segment_size, uint64_t meta_size) {
+    if (_block_size == 0 || segment_size == 0 || segment_size % _block_size != 0 || meta_size == 0 ||
+        meta_size % (2 * _block_size) != 0) {
+        return Status(EINVAL,
+                      std::format("invalid layout, block size:{} segment size:{} meta size:{}",
+                                  _block_size,
+                                  segment_size,
+                                  meta_size));
+    }
+    _segment_size = segment_size;
+    _meta_half_size = meta_size / 2;
+    _data_offset = _block_size + meta_size;
+    auto capacity = _device->capacity();
+    if (capacity < _data_offset + segment_size) {
+        return Status(ENOSPC, std::format("device of {} bytes is too small", capacity));
+    }
+    _segment_count = static_cast<uint32_t>(
+        std::min<uint64_t>((capacity - _data_offset) / segment_size, std::numeric_limits<uint32_t>::max()));
+    return Status::OK();
+}
+
+Status LogStore::init() {
+    _block_size = _device->block_size();
+    if (_block_size < sizeof(LogBatchHeader)) {
+        return Status(EINVAL, std::format("block size {} is too small", _block_size));
+    }
+    IOBuf buf;
+    auto status = _device->read(0, _block_size, &buf).get();
+    if (!status.ok()) {
+        return status;
+    }
+    LogSuperblock superblock;
+    if (buf.copy_to(&superblock, sizeof(superblock)) != sizeof(superblock) || superblock.magic != kLogSuperMagic ||
+        superblock.crc != superblock_crc(superblock)) {
+        if (!_options.format) {
+            return Status(EINVAL, "no valid superblock, the device is not formatted");
+        }
+        return format_device();
+    }
+    if (superblock.version != kLogFormatVersion) {
+        return Status(ENOTSUP, std::format("unsupported version {}", superblock.version));
+    }
+    if (superblock.block_size != _block_size) {
+        return Status(EINVAL, std::format("formatted with block size {}", superblock.block_size));
+    }
+    // the layout is fixed when the device is formatted
+    status = set_layout(superblock.segment_size, superblock.meta_size);
+    if (!status.ok()) {
+        return status;
+    }
+    return replay();
+}
+
+Status LogStore::format_device() {
+    auto status = set_layout(_options.segment_size, _options.meta_size);
+    if (!status.ok()) {
+        return status;
+    }
+    // a stale half of a previous format may have a higher generation
+    IOBuf zero;
+    zero.resize(_block_size, '\0');
+    status = _device->write(_block_size + _meta_half_size, std::move(zero)).get();
+    if (!status.ok()) {
+        return status;
+    }
+    // an empty snapshot
+    auto batch = encode_batch(1, 0, {}, _block_size);
+    auto length = batch.size();
+    status = _device->write(_block_size, std::move(batch)).get();
+    if (!status.ok()) {
+        return status;
+    }
+    LogSuperblock superblock;
+    superblock.block_size = _block_size;
+    superblock.segment_size = _segment_size;
+    superblock.meta_size = _meta_half_size * 2;
+    superblock.crc = superblock_crc(superblock);
+    IOBuf buf;
+    buf.append(&superblock, sizeof(superblock));
+    buf.resize(_block_size, '\0');
+    status = _device->write(0, std::move(buf)).get();
+    if (!status.ok()) {
+        return status;
+    }
+    status = _device->flush().get();
+    if (!status.ok()) {
+        return status;
+    }
+
+    Lock lock(_mutex);
+    _meta_half = 0;
+    _meta_generation = 1;
+    _meta_seq = 1;
+    _meta_pos = length;
+    for (uint32_t i = 0; i < _segment_count; i++) {
+        _free_segments.insert(_free_segments.end(), i);
+    }
+    PLOG_INFO(("desc", "device formatted")("segment_size", _segment_size)("segment_count", _segment_count));
+    return Status::OK();
+}
+
+Status LogStore::replay() {
+    // the generation of the snapshot at the start of each half, 0 if there is none
+    std::vector<std::pair<uint64_t, int>> halves;
+    for (int half = 0; half < 2; half++) {
+        IOBuf buf;
+        auto status = _device->read(_block_size + half * _meta_half_size, _block_size, &buf).get();
+        if (!status.ok()) {
+            return status;
+        }
+        LogBatchHeader header;
+        if (buf.copy_to(&header, sizeof(header)) == sizeof(header) && header.magic == kLogBatchMagic &&
+            header.seq == 0) {
+            halves.emplace_back(header.generation, half);
+        }
+    }
+    std::sort(halves.rbegin(), halves.rend());
+    for (auto [generation, half] : halves) {
+        auto status = replay_half(half, generation);
+        if (status.error_code() != EAGAIN) {
+            return status;
+        }
+        // the snapshot was torn, the other half is still complete
+        PLOG_WARN(("desc", "skip torn snapshot")("half", half)("generation", generation));
+    }
+    return Status(EIO, "no valid metadata log");
+}
+
+Status LogStore::replay_half(int half, uint64_t generation) {
+    IOBuf buf;
+    auto status = _device->read(_block_size + half * _meta_half_size, _meta_half_size, &buf).get();
+    if (!status.ok()) {
+        return status;
+    }
+    auto log = buf.to_string();
+    std::map<uint64_t, LogFilePtr> files;
+    uint64_t pos = 0;
+    uint64_t seq = 0;
+    while (pos + sizeof(LogBatchHeader) <= log.size()) {
+        LogBatchHeader header;
+        memcpy(&header, log.data() + pos, sizeof(header));
+        if (header.magic != kLogBatchMagic || header.generation != generation || header.seq != seq ||
+            header.length > log.size() - pos - sizeof(header)) {
+            break;
+        }
+        std::string_view records(log.data() + pos + sizeof(header), header.length);
+        if (header.crc != batch_crc(header, records)) {
+            break;
+        }
+        while (!records.empty()) {
+            status = apply_record(&records, _segment_count, &files);
+            if (!status.ok()) {
+                return status;
+            }
+        }
+        pos += round_up(sizeof(header) + header.length, _block_size);
+        seq++;
+    }
+    if (seq == 0) {
+        return Status(EAGAIN, "invalid snapshot");
+    }
+
+    std::vector<bool> used(_segment_count, false);
+    uint32_t head = 0;
+    std::vector<LogFilePtr> tails;
+    for (auto& [id, file] : files) {
+        for (auto segment : file->segments) {
+            if (segment >= _segment_count || used[segment]) {
+                return Status(EIO, std::format("invalid or shared segment {} of file {}", segment, file->name));
+            }
+            used[segment] = true;
+            head = std::max(head, segment + 1);
+        }
+        if (file->segments.size() * _segment_size < file->size) {
+            return Status(EIO, std::format("file {} of {} bytes is beyond its segments", file->name, file->size));
+        }
+        file->write_end = file->size;
+        if (!file->sealed && file->size % _block_size != 0) {
+            tails.push_back(file);
+        }
+    }
+    // the partial blocks of the files still being written
+    for (auto& file : tails) {
+        auto begin = round_down(file->size, _block_size);
+        IOBuf tail;
+        status = _device
+                     ->read(segment_offset(file->segments[begin / _segment_size]) + begin % _segment_size,
+                            _block_size,
+                            &tail)
+                     .get();
+        if (!status.ok()) {
+            return status;
+        }
+        file->tail.resize(file->size - begin);
+        tail.copy_to(file->tail.data(), file->tail.size());
+    }
+
+    Lock lock(_mutex);
+    _files.clear();
+    _free_segments.clear();
+    for (auto& [id, file] : files) {
+        _next_file_id = std::max(_next_file_id, id + 1);
+        _files.emplace(file->name, file);
+    }
+    for (uint32_t i = 0; i < _segment_count; i++) {
+        if (!used[i]) {
+            _free_segments.insert(_free_segments.end(), i);
+        }
+    }
+    _log_head = head < _segment_count ? head : 0;
+    _meta_half = half;
+    _meta_generation = generation;
+    _meta_seq = seq;
+    _meta_pos = pos;
+    PLOG_INFO(("desc", "metadata log replayed")            //
+              ("half", half)("generation", generation)     //
+              ("batches", seq)("files", _files.size())     //
+              ("free_segments", _free_segments.size()));
+    return Status::OK();
+}
+
+Future<Status> LogStore::log_record(std::string record) {
+    _meta_records.append(record);
+    _meta_waiters.emplace_back();
+    return _meta_waiters.back().get_future();
+}
+
+std::string LogStore::snapshot() const {
+    std::string records;
+    for (const auto& [name, file] : _files) {
+        records.append(create_record(file->id, name));
+        for (size_t i = 0; i < file->segments.size(); i++) {
+            records.append(extend_record(file->id, i, file->segments[i]));
+        }
+        // a seal being logged may be carried by this snapshot instead of its own record
+        records.append(size_record(file->sealed || file->sealing, file->id, file->size));
+        for (const auto& [key, value] : file->attrs) {
+            records.append(attr_record(file->id, key, value));
+        }
+    }
+    return records;
+}
+
+void LogStore::write_meta() {
+    Lock lock(_mutex);
+    if (_meta_writing || _meta_waiters.empty()) {
+        return;
+    }
+    auto records = std::exchange(_meta_records, {});
+    auto waiters = std::exchange(_meta_waiters, {});
+    auto half = _meta_half;
+    auto generation = _meta_generation;
+    auto seq = _meta_seq;
+    auto pos = _meta_pos;
+    if (pos + round_up(sizeof(LogBatchHeader) + records.size(), _block_size) > _meta_half_size) {
+        // the half is full, the whole state goes to the other half, these records included
+        records = snapshot();
+        half ^= 1;
+        generation++;
+        seq = 0;
+        pos = 0;
+    }
+    auto batch = encode_batch(generation, seq, records, _block_size);
+    auto length = batch.size();
+    if (length > _meta_half_size) {
+        lock.unlock();
+        PLOG_ERROR(("desc", "metadata log is full")("snapshot_size", length)("half_size", _meta_half_size));
+        for (auto& waiter : waiters) {
+            waiter.set_value(Status(ENOSPC, "metadata log is full"));
+        }
+        return;
+    }
+    _meta_writing = true;
+    auto offset = _block_size + half * _meta_half_size + pos;
+    lock.unlock();
+
+    StorePtr self(this);
+    _device->write(offset, std::move(batch))
+        .then([self, this](Status status) -> Future<Status> {
+            if (!status.ok()) {
+                return make_ready_future(std::move(status));
+            }
+            return _device->flush();
+        })
+        .then([self, this, waiters = std::move(waiters), half, generation, seq, pos, length](Status status) mutable {
+            {
+                Lock lock(_mutex);
+                if (status.ok()) {
+                    _meta_half = half;
+                    _meta_generation = generation;
+                    _meta_seq = seq + 1;
+                    _meta_pos = pos + length;
+                } else {
+                    // the records are lost, the next batch is a snapshot so that the log is consistent again
+                    _meta_pos = _meta_half_size;
+                }
+                _meta_writing = false;
+            }
+            if (!status.ok()) {
+                PLOG_ERROR(("desc", "failed to write metadata log")("error", status.error_str()));
+            }
+            for (auto& waiter : waiters) {
+                waiter.set_value(status);
+            }
+            write_meta();
+        });
+}
+
+bool LogStore::allocate_segment(uint32_t* segment) {
+    if (_free_segments.empty()) {
+        return false;
+    }
+    auto it = _free_segments.lower_bound(_log_head);
+    if (it == _free_segments.end()) {
+        it = _free_segments.begin();
+    }
+    *segment = *it;
+    _free_segments.erase(it);
+    _log_head = *segment + 1 < _segment_count ? *segment + 1 : 0;
+    return true;
+}
+
+void LogStore::release_segments(const LogFilePtr& file) {
+    for (auto segment : file->segments) {
+        _free_segments.insert(segment);
+    }
+    file->segments.clear();
+    file->release_segments = false;
+}
+
+Future<Status> LogStore::remove_file(const LogFilePtr& file, std::deque<LogFile::Append>* cancelled) {
+    file->removed = true;
+    *cancelled = std::exchange(file->appends, {});
+    StorePtr self(this);
+    return log_record(remove_record(file->id)).then([self, this, file](Status status) {
+        if (status.ok()) {
+            Lock lock(_mutex);
+            // an append in flight may still write to the segments
+            if (file->writing) {
+                file->release_segments = true;
+            } else {
+                release_segments(file);
+            }
+        }
+        return status;
+    });
+}
+
+Future<Status> LogStore::open(const char* path, int flags, FileHandlePtr* fh) {
+    SPAN(span);
+    if (path == nullptr) {
+        return make_ready_future(Status(EINVAL, "path is nullptr"));
+    }
+    if (fh == nullptr) {
+        return make_ready_future(Status(EINVAL, "fh is nullptr"));
+    }
+    std::string name(path);
+    if (name.size() > kMaxNameLength) {
+        return make_ready_future(Status(ENAMETOOLONG, "path is too long"));
+    }
+    std::vector<Future<Status>> futures;
+    std::deque<LogFile::Append> cancelled;
+    Lock lock(_mutex);
+    auto it = _files.find(name);
+    if (it != _files.end()) {
+        if ((flags & O_EXCL) != 0) {
+            return make_ready_future(Status(EEXIST, "file already exists"));
+        }
+        if ((flags & O_TRUNC) == 0) {
+            *fh = FileHandlePtr(new LogFileHandle(it->second, this));
+            return make_ready_future(Status::OK());
+        }
+        futures.push_back(remove_file(it->second, &cancelled));
+        _files.erase(it);
+    } else if ((flags & O_CREAT) == 0) {
+        return make_ready_future(Status(ENOENT, "file not found"));
+    }
+    LogFilePtr file(new LogFile());
+    file->id = _next_file_id++;
+    file->name = name;
+    futures.push_back(log_record(create_record(file->id, name)));
+    _files.emplace(std::move(name), file);
+    *fh = FileHandlePtr(new LogFileHandle(std::move(file), this));
+    lock.unlock();
+
+    cancel(&cancelled, Status(ENOENT, "file is truncated"));
+    write_meta();
+    return all_ok(std::move(futures));
+}
+
+Future<Status> LogStore::append(FileHandlePtr fh, uint64_t offset, IOBuf buf, bool direct_io) {
+    SPAN(span);
+    if (fh == nullptr) {
+        return make_ready_future(Status(EINVAL, "fh is nullptr"));
+    }
+    // nothing is cached, every request goes to the device
+    std::ignore = direct_io;
+    const auto& file = fh->as<LogFileHandle>()->file();
+    Lock lock(_mutex);
+    if (file->removed) {
+        return make_ready_future(Status(ENOENT, "file is removed"));
+    }
+    if (file->sealed || file->sealing) {
+        return make_ready_future(Status(EPERM, "file is sealed"));
+    }
+    if (offset != file->write_end) {
+        return make_ready_future(
+            Status(EINVAL, std::format("append at {} while the file ends at {}", offset, file->write_end)));
+    }
+    if (buf.empty()) {
+        return make_ready_future(Status::OK());
+    }
+    file->write_end += buf.size();
+    file->appends.push_back({offset, std::move(buf), {}});
+    auto future = file->appends.back().promise.get_future();
+    start_append(file, std::move(lock));
+    return future;
+}
+
+void LogStore::start_append(const LogFilePtr& file, Lock lock) {
+    if (file->writing || file->appends.empty()) {
+        return;
+    }
+    auto append = std::move(file->appends.front());
+    file->appends.pop_front();
+    file->writing = true;
+    auto end = append.offset + append.buf.size();
+
+    std::vector<Future<Status>> futures;
+    while (file->segments.size() * _segment_size < end) {
+        uint32_t segment = 0;
+        if (!allocate_segment(&segment)) {
+            lock.unlock();
+            // the segments allocated so far stay with the file
+            write_meta();
+            finish_append(file, end, {}, Status(ENOSPC, "no free segment"), std::move(append.promise));
+            return;
+        }
+        futures.push_back(log_record(extend_record(file->id, file->segments.size(), segment)));
+        file->segments.push_back(segment);
+    }
+
+    // the partial block at the end of the file is written again in front of the new data
+    auto begin = append.offset - file->tail.size();
+    IOBuf data;
+    data.append(file->tail);
+    data.append(append.buf);
+    std::string tail(end % _block_size, '\0');
+    data.copy_to(tail.data(), tail.size(), data.size() - tail.size());
+    data.resize(round_up(data.size(), _block_size), '\0');
+
+    std::vector<std::pair<uint64_t, IOBuf>> writes;
+    for (auto pos = begin; !data.empty();) {
+        auto in_segment = pos % _segment_size;
+        auto n = std::min<uint64_t>(_segment_size - in_segment, data.size());
+        IOBuf piece;
+        data.cutn(&piece, n);
+        writes.emplace_back(segment_offset(file->segments[pos / _segment_size]) + in_segment, std::move(piece));
+        pos += n;
+    }
+    lock.unlock();
+
+    write_meta();
+    for (auto& [offset, piece] : writes) {
+        futures.push_back(_device->write(offset, std::move(piece)));
+    }
+    StorePtr self(this);
+    when_all(std::move(futures))
+        .then([self, this, file, end, tail = std::move(tail), promise = std::move(append.promise)](
+                  std::vector<Status> statuses) mutable {
+            finish_append(file, end, std::move(tail), first_error(statuses), std::move(promise));
+        });
+}
+
+void LogStore::finish_append(
+    const LogFilePtr& file, uint64_t end, std::string tail, Status status, Promise<Status> promise) {
+    std::deque<LogFile::Append> failed;
+    Lock lock(_mutex);
+    file->writing = false;
+    if (status.ok()) {
+        file->size = end;
+        file->tail = std::move(tail);
+    } else {
+        // the queued appends follow the failed one, none of them can be written
+        failed = std::exchange(file->appends, {});
+        file->write_end = file->size;
+    }
+    if (file->release_segments) {
+        release_segments(file);
+    }
+    start_append(file, std::move(lock));
+
+    cancel(&failed, status);
+    promise.set_value(std::move(status));
+}
+
+Future<Status> LogStore::read(FileHandlePtr fh, uint64_t offset, uint64_t size, IOBuf* buf, bool direct_io) {
+    SPAN(span);
+    // nothing is cached, every request goes to the device
+    std::ignore = direct_io;
+    if (fh == nullptr) {
+        return make_ready_future(Status(EINVAL, "fh is nullptr"));
+    }
+    if (buf == nullptr) {
+        return make_ready_future(Status(EINVAL, "buf is nullptr"));
+    }
+    const auto& file = fh->as<LogFileHandle>()->file();
+    // the device ranges of the blocks covering [offset, offset + size)
+    std::vector<std::pair<uint64_t, uint64_t>> extents;
+    auto begin = round_down(offset, _block_size);
+    {
+        Lock lock(_mutex);
+        if (file->removed) {
+            return make_ready_future(Status(ENOENT, "file is removed"));
+        }
+        size = offset < file->size ? std::min(size, file->size - offset) : 0;
+        auto end = round_up(offset + size, _block_size);
+        for (auto pos = begin; pos < end;) {
+            auto in_segment = pos % _segment_size;
+            auto n = std::min(_segment_size - in_segment, end - pos);
+            extents.emplace_back(segment_offset(file->segments[pos / _segment_size]) + in_segment, n);
+            pos += n;
+        }
+    }
+    buf->clear();
+    if (size == 0) {
+        return make_ready_future(Status::OK());
+    }
+
+    auto pieces = std::make_shared<std::vector<IOBuf>>(extents.size());
+    std::vector<Future<Status>> futures;
+    for (size_t i = 0; i < extents.size(); i++) {
+        futures.push_back(_device->read(extents[i].first, extents[i].second, &(*pieces)[i]));
+    }
+    return when_all(std::move(futures)).then([pieces, buf, skip = offset - begin, size](std::vector<Status> statuses) {
+        auto status = first_error(statuses);
+        if (!status.ok()) {
+            return status;
+        }
+        IOBuf data;
+        for (auto& piece : *pieces) {
+            data.append(piece);
+        }
+        data.pop_front(skip);
+        data.cutn(buf, size);
+        return Status::OK();
+    });
+}
+
+Future<Status> LogStore::persist_size(const LogFilePtr& file, bool seal) {
+    uint64_t size = 0;
+    {
+        Lock lock(_mutex);
+        size = file->size;
+    }
+    StorePtr self(this);
+    // the data up to the size is flushed before the size is logged, so the size is taken before the flush,
+    // the appends completed during the flush are not covered by it
+    return _device->flush().then([self, this, file, seal, size](Status status) -> Future<Status> {
+        if (!status.ok()) {
+            return make_ready_future(std::move(status));
+        }
+        Lock lock(_mutex);
+        if (file->removed) {
+            return make_ready_future(Status(ENOENT, "file is removed"));
+        }
+        auto future = log_record(size_record(seal, file->id, size));
+        lock.unlock();
+        write_meta();
+        return future;
+    });
+}
+
+Future<Status> LogStore::seal(FileHandlePtr fh) {
+    SPAN(span);
+    if (fh == nullptr) {
+        return make_ready_future(Status(EINVAL, "fh is nullptr"));
+    }
+    const auto& file = fh->as<LogFileHandle>()->file();
+    {
+        Lock lock(_mutex);
+        if (file->removed) {
+            return make_ready_future(Status(ENOENT, "file is removed"));
+        }
+        file->sealing = true;
+    }
+    StorePtr self(this);
+    // the file is sealed once the seal record is durable, it can be appended again if that fails
+    return persist_size(file, true).then([self, this, file](Status status) {
+        Lock lock(_mutex);
+        file->sealing = false;
+        if (status.ok()) {
+            file->sealed = true;
+        }
+        return status;
+    });
+}
+
+Future<Status> LogStore::sync(FileHandlePtr fh) {
+    SPAN(span);
+    if (fh == nullptr) {
+        return make_ready_future(Status(EINVAL, "fh is nullptr"));
+    }
+    return persist_size(fh->as<LogFileHandle>()->file(), false);
+}
+
+Future<Status> LogStore::size(FileHandlePtr fh, uint64_t* size) {
+    SPAN(span);
+    if (fh == nullptr) {
+        return make_ready_future(Status(EINVAL, "fh is nullptr"));
+    }
+    if (size == nullptr) {
+        return make_ready_future(Status(EINVAL, "size is nullptr"));
+    }
+    Lock lock(_mutex);
+    *size = fh->as<LogFileHandle>()->file()->size;
+    return make_ready_future(Status::OK());
+}
+
+Future<Status> LogStore::remove(const char* path) {
+    SPAN(span);
+    if (path == nullptr) {
+        return make_ready_future(Status(EINVAL, "path is nullptr"));
+    }
+    std::deque<LogFile::Append> cancelled;
+    Lock lock(_mutex);
+    auto it = _files.find(path);
+    if (it == _files.end()) {
+        return make_ready_future(Status::OK());
+    }
+    auto future = remove_file(it->second, &cancelled);
+    _files.erase(it);
+    lock.unlock();
+
+    cancel(&cancelled, Status(ENOENT, "file is removed"));
+    write_meta();
+    return future;
+}
+
+Future<Status> LogStore::set_attr(FileHandlePtr fh, const char* key, const char* value) {
+    SPAN(span);
+    if (fh == nullptr) {
+        return make_ready_future(Status(EINVAL, "fh is nullptr"));
+    }
+    if (key == nullptr) {
+        return make_ready_future(Status(EINVAL, "key is nullptr"));
+    }
+    if (value == nullptr) {
+        return make_ready_future(Status(EINVAL, "value is nullptr"));
+    }
+    const auto& file = fh->as<LogFileHandle>()->file();
+    Lock lock(_mutex);
+    if (file->removed) {
+        return make_ready_future(Status(ENOENT, "file is removed"));
+    }
+    file->attrs[key] = value;
+    auto future = log_record(attr_record(file->id, key, value));
+    lock.unlock();
+    write_meta();
+    return future;
+}
+
+Future<Status> LogStore::get_attr(FileHandlePtr fh, const char* key, std::string* value) {
+    SPAN(span);
+    if (fh == nullptr) {
+        return make_ready_future(Status(EINVAL, "fh is nullptr"));
+    }
+    if (key == nullptr) {
+        return make_ready_future(Status(EINVAL, "key is nullptr"));
+    }
+    if (value == nullptr) {
+        return make_ready_future(Status(EINVAL, "value is nullptr"));
+    }
+    const auto& file = fh->as<LogFileHandle>()->file();
+    Lock lock(_mutex);
+    auto it = file->attrs.find(key);
+    if (it == file->attrs.end()) {
+        return make_ready_future(Status(ENOENT, "attribute not found"));
+    }
+    *value = it->second;
+    return make_ready_future(Status::OK());
+}
+
+Future<Status> LogStore::list_attrs(FileHandlePtr fh, std::map<std::string, std::string>* attrs) {
+    SPAN(span);
+    if (fh == nullptr) {
+        return make_ready_future(Status(EINVAL, "fh is nullptr"));
+    }
+    if (attrs == nullptr) {
+        return make_ready_future(Status(EINVAL, "attrs is nullptr"));
+    }
+    Lock lock(_mutex);
+    *attrs = fh->as<LogFileHandle>()->file()->attrs;
+    return make_ready_future(Status::OK());
+}
+
+void LogStore::for_each(std::function<void(const char* path)> cb) {
+    SPAN(span);
+    std::vector<std::string> paths;
+    {
+        Lock lock(_mutex);
+        for (const auto& [name, file] : _files) {
+            paths.push_back(name);
+        }
+    }
+    for (const auto& path : paths) {
+        cb(path.c_str());
+    }
+}
+
+Future<Status> LogStore::space(uint64_t* capacity, uint64_t* available) {
+    if (capacity == nullptr || available == nullptr) {
+        return make_ready_future(Status(EINVAL, "capacity or available is nullptr"));
+    }
+    Lock lock(_mutex);
+    *capacity = _segment_count * _segment_size;
+    *available = _free_segments.size() * _segment_size;
+    return make_ready_future(Status::OK());
+}
+
+} // namespace pain::manusya
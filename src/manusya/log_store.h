@@ -0,0 +1,199 @@
+#pragma once
+
+#include <bthread/mutex.h>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include <boost/intrusive_ptr.hpp>
+#include "manusya/block_device.h"
+#include "manusya/file_handle.h"
+#include "manusya/store.h"
+
+namespace pain::manusya {
+
+// The layout of a raw device managed by LogStore:
+//
+//   +------------------+ 0
+//   | LogSuperblock    |
+//   +------------------+ block_size
+//   | metadata log A   |
+//   +------------------+ block_size + meta_size / 2
+//   | metadata log B   |
+//   +------------------+ block_size + meta_size
+//   | segment 0        |
+//   | segment 1        |
+//   | ...              |
+//   +------------------+
+//
+// Files are made of segments, a new segment is taken from the log head when an append goes beyond the
+// last one, so the chunks being written fill the device sequentially.
+// The metadata log is a sequence of batches of records (create, extend, size, seal, remove, attr).
+// When one half is full the whole state is written to the other half as a snapshot with a higher
+// generation, the half with the highest valid generation is replayed on init.
+// Integers are stored in little endian.
+
+struct LogStoreOptions {
+    // the unit of allocation, a multiple of the block size
+    uint64_t segment_size = 16 * 1024 * 1024;
+    // the size of both halves of the metadata log, a multiple of twice the block size
+    uint64_t meta_size = 64 * 1024 * 1024;
+    // format the device if it has no valid superblock, otherwise init fails
+    bool format = false;
+};
+
+class LogFile;
+using LogFilePtr = boost::intrusive_ptr<LogFile>;
+
+// LogFile is the state of one file, guarded by the mutex of the store
+class LogFile {
+public:
+    struct Append {
+        uint64_t offset;
+        IOBuf buf;
+        Promise<Status> promise;
+    };
+
+    uint64_t id = 0;
+    std::string name;
+    // the device segment of every segment_size bytes of the file
+    std::vector<uint32_t> segments;
+    // the bytes of the completed appends
+    uint64_t size = 0;
+    // the end of the accepted appends, the next one must start here
+    uint64_t write_end = 0;
+    bool sealed = false;
+    // the seal record is being logged, appends are refused until it fails
+    bool sealing = false;
+    bool removed = false;
+    // the segments are released once the remove record is durable and no append is in flight
+    bool release_segments = false;
+    std::map<std::string, std::string> attrs;
+    // the partial block at the end of the file, it is written again in front of the next append
+    std::string tail;
+    // an append rewrites the tail block of the previous one, so one of them is in flight at a time
+    std::deque<Append> appends;
+    bool writing = false;
+
+private:
+    friend void intrusive_ptr_add_ref(LogFile* file) {
+        file->_use_count++;
+    }
+
+    friend void intrusive_ptr_release(LogFile* file) {
+        if (file->_use_count.fetch_sub(1) == 1) {
+            delete file;
+        }
+    }
+
+    std::atomic<int> _use_count = 0;
+};
+
+class LogFileHandle : public FileHandle {
+public:
+    LogFileHandle(LogFilePtr file, StorePtr store) : FileHandle(store), _file(std::move(file)) {}
+    ~LogFileHandle() override = default;
+
+    const LogFilePtr& file() const {
+        return _file;
+    }
+
+private:
+    LogFilePtr _file;
+};
+
+// LogStore keeps files on a raw block device without a file system, see the layout above.
+// Appends must be sequential, the store never holds its lock while calling the device.
+class LogStore : public Store {
+public:
+    LogStore(BlockDevicePtr device, LogStoreOptions options);
+    ~LogStore() override = default;
+
+    // format the device or replay the metadata log, must be called before anything else
+    Status init();
+
+    Future<Status> open(const char* path, int flags, FileHandlePtr* fh) override;
+    Future<Status> append(FileHandlePtr fh, uint64_t offset, IOBuf buf, bool direct_io = false) override;
+    Future<Status> read(FileHandlePtr fh, uint64_t offset, uint64_t size, IOBuf* buf, bool direct_io = false) override;
+    Future<Status> seal(FileHandlePtr fh) override;
+    Future<Status> sync(FileHandlePtr fh) override;
+    Future<Status> size(FileHandlePtr fh, uint64_t* size) override;
+    Future<Status> remove(const char* path) override;
+    Future<Status> set_attr(FileHandlePtr fh, const char* key, const char* value) override;
+    Future<Status> get_attr(FileHandlePtr fh, const char* key, std::string* value) override;
+    Future<Status> list_attrs(FileHandlePtr fh, std::map<std::string, std::string>* attrs) override;
+    void for_each(std::function<void(const char* path)> cb) override;
+    Future<Status> space(uint64_t* capacity, uint64_t* available) override;
+    uint64_t queue_depth() const override {
+        return _device->queue_depth();
+    }
+
+    uint64_t segment_size() const {
+        return _segment_size;
+    }
+
+    size_t free_segments() const {
+        std::unique_lock lock(_mutex);
+        return _free_segments.size();
+    }
+
+private:
+    using Lock = std::unique_lock<bthread::Mutex>;
+
+    Status set_layout(uint64_t segment_size, uint64_t meta_size);
+    Status format_device();
+    // replay the half with the highest generation, or the other one if its snapshot is torn
+    Status replay();
+    Status replay_half(int half, uint64_t generation);
+
+    // append a record to the metadata log, the future is ready once it is durable.
+    // must be called with _mutex held, the batch is written by write_meta after the lock is released
+    Future<Status> log_record(std::string record);
+    void write_meta();
+    std::string snapshot() const;
+
+    // start the first queued append of file, the lock is released when it returns
+    void start_append(const LogFilePtr& file, Lock lock);
+    void finish_append(const LogFilePtr& file, uint64_t end, std::string tail, Status status, Promise<Status> promise);
+    // flush the data and log the size of the file
+    Future<Status> persist_size(const LogFilePtr& file, bool seal);
+    bool allocate_segment(uint32_t* segment);
+    void release_segments(const LogFilePtr& file);
+    // must be called with _mutex held, the queued appends of file are moved to cancelled
+    Future<Status> remove_file(const LogFilePtr& file, std::deque<LogFile::Append>* cancelled);
+
+    uint64_t segment_offset(uint32_t segment) const {
+        return _data_offset + segment * _segment_size;
+    }
+
+    BlockDevicePtr _device;
+    LogStoreOptions _options;
+    uint32_t _block_size = 0;
+    uint64_t _segment_size = 0;
+    uint64_t _meta_half_size = 0;
+    uint64_t _data_offset = 0;
+    uint32_t _segment_count = 0;
+
+    mutable bthread::Mutex _mutex;
+    std::map<std::string, LogFilePtr> _files;
+    uint64_t _next_file_id = 1;
+    std::set<uint32_t> _free_segments;
+    // the next segment to allocate, it wraps around the device
+    uint32_t _log_head = 0;
+
+    // the position of the next batch of the metadata log
+    int _meta_half = 0;
+    uint64_t _meta_generation = 0;
+    uint64_t _meta_seq = 0;
+    uint64_t _meta_pos = 0;
+    // the records waiting for the batch in flight
+    std::string _meta_records;
+    std::vector<Promise<Status>> _meta_waiters;
+    bool _meta_writing = false;
+};
+
+} // namespace pain::manusya
@@ -2,6 +2,7 @@
 
 #include <brpc/controller.h>
 
+#include <pain/base/crc32c.h>
 #include <pain/base/plog.h>
 #include <pain/base/tracer.h>
 #include "butil/endpoint.h"
@@ -28,6 +29,9 @@ MANUSYA_SERVICE_METHOD(CreateChunk) {
                ("attached", cntl->request_attachment().size()));
 
     ChunkOptions options;
+    if (request->has_chunk_id()) {
+        options.uuid = UUID(request->chunk_id().high(), request->chunk_id().low());
+    }
 
     ChunkPtr chunk;
     auto status = Bank::instance().create_chunk(options, &chunk);
@@ -51,6 +55,7 @@ MANUSYA_SERVICE_METHOD(AppendChunk) {
                ("remote_side", butil::endpoint2str(cntl->remote_side()).c_str()) //
                ("chunk", uuid.str())                                             //
                ("offset", request->offset())                                     //
+               ("direct_io", request->direct_io())                               //
                ("attached", cntl->request_attachment().size()));
 
     ChunkPtr chunk;
@@ -62,19 +67,41 @@ MANUSYA_SERVICE_METHOD(AppendChunk) {
         return;
     }
 
-    status = chunk->append(cntl->request_attachment(), request->offset());
-    if (!status.ok()) {
-        PLOG_ERROR(("desc", "failed to append chunk") //
-                   ("uuid", uuid.str())               //
-                   ("errno", status.error_code())     //
-                   ("error", status.error_str()));
-        response->mutable_header()->set_status(status.error_code());
-        response->mutable_header()->set_message(status.error_str());
-        return;
+    // the data may be corrupted on the wire, it is checked before it reaches the chunk
+    if (request->has_crc32()) {
+        auto crc = crc32c(cntl->request_attachment());
+        if (crc != request->crc32()) {
+            PLOG_ERROR(("desc", "checksum mismatch")("uuid", uuid.str())("expected", request->crc32())("actual", crc));
+            response->mutable_header()->set_status(EBADMSG);
+            response->mutable_header()->set_message("checksum mismatch");
+            return;
+        }
     }
 
-    // return new offset
-    response->set_offset(chunk->size());
+    // done is run by the store completion, no bthread is parked while the write is in flight
+    chunk->async_append(cntl->request_attachment(), request->offset(), request->direct_io())
+        .then([chunk](Status status) {
+            if (!status.ok()) {
+                return make_ready_future(std::move(status));
+            }
+            // don't ack until the data is durable
+            return Bank::instance().sync_chunk(chunk);
+        })
+        .then([span, uuid, chunk, response, done = done_guard.release()](Status status) {
+            brpc::ClosureGuard guard(done);
+            if (!status.ok()) {
+                PLOG_ERROR(("desc", "failed to append chunk") //
+                           ("uuid", uuid.str())               //
+                           ("errno", status.error_code())     //
+                           ("error", status.error_str()));
+                response->mutable_header()->set_status(status.error_code());
+                response->mutable_header()->set_message(status.error_str());
+                return;
+            }
+
+            // return new offset
+            response->set_offset(chunk->size());
+        });
 }
 
 MANUSYA_SERVICE_METHOD(ListChunk) {
@@ -105,6 +132,7 @@ MANUSYA_SERVICE_METHOD(ReadChunk) {
                ("remote_side", butil::endpoint2str(cntl->remote_side()).c_str()) //
                ("chunk", uuid.str())                                             //
                ("offset", request->offset())                                     //
+               ("direct_io", request->direct_io())                               //
                ("attached", cntl->request_attachment().size()));
 
     ChunkPtr chunk;
@@ -116,12 +144,20 @@ MANUSYA_SERVICE_METHOD(ReadChunk) {
         return;
     }
 
-    status = chunk->read(request->offset(), request->length(), &cntl->response_attachment());
-    if (!status.ok()) {
-        PLOG_ERROR(("desc", "failed to read chunk")("uuid", uuid.str())("error", status.error_str()));
-        cntl->SetFailed(status.error_code(), "%s", status.error_cstr());
-        return;
-    }
+    // the data is read into the response attachment, done is run when the read completes
+    chunk->async_read(request->offset(), request->length(), &cntl->response_attachment(), request->direct_io())
+        .then([span, uuid, cntl, request, response, done = done_guard.release()](Status status) {
+            brpc::ClosureGuard guard(done);
+            if (!status.ok()) {
+                PLOG_ERROR(("desc", "failed to read chunk")("uuid", uuid.str())("error", status.error_str()));
+                cntl->SetFailed(status.error_code(), "%s", status.error_cstr());
+                return;
+            }
+            auto& data = cntl->response_attachment();
+            response->set_offset(request->offset());
+            response->set_length(data.size());
+            response->set_crc32(crc32c(data));
+        });
 }
 
 MANUSYA_SERVICE_METHOD(QueryAndSealChunk) {
@@ -1,5 +1,7 @@
 #include "manusya/mem_store.h"
+#include <algorithm>
 #include <memory>
+#include <mutex>
 #include "manusya/file_handle.h"
 #include "manusya/macro.h"
 
@@ -7,18 +9,84 @@ namespace pain::manusya {
 
 class MemFileHandle : public FileHandle {
 public:
-    MemFileHandle(const char* path, StorePtr store) : FileHandle(store), _path(path){};
+    MemFileHandle(MemFilePtr file, StorePtr store) : FileHandle(store), _file(std::move(file)){};
 
     ~MemFileHandle() override = default;
 
-    const std::string& handle() {
-        return _path;
+    MemFile* handle() {
+        return _file.get();
     }
 
 private:
-    std::string _path;
+    MemFilePtr _file;
 };
 
+void MemFile::append(IOBuf buf) {
+    if (buf.empty()) {
+        return;
+    }
+    std::unique_lock lock(_mutex);
+    auto offset = _size;
+    _size += buf.size();
+    _blocks.push_back({offset, std::move(buf)});
+}
+
+void MemFile::read(uint64_t offset, uint64_t size, IOBuf* buf) const {
+    std::unique_lock lock(_mutex);
+    if (offset >= _size) {
+        return;
+    }
+    size = std::min(size, _size - offset);
+    // the last block which starts at or before offset
+    auto it = std::upper_bound(_blocks.begin(), _blocks.end(), offset, [](uint64_t offset, const Block& block) {
+        return offset < block.offset;
+    });
+    --it;
+    for (; size > 0; ++it) {
+        auto pos = offset - it->offset;
+        auto n = std::min<uint64_t>(size, it->data.size() - pos);
+        it->data.append_to(buf, n, pos);
+        offset += n;
+        size -= n;
+    }
+}
+
+uint64_t MemFile::size() const {
+    std::unique_lock lock(_mutex);
+    return _size;
+}
+
+void MemFile::clear() {
+    std::vector<Block> blocks;
+    std::map<std::string, std::string> attrs;
+    std::unique_lock lock(_mutex);
+    blocks.swap(_blocks);
+    attrs.swap(_attrs);
+    _size = 0;
+    lock.unlock();
+    // blocks are released outside the lock
+}
+
+void MemFile::set_attr(const char* key, const char* value) {
+    std::unique_lock lock(_mutex);
+    _attrs[key] = value;
+}
+
+bool MemFile::get_attr(const char* key, std::string* value) const {
+    std::unique_lock lock(_mutex);
+    auto it = _attrs.find(key);
+    if (it == _attrs.end()) {
+        return false;
+    }
+    *value = it->second;
+    return true;
+}
+
+std::map<std::string, std::string> MemFile::list_attrs() const {
+    std::unique_lock lock(_mutex);
+    return _attrs;
+}
+
 Future<Status> MemStore::open(const char* path, int flags, FileHandlePtr* fh) {
     SPAN(span);
     if (path == nullptr) {
@@ -27,46 +95,57 @@ Future<Status> MemStore::open(const char* path, int flags, FileHandlePtr* fh) {
     if (fh == nullptr) {
         return make_ready_future(Status(EINVAL, "fh is nullptr"));
     }
-    if (_files.find(path) != _files.end()) {
-        if ((flags & O_EXCL) != 0) {
-            return make_ready_future(Status(EEXIST, "file already exists"));
-        }
-        if ((flags & O_TRUNC) != 0) {
-            _files[path].clear();
-        }
-    } else {
-        if ((flags & O_CREAT) != 0) {
-            _files[path] = IOBuf();
+    std::string key(path);
+    auto& s = shard(key);
+    MemFilePtr file;
+    bool truncate = false;
+    {
+        std::unique_lock lock(s.mutex);
+        auto it = s.files.find(key);
+        if (it != s.files.end()) {
+            if ((flags & O_EXCL) != 0) {
+                return make_ready_future(Status(EEXIST, "file already exists"));
+            }
+            file = it->second;
+            truncate = (flags & O_TRUNC) != 0;
         } else {
-            return make_ready_future(Status(ENOENT, "file not found"));
+            if ((flags & O_CREAT) == 0) {
+                return make_ready_future(Status(ENOENT, "file not found"));
+            }
+            file = MemFilePtr(new MemFile());
+            s.files.emplace(std::move(key), file);
         }
     }
-    *fh = FileHandlePtr(new MemFileHandle(path, this));
+    if (truncate) {
+        file->clear();
+    }
+    *fh = FileHandlePtr(new MemFileHandle(std::move(file), this));
     return make_ready_future(Status::OK());
 }
 
-Future<Status> MemStore::append(FileHandlePtr fh, uint64_t offset, IOBuf buf) {
+Future<Status> MemStore::append(FileHandlePtr fh, uint64_t offset, IOBuf buf, bool direct_io) {
     SPAN(span);
     if (fh == nullptr) {
         return make_ready_future(Status(EINVAL, "fh is nullptr"));
     }
-    std::unique_lock lock(_mutex);
-    auto& path = fh->as<MemFileHandle>()->handle();
-    auto& iobuf = _files[path];
-
-    iobuf.append(buf);
+    // data is always appended at the end of the file, the offset is checked by the chunk
+    std::ignore = offset;
+    // there is no cache to bypass
+    std::ignore = direct_io;
+    fh->as<MemFileHandle>()->handle()->append(std::move(buf));
     return make_ready_future(Status::OK());
 }
 
-Future<Status> MemStore::read(FileHandlePtr fh, uint64_t offset, uint64_t size, IOBuf* buf) {
+Future<Status> MemStore::read(FileHandlePtr fh, uint64_t offset, uint64_t size, IOBuf* buf, bool direct_io) {
     SPAN(span);
+    std::ignore = direct_io;
     if (fh == nullptr) {
         return make_ready_future(Status(EINVAL, "fh is nullptr"));
     }
-    std::unique_lock lock(_mutex);
-    auto path = fh->as<MemFileHandle>()->handle();
-    auto& iobuf = _files[path];
-    iobuf.append_to(buf, size, offset);
+    if (buf == nullptr) {
+        return make_ready_future(Status(EINVAL, "buf is nullptr"));
+    }
+    fh->as<MemFileHandle>()->handle()->read(offset, size, buf);
     return make_ready_future(Status::OK());
 }
 
@@ -75,15 +154,20 @@ Future<Status> MemStore::seal(FileHandlePtr fh) {
     return make_ready_future(Status::OK());
 }
 
+Future<Status> MemStore::sync(FileHandlePtr fh) {
+    std::ignore = fh;
+    return make_ready_future(Status::OK());
+}
+
 Future<Status> MemStore::size(FileHandlePtr fh, uint64_t* size) {
     SPAN(span);
     if (fh == nullptr) {
         return make_ready_future(Status(EINVAL, "fh is nullptr"));
     }
-    std::unique_lock lock(_mutex);
-    auto path = fh->as<MemFileHandle>()->handle();
-    auto& iobuf = _files[path];
-    *size = iobuf.size();
+    if (size == nullptr) {
+        return make_ready_future(Status(EINVAL, "size is nullptr"));
+    }
+    *size = fh->as<MemFileHandle>()->handle()->size();
     return make_ready_future(Status::OK());
 }
 
@@ -92,8 +176,21 @@ Future<Status> MemStore::remove(const char* path) {
     if (path == nullptr) {
         return make_ready_future(Status(EINVAL, "path is nullptr"));
     }
-    std::unique_lock lock(_mutex);
-    _files.erase(path);
+    std::string key(path);
+    auto& s = shard(key);
+    MemFilePtr file;
+    {
+        std::unique_lock lock(s.mutex);
+        auto it = s.files.find(key);
+        if (it == s.files.end()) {
+            return make_ready_future(Status::OK());
+        }
+        file = std::move(it->second);
+        s.files.erase(it);
+    }
+    // handles opened before may still point to the file, release the memory now rather than
+    // when the last of them is closed
+    file->clear();
     return make_ready_future(Status::OK());
 }
 
@@ -108,9 +205,7 @@ Future<Status> MemStore::set_attr(FileHandlePtr fh, const char* key, const char*
     if (value == nullptr) {
         return make_ready_future(Status(EINVAL, "value is nullptr"));
     }
-    std::unique_lock lock(_mutex);
-    auto path = fh->as<MemFileHandle>()->handle();
-    _attrs[path][key] = value;
+    fh->as<MemFileHandle>()->handle()->set_attr(key, value);
     return make_ready_future(Status::OK());
 }
 
@@ -125,13 +220,9 @@ Future<Status> MemStore::get_attr(FileHandlePtr fh, const char* key, std::string
     if (value == nullptr) {
         return make_ready_future(Status(EINVAL, "value is nullptr"));
     }
-    std::unique_lock lock(_mutex);
-    auto path = fh->as<MemFileHandle>()->handle();
-    auto it = _attrs[path].find(key);
-    if (it == _attrs[path].end()) {
+    if (!fh->as<MemFileHandle>()->handle()->get_attr(key, value)) {
         return make_ready_future(Status(ENOENT, "attribute not found"));
     }
-    *value = it->second;
     return make_ready_future(Status::OK());
 }
 
@@ -143,18 +234,43 @@ Future<Status> MemStore::list_attrs(FileHandlePtr fh, std::map<std::string, std:
     if (attrs == nullptr) {
         return make_ready_future(Status(EINVAL, "attrs is nullptr"));
     }
-    std::unique_lock lock(_mutex);
-    auto path = fh->as<MemFileHandle>()->handle();
-    *attrs = _attrs[path];
+    *attrs = fh->as<MemFileHandle>()->handle()->list_attrs();
     return make_ready_future(Status::OK());
 }
 
 void MemStore::for_each(std::function<void(const char* path)> cb) {
     SPAN(span);
-    std::unique_lock lock(_mutex);
-    for (const auto& [path, _] : _files) {
+    // collect the paths first, cb may open or remove files of the same shard
+    std::vector<std::string> paths;
+    for (auto& s : _shards) {
+        std::unique_lock lock(s.mutex);
+        for (const auto& [path, _] : s.files) {
+            paths.push_back(path);
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+    for (const auto& path : paths) {
         cb(path.c_str());
     }
 }
 
+Future<Status> MemStore::space(uint64_t* capacity, uint64_t* available) {
+    if (capacity == nullptr) {
+        return make_ready_future(Status(EINVAL, "capacity is nullptr"));
+    }
+    if (available == nullptr) {
+        return make_ready_future(Status(EINVAL, "available is nullptr"));
+    }
+    uint64_t used = 0;
+    for (auto& s : _shards) {
+        std::unique_lock lock(s.mutex);
+        for (const auto& [_, file] : s.files) {
+            used += file->size();
+        }
+    }
+    *capacity = _capacity;
+    *available = _capacity - std::min(used, _capacity);
+    return make_ready_future(Status::OK());
+}
+
 } // namespace pain::manusya
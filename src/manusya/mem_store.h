@@ -1,31 +1,99 @@
 #pragma once
 
 #include <bthread/mutex.h>
+#include <array>
+#include <atomic>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <boost/intrusive_ptr.hpp>
 #include "manusya/store.h"
 
 namespace pain::manusya {
 
+class MemFile;
+using MemFilePtr = boost::intrusive_ptr<MemFile>;
+
+// MemFile is the state of one file. The file handle points to it directly, so append/read/size/attrs
+// only take the lock of the file and never look up the file table.
+// Appended data is kept as a list of blocks in write order, a read binary searches the first block it
+// covers and takes references of the blocks without copying.
+class MemFile {
+public:
+    MemFile() = default;
+    ~MemFile() = default;
+
+    void append(IOBuf buf);
+    void read(uint64_t offset, uint64_t size, IOBuf* buf) const;
+    uint64_t size() const;
+    // drop data and attrs, the memory is released even if the file is still opened
+    void clear();
+
+    void set_attr(const char* key, const char* value);
+    bool get_attr(const char* key, std::string* value) const;
+    std::map<std::string, std::string> list_attrs() const;
+
+private:
+    struct Block {
+        uint64_t offset;
+        IOBuf data;
+    };
+
+    mutable bthread::Mutex _mutex;
+    std::vector<Block> _blocks;
+    uint64_t _size = 0;
+    std::map<std::string, std::string> _attrs;
+
+    friend void intrusive_ptr_add_ref(MemFile* file) {
+        file->_use_count++;
+    }
+
+    friend void intrusive_ptr_release(MemFile* file) {
+        if (file->_use_count.fetch_sub(1) == 1) {
+            delete file;
+        }
+    }
+
+    std::atomic<int> _use_count = 0;
+};
+
 class MemStore : public Store {
 public:
     MemStore() = default;
+    // the capacity only limits what space() reports, appends are never rejected
+    MemStore(uint64_t capacity) : _capacity(capacity) {}
     ~MemStore() override = default;
 
 protected:
     Future<Status> open(const char* path, int flags, FileHandlePtr* fh) override;
-    Future<Status> append(FileHandlePtr fh, uint64_t offset, IOBuf buf) override;
-    Future<Status> read(FileHandlePtr fh, uint64_t offset, uint64_t size, IOBuf* buf) override;
+    Future<Status> append(FileHandlePtr fh, uint64_t offset, IOBuf buf, bool direct_io = false) override;
+    Future<Status> read(FileHandlePtr fh, uint64_t offset, uint64_t size, IOBuf* buf, bool direct_io = false) override;
     Future<Status> seal(FileHandlePtr fh) override;
+    Future<Status> sync(FileHandlePtr fh) override;
     Future<Status> size(FileHandlePtr fh, uint64_t* size) override;
     Future<Status> remove(const char* path) override;
     Future<Status> set_attr(FileHandlePtr fh, const char* key, const char* value) override;
     Future<Status> get_attr(FileHandlePtr fh, const char* key, std::string* value) override;
     Future<Status> list_attrs(FileHandlePtr fh, std::map<std::string, std::string>* attrs) override;
     void for_each(std::function<void(const char* path)> cb) override;
+    Future<Status> space(uint64_t* capacity, uint64_t* available) override;
 
 private:
-    std::map<std::string, IOBuf> _files;
-    std::map<std::string, std::map<std::string, std::string>> _attrs;
-    mutable bthread::Mutex _mutex;
+    // the file table is only touched by open/remove/for_each, it is sharded by the hash of the path
+    // so that chunks created concurrently do not contend on one lock
+    static constexpr size_t kShardNum = 16;
+    struct Shard {
+        bthread::Mutex mutex;
+        std::unordered_map<std::string, MemFilePtr> files;
+    };
+
+    Shard& shard(const std::string& path) {
+        return _shards[std::hash<std::string>()(path) % kShardNum];
+    }
+
+    std::array<Shard, kShardNum> _shards;
+    uint64_t _capacity = std::numeric_limits<uint64_t>::max();
 
     friend class FileHandle;
 };
@@ -0,0 +1,354 @@
+#include "manusya/spdk_store.h"
+
+#include <bthread/bthread.h>
+#include <gflags/gflags.h>
+#include <pain/base/future.h>
+#include <pain/base/plog.h>
+#include <spdk/bdev.h>
+#include <spdk/env.h>
+#include <spdk/event.h>
+#include <spdk/thread.h>
+#include <atomic>
+#include <format>
+#include <memory>
+#include <thread>
+#include "manusya/log_store.h"
+
+DEFINE_string(manusya_spdk_config, "", "The json config of spdk, it creates the bdevs of the spdk:// stores");
+DEFINE_string(manusya_spdk_rpc_addr, "/var/tmp/manusya_spdk.sock", "The rpc listen address of spdk");
+DEFINE_string(manusya_spdk_reactor_mask, "0x1", "The cpu mask of the spdk reactors");
+DEFINE_int32(manusya_spdk_mem_size_mb, -1, "The memory reserved by spdk in MB, -1 for the default of spdk");
+DEFINE_bool(manusya_spdk_no_huge, false, "Run spdk without hugepages, only for malloc and aio bdevs");
+DEFINE_uint64(manusya_spdk_segment_size, 16 * 1024 * 1024, "The segment size of a newly formatted spdk:// store");
+DEFINE_uint64(manusya_spdk_meta_size, 64 * 1024 * 1024, "The metadata log size of a newly formatted spdk:// store");
+DEFINE_bool(manusya_spdk_format, false, "Format the bdev of a spdk:// store if it has no valid superblock");
+
+namespace pain::manusya {
+
+namespace {
+
+// SpdkEnv runs the spdk app on a thread of its own, the bdevs are opened and the requests are submitted
+// on the app thread. The app is never stopped, it lives as long as the process.
+class SpdkEnv {
+public:
+    // nullptr if spdk failed to start
+    static SpdkEnv* instance() {
+        static SpdkEnv* s_env = []() -> SpdkEnv* {
+            auto* env = new SpdkEnv();
+            auto status = env->start();
+            if (!status.ok()) {
+                PLOG_ERROR(("desc", "failed to start spdk")("error", status.error_str()));
+                delete env;
+                return nullptr;
+            }
+            return env;
+        }();
+        return s_env;
+    }
+
+    // run f on the app thread, false if the message can't be sent
+    template <typename F>
+    bool run(F f) {
+        auto* fn = new F(std::move(f));
+        int rc = spdk_thread_send_msg(
+            _app_thread,
+            [](void* arg) {
+                std::unique_ptr<F> fn(static_cast<F*>(arg));
+                (*fn)();
+            },
+            fn);
+        if (rc != 0) {
+            delete fn;
+            return false;
+        }
+        return true;
+    }
+
+    bool on_app_thread() const {
+        return spdk_get_thread() == _app_thread;
+    }
+
+private:
+    Status start() {
+        Promise<Status> started;
+        auto future = started.get_future();
+        std::thread thread([this, started = std::move(started)]() mutable {
+            struct spdk_app_opts opts = {};
+            spdk_app_opts_init(&opts, sizeof(opts));
+            opts.name = "manusya";
+            opts.json_config_file =
+                FLAGS_manusya_spdk_config.empty() ? nullptr : FLAGS_manusya_spdk_config.c_str();
+            opts.rpc_addr = FLAGS_manusya_spdk_rpc_addr.c_str();
+            opts.reactor_mask = FLAGS_manusya_spdk_reactor_mask.c_str();
+            opts.mem_size = FLAGS_manusya_spdk_mem_size_mb;
+            opts.no_huge = FLAGS_manusya_spdk_no_huge;
+            // manusya handles the signals itself
+            opts.disable_signal_handlers = true;
+
+            struct Context {
+                SpdkEnv* env;
+                Promise<Status>* started;
+                bool running;
+            };
+            Context context{this, &started, false};
+            int rc = spdk_app_start(
+                &opts,
+                [](void* arg) {
+                    auto* context = static_cast<Context*>(arg);
+                    context->env->_app_thread = spdk_get_thread();
+                    context->running = true;
+                    context->started->set_value(Status::OK());
+                },
+                &context);
+            // spdk_app_start returns when the app is stopped, or at once if it failed to start
+            if (!context.running) {
+                started.set_value(Status(EIO, std::format("spdk_app_start failed with {}", rc)));
+            }
+            spdk_app_fini();
+        });
+        auto status = future.get();
+        if (status.ok()) {
+            thread.detach();
+        } else {
+            thread.join();
+        }
+        return status;
+    }
+
+    struct spdk_thread* _app_thread = nullptr;
+};
+
+class SpdkBlockDevice : public BlockDevice {
+public:
+    SpdkBlockDevice(SpdkEnv* env) : _env(env) {}
+
+    ~SpdkBlockDevice() override {
+        auto close = [desc = _desc, channel = _channel]() {
+            if (channel != nullptr) {
+                spdk_put_io_channel(channel);
+            }
+            if (desc != nullptr) {
+                spdk_bdev_close(desc);
+            }
+        };
+        // the last reference of the store may be dropped by a completion on the app thread
+        if (_env->on_app_thread()) {
+            close();
+            return;
+        }
+        Promise<Status> closed;
+        auto future = closed.get_future();
+        if (_env->run([close, closed = std::move(closed)]() mutable {
+                close();
+                closed.set_value(Status::OK());
+            })) {
+            future.get();
+        }
+    }
+
+    Status open(const char* name) {
+        Promise<Status> opened;
+        auto future = opened.get_future();
+        bool sent = _env->run([this, name = std::string(name), opened = std::move(opened)]() mutable {
+            int rc = spdk_bdev_open_ext(name.c_str(), true, on_event, nullptr, &_desc);
+            if (rc != 0) {
+                opened.set_value(Status(-rc, std::format("failed to open bdev {}", name)));
+                return;
+            }
+            _bdev = spdk_bdev_desc_get_bdev(_desc);
+            _channel = spdk_bdev_get_io_channel(_desc);
+            if (_channel == nullptr) {
+                opened.set_value(Status(ENOMEM, std::format("failed to get io channel of bdev {}", name)));
+                return;
+            }
+            _block_size = spdk_bdev_get_block_size(_bdev);
+            _capacity = spdk_bdev_get_num_blocks(_bdev) * _block_size;
+            _buf_align = spdk_bdev_get_buf_align(_bdev);
+            _flush_supported = spdk_bdev_io_type_supported(_bdev, SPDK_BDEV_IO_TYPE_FLUSH);
+            opened.set_value(Status::OK());
+        });
+        if (!sent) {
+            return Status(ENOMEM, "failed to send message to spdk");
+        }
+        return future.get();
+    }
+
+    uint32_t block_size() const override {
+        return _block_size;
+    }
+
+    uint64_t capacity() const override {
+        return _capacity;
+    }
+
+    Future<Status> write(uint64_t offset, IOBuf buf) override {
+        auto size = buf.size();
+        auto* dma = spdk_dma_malloc(size, _buf_align, nullptr);
+        if (dma == nullptr) {
+            return make_ready_future(Status(ENOMEM, "failed to allocate dma buffer"));
+        }
+        // the blocks of an IOBuf are not pinned, the data is copied into memory the device can dma from
+        buf.copy_to(dma, size);
+        return submit(new Request{this, Request::kWrite, offset, size, dma, nullptr});
+    }
+
+    Future<Status> read(uint64_t offset, uint64_t size, IOBuf* buf) override {
+        auto* dma = spdk_dma_malloc(size, _buf_align, nullptr);
+        if (dma == nullptr) {
+            return make_ready_future(Status(ENOMEM, "failed to allocate dma buffer"));
+        }
+        return submit(new Request{this, Request::kRead, offset, size, dma, buf});
+    }
+
+    Future<Status> flush() override {
+        if (!_flush_supported) {
+            return make_ready_future(Status::OK());
+        }
+        return submit(new Request{this, Request::kFlush, 0, _capacity, nullptr, nullptr});
+    }
+
+    uint64_t queue_depth() const override {
+        return _inflight.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Request {
+        enum Type {
+            kWrite,
+            kRead,
+            kFlush,
+        };
+
+        SpdkBlockDevice* device;
+        Type type;
+        uint64_t offset;
+        uint64_t size;
+        void* dma;
+        IOBuf* buf;
+        Promise<Status> promise;
+        Status status;
+        struct spdk_bdev_io_wait_entry wait = {};
+    };
+
+    static void on_event(enum spdk_bdev_event_type type, struct spdk_bdev* bdev, void* ctx) {
+        std::ignore = ctx;
+        PLOG_WARN(("desc", "unhandled bdev event")("type", static_cast<int>(type))("bdev", spdk_bdev_get_name(bdev)));
+    }
+
+    Future<Status> submit(Request* request) {
+        auto future = request->promise.get_future();
+        _inflight.fetch_add(1, std::memory_order_relaxed);
+        if (!_env->run([request]() {
+                request->device->submit_on_app_thread(request);
+            })) {
+            finish(request, Status(ENOMEM, "failed to send message to spdk"));
+        }
+        return future;
+    }
+
+    void submit_on_app_thread(Request* request) {
+        int rc = 0;
+        switch (request->type) {
+        case Request::kWrite:
+            rc = spdk_bdev_write(_desc, _channel, request->dma, request->offset, request->size, on_complete, request);
+            break;
+        case Request::kRead:
+            rc = spdk_bdev_read(_desc, _channel, request->dma, request->offset, request->size, on_complete, request);
+            break;
+        case Request::kFlush:
+            rc = spdk_bdev_flush(_desc, _channel, request->offset, request->size, on_complete, request);
+            break;
+        }
+        if (rc == -ENOMEM) {
+            // the bdev_io pool is exhausted, retry once a bdev_io is released
+            request->wait.bdev = _bdev;
+            request->wait.cb_fn = [](void* arg) {
+                auto* request = static_cast<Request*>(arg);
+                request->device->submit_on_app_thread(request);
+            };
+            request->wait.cb_arg = request;
+            rc = spdk_bdev_queue_io_wait(_bdev, _channel, &request->wait);
+        }
+        if (rc != 0) {
+            finish(request, Status(-rc, "failed to submit bdev io"));
+        }
+    }
+
+    static void on_complete(struct spdk_bdev_io* bdev_io, bool success, void* arg) {
+        spdk_bdev_free_io(bdev_io);
+        auto* request = static_cast<Request*>(arg);
+        request->device->finish(request, success ? Status::OK() : Status(EIO, "bdev io failed"));
+    }
+
+    void finish(Request* request, Status status) {
+        if (status.ok() && request->type == Request::kRead) {
+            // the dma buffer is handed over to the IOBuf without copying
+            request->buf->clear();
+            request->buf->append_user_data(request->dma, request->size, spdk_dma_free);
+        } else if (request->dma != nullptr) {
+            spdk_dma_free(request->dma);
+        }
+        _inflight.fetch_sub(1, std::memory_order_relaxed);
+        // the continuations of the promise take bthread mutexes and run brpc closures, which must not
+        // stall the reactor polling the bdevs, so the promise is completed on a bthread
+        request->status = std::move(status);
+        bthread_t tid = 0;
+        if (bthread_start_background(&tid, nullptr, complete, request) != 0) {
+            complete(request);
+        }
+    }
+
+    static void* complete(void* arg) {
+        std::unique_ptr<Request> request(static_cast<Request*>(arg));
+        request->promise.set_value(std::move(request->status));
+        return nullptr;
+    }
+
+    SpdkEnv* _env;
+    struct spdk_bdev_desc* _desc = nullptr;
+    struct spdk_bdev* _bdev = nullptr;
+    struct spdk_io_channel* _channel = nullptr;
+    uint32_t _block_size = 0;
+    uint64_t _capacity = 0;
+    size_t _buf_align = 1;
+    bool _flush_supported = false;
+    std::atomic<uint64_t> _inflight = 0;
+};
+
+} // namespace
+
+Status open_spdk_device(const char* bdev_name, BlockDevicePtr* device) {
+    auto* env = SpdkEnv::instance();
+    if (env == nullptr) {
+        return Status(EIO, "spdk is not started");
+    }
+    auto spdk_device = std::make_unique<SpdkBlockDevice>(env);
+    auto status = spdk_device->open(bdev_name);
+    if (!status.ok()) {
+        return status;
+    }
+    *device = std::move(spdk_device);
+    return Status::OK();
+}
+
+Status create_spdk_store(const char* bdev_name, StorePtr* store) {
+    BlockDevicePtr device;
+    auto status = open_spdk_device(bdev_name, &device);
+    if (!status.ok()) {
+        return status;
+    }
+    LogStoreOptions options;
+    options.segment_size = FLAGS_manusya_spdk_segment_size;
+    options.meta_size = FLAGS_manusya_spdk_meta_size;
+    options.format = FLAGS_manusya_spdk_format;
+    auto* log_store = new LogStore(std::move(device), options);
+    StorePtr holder(log_store);
+    status = log_store->init();
+    if (!status.ok()) {
+        return status;
+    }
+    *store = std::move(holder);
+    return Status::OK();
+}
+
+} // namespace pain::manusya
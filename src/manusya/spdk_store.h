@@ -0,0 +1,18 @@
+#pragma once
+
+#include <pain/base/types.h>
+#include "manusya/block_device.h"
+#include "manusya/store.h"
+
+namespace pain::manusya {
+
+// open the spdk bdev named bdev_name as a BlockDevice.
+// spdk is started on first use with the json config of --manusya_spdk_config, which creates the bdevs,
+// e.g. bdev_nvme_attach_controller for a nvme namespace, bdev_malloc_create or bdev_aio_create for tests.
+// requests are submitted to the spdk app thread, the futures are completed on it by the polled completions.
+Status open_spdk_device(const char* bdev_name, BlockDevicePtr* device);
+
+// a LogStore on the spdk bdev, see LogStore
+Status create_spdk_store(const char* bdev_name, StorePtr* store);
+
+} // namespace pain::manusya
@@ -1,21 +1,42 @@
 #include "manusya/store.h"
 
+#include <pain/base/plog.h>
 #include <format>
 #include <boost/assert.hpp>
 
 #include "manusya/local_store.h"
 #include "manusya/mem_store.h"
+#include "manusya/spdk_store.h"
+#include "manusya/uring_store.h"
 
 namespace pain::manusya {
 
 StorePtr Store::create(const char* uri) {
     constexpr size_t local_prefix_len = 8;
     constexpr size_t memory_prefix_len = 9;
+    constexpr size_t uring_prefix_len = 8;
+    constexpr size_t spdk_prefix_len = 7;
     if (strncmp(uri, "local://", local_prefix_len) == 0) {
         const char* data_path = uri + local_prefix_len;
         return StorePtr(new LocalStore(data_path));
     }
 
+    if (strncmp(uri, "uring://", uring_prefix_len) == 0) {
+        const char* data_path = uri + uring_prefix_len;
+        return StorePtr(new UringStore(data_path));
+    }
+
+    if (strncmp(uri, "spdk://", spdk_prefix_len) == 0) {
+        const char* bdev_name = uri + spdk_prefix_len;
+        StorePtr store;
+        auto status = create_spdk_store(bdev_name, &store);
+        if (!status.ok()) {
+            PLOG_ERROR(("desc", "failed to create spdk store")("bdev", bdev_name)("error", status.error_str()));
+            return nullptr;
+        }
+        return store;
+    }
+
     if (strncmp(uri, "memory://", memory_prefix_len) == 0) {
         return StorePtr(new MemStore());
     }
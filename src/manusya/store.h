@@ -19,18 +19,31 @@ public:
 
     // support:
     //   local:///path/to/dir
+    //   uring:///path/to/dir
     //   memory://
+    //   spdk://<bdev name>, a LogStore on the spdk bdev, nullptr if it can't be opened
+    // a manusya with several disks has one store per disk, see Bank
     static StorePtr create(const char* uri);
     virtual Future<Status> open(const char* path, int flags, FileHandlePtr* fh) = 0;
-    virtual Future<Status> append(FileHandlePtr fh, uint64_t offset, IOBuf buf) = 0;
-    virtual Future<Status> read(FileHandlePtr fh, uint64_t offset, uint64_t size, IOBuf* buf) = 0;
+    // direct_io is a hint, the store may bypass its cache for the request, e.g. by O_DIRECT
+    virtual Future<Status> append(FileHandlePtr fh, uint64_t offset, IOBuf buf, bool direct_io = false) = 0;
+    virtual Future<Status>
+    read(FileHandlePtr fh, uint64_t offset, uint64_t size, IOBuf* buf, bool direct_io = false) = 0;
     virtual Future<Status> seal(FileHandlePtr fh) = 0;
+    // make the written data durable
+    virtual Future<Status> sync(FileHandlePtr fh) = 0;
     virtual Future<Status> size(FileHandlePtr fh, uint64_t* size) = 0;
     virtual Future<Status> remove(const char* path) = 0;
     virtual Future<Status> set_attr(FileHandlePtr fh, const char* key, const char* value) = 0;
     virtual Future<Status> get_attr(FileHandlePtr fh, const char* key, std::string* value) = 0;
     virtual Future<Status> list_attrs(FileHandlePtr fh, std::map<std::string, std::string>* attrs) = 0;
     virtual void for_each(std::function<void(const char* path)> cb) = 0;
+    // the capacity and the free bytes of the device the store is on
+    virtual Future<Status> space(uint64_t* capacity, uint64_t* available) = 0;
+    // the number of data requests in flight, the bank places new chunks on the less busy stores
+    virtual uint64_t queue_depth() const {
+        return 0;
+    }
 
     int use_count() const {
         return _use_count;
@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstring>
+#include "manusya/aligned_buffer_pool.h"
+
+// NOLINTBEGIN(readability-magic-numbers)
+namespace {
+using namespace pain;
+using namespace pain::manusya;
+
+TEST(TestAlignedBufferPool, Align) {
+    ASSERT_EQ(align_down(0), 0);
+    ASSERT_EQ(align_down(4095), 0);
+    ASSERT_EQ(align_down(4096), 4096);
+    ASSERT_EQ(align_up(0), 0);
+    ASSERT_EQ(align_up(1), 4096);
+    ASSERT_EQ(align_up(4096), 4096);
+    ASSERT_EQ(align_up(4097), 8192);
+}
+
+TEST(TestAlignedBufferPool, AcquireAndRelease) {
+    AlignedBufferPool pool(8192, 2);
+    ASSERT_EQ(pool.buffer_size(), 8192);
+
+    void* a = pool.acquire();
+    void* b = pool.acquire();
+    void* c = pool.acquire();
+    ASSERT_NE(a, nullptr);
+    ASSERT_NE(b, nullptr);
+    ASSERT_NE(c, nullptr);
+    for (auto* buffer : {a, b, c}) {
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(buffer) % kDirectIOAlignment, 0);
+    }
+
+    // 空闲的 buffer 最多保留 2 个，其余的直接释放
+    pool.release(a);
+    pool.release(b);
+    pool.release(c);
+    ASSERT_EQ(pool.free_buffers(), 2);
+
+    // 释放的 buffer 被复用
+    void* d = pool.acquire();
+    ASSERT_TRUE(d == a || d == b);
+    ASSERT_EQ(pool.free_buffers(), 1);
+    pool.release(d);
+}
+
+TEST(TestAlignedBufferPool, AppendToIOBuf) {
+    auto& pool = AlignedBufferPool::instance();
+    auto* buffer = static_cast<char*>(pool.acquire());
+    ASSERT_NE(buffer, nullptr);
+    memset(buffer, 'x', 100);
+    auto free_buffers = pool.free_buffers();
+    {
+        IOBuf buf;
+        AlignedBufferPool::append_to(buffer, 100, &buf);
+        ASSERT_EQ(buf.to_string(), std::string(100, 'x'));
+    }
+    // IOBuf 释放后 buffer 回到 pool
+    ASSERT_EQ(pool.free_buffers(), free_buffers + 1);
+}
+
+} // namespace
+// NOLINTEND(readability-magic-numbers)
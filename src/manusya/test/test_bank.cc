@@ -1,6 +1,8 @@
+#include <gflags/gflags.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include <algorithm>
+#include <atomic>
 #include <set>
 #include <thread>
 #include <fmt/format.h>
@@ -8,6 +10,10 @@
 #include "manusya/bank.h"
 #include "manusya/mem_store.h"
 
+DECLARE_bool(manusya_lazy_load);
+DECLARE_uint32(manusya_load_concurrency);
+DECLARE_uint64(manusya_disk_reserved_bytes);
+
 // NOLINTBEGIN(readability-magic-numbers)
 namespace {
 using namespace pain;
@@ -18,7 +24,7 @@ protected:
     void SetUp() override {
         _store = Store::create("memory://");
         ASSERT_TRUE(_store != nullptr);
-        _bank = std::make_unique<Bank>(_store);
+        _bank = std::make_unique<Bank>(_store, "test_bank");
     }
 
     void TearDown() override {
@@ -28,6 +34,34 @@ protected:
 
     StorePtr _store;
     std::unique_ptr<Bank> _bank;
+
+    // 创建 count 个 chunk，写入数据，封存其中偶数个
+    std::vector<UUID> prepare_chunks(int count) {
+        std::vector<UUID> uuids;
+        for (int i = 0; i < count; ++i) {
+            ChunkPtr chunk;
+            EXPECT_TRUE(_bank->create_chunk({}, &chunk).ok());
+            IOBuf buf;
+            buf.append(std::string(i + 1, 'x'));
+            EXPECT_TRUE(chunk->append(buf, 0).ok());
+            if (i % 2 == 0) {
+                uint64_t size = 0;
+                EXPECT_TRUE(chunk->query_and_seal(&size).ok());
+            }
+            uuids.push_back(chunk->uuid());
+        }
+        return uuids;
+    }
+};
+
+// 统计 open 次数的 store
+class CountingStore : public MemStore {
+public:
+    Future<Status> open(const char* path, int flags, FileHandlePtr* fh) override {
+        _open_count++;
+        return MemStore::open(path, flags, fh);
+    }
+    std::atomic<int> _open_count = 0;
 };
 
 TEST_F(TestBank, BasicCreateChunk) {
@@ -174,6 +208,35 @@ TEST_F(TestBank, ListChunkWithStartUUID) {
     ASSERT_EQ(listed_uuids[0].str(), created_uuids[1].str()) << "First listed UUID should match start UUID";
 }
 
+TEST_F(TestBank, ListChunkOrderedAcrossShards) {
+    ChunkOptions options;
+    std::vector<UUID> created_uuids;
+
+    // chunk 分布在不同的 shard 中，list 仍然按 UUID 有序
+    for (int i = 0; i < 200; ++i) {
+        ChunkPtr chunk;
+        auto status = _bank->create_chunk(options, &chunk);
+        ASSERT_TRUE(status.ok());
+        created_uuids.push_back(chunk->uuid());
+    }
+    std::sort(created_uuids.begin(), created_uuids.end());
+
+    std::vector<UUID> listed_uuids;
+    _bank->list_chunk(UUID(0, 0), 1000, [&listed_uuids](UUID uuid) {
+        listed_uuids.push_back(uuid);
+    });
+    ASSERT_EQ(listed_uuids, created_uuids);
+
+    // 删除后不再出现在 list 中
+    ASSERT_TRUE(_bank->remove_chunk(created_uuids[0]).ok());
+    listed_uuids.clear();
+    _bank->list_chunk(UUID(0, 0), 1000, [&listed_uuids](UUID uuid) {
+        listed_uuids.push_back(uuid);
+    });
+    ASSERT_EQ(listed_uuids.size(), created_uuids.size() - 1);
+    ASSERT_EQ(listed_uuids.front(), created_uuids[1]);
+}
+
 TEST_F(TestBank, LoadEmptyStore) {
     auto status = _bank->load();
     ASSERT_TRUE(status.ok()) << "Load should succeed even with empty store";
@@ -278,5 +341,209 @@ TEST_F(TestBank, ErrorHandling) {
     ASSERT_EQ(status.error_code(), ENOENT);
 }
 
+TEST_F(TestBank, LoadChunks) {
+    gflags::FlagSaver saver;
+    FLAGS_manusya_load_concurrency = 4;
+    auto uuids = prepare_chunks(20);
+
+    // 重启后从 store 中加载所有 chunk
+    Bank bank(_store, "test_bank_reloaded");
+    auto status = bank.load();
+    ASSERT_TRUE(status.ok()) << status.error_str();
+
+    std::vector<UUID> listed;
+    bank.list_chunk(UUID(0, 0), 100, [&listed](UUID uuid) {
+        listed.push_back(uuid);
+    });
+    ASSERT_EQ(listed.size(), uuids.size());
+
+    for (size_t i = 0; i < uuids.size(); ++i) {
+        ChunkPtr chunk;
+        status = bank.get_chunk(uuids[i], &chunk);
+        ASSERT_TRUE(status.ok()) << status.error_str();
+        // 未封存的 chunk 在加载时封存
+        ASSERT_EQ(chunk->state(), ChunkState::kSealed);
+        ASSERT_EQ(chunk->size(), i + 1);
+        IOBuf buf;
+        ASSERT_TRUE(chunk->read(0, i + 1, &buf).ok());
+        ASSERT_EQ(buf.to_string(), std::string(i + 1, 'x'));
+    }
+}
+
+TEST_F(TestBank, LoadSkipsUnknownFiles) {
+    auto uuids = prepare_chunks(2);
+    FileHandlePtr fh;
+    ASSERT_TRUE(_store->open("not_a_chunk", O_CREAT | O_RDWR, &fh).get().ok());
+
+    Bank bank(_store, "test_bank_reloaded");
+    ASSERT_TRUE(bank.load().ok());
+    std::vector<UUID> listed;
+    bank.list_chunk(UUID(0, 0), 100, [&listed](UUID uuid) {
+        listed.push_back(uuid);
+    });
+    ASSERT_EQ(listed.size(), 2);
+}
+
+// 加载时封存失败的 chunk 不注册，不能再写入
+TEST_F(TestBank, LoadSkipsChunksFailedToSeal) {
+    class SealFailingStore : public MemStore {
+    public:
+        Future<Status> seal(FileHandlePtr fh) override {
+            if (_fail) {
+                return make_ready_future(Status(EIO, "seal failed"));
+            }
+            return MemStore::seal(fh);
+        }
+        std::atomic<bool> _fail = false;
+    };
+    auto* store = new SealFailingStore();
+    StorePtr store_ptr(store);
+    _bank.reset();
+    _bank = std::make_unique<Bank>(store_ptr, "test_bank");
+    auto uuids = prepare_chunks(4);
+
+    store->_fail = true;
+    Bank bank(store_ptr, "test_bank_reloaded");
+    ASSERT_TRUE(bank.load().ok());
+    ASSERT_EQ(bank._load_failed_chunks.get_value(), 2);
+    for (size_t i = 0; i < uuids.size(); ++i) {
+        ChunkPtr chunk;
+        auto status = bank.get_chunk(uuids[i], &chunk);
+        if (i % 2 == 0) {
+            ASSERT_TRUE(status.ok()) << status.error_str();
+        } else {
+            ASSERT_EQ(status.error_code(), ENOENT);
+        }
+    }
+}
+
+TEST_F(TestBank, LazyLoad) {
+    gflags::FlagSaver saver;
+    FLAGS_manusya_lazy_load = true;
+    auto* store = new CountingStore();
+    StorePtr store_ptr(store);
+    _bank = std::make_unique<Bank>(store_ptr, "test_bank_lazy");
+    auto uuids = prepare_chunks(10);
+
+    // 加载时只注册 uuid，不打开文件
+    Bank bank(store_ptr, "test_bank_reloaded");
+    store->_open_count = 0;
+    ASSERT_TRUE(bank.load().ok());
+    ASSERT_EQ(store->_open_count, 0);
+    std::vector<UUID> listed;
+    bank.list_chunk(UUID(0, 0), 100, [&listed](UUID uuid) {
+        listed.push_back(uuid);
+    });
+    ASSERT_EQ(listed.size(), uuids.size());
+
+    // 第一次访问时打开，并发访问只打开一次
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; ++i) {
+        threads.emplace_back([&bank, &uuids]() {
+            ChunkPtr chunk;
+            auto status = bank.get_chunk(uuids[1], &chunk);
+            ASSERT_TRUE(status.ok()) << status.error_str();
+            ASSERT_EQ(chunk->size(), 2);
+            ASSERT_EQ(chunk->state(), ChunkState::kSealed);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    ASSERT_EQ(store->_open_count, 1);
+
+    // 未打开的 chunk 也可以删除
+    ASSERT_TRUE(bank.remove_chunk(uuids[2]).ok());
+    ChunkPtr chunk;
+    ASSERT_EQ(bank.get_chunk(uuids[2], &chunk).error_code(), ENOENT);
+}
+
+TEST_F(TestBank, MultipleDisks) {
+    std::vector<StorePtr> stores;
+    for (int i = 0; i < 3; ++i) {
+        stores.push_back(StorePtr(new MemStore()));
+    }
+    Bank bank(stores, "test_bank_disks");
+    ASSERT_EQ(bank.disk_count(), 3);
+
+    // chunk 分布在所有磁盘上，并路由到所在的磁盘
+    std::vector<int> counts(3, 0);
+    std::vector<UUID> uuids;
+    for (int i = 0; i < 300; ++i) {
+        ChunkPtr chunk;
+        ASSERT_TRUE(bank.create_chunk({}, &chunk).ok());
+        IOBuf buf;
+        buf.append(std::to_string(i));
+        ASSERT_TRUE(chunk->append(buf, 0).ok());
+        int disk = bank.disk_of(chunk->uuid());
+        ASSERT_GE(disk, 0);
+        ASSERT_EQ(chunk->store(), stores[disk]);
+        counts[disk]++;
+        uuids.push_back(chunk->uuid());
+    }
+    for (int count : counts) {
+        ASSERT_GT(count, 0);
+    }
+
+    // 重启后从所有磁盘加载，chunk 仍在原来的磁盘上
+    Bank reloaded(stores, "test_bank_reloaded");
+    ASSERT_TRUE(reloaded.load().ok());
+    for (size_t i = 0; i < uuids.size(); ++i) {
+        ChunkPtr chunk;
+        ASSERT_TRUE(reloaded.get_chunk(uuids[i], &chunk).ok());
+        ASSERT_EQ(reloaded.disk_of(uuids[i]), bank.disk_of(uuids[i]));
+        IOBuf buf;
+        ASSERT_TRUE(chunk->read(0, std::to_string(i).size(), &buf).ok());
+        ASSERT_EQ(buf.to_string(), std::to_string(i));
+    }
+
+    // 删除 chunk 时删除所在磁盘上的文件
+    int disk = reloaded.disk_of(uuids[0]);
+    ASSERT_TRUE(reloaded.remove_chunk(uuids[0]).ok());
+    FileHandlePtr fh;
+    ASSERT_FALSE(stores[disk]->open(uuids[0].str().c_str(), O_RDONLY, &fh).get().ok());
+    ASSERT_EQ(reloaded.disk_of(uuids[0]), -1);
+}
+
+TEST_F(TestBank, PlacementByFreeSpace) {
+    gflags::FlagSaver saver;
+    FLAGS_manusya_disk_reserved_bytes = 1024;
+
+    // 剩余空间不足的磁盘不放置新的 chunk
+    std::vector<StorePtr> stores = {StorePtr(new MemStore(512)), StorePtr(new MemStore(1UL << 30))};
+    Bank bank(stores, "test_bank_disks");
+    for (int i = 0; i < 50; ++i) {
+        ChunkPtr chunk;
+        ASSERT_TRUE(bank.create_chunk({}, &chunk).ok());
+        ASSERT_EQ(bank.disk_of(chunk->uuid()), 1);
+    }
+
+    Bank full({StorePtr(new MemStore(512)), StorePtr(new MemStore(512))}, "test_bank_full");
+    ChunkPtr chunk;
+    ASSERT_EQ(full.create_chunk({}, &chunk).error_code(), ENOSPC);
+}
+
+TEST_F(TestBank, PlacementByQueueDepth) {
+    // 队列深度固定的 store
+    class BusyStore : public MemStore {
+    public:
+        BusyStore(uint64_t depth) : _depth(depth) {}
+        uint64_t queue_depth() const override {
+            return _depth;
+        }
+        uint64_t _depth;
+    };
+
+    // 空间相同时，队列较短的磁盘得到更多的 chunk
+    Bank bank({StorePtr(new BusyStore(100)), StorePtr(new BusyStore(0))}, "test_bank_disks");
+    std::vector<int> counts(2, 0);
+    for (int i = 0; i < 1000; ++i) {
+        ChunkPtr chunk;
+        ASSERT_TRUE(bank.create_chunk({}, &chunk).ok());
+        counts[bank.disk_of(chunk->uuid())]++;
+    }
+    ASSERT_GT(counts[1], counts[0] * 2) << fmt::format("{}", counts);
+}
+
 } // namespace
 // NOLINTEND(readability-magic-numbers)
@@ -1,12 +1,23 @@
 #include <gmock/gmock.h>
+#include <gflags/gflags.h>
 #include <gtest/gtest.h>
 #include <algorithm>
+#include <chrono>
+#include <deque>
+#include <format>
 #include <future>
 #include <thread>
 #include <vector>
+#include <butil/crc32c.h>
 #include "manusya/chunk.h"
+#include "manusya/chunk_format.h"
 #include "manusya/mem_store.h"
 
+DECLARE_uint32(manusya_append_reorder_timeout_ms);
+DECLARE_uint32(manusya_append_reorder_window_requests);
+DECLARE_uint32(manusya_checksum_block_size);
+DECLARE_bool(manusya_verify_checksum);
+
 // NOLINTBEGIN(readability-magic-numbers)
 namespace {
 using namespace pain;
@@ -69,6 +80,22 @@ TEST_F(TestChunk, CreateWithUUID) {
     ASSERT_EQ(chunk->uuid().str(), uuid.str());
 }
 
+// deva 指定 uuid 创建新 chunk，同一个 uuid 不能创建两次
+TEST_F(TestChunk, CreateWithOptionsUUID) {
+    ChunkOptions options;
+    options.uuid = UUID::generate();
+    ChunkPtr chunk;
+
+    auto status = Chunk::create(options, _store, &chunk);
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(chunk->state(), ChunkState::kOpen);
+    ASSERT_EQ(chunk->uuid().str(), options.uuid->str());
+
+    ChunkPtr duplicate;
+    status = Chunk::create(options, _store, &duplicate);
+    ASSERT_FALSE(status.ok());
+}
+
 TEST_F(TestChunk, CreateMultipleChunks) {
     ChunkOptions options;
     std::vector<ChunkPtr> chunks;
@@ -578,6 +605,37 @@ TEST_F(TestChunk, ConcurrentReads) {
     }
 }
 
+TEST_F(TestChunk, ReadReusesFileHandle) {
+    // 统计 open 次数的 store
+    class CountingStore : public MemStore {
+    public:
+        Future<Status> open(const char* path, int flags, FileHandlePtr* fh) override {
+            _open_count++;
+            return MemStore::open(path, flags, fh);
+        }
+        std::atomic<int> _open_count = 0;
+    };
+    auto store = new CountingStore();
+    StorePtr store_ptr(store);
+
+    ChunkPtr chunk;
+    auto status = Chunk::create({}, store_ptr, &chunk);
+    ASSERT_TRUE(status.ok()) << "Failed to create chunk: " << status.error_str();
+    ASSERT_EQ(store->_open_count, 1);
+
+    status = chunk->append(create_test_data("Hello, World!"), 0);
+    ASSERT_TRUE(status.ok()) << "Failed to append data: " << status.error_str();
+
+    // 读取不应该重新打开文件
+    for (int i = 0; i < 100; ++i) {
+        IOBuf read_buf;
+        status = chunk->read(7, 5, &read_buf);
+        ASSERT_TRUE(status.ok()) << "Failed to read data: " << status.error_str();
+        verify_iobuf_content(read_buf, "World");
+    }
+    ASSERT_EQ(store->_open_count, 1);
+}
+
 // 内存管理测试
 TEST_F(TestChunk, ReferenceCounting) {
     ChunkOptions options;
@@ -723,6 +781,234 @@ TEST_F(TestChunk, AppendRequestOrdering) {
     ASSERT_EQ(chunk->size(), 18); // 最大偏移量 + 数据长度
 }
 
+TEST_F(TestChunk, OutOfOrderAppendsCoalesced) {
+    // 统计 append 次数的 store
+    class CountingStore : public MemStore {
+    public:
+        Future<Status> append(FileHandlePtr fh, uint64_t offset, IOBuf buf, bool direct_io) override {
+            _append_count++;
+            return MemStore::append(fh, offset, std::move(buf), direct_io);
+        }
+        std::atomic<int> _append_count = 0;
+    };
+    auto store = new CountingStore();
+    StorePtr store_ptr(store);
+
+    ChunkPtr chunk;
+    auto status = Chunk::create({}, store_ptr, &chunk);
+    ASSERT_TRUE(status.ok()) << "Failed to create chunk: " << status.error_str();
+
+    // 乱序到达的请求在窗口中等待
+    std::vector<std::future<Status>> futures;
+    for (uint64_t offset : {15, 10, 5}) {
+        futures.emplace_back(std::async(std::launch::async, [this, chunk, offset]() {
+            return chunk->append(create_test_data("01234"), offset);
+        }));
+        while (chunk->pending_append_count() < futures.size()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    status = chunk->append(create_test_data("01234"), 0);
+    ASSERT_TRUE(status.ok()) << "Failed to append data: " << status.error_str();
+    for (auto& future : futures) {
+        status = future.get();
+        ASSERT_TRUE(status.ok()) << "Failed to append queued data: " << status.error_str();
+    }
+    ASSERT_EQ(chunk->size(), 20);
+    ASSERT_EQ(chunk->pending_append_count(), 0);
+    // 顺序请求和窗口中连续的请求合并为一次写入
+    ASSERT_EQ(store->_append_count, 1);
+
+    IOBuf read_buf;
+    status = chunk->read(0, 20, &read_buf);
+    ASSERT_TRUE(status.ok()) << "Failed to read data: " << status.error_str();
+    verify_iobuf_content(read_buf, "01234012340123401234");
+}
+
+TEST_F(TestChunk, AppendBeyondReorderWindow) {
+    ChunkPtr chunk;
+    auto status = Chunk::create({}, _store, &chunk);
+    ASSERT_TRUE(status.ok()) << "Failed to create chunk: " << status.error_str();
+
+    // 超出窗口的请求立即失败，不排队
+    status = chunk->append(create_test_data("Hello"), 1UL << 40);
+    ASSERT_FALSE(status.ok());
+    ASSERT_EQ(status.error_code(), EINVAL);
+    ASSERT_EQ(chunk->pending_append_count(), 0);
+}
+
+TEST_F(TestChunk, ReorderWindowFull) {
+    gflags::FlagSaver saver;
+    FLAGS_manusya_append_reorder_window_requests = 1;
+
+    ChunkPtr chunk;
+    auto status = Chunk::create({}, _store, &chunk);
+    ASSERT_TRUE(status.ok()) << "Failed to create chunk: " << status.error_str();
+
+    auto future = std::async(std::launch::async, [this, chunk]() {
+        return chunk->append(create_test_data("World"), 5);
+    });
+    while (chunk->pending_append_count() < 1) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    status = chunk->append(create_test_data("Data"), 10);
+    ASSERT_FALSE(status.ok());
+    ASSERT_EQ(status.error_code(), EAGAIN);
+
+    // 同一偏移量的请求不能重复排队
+    FLAGS_manusya_append_reorder_window_requests = 2;
+    status = chunk->append(create_test_data("World"), 5);
+    ASSERT_FALSE(status.ok());
+    ASSERT_EQ(status.error_code(), EINVAL);
+
+    status = chunk->append(create_test_data("Hello"), 0);
+    ASSERT_TRUE(status.ok()) << "Failed to append data: " << status.error_str();
+    status = future.get();
+    ASSERT_TRUE(status.ok()) << "Failed to append queued data: " << status.error_str();
+    ASSERT_EQ(chunk->size(), 10);
+}
+
+TEST_F(TestChunk, ReorderWindowExpire) {
+    gflags::FlagSaver saver;
+    FLAGS_manusya_append_reorder_timeout_ms = 100;
+
+    ChunkOptions options;
+    options.timer_wheel = std::make_shared<TimerWheel>(10 * 1000, 16);
+    ChunkPtr chunk;
+    auto status = Chunk::create(options, _store, &chunk);
+    ASSERT_TRUE(status.ok()) << "Failed to create chunk: " << status.error_str();
+
+    auto start = std::chrono::steady_clock::now();
+    status = chunk->append(create_test_data("World"), 5);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_FALSE(status.ok());
+    ASSERT_EQ(status.error_code(), EINVAL);
+    ASSERT_TRUE(status.error_str().find("invalid offset at 5@5, current size:0") != std::string::npos);
+    ASSERT_GE(elapsed, std::chrono::milliseconds(100));
+    ASSERT_LT(elapsed, std::chrono::seconds(2));
+    ASSERT_EQ(chunk->pending_append_count(), 0);
+}
+
+TEST_F(TestChunk, SealFailsPendingAppends) {
+    ChunkPtr chunk;
+    auto status = Chunk::create({}, _store, &chunk);
+    ASSERT_TRUE(status.ok()) << "Failed to create chunk: " << status.error_str();
+
+    auto future = std::async(std::launch::async, [this, chunk]() {
+        return chunk->append(create_test_data("World"), 5);
+    });
+    while (chunk->pending_append_count() < 1) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    uint64_t length = 0;
+    status = chunk->query_and_seal(&length);
+    ASSERT_TRUE(status.ok()) << "Failed to seal chunk: " << status.error_str();
+    status = future.get();
+    ASSERT_FALSE(status.ok());
+    ASSERT_EQ(status.error_code(), EPERM);
+}
+
+TEST_F(TestChunk, AsyncAppendPipelined) {
+    // append 由测试手动完成的 store
+    class DeferredStore : public MemStore {
+    public:
+        Future<Status> append(FileHandlePtr fh, uint64_t offset, IOBuf buf, bool direct_io) override {
+            std::ignore = direct_io;
+            _pending.push_back({fh, offset, std::move(buf), Promise<Status>()});
+            return _pending.back().promise.get_future();
+        }
+        void complete_one() {
+            auto write = std::move(_pending.front());
+            _pending.pop_front();
+            write.promise.set_value(MemStore::append(write.fh, write.offset, std::move(write.buf)).get());
+        }
+        struct Write {
+            FileHandlePtr fh;
+            uint64_t offset;
+            IOBuf buf;
+            Promise<Status> promise;
+        };
+        std::deque<Write> _pending;
+    };
+    auto store = new DeferredStore();
+    StorePtr store_ptr(store);
+
+    ChunkPtr chunk;
+    auto status = Chunk::create({}, store_ptr, &chunk);
+    ASSERT_TRUE(status.ok()) << "Failed to create chunk: " << status.error_str();
+
+    // 写入未完成时不阻塞调用者
+    auto f1 = chunk->async_append(create_test_data("Hello"), 0);
+    auto f2 = chunk->async_append(create_test_data("World"), 5);
+    auto f3 = chunk->async_append(create_test_data("Data"), 10);
+    ASSERT_FALSE(f1.is_ready());
+    ASSERT_FALSE(f2.is_ready());
+    ASSERT_EQ(store->_pending.size(), 1);
+    ASSERT_EQ(chunk->pending_append_count(), 2);
+
+    // 第一次写完成后，窗口中连续的请求合并为一次写入
+    store->complete_one();
+    ASSERT_TRUE(f1.get().ok());
+    ASSERT_EQ(chunk->size(), 5);
+    ASSERT_EQ(store->_pending.size(), 1);
+    ASSERT_EQ(chunk->pending_append_count(), 0);
+    ASSERT_FALSE(f2.is_ready());
+
+    store->complete_one();
+    ASSERT_TRUE(f2.get().ok());
+    ASSERT_TRUE(f3.get().ok());
+    ASSERT_EQ(chunk->size(), 14);
+
+    IOBuf read_buf;
+    status = chunk->async_read(0, 14, &read_buf).get();
+    ASSERT_TRUE(status.ok()) << "Failed to read data: " << status.error_str();
+    verify_iobuf_content(read_buf, "HelloWorldData");
+}
+
+TEST_F(TestChunk, DirectIoHint) {
+    // 记录每次写入和读取是否要求 direct io 的 store
+    class RecordingStore : public MemStore {
+    public:
+        Future<Status> append(FileHandlePtr fh, uint64_t offset, IOBuf buf, bool direct_io) override {
+            _append_direct_io.push_back(direct_io);
+            return MemStore::append(fh, offset, std::move(buf), direct_io);
+        }
+        Future<Status> read(FileHandlePtr fh, uint64_t offset, uint64_t size, IOBuf* buf, bool direct_io) override {
+            _read_direct_io.push_back(direct_io);
+            return MemStore::read(fh, offset, size, buf, direct_io);
+        }
+        std::vector<bool> _append_direct_io;
+        std::vector<bool> _read_direct_io;
+    };
+    auto store = new RecordingStore();
+    StorePtr store_ptr(store);
+
+    ChunkPtr chunk;
+    auto status = Chunk::create({}, store_ptr, &chunk);
+    ASSERT_TRUE(status.ok()) << "Failed to create chunk: " << status.error_str();
+
+    // 合并写入中只要有一个请求不要求 direct io，整个写入就走 page cache
+    auto f2 = chunk->async_append(create_test_data("World"), 5, true);
+    auto f3 = chunk->async_append(create_test_data("Data"), 10, false);
+    auto f1 = chunk->async_append(create_test_data("Hello"), 0, true);
+    ASSERT_TRUE(f1.get().ok());
+    ASSERT_TRUE(f2.get().ok());
+    ASSERT_TRUE(f3.get().ok());
+    ASSERT_EQ(store->_append_direct_io, std::vector<bool>{false});
+
+    ASSERT_TRUE(chunk->async_append(create_test_data("Tail"), 14, true).get().ok());
+    ASSERT_EQ(store->_append_direct_io, (std::vector<bool>{false, true}));
+
+    IOBuf read_buf;
+    status = chunk->async_read(0, 18, &read_buf, true).get();
+    ASSERT_TRUE(status.ok()) << "Failed to read data: " << status.error_str();
+    verify_iobuf_content(read_buf, "HelloWorldDataTail");
+    ASSERT_EQ(store->_read_direct_io, std::vector<bool>{true});
+}
+
 TEST_F(TestChunk, ChunkOptionsAccess) {
     ChunkOptions options;
     ChunkPtr chunk;
@@ -731,5 +1017,199 @@ TEST_F(TestChunk, ChunkOptionsAccess) {
     ASSERT_TRUE(status.ok()) << "Failed to create chunk: " << status.error_str();
 }
 
+TEST_F(TestChunk, ChecksumsInChunkFile) {
+    gflags::FlagSaver saver;
+    FLAGS_manusya_checksum_block_size = 16;
+
+    ChunkPtr chunk;
+    auto status = Chunk::create({}, _store, &chunk);
+    ASSERT_TRUE(status.ok()) << "Failed to create chunk: " << status.error_str();
+
+    // 写入跨越多个校验块，最后一个块不满
+    std::string data = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMN";
+    uint64_t offset = 0;
+    for (size_t len : {10, 25, 15}) {
+        status = chunk->append(create_test_data(data.substr(offset, len)), offset);
+        ASSERT_TRUE(status.ok()) << "Failed to append data: " << status.error_str();
+        offset += len;
+    }
+    uint64_t size = 0;
+    status = chunk->query_and_seal(&size);
+    ASSERT_TRUE(status.ok()) << "Failed to seal chunk: " << status.error_str();
+    ASSERT_EQ(size, data.size());
+
+    std::vector<uint32_t> expected;
+    for (size_t pos = 0; pos < data.size(); pos += 16) {
+        auto block = data.substr(pos, 16);
+        expected.push_back(butil::crc32c::Value(block.data(), block.size()));
+    }
+    // 校验值写在 chunk 文件的索引中
+    FileHandlePtr fh;
+    ASSERT_TRUE(_store->open(chunk->uuid().str().c_str(), O_RDWR, &fh).get().ok());
+    uint64_t file_size = 0;
+    ASSERT_TRUE(fh->size(&file_size).get().ok());
+    IOBuf file;
+    ASSERT_TRUE(fh->read(0, file_size, &file).get().ok());
+    ChunkHeader header;
+    status = decode_chunk_header(file, chunk->uuid(), &header);
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(header.checksum_block_size, 16);
+    ChunkFooter footer;
+    std::vector<uint32_t> checksums;
+    uint64_t trailer_size = 0;
+    status = decode_chunk_trailer(file, file_size, &footer, &checksums, &trailer_size);
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(footer.data_size, data.size());
+    ASSERT_EQ(checksums, expected);
+    IOBuf stored;
+    file.append_to(&stored, data.size(), kChunkHeaderSize);
+    ASSERT_EQ(stored.to_string(), data);
+}
+
+TEST_F(TestChunk, ReadVerifiesChecksums) {
+    gflags::FlagSaver saver;
+    FLAGS_manusya_checksum_block_size = 16;
+
+    // 读取时翻转第一个字节，模拟磁盘上的数据损坏
+    class CorruptingStore : public MemStore {
+    public:
+        Future<Status> read(FileHandlePtr fh, uint64_t offset, uint64_t size, IOBuf* buf, bool direct_io) override {
+            IOBuf data;
+            auto status = MemStore::read(fh, offset, size, &data, direct_io).get();
+            if (status.ok() && _corrupt && !data.empty()) {
+                auto str = data.to_string();
+                str[0] ^= 0x1;
+                data.clear();
+                data.append(str);
+            }
+            buf->append(data);
+            return make_ready_future(std::move(status));
+        }
+        bool _corrupt = false;
+    };
+    auto store = new CorruptingStore();
+    StorePtr store_ptr(store);
+
+    ChunkPtr chunk;
+    auto status = Chunk::create({}, store_ptr, &chunk);
+    ASSERT_TRUE(status.ok()) << "Failed to create chunk: " << status.error_str();
+    std::string data = "0123456789abcdefghijklmnopqrstuvwxyzABCD";
+    status = chunk->append(create_test_data(data), 0);
+    ASSERT_TRUE(status.ok()) << "Failed to append data: " << status.error_str();
+
+    // 未损坏时，任意范围都可以读到正确的数据
+    for (uint64_t offset = 0; offset < data.size(); offset++) {
+        for (uint64_t len = 0; offset + len <= data.size(); len += 7) {
+            IOBuf buf;
+            status = chunk->read(offset, len, &buf);
+            ASSERT_TRUE(status.ok()) << "Failed to read data: " << status.error_str();
+            ASSERT_EQ(buf.to_string(), data.substr(offset, len));
+        }
+    }
+
+    store->_corrupt = true;
+    IOBuf buf;
+    status = chunk->read(20, 5, &buf);
+    ASSERT_EQ(status.error_code(), EIO);
+    // 未写满的最后一个块还没有校验值
+    buf.clear();
+    status = chunk->read(33, 4, &buf);
+    ASSERT_TRUE(status.ok()) << status.error_str();
+
+    // 封存后最后一个块也会校验
+    uint64_t size = 0;
+    ASSERT_TRUE(chunk->query_and_seal(&size).ok());
+    buf.clear();
+    status = chunk->read(33, 4, &buf);
+    ASSERT_EQ(status.error_code(), EIO);
+
+    FLAGS_manusya_verify_checksum = false;
+    buf.clear();
+    status = chunk->read(20, 5, &buf);
+    ASSERT_TRUE(status.ok()) << status.error_str();
+}
+
+TEST_F(TestChunk, OpenExistingChunk) {
+    gflags::FlagSaver saver;
+    FLAGS_manusya_checksum_block_size = 4;
+
+    ChunkPtr sealed;
+    ASSERT_TRUE(Chunk::create({}, _store, &sealed).ok());
+    ASSERT_TRUE(sealed->append(create_test_data("Hello, World!"), 0).ok());
+    uint64_t size = 0;
+    ASSERT_TRUE(sealed->query_and_seal(&size).ok());
+
+    ChunkPtr unsealed;
+    ASSERT_TRUE(Chunk::create({}, _store, &unsealed).ok());
+    ASSERT_TRUE(unsealed->append(create_test_data("Hello"), 0).ok());
+
+    // 封存的 chunk 从 footer 中得到大小和校验值
+    ChunkPtr chunk;
+    auto status = Chunk::open({}, _store, sealed->uuid(), &chunk);
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(chunk->state(), ChunkState::kSealed);
+    ASSERT_EQ(chunk->size(), 13);
+    IOBuf buf;
+    ASSERT_TRUE(chunk->read(7, 5, &buf).ok());
+    verify_iobuf_content(buf, "World");
+    ASSERT_TRUE(chunk->query_and_seal(&size).ok());
+    ASSERT_EQ(size, 13);
+
+    // 未封存的 chunk 可以继续写入和封存
+    status = Chunk::open({}, _store, unsealed->uuid(), &chunk);
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(chunk->state(), ChunkState::kOpen);
+    ASSERT_EQ(chunk->size(), 5);
+    ASSERT_TRUE(chunk->append(create_test_data(", World!"), 5).ok());
+    ASSERT_TRUE(chunk->query_and_seal(&size).ok());
+    ASSERT_EQ(size, 13);
+    status = Chunk::open({}, _store, unsealed->uuid(), &chunk);
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(chunk->state(), ChunkState::kSealed);
+    buf.clear();
+    ASSERT_TRUE(chunk->read(0, 13, &buf).ok());
+    verify_iobuf_content(buf, "Hello, World!");
+
+    status = Chunk::open({}, _store, UUID::generate(), &chunk);
+    ASSERT_EQ(status.error_code(), ENOENT);
+}
+
+// 旧版本写的 chunk 文件没有 header，按未封存、无校验值的 chunk 加载
+TEST_F(TestChunk, OpenLegacyChunk) {
+    gflags::FlagSaver saver;
+    FLAGS_manusya_checksum_block_size = 4;
+
+    for (const std::string& data : {std::string("Hello"), std::string(kChunkHeaderSize + 100, 'x')}) {
+        auto uuid = UUID::generate();
+        FileHandlePtr fh;
+        ASSERT_TRUE(_store->open(uuid.str().c_str(), O_CREAT | O_RDWR | O_EXCL, &fh).get().ok());
+        ASSERT_TRUE(fh->append(0, create_test_data(data)).get().ok());
+        fh.reset();
+
+        ChunkPtr chunk;
+        auto status = Chunk::open({}, _store, uuid, &chunk);
+        ASSERT_TRUE(status.ok()) << status.error_str();
+        ASSERT_EQ(chunk->state(), ChunkState::kOpen);
+        ASSERT_EQ(chunk->size(), data.size());
+        IOBuf buf;
+        ASSERT_TRUE(chunk->read(0, data.size(), &buf).ok());
+        verify_iobuf_content(buf, data);
+
+        // 继续写入并封存后，重新打开仍然从 0 开始读数据
+        ASSERT_TRUE(chunk->append(create_test_data(", World!"), data.size()).ok());
+        uint64_t size = 0;
+        ASSERT_TRUE(chunk->query_and_seal(&size).ok());
+        ASSERT_EQ(size, data.size() + 8);
+        chunk.reset();
+        status = Chunk::open({}, _store, uuid, &chunk);
+        ASSERT_TRUE(status.ok()) << status.error_str();
+        ASSERT_EQ(chunk->state(), ChunkState::kSealed);
+        ASSERT_EQ(chunk->size(), data.size() + 8);
+        buf.clear();
+        ASSERT_TRUE(chunk->read(0, size, &buf).ok());
+        verify_iobuf_content(buf, data + ", World!");
+    }
+}
+
 } // namespace
 // NOLINTEND(readability-magic-numbers)
@@ -0,0 +1,129 @@
+#include <butil/crc32c.h>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "manusya/chunk_format.h"
+
+// NOLINTBEGIN(readability-magic-numbers)
+namespace {
+using namespace pain;
+using namespace pain::manusya;
+
+// 模拟一个封存的 chunk 文件
+IOBuf make_chunk_file(const UUID& uuid, const std::string& data, uint32_t block_size, std::vector<uint32_t>* checksums) {
+    checksums->clear();
+    for (size_t pos = 0; block_size != 0 && pos < data.size(); pos += block_size) {
+        auto block = data.substr(pos, block_size);
+        checksums->push_back(butil::crc32c::Value(block.data(), block.size()));
+    }
+    IOBuf file = encode_chunk_header(uuid, block_size);
+    file.append(data);
+    file.append(encode_chunk_trailer(data.size(), block_size, *checksums));
+    return file;
+}
+
+TEST(ChunkFormat, Header) {
+    auto uuid = UUID::generate();
+    auto buf = encode_chunk_header(uuid, 4096);
+    ASSERT_EQ(buf.size(), kChunkHeaderSize);
+
+    ChunkHeader header;
+    auto status = decode_chunk_header(buf, uuid, &header);
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(header.version, kChunkFormatVersion);
+    ASSERT_EQ(header.checksum_block_size, 4096);
+
+    // 其他 chunk 的文件
+    status = decode_chunk_header(buf, UUID::generate(), &header);
+    ASSERT_EQ(status.error_code(), EINVAL);
+
+    // 头部损坏
+    auto str = buf.to_string();
+    str[20] ^= 0x1;
+    IOBuf corrupted;
+    corrupted.append(str);
+    status = decode_chunk_header(corrupted, uuid, &header);
+    ASSERT_EQ(status.error_code(), EIO);
+}
+
+TEST(ChunkFormat, Trailer) {
+    auto uuid = UUID::generate();
+    std::string data(100, 'x');
+    std::vector<uint32_t> checksums;
+    auto file = make_chunk_file(uuid, data, 16, &checksums);
+    ASSERT_EQ(checksums.size(), 7);
+
+    ChunkFooter footer;
+    std::vector<uint32_t> decoded;
+    uint64_t trailer_size = 0;
+    auto status = decode_chunk_trailer(file, file.size(), &footer, &decoded, &trailer_size);
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(footer.data_size, data.size());
+    ASSERT_EQ(footer.checksum_block_size, 16);
+    ASSERT_EQ(decoded, checksums);
+    ASSERT_EQ(trailer_size, 7 * sizeof(ChunkIndexEntry) + kChunkFooterSize);
+
+    // 只读到 footer 时需要再读索引
+    IOBuf tail;
+    file.append_to(&tail, kChunkFooterSize, file.size() - kChunkFooterSize);
+    status = decode_chunk_trailer(tail, file.size(), &footer, &decoded, &trailer_size);
+    ASSERT_EQ(status.error_code(), EAGAIN);
+    ASSERT_EQ(trailer_size, 7 * sizeof(ChunkIndexEntry) + kChunkFooterSize);
+}
+
+TEST(ChunkFormat, TrailerWithoutChecksums) {
+    auto uuid = UUID::generate();
+    std::vector<uint32_t> checksums;
+    auto file = make_chunk_file(uuid, "hello", 0, &checksums);
+
+    ChunkFooter footer;
+    std::vector<uint32_t> decoded = {1, 2};
+    uint64_t trailer_size = 0;
+    auto status = decode_chunk_trailer(file, file.size(), &footer, &decoded, &trailer_size);
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(footer.data_size, 5);
+    ASSERT_TRUE(decoded.empty());
+}
+
+TEST(ChunkFormat, NotSealed) {
+    auto uuid = UUID::generate();
+    IOBuf file = encode_chunk_header(uuid, 16);
+    file.append(std::string(1000, 'x'));
+
+    ChunkFooter footer;
+    std::vector<uint32_t> checksums;
+    uint64_t trailer_size = 0;
+    auto status = decode_chunk_trailer(file, file.size(), &footer, &checksums, &trailer_size);
+    ASSERT_EQ(status.error_code(), ENOENT);
+
+    // 数据太少，放不下 footer
+    IOBuf small = encode_chunk_header(uuid, 16);
+    small.append("x");
+    status = decode_chunk_trailer(small, small.size(), &footer, &checksums, &trailer_size);
+    ASSERT_EQ(status.error_code(), ENOENT);
+}
+
+TEST(ChunkFormat, CorruptedTrailer) {
+    auto uuid = UUID::generate();
+    std::string data(100, 'x');
+    std::vector<uint32_t> checksums;
+    auto file = make_chunk_file(uuid, data, 16, &checksums);
+
+    ChunkFooter footer;
+    std::vector<uint32_t> decoded;
+    uint64_t trailer_size = 0;
+    // 文件大小与 footer 不一致
+    auto status = decode_chunk_trailer(file, file.size() + 1, &footer, &decoded, &trailer_size);
+    ASSERT_EQ(status.error_code(), EIO);
+
+    // 索引损坏
+    auto str = file.to_string();
+    str[kChunkHeaderSize + data.size() + 8] ^= 0x1;
+    IOBuf corrupted;
+    corrupted.append(str);
+    status = decode_chunk_trailer(corrupted, corrupted.size(), &footer, &decoded, &trailer_size);
+    ASSERT_EQ(status.error_code(), EIO);
+}
+
+} // namespace
+// NOLINTEND(readability-magic-numbers)
@@ -0,0 +1,166 @@
+#include <bthread/bthread.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <atomic>
+#include <vector>
+#include "manusya/chunk.h"
+#include "manusya/group_commit.h"
+#include "manusya/mem_store.h"
+
+// NOLINTBEGIN(readability-magic-numbers)
+namespace {
+using namespace pain;
+using namespace pain::manusya;
+
+// 统计 sync 次数的 store
+class SyncCountingStore : public MemStore {
+public:
+    Future<Status> sync(FileHandlePtr fh) override {
+        _sync_count++;
+        if (_delay_us > 0) {
+            auto inflight = ++_inflight;
+            auto max_inflight = _max_inflight.load();
+            while (inflight > max_inflight && !_max_inflight.compare_exchange_weak(max_inflight, inflight)) {
+            }
+            bthread_usleep(_delay_us);
+            _inflight--;
+        }
+        if (_fail) {
+            return make_ready_future(Status(EIO, "sync failed"));
+        }
+        return MemStore::sync(fh);
+    }
+    std::atomic<int> _sync_count = 0;
+    std::atomic<bool> _fail = false;
+    // 像 fdatasync 一样阻塞调用方
+    std::atomic<int> _delay_us = 0;
+    std::atomic<int> _inflight = 0;
+    std::atomic<int> _max_inflight = 0;
+};
+
+class TestGroupCommit : public ::testing::Test {
+protected:
+    void SetUp() override {
+        _counting_store = new SyncCountingStore();
+        _store = StorePtr(_counting_store);
+    }
+
+    void TearDown() override {
+        _store.reset();
+    }
+
+    ChunkPtr create_chunk() {
+        ChunkPtr chunk;
+        auto status = Chunk::create({}, _store, &chunk);
+        EXPECT_TRUE(status.ok()) << status.error_str();
+        return chunk;
+    }
+
+    SyncCountingStore* _counting_store = nullptr;
+    StorePtr _store;
+};
+
+TEST_F(TestGroupCommit, OneSyncPerBatch) {
+    auto chunk = create_chunk();
+    // the batch is only committed when it is full
+    GroupCommitter committer(10 * 1000 * 1000, 16);
+    std::vector<Future<Status>> futures;
+    for (int i = 0; i < 16; ++i) {
+        futures.emplace_back(committer.sync(chunk));
+    }
+    for (auto& future : futures) {
+        auto status = future.get();
+        ASSERT_TRUE(status.ok()) << status.error_str();
+    }
+    ASSERT_EQ(_counting_store->_sync_count, 1);
+}
+
+TEST_F(TestGroupCommit, SyncEachChunkOnce) {
+    std::vector<ChunkPtr> chunks;
+    for (int i = 0; i < 4; ++i) {
+        chunks.push_back(create_chunk());
+    }
+    GroupCommitter committer(10 * 1000 * 1000, 32);
+    std::vector<Future<Status>> futures;
+    for (int i = 0; i < 32; ++i) {
+        futures.emplace_back(committer.sync(chunks[i % chunks.size()]));
+    }
+    for (auto& future : futures) {
+        ASSERT_TRUE(future.get().ok());
+    }
+    ASSERT_EQ(_counting_store->_sync_count, 4);
+}
+
+// 一个批次里不同 chunk 的 sync 同时进行
+TEST_F(TestGroupCommit, SyncChunksInParallel) {
+    std::vector<ChunkPtr> chunks;
+    for (int i = 0; i < 4; ++i) {
+        chunks.push_back(create_chunk());
+    }
+    _counting_store->_delay_us = 100 * 1000;
+    GroupCommitter committer(10 * 1000 * 1000, 4);
+    std::vector<Future<Status>> futures;
+    for (auto& chunk : chunks) {
+        futures.emplace_back(committer.sync(chunk));
+    }
+    for (auto& future : futures) {
+        ASSERT_TRUE(future.get().ok());
+    }
+    ASSERT_EQ(_counting_store->_sync_count, 4);
+    ASSERT_EQ(_counting_store->_max_inflight, 4);
+}
+
+TEST_F(TestGroupCommit, BatchSizeLimit) {
+    auto chunk = create_chunk();
+    GroupCommitter committer(10 * 1000 * 1000, 4);
+    std::vector<Future<Status>> futures;
+    for (int i = 0; i < 8; ++i) {
+        futures.emplace_back(committer.sync(chunk));
+    }
+    for (auto& future : futures) {
+        ASSERT_TRUE(future.get().ok());
+    }
+    ASSERT_EQ(_counting_store->_sync_count, 2);
+}
+
+TEST_F(TestGroupCommit, MaxDelay) {
+    auto chunk = create_chunk();
+    // a single request is committed once the delay expires
+    GroupCommitter committer(1000, 128);
+    auto status = committer.sync(chunk).get();
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(_counting_store->_sync_count, 1);
+}
+
+TEST_F(TestGroupCommit, SyncFailure) {
+    auto chunk = create_chunk();
+    _counting_store->_fail = true;
+    GroupCommitter committer(10 * 1000 * 1000, 8);
+    std::vector<Future<Status>> futures;
+    for (int i = 0; i < 8; ++i) {
+        futures.emplace_back(committer.sync(chunk));
+    }
+    for (auto& future : futures) {
+        auto status = future.get();
+        ASSERT_FALSE(status.ok());
+        ASSERT_EQ(status.error_code(), EIO);
+    }
+}
+
+TEST_F(TestGroupCommit, PendingCompletedOnDestroy) {
+    auto chunk = create_chunk();
+    std::vector<Future<Status>> futures;
+    {
+        GroupCommitter committer(10 * 1000 * 1000, 128);
+        for (int i = 0; i < 3; ++i) {
+            futures.emplace_back(committer.sync(chunk));
+        }
+    }
+    for (auto& future : futures) {
+        ASSERT_TRUE(future.get().ok());
+    }
+    ASSERT_EQ(_counting_store->_sync_count, 1);
+}
+
+} // namespace
+// NOLINTEND(readability-magic-numbers)
@@ -1,13 +1,17 @@
+#include <gflags/gflags.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include <algorithm>
 #include <filesystem>
 #include <future>
+#include <random>
 #include <thread>
 #include <vector>
 #include "manusya/file_handle.h"
 #include "manusya/local_store.h"
 
+DECLARE_bool(manusya_direct_io);
+
 // NOLINTBEGIN(readability-magic-numbers)
 namespace {
 using namespace pain;
@@ -129,7 +133,7 @@ TEST_F(TestLocalStore, AppendMultipleTimes) {
         IOBuf buf;
         buf.append(data.c_str(), data.length());
 
-        auto append_future = _store->append(fh, 0, buf);
+        auto append_future = _store->append(fh, total_size, buf);
         status = append_future.get();
         ASSERT_TRUE(status.ok());
 
@@ -176,6 +180,59 @@ TEST_F(TestLocalStore, ReadWithOffset) {
     ASSERT_EQ(actual, expected);
 }
 
+TEST_F(TestLocalStore, AppendAtOffset) {
+    FileHandlePtr fh;
+    auto status = _store->open("test_file1", O_RDWR | O_CREAT, &fh).get();
+    ASSERT_TRUE(status.ok());
+
+    // append 按 offset 写入，不依赖 fd 的文件位置
+    IOBuf buf1;
+    buf1.append("World!");
+    status = _store->append(fh, 7, buf1).get();
+    ASSERT_TRUE(status.ok());
+    IOBuf buf2;
+    buf2.append("Hello, ");
+    status = _store->append(fh, 0, buf2).get();
+    ASSERT_TRUE(status.ok());
+
+    IOBuf read_buf;
+    status = _store->read(fh, 0, 13, &read_buf).get();
+    ASSERT_TRUE(status.ok());
+    ASSERT_EQ(read_buf.to_string(), "Hello, World!");
+}
+
+TEST_F(TestLocalStore, ConcurrentReadsOnSharedHandle) {
+    FileHandlePtr fh;
+    auto status = _store->open("test_file1", O_RDWR | O_CREAT, &fh).get();
+    ASSERT_TRUE(status.ok());
+
+    std::string data;
+    for (int i = 0; i < 1000; ++i) {
+        data += std::to_string(i % 10);
+    }
+    IOBuf write_buf;
+    write_buf.append(data);
+    status = _store->append(fh, 0, write_buf).get();
+    ASSERT_TRUE(status.ok());
+
+    // 多个线程共享同一个 fd 读取不同的 offset
+    std::vector<std::future<void>> futures;
+    for (int i = 0; i < 10; ++i) {
+        futures.emplace_back(std::async(std::launch::async, [&, i]() {
+            for (int j = 0; j < 100; ++j) {
+                uint64_t offset = (i * 100 + j) % 990;
+                IOBuf read_buf;
+                auto status = _store->read(fh, offset, 10, &read_buf).get();
+                ASSERT_TRUE(status.ok());
+                ASSERT_EQ(read_buf.to_string(), data.substr(offset, 10));
+            }
+        }));
+    }
+    for (auto& future : futures) {
+        future.get();
+    }
+}
+
 TEST_F(TestLocalStore, FileSize) {
     FileHandlePtr fh;
     auto future = _store->open("test_file1", O_RDWR | O_CREAT, &fh);
@@ -1091,5 +1148,94 @@ TEST_F(TestLocalStore, ThreadSafetyWithMultipleStores) {
     }
 }
 
+TEST_F(TestLocalStore, DirectAppendAndRead) {
+    FileHandlePtr fh;
+    auto status = _store->open("direct_file", O_RDWR | O_CREAT, &fh).get();
+    ASSERT_TRUE(status.ok()) << status.error_str();
+
+    // 未对齐的追加：头尾经过 page cache，中间对齐的部分绕过 page cache
+    std::string expected;
+    std::mt19937 rng(0);
+    for (size_t len : {100, 5000, 70000, 3, 4093, 200000, 4096}) {
+        std::string data(len, '\0');
+        for (auto& c : data) {
+            c = static_cast<char>('a' + rng() % 26);
+        }
+        IOBuf buf;
+        buf.append(data);
+        status = _store->append(fh, expected.size(), buf, true).get();
+        ASSERT_TRUE(status.ok()) << status.error_str();
+        expected += data;
+    }
+    ASSERT_EQ(get_file_size("direct_file"), expected.size());
+
+    // direct io 和 buffered io 读到的数据一致
+    for (bool direct_io : {false, true}) {
+        IOBuf read_buf;
+        status = _store->read(fh, 0, expected.size(), &read_buf, direct_io).get();
+        ASSERT_TRUE(status.ok()) << status.error_str();
+        ASSERT_EQ(read_buf.to_string(), expected);
+    }
+    for (int i = 0; i < 100; i++) {
+        uint64_t offset = rng() % expected.size();
+        uint64_t size = rng() % (expected.size() - offset);
+        IOBuf read_buf;
+        status = _store->read(fh, offset, size, &read_buf, true).get();
+        ASSERT_TRUE(status.ok()) << status.error_str();
+        ASSERT_EQ(read_buf.to_string(), expected.substr(offset, size));
+    }
+
+    IOBuf read_buf;
+    status = _store->read(fh, expected.size() - 10, 100, &read_buf, true).get();
+    ASSERT_FALSE(status.ok());
+}
+
+// O_DIRECT 的 fd 在第一个 direct io 请求时才打开
+TEST_F(TestLocalStore, DirectHandleOpenedLazily) {
+    auto count_fds = []() {
+        return std::distance(std::filesystem::directory_iterator("/proc/self/fd"),
+                             std::filesystem::directory_iterator{});
+    };
+    auto before = count_fds();
+    FileHandlePtr fh;
+    auto status = _store->open("lazy_file", O_RDWR | O_CREAT, &fh).get();
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(count_fds(), before + 1);
+
+    IOBuf buf;
+    buf.append(std::string(10000, 'x'));
+    ASSERT_TRUE(_store->append(fh, 0, buf, false).get().ok());
+    ASSERT_EQ(count_fds(), before + 1);
+
+    ASSERT_TRUE(_store->append(fh, buf.size(), buf, true).get().ok());
+    auto direct_fd = fh->as<LocalFileHandle>()->direct_handle();
+    // tmpfs 之类不支持 O_DIRECT 的文件系统上没有第二个 fd
+    ASSERT_EQ(count_fds(), before + (direct_fd >= 0 ? 2 : 1));
+    ASSERT_EQ(fh->as<LocalFileHandle>()->direct_handle(), direct_fd);
+
+    fh.reset();
+    ASSERT_EQ(count_fds(), before);
+}
+
+TEST_F(TestLocalStore, DirectIoDisabled) {
+    gflags::FlagSaver saver;
+    FLAGS_manusya_direct_io = false;
+
+    FileHandlePtr fh;
+    auto status = _store->open("buffered_file", O_RDWR | O_CREAT, &fh).get();
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(fh->as<LocalFileHandle>()->direct_handle(), -1);
+
+    // 要求 direct io 的请求退化为 buffered io
+    std::string data(10000, 'x');
+    IOBuf buf;
+    buf.append(data);
+    ASSERT_TRUE(_store->append(fh, 0, buf, true).get().ok());
+    IOBuf read_buf;
+    status = _store->read(fh, 0, data.size(), &read_buf, true).get();
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(read_buf.to_string(), data);
+}
+
 } // namespace
 // NOLINTEND(readability-magic-numbers)
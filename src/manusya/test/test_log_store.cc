@@ -0,0 +1,448 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "manusya/block_device.h"
+#include "manusya/file_handle.h"
+#include "manusya/log_store.h"
+
+// NOLINTBEGIN(readability-magic-numbers)
+namespace {
+using namespace pain;
+using namespace pain::manusya;
+
+constexpr uint32_t kBlockSize = 4096;
+constexpr uint64_t kSegmentSize = 4 * kBlockSize;
+constexpr uint64_t kMetaSize = 8 * kBlockSize;
+constexpr uint64_t kSegmentCount = 8;
+
+// 内存中的块设备，同一个 data 可以被多个设备共享，模拟重启
+class MemBlockDevice : public BlockDevice {
+public:
+    MemBlockDevice(std::shared_ptr<std::string> data) : _data(std::move(data)) {}
+
+    uint32_t block_size() const override {
+        return kBlockSize;
+    }
+
+    uint64_t capacity() const override {
+        return _data->size();
+    }
+
+    Future<Status> write(uint64_t offset, IOBuf buf) override {
+        EXPECT_EQ(offset % kBlockSize, 0);
+        EXPECT_EQ(buf.size() % kBlockSize, 0);
+        if (offset + buf.size() > _data->size()) {
+            return make_ready_future(Status(EINVAL, "out of range"));
+        }
+        if (_fail_writes) {
+            return make_ready_future(Status(EIO, "injected"));
+        }
+        if (_paused) {
+            Promise<Status> promise;
+            auto future = promise.get_future();
+            _pending.push_back({offset, std::move(buf), std::move(promise)});
+            return future;
+        }
+        buf.copy_to(_data->data() + offset, buf.size());
+        return make_ready_future(Status::OK());
+    }
+
+    Future<Status> read(uint64_t offset, uint64_t size, IOBuf* buf) override {
+        EXPECT_EQ(offset % kBlockSize, 0);
+        EXPECT_EQ(size % kBlockSize, 0);
+        if (offset + size > _data->size()) {
+            return make_ready_future(Status(EINVAL, "out of range"));
+        }
+        buf->clear();
+        buf->append(_data->data() + offset, size);
+        return make_ready_future(Status::OK());
+    }
+
+    Future<Status> flush() override {
+        return make_ready_future(Status::OK());
+    }
+
+    uint64_t queue_depth() const override {
+        return _pending.size();
+    }
+
+    // 暂停后写请求挂起，直到 resume
+    void pause() {
+        _paused = true;
+    }
+
+    void resume() {
+        _paused = false;
+        auto pending = std::move(_pending);
+        _pending.clear();
+        for (auto& write : pending) {
+            write.buf.copy_to(_data->data() + write.offset, write.buf.size());
+            write.promise.set_value(Status::OK());
+        }
+    }
+
+    void fail_writes(bool fail) {
+        _fail_writes = fail;
+    }
+
+private:
+    struct Write {
+        uint64_t offset;
+        IOBuf buf;
+        Promise<Status> promise;
+    };
+
+    std::shared_ptr<std::string> _data;
+    bool _paused = false;
+    bool _fail_writes = false;
+    std::vector<Write> _pending;
+};
+
+class TestLogStore : public ::testing::Test {
+protected:
+    void SetUp() override {
+        _data = std::make_shared<std::string>(kBlockSize + kMetaSize + kSegmentCount * kSegmentSize, 'x');
+        open_store(true);
+    }
+
+    void open_store(bool format) {
+        auto device = std::make_unique<MemBlockDevice>(_data);
+        _device = device.get();
+        LogStoreOptions options;
+        options.segment_size = kSegmentSize;
+        options.meta_size = kMetaSize;
+        options.format = format;
+        _log_store = new LogStore(std::move(device), options);
+        _store = _log_store;
+        auto status = _log_store->init();
+        ASSERT_TRUE(status.ok()) << status.error_str();
+    }
+
+    // 模拟重启，所有句柄需要先释放
+    void reopen() {
+        _store.reset();
+        open_store(false);
+    }
+
+    FileHandlePtr create(const char* path) {
+        FileHandlePtr fh;
+        auto status = _store->open(path, O_CREAT | O_RDWR, &fh).get();
+        EXPECT_TRUE(status.ok()) << status.error_str();
+        return fh;
+    }
+
+    static std::string data(size_t n, char c) {
+        std::string s;
+        for (size_t i = 0; i < n; i++) {
+            s.push_back(static_cast<char>(c + i % 7));
+        }
+        return s;
+    }
+
+    static std::string read(FileHandlePtr fh, uint64_t offset, uint64_t size) {
+        IOBuf buf;
+        auto status = fh->read(offset, size, &buf).get();
+        EXPECT_TRUE(status.ok()) << status.error_str();
+        return buf.to_string();
+    }
+
+    static Status append(FileHandlePtr fh, uint64_t offset, const std::string& s) {
+        IOBuf buf;
+        buf.append(s);
+        return fh->append(offset, buf).get();
+    }
+
+    std::shared_ptr<std::string> _data;
+    MemBlockDevice* _device = nullptr;
+    LogStore* _log_store = nullptr;
+    StorePtr _store;
+};
+
+TEST_F(TestLogStore, NotFormatted) {
+    auto blank = std::make_shared<std::string>(kBlockSize + kMetaSize + kSegmentCount * kSegmentSize, '\0');
+    LogStoreOptions options;
+    options.segment_size = kSegmentSize;
+    options.meta_size = kMetaSize;
+    StorePtr holder(new LogStore(std::make_unique<MemBlockDevice>(blank), options));
+    auto* store = static_cast<LogStore*>(holder.get());
+    ASSERT_EQ(store->init().error_code(), EINVAL);
+
+    // 设备太小
+    auto tiny = std::make_shared<std::string>(kBlockSize + kMetaSize, '\0');
+    options.format = true;
+    StorePtr tiny_holder(new LogStore(std::make_unique<MemBlockDevice>(tiny), options));
+    ASSERT_EQ(static_cast<LogStore*>(tiny_holder.get())->init().error_code(), ENOSPC);
+}
+
+TEST_F(TestLogStore, OpenAndRemove) {
+    FileHandlePtr fh;
+    ASSERT_EQ(_store->open("a", O_RDWR, &fh).get().error_code(), ENOENT);
+    fh = create("a");
+    ASSERT_EQ(_store->open("a", O_CREAT | O_EXCL | O_RDWR, &fh).get().error_code(), EEXIST);
+    ASSERT_TRUE(_store->open("a", O_RDWR, &fh).get().ok());
+
+    std::vector<std::string> paths;
+    _store->for_each([&](const char* path) {
+        paths.emplace_back(path);
+    });
+    ASSERT_EQ(paths, std::vector<std::string>{"a"});
+
+    ASSERT_TRUE(_store->remove("a").get().ok());
+    ASSERT_EQ(_store->open("a", O_RDWR, &fh).get().error_code(), ENOENT);
+    // 删除后旧句柄不可用
+    ASSERT_EQ(append(fh, 0, "x").error_code(), ENOENT);
+}
+
+TEST_F(TestLogStore, UnalignedAppendAndRead) {
+    auto fh = create("a");
+    std::string expected;
+    // 不对齐的追加，并跨越多个 segment
+    for (size_t n : {100, 5000, 1, 20000, 4095, 4096, 12345}) {
+        auto s = data(n, static_cast<char>('a' + expected.size() % 13));
+        ASSERT_TRUE(append(fh, expected.size(), s).ok());
+        expected.append(s);
+    }
+    uint64_t size = 0;
+    ASSERT_TRUE(fh->size(&size).get().ok());
+    ASSERT_EQ(size, expected.size());
+    ASSERT_EQ(read(fh, 0, size), expected);
+    ASSERT_EQ(read(fh, 4000, 200), expected.substr(4000, 200));
+    ASSERT_EQ(read(fh, kSegmentSize - 10, 20), expected.substr(kSegmentSize - 10, 20));
+    ASSERT_EQ(read(fh, 1, kSegmentSize * 2), expected.substr(1, kSegmentSize * 2));
+    // 超出文件大小的部分被截断
+    ASSERT_EQ(read(fh, size - 5, 100), expected.substr(size - 5));
+    ASSERT_EQ(read(fh, size + 1, 100), "");
+
+    // 追加必须是顺序的
+    ASSERT_EQ(append(fh, size + 1, "x").error_code(), EINVAL);
+    ASSERT_EQ(append(fh, 0, "x").error_code(), EINVAL);
+}
+
+TEST_F(TestLogStore, SegmentsAreAllocatedSequentially) {
+    auto a = create("a");
+    auto b = create("b");
+    ASSERT_TRUE(append(a, 0, data(kSegmentSize, 'a')).ok());
+    ASSERT_TRUE(append(b, 0, data(kSegmentSize, 'b')).ok());
+    ASSERT_TRUE(append(a, kSegmentSize, data(1, 'a')).ok());
+    ASSERT_EQ(_log_store->free_segments(), kSegmentCount - 3);
+
+    uint64_t capacity = 0;
+    uint64_t available = 0;
+    ASSERT_TRUE(_store->space(&capacity, &available).get().ok());
+    ASSERT_EQ(capacity, kSegmentCount * kSegmentSize);
+    ASSERT_EQ(available, (kSegmentCount - 3) * kSegmentSize);
+
+    // 数据按 segment 0, 1, 2 的顺序写入设备
+    auto data_offset = kBlockSize + kMetaSize;
+    ASSERT_EQ(_data->substr(data_offset, kSegmentSize), data(kSegmentSize, 'a'));
+    ASSERT_EQ(_data->substr(data_offset + kSegmentSize, kSegmentSize), data(kSegmentSize, 'b'));
+    ASSERT_EQ(_data->substr(data_offset + 2 * kSegmentSize, 1), data(1, 'a'));
+}
+
+TEST_F(TestLogStore, RemoveReleasesSegments) {
+    auto a = create("a");
+    ASSERT_TRUE(append(a, 0, data(3 * kSegmentSize, 'a')).ok());
+    ASSERT_EQ(_log_store->free_segments(), kSegmentCount - 3);
+    ASSERT_TRUE(_store->remove("a").get().ok());
+    ASSERT_EQ(_log_store->free_segments(), kSegmentCount);
+
+    // O_TRUNC 也释放旧文件的 segment
+    auto b = create("b");
+    ASSERT_TRUE(append(b, 0, data(kSegmentSize, 'b')).ok());
+    ASSERT_TRUE(_store->open("b", O_CREAT | O_TRUNC | O_RDWR, &b).get().ok());
+    ASSERT_EQ(_log_store->free_segments(), kSegmentCount);
+    uint64_t size = 1;
+    ASSERT_TRUE(b->size(&size).get().ok());
+    ASSERT_EQ(size, 0);
+}
+
+TEST_F(TestLogStore, NoSpace) {
+    auto a = create("a");
+    ASSERT_TRUE(append(a, 0, data(kSegmentCount * kSegmentSize - 1, 'a')).ok());
+    ASSERT_EQ(append(a, kSegmentCount * kSegmentSize - 1, "xx").error_code(), ENOSPC);
+    // 失败的追加之后还可以从原来的位置继续
+    ASSERT_TRUE(append(a, kSegmentCount * kSegmentSize - 1, "x").ok());
+    auto expected = data(kSegmentCount * kSegmentSize - 1, 'a') + "x";
+    ASSERT_EQ(read(a, 0, expected.size()), expected);
+}
+
+TEST_F(TestLogStore, SealAndAttrs) {
+    auto a = create("a");
+    ASSERT_TRUE(append(a, 0, "hello").ok());
+    ASSERT_TRUE(a->set_attr("k1", "v1").get().ok());
+    ASSERT_TRUE(a->set_attr("k2", "v2").get().ok());
+    std::string value;
+    ASSERT_TRUE(a->get_attr("k1", &value).get().ok());
+    ASSERT_EQ(value, "v1");
+    ASSERT_EQ(a->get_attr("k3", &value).get().error_code(), ENOENT);
+    std::map<std::string, std::string> attrs;
+    ASSERT_TRUE(a->list_attrs(&attrs).get().ok());
+    ASSERT_EQ(attrs.size(), 2);
+
+    ASSERT_TRUE(a->seal().get().ok());
+    ASSERT_EQ(append(a, 5, "x").error_code(), EPERM);
+}
+
+// seal 记录写失败时文件没有封存，可以继续写入
+TEST_F(TestLogStore, FailedSealIsNotSealed) {
+    auto a = create("a");
+    ASSERT_TRUE(append(a, 0, "hello").ok());
+    _device->fail_writes(true);
+    ASSERT_EQ(a->seal().get().error_code(), EIO);
+    _device->fail_writes(false);
+    ASSERT_TRUE(append(a, 5, " world").ok());
+    ASSERT_TRUE(a->seal().get().ok());
+    ASSERT_EQ(append(a, 11, "x").error_code(), EPERM);
+    a.reset();
+    reopen();
+
+    ASSERT_TRUE(_store->open("a", O_RDWR, &a).get().ok());
+    uint64_t size = 0;
+    ASSERT_TRUE(a->size(&size).get().ok());
+    ASSERT_EQ(size, 11);
+    ASSERT_EQ(append(a, 11, "x").error_code(), EPERM);
+}
+
+TEST_F(TestLogStore, Replay) {
+    {
+        auto a = create("a");
+        auto b = create("b");
+        auto c = create("c");
+        ASSERT_TRUE(append(a, 0, data(kSegmentSize + 100, 'a')).ok());
+        ASSERT_TRUE(a->set_attr("k", "v").get().ok());
+        ASSERT_TRUE(a->sync().get().ok());
+        ASSERT_TRUE(append(b, 0, data(5000, 'b')).ok());
+        ASSERT_TRUE(b->seal().get().ok());
+        ASSERT_TRUE(append(c, 0, data(kSegmentSize, 'c')).ok());
+        ASSERT_TRUE(c->sync().get().ok());
+        ASSERT_TRUE(_store->remove("c").get().ok());
+    }
+    reopen();
+
+    std::vector<std::string> paths;
+    _store->for_each([&](const char* path) {
+        paths.emplace_back(path);
+    });
+    ASSERT_EQ(paths, (std::vector<std::string>{"a", "b"}));
+    // c 的 segment 被回收
+    ASSERT_EQ(_log_store->free_segments(), kSegmentCount - 3);
+
+    FileHandlePtr a;
+    ASSERT_TRUE(_store->open("a", O_RDWR, &a).get().ok());
+    uint64_t size = 0;
+    ASSERT_TRUE(a->size(&size).get().ok());
+    ASSERT_EQ(size, kSegmentSize + 100);
+    ASSERT_EQ(read(a, 0, size), data(kSegmentSize + 100, 'a'));
+    std::string value;
+    ASSERT_TRUE(a->get_attr("k", &value).get().ok());
+    ASSERT_EQ(value, "v");
+
+    // 未封存的文件可以在不对齐的末尾继续追加
+    ASSERT_TRUE(append(a, size, "tail").ok());
+    ASSERT_EQ(read(a, size - 3, 7), data(kSegmentSize + 100, 'a').substr(size - 3) + "tail");
+    ASSERT_TRUE(a->sync().get().ok());
+
+    FileHandlePtr b;
+    ASSERT_TRUE(_store->open("b", O_RDWR, &b).get().ok());
+    ASSERT_EQ(read(b, 0, 5000), data(5000, 'b'));
+    ASSERT_EQ(append(b, 5000, "x").error_code(), EPERM);
+
+    // 新文件的 id 不和已有的冲突
+    auto d = create("d");
+    ASSERT_TRUE(append(d, 0, "d").ok());
+    a.reset();
+    b.reset();
+    d.reset();
+    reopen();
+    FileHandlePtr fh;
+    ASSERT_TRUE(_store->open("d", O_RDWR, &fh).get().ok());
+    ASSERT_TRUE(_store->open("a", O_RDWR, &fh).get().ok());
+    ASSERT_TRUE(fh->size(&size).get().ok());
+    ASSERT_EQ(size, kSegmentSize + 104);
+}
+
+TEST_F(TestLogStore, UnsyncedSizeIsLost) {
+    {
+        auto a = create("a");
+        ASSERT_TRUE(append(a, 0, "synced").ok());
+        ASSERT_TRUE(a->sync().get().ok());
+        ASSERT_TRUE(append(a, 6, "lost").ok());
+    }
+    reopen();
+    FileHandlePtr a;
+    ASSERT_TRUE(_store->open("a", O_RDWR, &a).get().ok());
+    uint64_t size = 0;
+    ASSERT_TRUE(a->size(&size).get().ok());
+    ASSERT_EQ(size, 6);
+    ASSERT_TRUE(append(a, 6, "again").ok());
+    ASSERT_EQ(read(a, 0, 11), "syncedagain");
+}
+
+TEST_F(TestLogStore, MetadataLogCompaction) {
+    auto a = create("a");
+    ASSERT_TRUE(append(a, 0, "data").ok());
+    // 每条记录一个 batch，一半日志写满后切到另一半
+    for (int i = 0; i < 20; i++) {
+        auto value = std::to_string(i);
+        ASSERT_TRUE(a->set_attr("k", value.c_str()).get().ok());
+    }
+    ASSERT_TRUE(a->sync().get().ok());
+    a.reset();
+    reopen();
+
+    ASSERT_TRUE(_store->open("a", O_RDWR, &a).get().ok());
+    std::string value;
+    ASSERT_TRUE(a->get_attr("k", &value).get().ok());
+    ASSERT_EQ(value, "19");
+    ASSERT_EQ(read(a, 0, 4), "data");
+}
+
+TEST_F(TestLogStore, FailedMetadataWriteIsRecovered) {
+    auto a = create("a");
+    ASSERT_TRUE(append(a, 0, "data").ok());
+    _device->fail_writes(true);
+    ASSERT_EQ(a->set_attr("k", "v1").get().error_code(), EIO);
+    _device->fail_writes(false);
+    // 之后写入的是完整的快照，包含失败的那条记录
+    ASSERT_TRUE(a->sync().get().ok());
+    a.reset();
+    reopen();
+
+    ASSERT_TRUE(_store->open("a", O_RDWR, &a).get().ok());
+    std::string value;
+    ASSERT_TRUE(a->get_attr("k", &value).get().ok());
+    ASSERT_EQ(value, "v1");
+    uint64_t size = 0;
+    ASSERT_TRUE(a->size(&size).get().ok());
+    ASSERT_EQ(size, 4);
+}
+
+TEST_F(TestLogStore, QueuedAppends) {
+    auto a = create("a");
+    _device->pause();
+    std::vector<Future<Status>> futures;
+    std::string expected;
+    for (int i = 0; i < 5; i++) {
+        auto s = data(3000, static_cast<char>('a' + i));
+        IOBuf buf;
+        buf.append(s);
+        futures.push_back(a->append(expected.size(), buf));
+        expected.append(s);
+    }
+    // 每个文件同时只有一个追加在写，另一个请求是它的 extend 记录
+    ASSERT_EQ(_device->queue_depth(), 2);
+    for (auto& future : futures) {
+        ASSERT_FALSE(future.is_ready());
+    }
+    _device->resume();
+    for (auto& future : futures) {
+        ASSERT_TRUE(future.get().ok());
+    }
+    ASSERT_EQ(read(a, 0, expected.size()), expected);
+}
+
+} // namespace
+// NOLINTEND(readability-magic-numbers)
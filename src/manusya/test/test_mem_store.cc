@@ -372,7 +372,7 @@ TEST_F(TestMemStore, AppendToInvalidFileHandle) {
 }
 
 // WARNING: ConcurrentWrite is not yet supported in the current implementation
-TEST_F(TestMemStore, DISABLED_ConcurrentAccess) {
+TEST_F(TestMemStore, ConcurrentAccess) {
     FileHandlePtr fh;
     auto future = _store->open("/test/file1", O_RDWR | O_CREAT, &fh);
     auto status = future.get();
@@ -1165,5 +1165,82 @@ TEST_F(TestMemStore, FileHandleTypeSafety) {
     ASSERT_EQ(size, strlen(test_data));
 }
 
+TEST_F(TestMemStore, ReadAcrossBlocks) {
+    FileHandlePtr fh;
+    auto status = _store->open("/test/blocks", O_RDWR | O_CREAT, &fh).get();
+    ASSERT_TRUE(status.ok());
+
+    // 每次 append 是一个 block，读取可以跨越多个 block
+    std::string expected;
+    for (int i = 0; i < 10; ++i) {
+        std::string data(100 + i, static_cast<char>('a' + i));
+        IOBuf buf;
+        buf.append(data);
+        ASSERT_TRUE(fh->append(expected.size(), buf).get().ok());
+        expected += data;
+    }
+
+    for (uint64_t offset : {0UL, 1UL, 99UL, 100UL, 250UL, expected.size() - 1}) {
+        for (uint64_t size : {1UL, 100UL, 333UL, expected.size()}) {
+            IOBuf read_buf;
+            ASSERT_TRUE(fh->read(offset, size, &read_buf).get().ok());
+            ASSERT_EQ(read_buf.to_string(), expected.substr(offset, size)) << offset << " " << size;
+        }
+    }
+}
+
+TEST_F(TestMemStore, RecreateAfterRemove) {
+    FileHandlePtr fh1;
+    ASSERT_TRUE(_store->open("/test/recreate", O_RDWR | O_CREAT, &fh1).get().ok());
+    IOBuf buf;
+    buf.append("Hello");
+    ASSERT_TRUE(fh1->append(0, buf).get().ok());
+    ASSERT_TRUE(_store->remove("/test/recreate").get().ok());
+
+    // 删除后以相同路径创建的是新文件，旧句柄不会看到新文件的数据
+    FileHandlePtr fh2;
+    ASSERT_TRUE(_store->open("/test/recreate", O_RDWR | O_CREAT | O_EXCL, &fh2).get().ok());
+    buf.clear();
+    buf.append("World!");
+    ASSERT_TRUE(fh2->append(0, buf).get().ok());
+
+    uint64_t size = 0;
+    ASSERT_TRUE(fh1->size(&size).get().ok());
+    ASSERT_EQ(size, 0);
+    ASSERT_TRUE(fh2->size(&size).get().ok());
+    ASSERT_EQ(size, 6);
+}
+
+TEST_F(TestMemStore, ConcurrentFiles) {
+    constexpr int num_threads = 8;
+    constexpr int appends_per_thread = 1000;
+    std::vector<std::future<void>> futures;
+    for (int i = 0; i < num_threads; ++i) {
+        futures.emplace_back(std::async(std::launch::async, [this, i]() {
+            FileHandlePtr fh;
+            auto path = "/test/file" + std::to_string(i);
+            ASSERT_TRUE(_store->open(path.c_str(), O_RDWR | O_CREAT, &fh).get().ok());
+            for (int j = 0; j < appends_per_thread; ++j) {
+                IOBuf buf;
+                buf.append("0123456789");
+                ASSERT_TRUE(fh->append(j * 10, buf).get().ok());
+                IOBuf read_buf;
+                ASSERT_TRUE(fh->read(j * 10, 10, &read_buf).get().ok());
+                ASSERT_EQ(read_buf.to_string(), "0123456789");
+            }
+        }));
+    }
+    for (auto& future : futures) {
+        future.get();
+    }
+
+    std::vector<std::string> paths;
+    _store->for_each([&paths](const char* path) {
+        paths.emplace_back(path);
+    });
+    ASSERT_EQ(paths.size(), num_threads);
+    ASSERT_TRUE(std::is_sorted(paths.begin(), paths.end()));
+}
+
 } // namespace
 // NOLINTEND(readability-magic-numbers)
@@ -0,0 +1,143 @@
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include "manusya/file_handle.h"
+#include "manusya/spdk_store.h"
+
+DECLARE_string(manusya_spdk_config);
+DECLARE_string(manusya_spdk_rpc_addr);
+DECLARE_int32(manusya_spdk_mem_size_mb);
+DECLARE_bool(manusya_spdk_no_huge);
+DECLARE_uint64(manusya_spdk_segment_size);
+DECLARE_uint64(manusya_spdk_meta_size);
+DECLARE_bool(manusya_spdk_format);
+
+// NOLINTBEGIN(readability-magic-numbers)
+namespace {
+using namespace pain;
+using namespace pain::manusya;
+
+// spdk 在进程内只启动一次，malloc bdev 和文件上的 aio bdev 在同一个配置里创建
+class TestSpdkStore : public ::testing::Test {
+protected:
+    static void SetUpTestSuite() {
+        char dir[] = "/tmp/test_spdk_store_XXXXXX";
+        ASSERT_NE(mkdtemp(dir), nullptr);
+        s_dir = dir;
+        auto aio_file = s_dir + "/aio0";
+        ASSERT_EQ(truncate_file(aio_file, 64 * 1024 * 1024), 0);
+        auto config = s_dir + "/spdk.json";
+        std::ofstream(config) << R"({"subsystems": [{"subsystem": "bdev", "config": [)"
+                              << R"({"method": "bdev_malloc_create",)"
+                              << R"( "params": {"name": "Malloc0", "num_blocks": 16384, "block_size": 4096}},)"
+                              << R"({"method": "bdev_aio_create",)"
+                              << R"( "params": {"name": "Aio0", "filename": ")" << aio_file
+                              << R"(", "block_size": 4096}}]}]})";
+        FLAGS_manusya_spdk_config = config;
+        FLAGS_manusya_spdk_rpc_addr = s_dir + "/spdk.sock";
+        FLAGS_manusya_spdk_mem_size_mb = 256;
+        FLAGS_manusya_spdk_no_huge = true;
+        FLAGS_manusya_spdk_segment_size = 1024 * 1024;
+        FLAGS_manusya_spdk_meta_size = 1024 * 1024;
+        FLAGS_manusya_spdk_format = true;
+    }
+
+    static void TearDownTestSuite() {
+        std::filesystem::remove_all(s_dir);
+    }
+
+    static int truncate_file(const std::string& path, off_t size) {
+        std::ofstream(path).close();
+        return ::truncate(path.c_str(), size);
+    }
+
+    StorePtr create_store(const char* bdev) {
+        StorePtr store;
+        auto status = create_spdk_store(bdev, &store);
+        if (!status.ok()) {
+            // 没有 hugepage 或者权限时 spdk 启动不了
+            return nullptr;
+        }
+        return store;
+    }
+
+    static std::string s_dir;
+};
+
+std::string TestSpdkStore::s_dir;
+
+void append_and_read(StorePtr store) {
+    FileHandlePtr fh;
+    ASSERT_TRUE(store->open("chunk", O_CREAT | O_TRUNC | O_RDWR, &fh).get().ok());
+    std::string expected;
+    for (size_t n : {100, 5000, 4096, 300000}) {
+        std::string s(n, static_cast<char>('a' + expected.size() % 26));
+        IOBuf buf;
+        buf.append(s);
+        auto status = fh->append(expected.size(), buf).get();
+        ASSERT_TRUE(status.ok()) << status.error_str();
+        expected.append(s);
+    }
+    ASSERT_TRUE(fh->sync().get().ok());
+
+    IOBuf buf;
+    ASSERT_TRUE(fh->read(0, expected.size(), &buf).get().ok());
+    ASSERT_EQ(buf.to_string(), expected);
+    buf.clear();
+    ASSERT_TRUE(fh->read(4000, 2000, &buf).get().ok());
+    ASSERT_EQ(buf.to_string(), expected.substr(4000, 2000));
+
+    uint64_t capacity = 0;
+    uint64_t available = 0;
+    ASSERT_TRUE(store->space(&capacity, &available).get().ok());
+    ASSERT_LT(available, capacity);
+    ASSERT_TRUE(store->remove("chunk").get().ok());
+}
+
+TEST_F(TestSpdkStore, MallocBdev) {
+    auto store = create_store("Malloc0");
+    if (store == nullptr) {
+        GTEST_SKIP() << "spdk is not available";
+    }
+    append_and_read(store);
+}
+
+TEST_F(TestSpdkStore, AioBdev) {
+    auto store = create_store("Aio0");
+    if (store == nullptr) {
+        GTEST_SKIP() << "spdk is not available";
+    }
+    append_and_read(store);
+
+    // 重新打开后元数据从设备上恢复
+    FileHandlePtr fh;
+    ASSERT_TRUE(store->open("kept", O_CREAT | O_RDWR, &fh).get().ok());
+    IOBuf buf;
+    buf.append("persisted");
+    ASSERT_TRUE(fh->append(0, buf).get().ok());
+    ASSERT_TRUE(fh->sync().get().ok());
+    fh.reset();
+    store.reset();
+
+    store = create_store("Aio0");
+    ASSERT_TRUE(store != nullptr);
+    ASSERT_TRUE(store->open("kept", O_RDWR, &fh).get().ok());
+    buf.clear();
+    ASSERT_TRUE(fh->read(0, 9, &buf).get().ok());
+    ASSERT_EQ(buf.to_string(), "persisted");
+}
+
+TEST_F(TestSpdkStore, UnknownBdev) {
+    if (create_store("Malloc0") == nullptr) {
+        GTEST_SKIP() << "spdk is not available";
+    }
+    StorePtr store;
+    ASSERT_FALSE(create_spdk_store("NotExist", &store).ok());
+}
+
+} // namespace
+// NOLINTEND(readability-magic-numbers)
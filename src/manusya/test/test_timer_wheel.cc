@@ -0,0 +1,86 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <butil/time.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "manusya/timer_wheel.h"
+
+// NOLINTBEGIN(readability-magic-numbers)
+namespace {
+using namespace pain;
+using namespace pain::manusya;
+
+void wait_until(const std::atomic<int>& value, int expected, std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (value < expected && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+TEST(TestTimerWheel, FireAfterDeadline) {
+    TimerWheel wheel(10 * 1000, 16);
+    std::atomic<int> fired = 0;
+    std::atomic<int64_t> fired_at = 0;
+    auto deadline = butil::gettimeofday_us() + 50 * 1000;
+    wheel.schedule(deadline, [&]() {
+        fired_at = butil::gettimeofday_us();
+        fired++;
+    });
+    wait_until(fired, 1, std::chrono::seconds(2));
+    ASSERT_EQ(fired, 1);
+    ASSERT_GE(fired_at, deadline);
+}
+
+TEST(TestTimerWheel, DeadlineInThePast) {
+    TimerWheel wheel(10 * 1000, 16);
+    std::atomic<int> fired = 0;
+    wheel.schedule(0, [&]() {
+        fired++;
+    });
+    wait_until(fired, 1, std::chrono::seconds(2));
+    ASSERT_EQ(fired, 1);
+}
+
+TEST(TestTimerWheel, ManyTimers) {
+    TimerWheel wheel(10 * 1000, 16);
+    std::atomic<int> fired = 0;
+    auto now = butil::gettimeofday_us();
+    for (int i = 0; i < 10000; ++i) {
+        wheel.schedule(now + (i % 100) * 1000, [&]() {
+            fired++;
+        });
+    }
+    wait_until(fired, 10000, std::chrono::seconds(5));
+    ASSERT_EQ(fired, 10000);
+}
+
+TEST(TestTimerWheel, DeadlineBeyondOneRound) {
+    // one round is 4 * 10ms, the timer must survive several rounds
+    TimerWheel wheel(10 * 1000, 4);
+    std::atomic<int> fired = 0;
+    auto deadline = butil::gettimeofday_us() + 200 * 1000;
+    wheel.schedule(deadline, [&]() {
+        fired++;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_EQ(fired, 0);
+    wait_until(fired, 1, std::chrono::seconds(2));
+    ASSERT_EQ(fired, 1);
+}
+
+TEST(TestTimerWheel, ScheduleInCallback) {
+    TimerWheel wheel(10 * 1000, 16);
+    std::atomic<int> fired = 0;
+    wheel.schedule(butil::gettimeofday_us(), [&]() {
+        fired++;
+        wheel.schedule(butil::gettimeofday_us() + 10 * 1000, [&]() {
+            fired++;
+        });
+    });
+    wait_until(fired, 2, std::chrono::seconds(2));
+    ASSERT_EQ(fired, 2);
+}
+
+} // namespace
+// NOLINTEND(readability-magic-numbers)
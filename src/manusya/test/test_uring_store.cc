@@ -0,0 +1,239 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <thread>
+#include <vector>
+#include "manusya/file_handle.h"
+#include "manusya/uring_store.h"
+
+// NOLINTBEGIN(readability-magic-numbers)
+namespace {
+using namespace pain;
+using namespace pain::manusya;
+
+class TestUringStore : public ::testing::Test {
+protected:
+    void SetUp() override {
+        // 创建临时测试目录
+        _test_dir = std::filesystem::temp_directory_path() / "test_uring_store";
+        std::filesystem::create_directories(_test_dir);
+
+        _store = Store::create(("uring://" + _test_dir.string()).c_str());
+        ASSERT_TRUE(_store != nullptr);
+    }
+
+    void TearDown() override {
+        _store.reset();
+
+        // 清理测试目录
+        if (std::filesystem::exists(_test_dir)) {
+            std::filesystem::remove_all(_test_dir);
+        }
+    }
+
+    uint64_t get_file_size(const std::string& filename) {
+        return std::filesystem::file_size(_test_dir / filename);
+    }
+
+    std::filesystem::path _test_dir;
+    StorePtr _store;
+};
+
+TEST_F(TestUringStore, BasicAppendAndRead) {
+    FileHandlePtr fh;
+    auto status = _store->open("test_file1", O_RDWR | O_CREAT, &fh).get();
+    ASSERT_TRUE(status.ok()) << status.error_str();
+
+    IOBuf write_buf;
+    const char* test_data = "Hello, World!";
+    write_buf.append(test_data, strlen(test_data));
+    status = _store->append(fh, 0, write_buf).get();
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(get_file_size("test_file1"), strlen(test_data));
+
+    IOBuf read_buf;
+    status = _store->read(fh, 0, strlen(test_data), &read_buf).get();
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(read_buf.to_string(), test_data);
+}
+
+TEST_F(TestUringStore, AppendAtOffset) {
+    FileHandlePtr fh;
+    auto status = _store->open("test_file1", O_RDWR | O_CREAT, &fh).get();
+    ASSERT_TRUE(status.ok());
+
+    IOBuf buf1;
+    buf1.append("Hello, ");
+    IOBuf buf2;
+    buf2.append("World!");
+    ASSERT_TRUE(_store->append(fh, 0, buf1).get().ok());
+    ASSERT_TRUE(_store->append(fh, 7, buf2).get().ok());
+
+    IOBuf read_buf;
+    status = _store->read(fh, 7, 6, &read_buf).get();
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(read_buf.to_string(), "World!");
+}
+
+TEST_F(TestUringStore, ManyAppendsInFlight) {
+    FileHandlePtr fh;
+    auto status = _store->open("test_file1", O_RDWR | O_CREAT, &fh).get();
+    ASSERT_TRUE(status.ok());
+
+    // submit all appends before waiting any of them
+    constexpr int count = 1000;
+    const std::string block(4096, 'x');
+    std::vector<Future<Status>> futures;
+    for (int i = 0; i < count; ++i) {
+        IOBuf buf;
+        buf.append(block);
+        futures.emplace_back(_store->append(fh, i * block.size(), buf));
+    }
+    for (auto& future : futures) {
+        status = future.get();
+        ASSERT_TRUE(status.ok()) << status.error_str();
+    }
+
+    uint64_t size = 0;
+    status = _store->size(fh, &size).get();
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(size, count * block.size());
+}
+
+TEST_F(TestUringStore, AppendMultipleBlocks) {
+    FileHandlePtr fh;
+    auto status = _store->open("test_file1", O_RDWR | O_CREAT, &fh).get();
+    ASSERT_TRUE(status.ok());
+
+    // IOBuf with many backing blocks goes through a single writev
+    IOBuf buf;
+    std::string expected;
+    for (int i = 0; i < 100; ++i) {
+        IOBuf piece;
+        std::string data(10000, static_cast<char>('a' + i % 26));
+        piece.append(data);
+        buf.append(piece);
+        expected += data;
+    }
+    status = _store->append(fh, 0, buf).get();
+    ASSERT_TRUE(status.ok()) << status.error_str();
+
+    IOBuf read_buf;
+    status = _store->read(fh, 0, expected.size(), &read_buf).get();
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(read_buf.to_string(), expected);
+}
+
+// 超过 IOV_MAX 个 block 时，剩余的部分再次提交
+TEST_F(TestUringStore, AppendMoreThanIovMaxBlocks) {
+    FileHandlePtr fh;
+    auto status = _store->open("test_file1", O_RDWR | O_CREAT, &fh).get();
+    ASSERT_TRUE(status.ok());
+
+    IOBuf buf;
+    std::string expected;
+    for (int i = 0; i < 3 * IOV_MAX; ++i) {
+        std::string data(1000, static_cast<char>('a' + i % 26));
+        IOBuf piece;
+        piece.append_user_data(strdup(data.c_str()), data.size(), free);
+        buf.append(piece);
+        expected += data;
+    }
+    ASSERT_GT(buf.backing_block_num(), IOV_MAX);
+    status = _store->append(fh, 0, buf).get();
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(get_file_size("test_file1"), expected.size());
+
+    IOBuf read_buf;
+    status = _store->read(fh, 0, expected.size(), &read_buf).get();
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(read_buf.to_string(), expected);
+}
+
+TEST_F(TestUringStore, ReadBeyondFileSize) {
+    FileHandlePtr fh;
+    auto status = _store->open("test_file1", O_RDWR | O_CREAT, &fh).get();
+    ASSERT_TRUE(status.ok());
+
+    IOBuf buf;
+    buf.append("Hello");
+    ASSERT_TRUE(_store->append(fh, 0, buf).get().ok());
+
+    IOBuf read_buf;
+    status = _store->read(fh, 0, 100, &read_buf).get();
+    ASSERT_FALSE(status.ok());
+
+    // 请求的大小远超文件大小时，不会按请求的大小分配内存
+    status = _store->read(fh, 0, 1ULL << 50, &read_buf).get();
+    ASSERT_EQ(status.error_code(), EINVAL);
+}
+
+TEST_F(TestUringStore, SealAndSize) {
+    FileHandlePtr fh;
+    auto status = _store->open("test_file1", O_RDWR | O_CREAT, &fh).get();
+    ASSERT_TRUE(status.ok());
+
+    IOBuf buf;
+    buf.append("Hello");
+    ASSERT_TRUE(_store->append(fh, 0, buf).get().ok());
+
+    status = _store->seal(fh).get();
+    ASSERT_TRUE(status.ok()) << status.error_str();
+
+    auto perms = std::filesystem::status(_test_dir / "test_file1").permissions();
+    ASSERT_EQ(perms & std::filesystem::perms::owner_write, std::filesystem::perms::none);
+
+    uint64_t size = 0;
+    status = _store->size(fh, &size).get();
+    ASSERT_TRUE(status.ok()) << status.error_str();
+    ASSERT_EQ(size, 5);
+}
+
+TEST_F(TestUringStore, ConcurrentAppendsFromThreads) {
+    constexpr int num_threads = 8;
+    constexpr int appends_per_thread = 100;
+    std::vector<std::future<void>> futures;
+    for (int i = 0; i < num_threads; ++i) {
+        futures.emplace_back(std::async(std::launch::async, [this, i]() {
+            FileHandlePtr fh;
+            auto filename = "test_file" + std::to_string(i);
+            auto status = _store->open(filename.c_str(), O_RDWR | O_CREAT, &fh).get();
+            ASSERT_TRUE(status.ok());
+            for (int j = 0; j < appends_per_thread; ++j) {
+                IOBuf buf;
+                buf.append("0123456789");
+                status = _store->append(fh, j * 10, buf).get();
+                ASSERT_TRUE(status.ok()) << status.error_str();
+            }
+        }));
+    }
+    for (auto& future : futures) {
+        future.get();
+    }
+    for (int i = 0; i < num_threads; ++i) {
+        ASSERT_EQ(get_file_size("test_file" + std::to_string(i)), appends_per_thread * 10);
+    }
+}
+
+TEST_F(TestUringStore, NullPointerHandling) {
+    IOBuf buf;
+    uint64_t size = 0;
+    ASSERT_FALSE(_store->append(nullptr, 0, buf).get().ok());
+    ASSERT_FALSE(_store->read(nullptr, 0, 1, &buf).get().ok());
+    ASSERT_FALSE(_store->seal(nullptr).get().ok());
+    ASSERT_FALSE(_store->sync(nullptr).get().ok());
+    ASSERT_FALSE(_store->size(nullptr, &size).get().ok());
+
+    FileHandlePtr fh;
+    auto status = _store->open("test_file1", O_RDWR | O_CREAT, &fh).get();
+    ASSERT_TRUE(status.ok());
+    ASSERT_FALSE(_store->read(fh, 0, 1, nullptr).get().ok());
+    ASSERT_FALSE(_store->size(fh, nullptr).get().ok());
+}
+
+} // namespace
+// NOLINTEND(readability-magic-numbers)
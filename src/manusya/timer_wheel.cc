@@ -0,0 +1,90 @@
+#include "manusya/timer_wheel.h"
+
+#include <butil/time.h>
+#include <gflags/gflags.h>
+#include <pain/base/plog.h>
+#include <algorithm>
+#include <utility>
+
+DEFINE_uint32(manusya_timer_wheel_tick_us, 100 * 1000, "The tick of the timer wheel, which is the timer precision");
+DEFINE_uint32(manusya_timer_wheel_slots, 512, "The number of slots of the timer wheel");
+
+namespace pain::manusya {
+
+TimerWheel::TimerWheel(uint32_t tick_us, uint32_t slot_num) :
+    _tick_us(std::max(tick_us, 1U)),
+    _slots(std::max(slot_num, 1U)),
+    _current_tick(butil::gettimeofday_us() / _tick_us) {
+    if (bthread_start_background(&_tid, nullptr, run, this) != 0) {
+        PLOG_ERROR(("desc", "failed to start timer wheel bthread"));
+        _tid = 0;
+    }
+}
+
+TimerWheel::~TimerWheel() {
+    {
+        std::unique_lock lock(_mutex);
+        _stopped = true;
+        _cond.notify_all();
+    }
+    if (_tid != 0) {
+        bthread_join(_tid, nullptr);
+    }
+}
+
+TimerWheelPtr TimerWheel::default_instance() {
+    static auto s_wheel = std::make_shared<TimerWheel>(FLAGS_manusya_timer_wheel_tick_us, FLAGS_manusya_timer_wheel_slots);
+    return s_wheel;
+}
+
+void TimerWheel::schedule(int64_t deadline_us, Callback cb) {
+    std::unique_lock lock(_mutex);
+    // round up, so the deadline has passed once the tick is reached,
+    // and a deadline in a processed tick goes to the next one
+    auto tick = std::max((deadline_us + _tick_us - 1) / _tick_us, _current_tick + 1);
+    _slots[tick % _slots.size()].push_back({deadline_us, std::move(cb)});
+}
+
+void* TimerWheel::run(void* arg) {
+    static_cast<TimerWheel*>(arg)->loop();
+    return nullptr;
+}
+
+void TimerWheel::loop() {
+    std::vector<Callback> expired;
+    while (true) {
+        {
+            std::unique_lock lock(_mutex);
+            if (_stopped) {
+                break;
+            }
+            _cond.wait_for(lock, _tick_us);
+            if (_stopped) {
+                break;
+            }
+            auto now = butil::gettimeofday_us();
+            auto now_tick = now / _tick_us;
+            // a full round covers every slot, no need to go further if we were late
+            auto first_tick = std::max(_current_tick + 1, now_tick - static_cast<int64_t>(_slots.size()) + 1);
+            for (auto tick = first_tick; tick <= now_tick; tick++) {
+                auto& slot = _slots[tick % _slots.size()];
+                // timers of later rounds stay in the slot
+                auto it = std::partition(slot.begin(), slot.end(), [now](const Timer& timer) {
+                    return timer.deadline_us > now;
+                });
+                for (auto i = it; i != slot.end(); i++) {
+                    expired.emplace_back(std::move(i->cb));
+                }
+                slot.erase(it, slot.end());
+            }
+            _current_tick = std::max(_current_tick, now_tick);
+        }
+        // run the callbacks without the lock, they may schedule again
+        for (auto& cb : expired) {
+            cb();
+        }
+        expired.clear();
+    }
+}
+
+} // namespace pain::manusya
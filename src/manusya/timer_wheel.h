@@ -0,0 +1,59 @@
+#pragma once
+
+#include <bthread/bthread.h>
+#include <bthread/condition_variable.h>
+#include <bthread/mutex.h>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace pain::manusya {
+
+class TimerWheel;
+using TimerWheelPtr = std::shared_ptr<TimerWheel>;
+
+// TimerWheel is a coarse-grained hashed timer wheel driven by a single background bthread.
+// Timers are bucketed by tick, a callback runs on the wheel bthread within one tick after
+// its deadline. It is meant for timeouts where precision doesn't matter and the number of
+// timers is large, bthread_timer_add per timer is much more expensive in that case.
+class TimerWheel {
+public:
+    using Callback = std::function<void()>;
+
+    TimerWheel(uint32_t tick_us, uint32_t slot_num);
+    ~TimerWheel();
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // the wheel shared by users which don't own one
+    static TimerWheelPtr default_instance();
+
+    // deadline_us is the absolute time from butil::gettimeofday_us()
+    void schedule(int64_t deadline_us, Callback cb);
+
+    uint32_t tick_us() const {
+        return _tick_us;
+    }
+
+private:
+    struct Timer {
+        int64_t deadline_us;
+        Callback cb;
+    };
+
+    static void* run(void* arg);
+    void loop();
+
+    uint32_t _tick_us;
+    std::vector<std::vector<Timer>> _slots;
+    int64_t _current_tick = 0; // every slot up to this tick has been processed
+
+    bool _stopped = false;
+    bthread::Mutex _mutex;
+    bthread::ConditionVariable _cond;
+    bthread_t _tid = 0;
+};
+
+} // namespace pain::manusya
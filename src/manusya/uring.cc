@@ -0,0 +1,317 @@
+#include "manusya/uring.h"
+
+#include <bthread/bthread.h>
+#include <pain/base/plog.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <boost/assert.hpp>
+
+namespace pain::manusya {
+
+namespace {
+
+int io_uring_setup(uint32_t entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int io_uring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+constexpr uint32_t kMinReapBackoffUs = 1000;
+constexpr uint32_t kMaxReapBackoffUs = 1000 * 1000;
+
+template <typename T>
+T* ring_ptr(void* ring, uint32_t offset) {
+    return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+}
+
+} // namespace
+
+Uring::~Uring() {
+    stop();
+}
+
+int Uring::init(uint32_t entries) {
+    BOOST_ASSERT(_ring_fd < 0);
+    int fd = io_uring_setup(entries, &_params);
+    if (fd < 0) {
+        int err = errno;
+        PLOG_ERROR(("desc", "failed to setup io_uring")("entries", entries)("errno", err));
+        return -err;
+    }
+
+    _sq_ring_size = _params.sq_off.array + _params.sq_entries * sizeof(uint32_t);
+    _cq_ring_size = _params.cq_off.cqes + _params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (_params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        _sq_ring_size = std::max(_sq_ring_size, _cq_ring_size);
+        _cq_ring_size = _sq_ring_size;
+    }
+
+    auto unmap_all = [this, fd]() {
+        if (_sqes != nullptr) {
+            munmap(_sqes, _sqes_size);
+        }
+        if (_cq_ring != nullptr && _cq_ring != _sq_ring) {
+            munmap(_cq_ring, _cq_ring_size);
+        }
+        if (_sq_ring != nullptr) {
+            munmap(_sq_ring, _sq_ring_size);
+        }
+        _sqes = nullptr;
+        _cq_ring = nullptr;
+        _sq_ring = nullptr;
+        ::close(fd);
+    };
+
+    _sq_ring = mmap(nullptr, _sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (_sq_ring == MAP_FAILED) {
+        int err = errno;
+        _sq_ring = nullptr;
+        unmap_all();
+        PLOG_ERROR(("desc", "failed to mmap sq ring")("errno", err));
+        return -err;
+    }
+
+    if (single_mmap) {
+        _cq_ring = _sq_ring;
+    } else {
+        _cq_ring =
+            mmap(nullptr, _cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (_cq_ring == MAP_FAILED) {
+            int err = errno;
+            _cq_ring = nullptr;
+            unmap_all();
+            PLOG_ERROR(("desc", "failed to mmap cq ring")("errno", err));
+            return -err;
+        }
+    }
+
+    _sqes_size = _params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        int err = errno;
+        unmap_all();
+        PLOG_ERROR(("desc", "failed to mmap sqes")("errno", err));
+        return -err;
+    }
+    _sqes = static_cast<io_uring_sqe*>(sqes);
+
+    _sq_head = ring_ptr<uint32_t>(_sq_ring, _params.sq_off.head);
+    _sq_tail = ring_ptr<uint32_t>(_sq_ring, _params.sq_off.tail);
+    _sq_mask = *ring_ptr<uint32_t>(_sq_ring, _params.sq_off.ring_mask);
+    _sq_array = ring_ptr<uint32_t>(_sq_ring, _params.sq_off.array);
+    _cq_head = ring_ptr<uint32_t>(_cq_ring, _params.cq_off.head);
+    _cq_tail = ring_ptr<uint32_t>(_cq_ring, _params.cq_off.tail);
+    _cq_mask = *ring_ptr<uint32_t>(_cq_ring, _params.cq_off.ring_mask);
+    _cqes = ring_ptr<io_uring_cqe>(_cq_ring, _params.cq_off.cqes);
+
+    // sqe slots are used in ring order, so the indirection array is an identity map
+    for (uint32_t i = 0; i < _params.sq_entries; i++) {
+        _sq_array[i] = i;
+    }
+
+    // the sq only holds the sqes queued while a submitter is in io_uring_enter, a submitter waits
+    // for it when it's full. The real limit is the cq which must not overflow. Without NODROP, keep half
+    // of the cq for the submissions from the reaper thread, which don't wait for the quota
+    _max_inflight = _params.cq_entries;
+    if ((_params.features & IORING_FEAT_NODROP) == 0) {
+        _max_inflight /= 2;
+    }
+    _ring_fd = fd;
+    _reaper = std::thread([this]() {
+        reap();
+    });
+    PLOG_INFO(("desc", "io_uring is ready")("sq_entries", _params.sq_entries)("cq_entries", _params.cq_entries));
+    return 0;
+}
+
+void Uring::stop() {
+    if (_ring_fd < 0) {
+        return;
+    }
+    {
+        std::unique_lock lock(_sq_mutex);
+        if (!_stopped) {
+            _stopped = true;
+            _sq_cond.notify_all();
+            while (sq_full()) {
+                _sq_cond.wait(lock);
+            }
+            // wake up the reaper by a nop whose user_data is nullptr
+            auto sqe = next_sqe();
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_NOP;
+            push();
+            enter(lock);
+        }
+        _sq_cond.notify_all();
+    }
+    if (_reaper.joinable()) {
+        _reaper.join();
+    }
+    {
+        std::unique_lock lock(_sq_mutex);
+        while (_completing.load(std::memory_order_acquire) > 0) {
+            _sq_cond.wait(lock);
+        }
+    }
+    munmap(_sqes, _sqes_size);
+    if (_cq_ring != _sq_ring) {
+        munmap(_cq_ring, _cq_ring_size);
+    }
+    munmap(_sq_ring, _sq_ring_size);
+    ::close(_ring_fd);
+    _ring_fd = -1;
+}
+
+// must be called with _sq_mutex held
+io_uring_sqe* Uring::next_sqe() {
+    auto tail = *_sq_tail;
+    return &_sqes[tail & _sq_mask];
+}
+
+// must be called with _sq_mutex held
+bool Uring::sq_full() const {
+    return *_sq_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) >= _params.sq_entries;
+}
+
+// must be called with _sq_mutex held
+void Uring::push() {
+    __atomic_store_n(_sq_tail, *_sq_tail + 1, __ATOMIC_RELEASE);
+    _inflight.fetch_add(1, std::memory_order_relaxed);
+}
+
+// must be called with _sq_mutex held, it's released while in io_uring_enter
+void Uring::enter(std::unique_lock<bthread::Mutex>& lock) {
+    if (_entering) {
+        return;
+    }
+    _entering = true;
+    while (true) {
+        uint32_t queued = *_sq_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+        if (queued == 0) {
+            break;
+        }
+        // the kernel consumes at most the sqes queued so far, the slots behind them are filled meanwhile
+        lock.unlock();
+        int r = io_uring_enter(_ring_fd, queued, 0, 0);
+        int err = r < 0 ? errno : EAGAIN;
+        lock.lock();
+        if (r < 0 && err == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            auto failed = fail_queued(err);
+            // the ops are completed out of the lock, their callbacks may submit again
+            lock.unlock();
+            for (auto* op : failed) {
+                complete(op, -err);
+            }
+            lock.lock();
+        }
+        _sq_cond.notify_all();
+    }
+    _entering = false;
+}
+
+// must be called with _sq_mutex held, none of the queued sqes has been consumed by the kernel,
+// return the ops of them to be completed with -err
+std::vector<UringOp*> Uring::fail_queued(int err) {
+    auto head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+    auto tail = *_sq_tail;
+    std::vector<UringOp*> failed;
+    for (auto i = head; i != tail; i++) {
+        auto op = reinterpret_cast<UringOp*>(_sqes[i & _sq_mask].user_data);
+        BOOST_ASSERT_MSG(op != nullptr, "failed to wake up io_uring reaper");
+        if (op != nullptr) {
+            failed.push_back(op);
+        }
+    }
+    // take the sqes back so that they will never be submitted along with later ones
+    __atomic_store_n(_sq_tail, head, __ATOMIC_RELEASE);
+    _inflight.fetch_sub(tail - head, std::memory_order_relaxed);
+    PLOG_ERROR(("desc", "failed to submit sqes")("count", tail - head)("errno", err));
+    return failed;
+}
+
+void Uring::reap() {
+    bool stopped = false;
+    // the wait after a failed io_uring_enter, doubled on every failure in a row
+    uint32_t backoff_us = 0;
+    // keep reaping after stop until every op in flight has been completed
+    while (!stopped || _inflight.load(std::memory_order_relaxed) > 0) {
+        int r = io_uring_enter(_ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+        int err = r < 0 ? errno : 0;
+        if (err != 0 && err != EINTR) {
+            // the ops in flight still belong to the kernel and can't be failed,
+            // back off rather than spin on an error that may not go away
+            backoff_us = std::clamp(backoff_us * 2, kMinReapBackoffUs, kMaxReapBackoffUs);
+            PLOG_ERROR(("desc", "failed to wait cqe")("errno", err)("backoff_us", backoff_us));
+            std::this_thread::sleep_for(std::chrono::microseconds(backoff_us));
+        } else if (err == 0) {
+            backoff_us = 0;
+        }
+
+        auto head = *_cq_head;
+        auto tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+        uint32_t reaped = 0;
+        while (head != tail) {
+            auto cqe = &_cqes[head & _cq_mask];
+            auto op = reinterpret_cast<UringOp*>(cqe->user_data);
+            int res = cqe->res;
+            head++;
+            // release the cq slot and the inflight quota before dispatching the callback,
+            // the callback may submit again
+            __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+            _inflight.fetch_sub(1, std::memory_order_relaxed);
+            reaped++;
+            if (op == nullptr) {
+                stopped = true;
+                continue;
+            }
+            complete(op, res);
+        }
+
+        if (reaped > 0) {
+            std::unique_lock lock(_sq_mutex);
+            _sq_cond.notify_all();
+        }
+    }
+}
+
+// the op is completed on a bthread rather than on the reaper, which all the other completions wait for,
+// or inside a submit, whose caller may hold the locks the continuations take. Inline if none can be started
+void Uring::complete(UringOp* op, int res) {
+    struct Completion {
+        Uring* uring;
+        UringOp* op;
+        int res;
+    };
+    auto run = [](void* arg) -> void* {
+        std::unique_ptr<Completion> completion(static_cast<Completion*>(arg));
+        auto* uring = completion->uring;
+        completion->op->on_complete(completion->res);
+        if (uring->_completing.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::unique_lock lock(uring->_sq_mutex);
+            uring->_sq_cond.notify_all();
+        }
+        return nullptr;
+    };
+    _completing.fetch_add(1, std::memory_order_relaxed);
+    auto* completion = new Completion{this, op, res};
+    bthread_t tid = 0;
+    if (bthread_start_background(&tid, nullptr, run, completion) != 0) {
+        run(completion);
+    }
+}
+
+} // namespace pain::manusya
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <bthread/condition_variable.h>
+#include <bthread/mutex.h>
+#include <linux/io_uring.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pain::manusya {
+
+// UringOp is the completion target of a submitted sqe, the sqe's user_data points to it.
+// on_complete is invoked on a bthread with the cqe's res (>= 0 or -errno),
+// or with -errno if io_uring_enter rejected the sqe. It may submit the op again.
+class UringOp {
+public:
+    virtual ~UringOp() = default;
+    virtual void on_complete(int res) = 0;
+};
+
+// Uring is a minimal io_uring instance driven by raw syscalls:
+//   - any bthread/pthread can submit, the sqes are queued under a mutex, and the submitter that finds nobody
+//     entering the kernel hands all the queued sqes to a single io_uring_enter, the sqes queued meanwhile
+//     go with its next one, so a burst of submissions costs a few syscalls rather than one each
+//   - a dedicated reaper pthread waits for completions and dispatches them to UringOp on bthreads,
+//     the continuations take bthread mutexes which must not stall the reaping of the others
+//   - the number of in-flight ops is bounded by the size of completion queue
+class Uring {
+public:
+    Uring() = default;
+    ~Uring();
+
+    Uring(const Uring&) = delete;
+    Uring& operator=(const Uring&) = delete;
+
+    // return 0 on success, -errno on failure
+    int init(uint32_t entries);
+    void stop();
+
+    bool ready() const {
+        return _ring_fd >= 0;
+    }
+
+    // prepare fills the sqe, user_data is set by submit
+    // return 0 once the sqe is queued, -ESHUTDOWN after stop, op->on_complete will not be called on failure.
+    // An sqe rejected by io_uring_enter is completed with -errno on a bthread
+    template <typename Prepare>
+    int submit(UringOp* op, Prepare&& prepare) {
+        std::unique_lock lock(_sq_mutex);
+        // a completion runs on the reaper thread if no bthread can be started, it may submit there
+        // and must never wait for the quota the reaper is supposed to release, the kernel keeps the overflowed cqes
+        bool on_reaper = std::this_thread::get_id() == _reaper.get_id();
+        while (!_stopped && ((_inflight >= _max_inflight && !on_reaper) || sq_full())) {
+            _sq_cond.wait(lock);
+        }
+        if (_stopped) {
+            return -ESHUTDOWN;
+        }
+        auto sqe = next_sqe();
+        memset(sqe, 0, sizeof(*sqe));
+        prepare(sqe);
+        sqe->user_data = reinterpret_cast<uint64_t>(op);
+        push();
+        enter(lock);
+        return 0;
+    }
+
+    uint64_t inflight() const {
+        return _inflight.load(std::memory_order_relaxed);
+    }
+
+private:
+    io_uring_sqe* next_sqe();
+    bool sq_full() const;
+    void push();
+    void enter(std::unique_lock<bthread::Mutex>& lock);
+    std::vector<UringOp*> fail_queued(int err);
+    void reap();
+    void complete(UringOp* op, int res);
+
+    int _ring_fd = -1;
+    io_uring_params _params = {};
+
+    void* _sq_ring = nullptr;
+    size_t _sq_ring_size = 0;
+    void* _cq_ring = nullptr;
+    size_t _cq_ring_size = 0;
+    io_uring_sqe* _sqes = nullptr;
+    size_t _sqes_size = 0;
+
+    uint32_t* _sq_head = nullptr;
+    uint32_t* _sq_tail = nullptr;
+    uint32_t _sq_mask = 0;
+    uint32_t* _sq_array = nullptr;
+    uint32_t* _cq_head = nullptr;
+    uint32_t* _cq_tail = nullptr;
+    uint32_t _cq_mask = 0;
+    io_uring_cqe* _cqes = nullptr;
+
+    std::atomic<uint64_t> _inflight = 0;
+    // the completions dispatched but not done yet, stop waits for them since they may submit again
+    std::atomic<uint64_t> _completing = 0;
+    uint64_t _max_inflight = 0;
+    bool _stopped = false;
+    // a submitter is in io_uring_enter, the sqes queued meanwhile are submitted by it
+    bool _entering = false;
+    bthread::Mutex _sq_mutex;
+    bthread::ConditionVariable _sq_cond;
+    std::thread _reaper;
+};
+
+} // namespace pain::manusya
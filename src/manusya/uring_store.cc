@@ -0,0 +1,343 @@
+#include "manusya/uring_store.h"
+
+#include <fcntl.h>
+#include <gflags/gflags.h>
+#include <pain/base/future.h>
+#include <pain/base/plog.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+#include <boost/assert.hpp>
+#include "manusya/file_handle.h"
+#include "manusya/macro.h"
+
+DEFINE_uint32(manusya_uring_entries, 256, "The number of sq entries of the io_uring used by uring store");
+DEFINE_uint64(manusya_uring_max_read_size,
+              64 * 1024 * 1024,
+              "The largest read submitted to io_uring, larger ones are read by pread as the data comes");
+
+namespace pain::manusya {
+
+namespace {
+
+class UringStoreOp : public UringOp {
+public:
+    UringStoreOp(Uring* uring, FileHandlePtr fh) : _uring(uring), _fh(fh) {}
+
+    Future<Status> get_future() {
+        return _promise.get_future();
+    }
+
+    int fd() {
+        return _fh->as<LocalFileHandle>()->handle();
+    }
+
+    virtual void prepare(io_uring_sqe* sqe) = 0;
+
+    // also called by on_complete to go on with what is left
+    void submit() {
+        int r = _uring->submit(this, [this](io_uring_sqe* sqe) {
+            prepare(sqe);
+        });
+        if (r != 0) {
+            finish(Status(-r, "failed to submit to io_uring"));
+        }
+    }
+
+    void finish(Status status) {
+        _promise.set_value(std::move(status));
+        delete this;
+    }
+
+private:
+    Uring* _uring;
+    FileHandlePtr _fh; // keep fd open until the op is completed
+    Promise<Status> _promise;
+};
+
+class AppendOp : public UringStoreOp {
+public:
+    AppendOp(Uring* uring, FileHandlePtr fh, uint64_t offset, IOBuf buf) :
+        UringStoreOp(uring, fh),
+        _offset(offset),
+        _buf(std::move(buf)) {
+        fill_iov();
+    }
+
+    void prepare(io_uring_sqe* sqe) override {
+        sqe->opcode = IORING_OP_WRITEV;
+        sqe->fd = fd();
+        sqe->addr = reinterpret_cast<uint64_t>(_iov.data());
+        sqe->len = _iov.size();
+        sqe->off = _offset;
+    }
+
+    void on_complete(int res) override {
+        if (res < 0) {
+            PLOG_ERROR(("desc", "failed to write to file")("fd", fd())("errno", -res));
+            finish(Status(-res, "failed to write to file"));
+            return;
+        }
+        if (res == 0) {
+            PLOG_ERROR(("desc", "no progress writing to file")("fd", fd())("offset", _offset));
+            finish(Status(EIO, "failed to write to file"));
+            return;
+        }
+        _buf.pop_front(res);
+        _offset += res;
+        if (!_buf.empty()) {
+            // short write or more than IOV_MAX blocks
+            fill_iov();
+            submit();
+            return;
+        }
+        finish(Status::OK());
+    }
+
+private:
+    // at most IOV_MAX blocks a time, the rest is submitted again once they are written
+    void fill_iov() {
+        auto n = std::min<size_t>(_buf.backing_block_num(), IOV_MAX);
+        _iov.clear();
+        _iov.reserve(n);
+        for (size_t i = 0; i < n; i++) {
+            auto block = _buf.backing_block(i);
+            _iov.push_back({const_cast<char*>(block.data()), block.size()});
+        }
+    }
+
+    uint64_t _offset;
+    IOBuf _buf;
+    std::vector<iovec> _iov;
+};
+
+class ReadOp : public UringStoreOp {
+public:
+    ReadOp(Uring* uring, FileHandlePtr fh, uint64_t offset, uint64_t size, IOBuf* buf) :
+        UringStoreOp(uring, fh),
+        _offset(offset),
+        _size(size),
+        _data(malloc(size)),
+        _out(buf) {}
+
+    ~ReadOp() override {
+        free(_data);
+    }
+
+    bool allocated() const {
+        return _data != nullptr;
+    }
+
+    void prepare(io_uring_sqe* sqe) override {
+        _iov.iov_base = static_cast<char*>(_data) + _nread;
+        _iov.iov_len = _size - _nread;
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = fd();
+        sqe->addr = reinterpret_cast<uint64_t>(&_iov);
+        sqe->len = 1;
+        sqe->off = _offset + _nread;
+    }
+
+    void on_complete(int res) override {
+        if (res < 0) {
+            PLOG_ERROR(("desc", "failed to read from file")("fd", fd())("errno", -res));
+            finish(Status(-res, "failed to read from file"));
+            return;
+        }
+        if (res == 0) {
+            // the end of the file
+            finish(Status(EINVAL, "invalid size"));
+            return;
+        }
+        _nread += res;
+        if (_nread < _size) {
+            // short read, go on with the rest
+            submit();
+            return;
+        }
+        IOBuf buf;
+        // hand the buffer over to IOBuf without copying
+        buf.append_user_data(std::exchange(_data, nullptr), _size, free);
+        _out->swap(buf);
+        finish(Status::OK());
+    }
+
+private:
+    uint64_t _offset;
+    uint64_t _size;
+    uint64_t _nread = 0;
+    void* _data;
+    iovec _iov = {};
+    IOBuf* _out;
+};
+
+class SealOp : public UringStoreOp {
+public:
+    SealOp(Uring* uring, FileHandlePtr fh) : UringStoreOp(uring, fh) {}
+
+    void prepare(io_uring_sqe* sqe) override {
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fd = fd();
+    }
+
+    void on_complete(int res) override {
+        if (res < 0) {
+            PLOG_ERROR(("desc", "failed to fsync")("fd", fd())("errno", -res));
+            finish(Status(-res, "failed to fsync"));
+            return;
+        }
+        // io_uring has no fchmod, it only updates the inode and runs on the completion bthread
+        constexpr mode_t mode = 0444;
+        if (::fchmod(fd(), mode) < 0) {
+            finish(Status(errno, "failed to fchmod"));
+            return;
+        }
+        finish(Status::OK());
+    }
+};
+
+class SyncOp : public UringStoreOp {
+public:
+    SyncOp(Uring* uring, FileHandlePtr fh) : UringStoreOp(uring, fh) {}
+
+    void prepare(io_uring_sqe* sqe) override {
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fd = fd();
+        sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    }
+
+    void on_complete(int res) override {
+        if (res < 0) {
+            PLOG_ERROR(("desc", "failed to fdatasync")("fd", fd())("errno", -res));
+            finish(Status(-res, "failed to fdatasync"));
+            return;
+        }
+        finish(Status::OK());
+    }
+};
+
+class SizeOp : public UringStoreOp {
+public:
+    SizeOp(Uring* uring, FileHandlePtr fh, uint64_t* size) : UringStoreOp(uring, fh), _size(size) {}
+
+    void prepare(io_uring_sqe* sqe) override {
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = fd();
+        sqe->addr = reinterpret_cast<uint64_t>("");
+        sqe->len = STATX_SIZE;
+        sqe->off = reinterpret_cast<uint64_t>(&_statx);
+        sqe->statx_flags = AT_EMPTY_PATH;
+    }
+
+    void on_complete(int res) override {
+        if (res < 0) {
+            finish(Status(-res, "failed to statx"));
+            return;
+        }
+        *_size = _statx.stx_size;
+        finish(Status::OK());
+    }
+
+private:
+    struct statx _statx = {};
+    uint64_t* _size;
+};
+
+Future<Status> submit(UringStoreOp* op) {
+    auto future = op->get_future();
+    op->submit();
+    return future;
+}
+
+} // namespace
+
+UringStore::UringStore(const char* data_path) : LocalStore(data_path) {
+    int r = _uring.init(FLAGS_manusya_uring_entries);
+    if (r != 0) {
+        PLOG_WARN(("desc", "io_uring is unavailable, fallback to local store")("path", data_path)("errno", -r));
+    }
+}
+
+Future<Status> UringStore::append(FileHandlePtr fh, uint64_t offset, IOBuf buf, bool direct_io) {
+    SPAN(span);
+    if (fh == nullptr) {
+        return make_ready_future(Status(EINVAL, "fh is nullptr"));
+    }
+    // direct io is staged through the aligned buffers by LocalStore, it is not submitted to io_uring
+    if (!_uring.ready() || (direct_io && fh->as<LocalFileHandle>()->direct_handle() >= 0)) {
+        return LocalStore::append(fh, offset, std::move(buf), direct_io);
+    }
+    if (buf.empty()) {
+        return make_ready_future(Status::OK());
+    }
+    return submit(new AppendOp(&_uring, fh, offset, std::move(buf)));
+}
+
+Future<Status> UringStore::read(FileHandlePtr fh, uint64_t offset, uint64_t size, IOBuf* buf, bool direct_io) {
+    SPAN(span);
+    if (fh == nullptr) {
+        return make_ready_future(Status(EINVAL, "fh is nullptr"));
+    }
+    if (buf == nullptr) {
+        return make_ready_future(Status(EINVAL, "buf is nullptr"));
+    }
+    // the buffer of a read through io_uring is allocated for the whole size up front, the size is from
+    // the request, so a large one goes to LocalStore which only grows the buffer by the data read
+    if (!_uring.ready() || (direct_io && fh->as<LocalFileHandle>()->direct_handle() >= 0) ||
+        size > FLAGS_manusya_uring_max_read_size) {
+        return LocalStore::read(fh, offset, size, buf, direct_io);
+    }
+    if (size == 0) {
+        buf->clear();
+        return make_ready_future(Status::OK());
+    }
+    auto* op = new ReadOp(&_uring, fh, offset, size, buf);
+    if (!op->allocated()) {
+        delete op;
+        PLOG_ERROR(("desc", "failed to allocate read buffer")("size", size));
+        return make_ready_future(Status(ENOMEM, "failed to allocate read buffer"));
+    }
+    return submit(op);
+}
+
+Future<Status> UringStore::seal(FileHandlePtr fh) {
+    SPAN(span);
+    if (fh == nullptr) {
+        return make_ready_future(Status(EINVAL, "fh is nullptr"));
+    }
+    if (!_uring.ready()) {
+        return LocalStore::seal(fh);
+    }
+    return submit(new SealOp(&_uring, fh));
+}
+
+Future<Status> UringStore::sync(FileHandlePtr fh) {
+    SPAN(span);
+    if (fh == nullptr) {
+        return make_ready_future(Status(EINVAL, "fh is nullptr"));
+    }
+    if (!_uring.ready()) {
+        return LocalStore::sync(fh);
+    }
+    return submit(new SyncOp(&_uring, fh));
+}
+
+Future<Status> UringStore::size(FileHandlePtr fh, uint64_t* size) {
+    SPAN(span);
+    if (fh == nullptr) {
+        return make_ready_future(Status(EINVAL, "fh is nullptr"));
+    }
+    if (size == nullptr) {
+        return make_ready_future(Status(EINVAL, "size is nullptr"));
+    }
+    if (!_uring.ready()) {
+        return LocalStore::size(fh, size);
+    }
+    return submit(new SizeOp(&_uring, fh, size));
+}
+
+} // namespace pain::manusya
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include "manusya/local_store.h"
+#include "manusya/uring.h"
+
+namespace pain::manusya {
+
+// UringStore shares the on-disk layout and the metadata path (open/remove/attrs) with LocalStore,
+// but the data path (append/read/seal/sync/size) is submitted to io_uring and the returned future
+// is completed by the reaper thread, so the caller can keep many requests in flight.
+// If io_uring is unavailable, it falls back to the synchronous LocalStore implementation.
+class UringStore : public LocalStore {
+public:
+    UringStore(const char* data_path);
+    ~UringStore() override = default;
+
+    Future<Status> append(FileHandlePtr fh, uint64_t offset, IOBuf buf, bool direct_io = false) override;
+    Future<Status> read(FileHandlePtr fh, uint64_t offset, uint64_t size, IOBuf* buf, bool direct_io = false) override;
+    Future<Status> seal(FileHandlePtr fh) override;
+    Future<Status> sync(FileHandlePtr fh) override;
+    Future<Status> size(FileHandlePtr fh, uint64_t* size) override;
+    // the requests falling back to LocalStore are counted by it
+    uint64_t queue_depth() const override {
+        return LocalStore::queue_depth() + _uring.inflight();
+    }
+
+private:
+    Uring _uring;
+};
+
+} // namespace pain::manusya
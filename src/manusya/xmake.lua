@@ -1,6 +1,6 @@
 target("manusya")
     set_kind("binary")
-    add_files("**.cc")
+    add_files("**.cc|test/**.cc|bench/**.cc")
     add_deps("pain_base")
     add_deps("pain_proto")
     add_packages("spdlog")
@@ -8,3 +8,4 @@ target("manusya")
     add_packages("gflags")
     add_packages("uuid_v4")
     add_packages("boost")
+    add_packages("spdk")
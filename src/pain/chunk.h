@@ -11,7 +11,7 @@ enum class ChunkState {
 
 enum class ChunkType {
     kReplication = 0,
-    kEc = 1, // not supported
+    kEc = 1, // see EcChunk
 };
 
 struct Location {
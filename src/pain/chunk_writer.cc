@@ -0,0 +1,410 @@
+#include "pain/chunk_writer.h"
+
+#include <bthread/bthread.h>
+#include <pain/base/plog.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace pain {
+
+namespace {
+
+// the replies of the replicas to one append, the promise is set once when the append is acked or can't be
+struct ReplicaAck {
+    ReplicaAck(uint32_t needed, uint32_t total) : needed(needed), total(total) {}
+
+    void on_reply(const Status& status) {
+        if (status.ok()) {
+            if (acked.fetch_add(1) + 1 == needed) {
+                promise.set_value(Status::OK());
+            }
+        } else if (failed.fetch_add(1) + 1 == total - needed + 1) {
+            promise.set_value(status);
+        }
+    }
+
+    uint32_t needed;
+    uint32_t total;
+    std::atomic<uint32_t> acked = 0;
+    std::atomic<uint32_t> failed = 0;
+    Promise<Status> promise;
+};
+
+bool same_uuid(const proto::UUID& lhs, const proto::UUID& rhs) {
+    return lhs.low() == rhs.low() && lhs.high() == rhs.high();
+}
+
+// the replicas of an EC chunk are its data fragments followed by its parity fragments
+std::shared_ptr<EcChunk> make_ec_chunk(const proto::ChunkInfo& chunk, uint32_t cell_size, ManusyaClient* client) {
+    if (chunk.type() != proto::CHUNK_TYPE_EC || chunk.state() == proto::CHUNK_STATE_SEALED) {
+        return nullptr;
+    }
+    auto parity_count = chunk.config().parity_count();
+    auto fragment_count = static_cast<uint32_t>(chunk.replicas_size());
+    if (parity_count == 0 || fragment_count <= parity_count) {
+        return nullptr;
+    }
+    std::vector<EcFragment> fragments;
+    for (const auto& replica : chunk.replicas()) {
+        fragments.push_back(EcFragment{.chunk_id = UUID(replica.chunk_id().high(), replica.chunk_id().low()),
+                                       .location = replica.location().uri()});
+    }
+    return std::make_shared<EcChunk>(
+        fragment_count - parity_count, parity_count, cell_size, std::move(fragments), client);
+}
+
+} // namespace
+
+std::shared_ptr<ChunkWriter> ChunkWriter::create(proto::ChunkInfo chunk,
+                                                 Roller roller,
+                                                 const ChunkWriterOptions& options,
+                                                 ManusyaClient* client) {
+    return std::shared_ptr<ChunkWriter>(new ChunkWriter(std::move(chunk), std::move(roller), options, client));
+}
+
+ChunkWriter::ChunkWriter(proto::ChunkInfo chunk,
+                         Roller roller,
+                         const ChunkWriterOptions& options,
+                         ManusyaClient* client) :
+    _roller(std::move(roller)), _options(options), _client(client), _chunk(std::move(chunk)) {
+    _send_offset = _chunk.length();
+    if (_chunk.type() == proto::CHUNK_TYPE_EC && _chunk.state() != proto::CHUNK_STATE_SEALED) {
+        // the stripes of an EC chunk written before are not known here, so it's sealed at its length
+        _broken = true;
+    }
+}
+
+Future<Status> ChunkWriter::flush() {
+    std::shared_ptr<EcChunk> ec;
+    {
+        std::unique_lock lock(_mutex);
+        if (_ec != nullptr) {
+            ec = end_ec();
+        }
+    }
+    if (ec == nullptr) {
+        return make_ready_future(Status::OK());
+    }
+    return ec->flush();
+}
+
+uint64_t ChunkWriter::size() const {
+    std::unique_lock lock(_mutex);
+    return _chunk.offset() + _chunk.length();
+}
+
+Future<Status> ChunkWriter::append(IOBuf data, bool direct_io, uint64_t* offset) {
+    PendingAppend append;
+    append.data.swap(data);
+    append.direct_io = direct_io;
+    append.offset = offset;
+    auto future = append.promise.get_future();
+    {
+        std::unique_lock lock(_mutex);
+        _pending.push_back(std::move(append));
+    }
+    kick();
+    return future;
+}
+
+bool ChunkWriter::need_roll(const PendingAppend& append) const {
+    if (_broken || _chunk.state() == proto::CHUNK_STATE_SEALED || _chunk.replicas_size() == 0) {
+        return true;
+    }
+    // an append larger than a chunk goes to an empty chunk alone
+    return _send_offset > 0 && _send_offset + append.data.size() > _options.chunk_size;
+}
+
+bool ChunkWriter::window_full(const PendingAppend& append) const {
+    // the appends waiting for the partial stripe of an EC chunk are not sent yet, they don't take the window
+    auto requests = _inflight.size() - _ec_waiting;
+    auto bytes = _inflight_bytes - _ec_waiting_bytes;
+    if (requests == 0) {
+        return false;
+    }
+    return requests >= _options.window_requests || bytes + append.data.size() > _options.window_bytes;
+}
+
+void ChunkWriter::kick() {
+    struct Send {
+        uint64_t offset;
+        IOBuf data;
+        bool direct_io;
+        // the stripes cut by the append to an EC chunk and the future of its ack
+        EcChunk::Stripes stripes;
+        Future<Status> ec;
+    };
+    std::vector<Send> sends;
+    proto::ChunkInfo chunk;
+    std::shared_ptr<EcChunk> ec_chunk;
+    bool start_roll = false;
+
+    std::unique_lock lock(_mutex);
+    if (_rolling) {
+        return;
+    }
+    while (!_pending.empty()) {
+        auto& front = _pending.front();
+        if (need_roll(front)) {
+            // the chunk is sealed at the bytes acked, which are known once nothing is in flight
+            if (_inflight.empty()) {
+                _rolling = true;
+                start_roll = true;
+            }
+            break;
+        }
+        if (window_full(front)) {
+            break;
+        }
+        auto size = front.data.size();
+        Send send{.offset = _send_offset, .data = front.data, .direct_io = front.direct_io, .stripes = {}, .ec = {}};
+        if (_ec != nullptr) {
+            // an EC chunk cuts the stripes in the order of its appends, so they are cut under the lock,
+            // and written without it as writing them may ack the appends waiting
+            auto buffered = _ec->buffered();
+            send.ec = _ec->cut(front.data, &send.stripes);
+            auto left = _ec->buffered();
+            if (left < buffered + size) {
+                // a stripe is cut, the appends waiting end in it
+                _ec_waiting = 0;
+                _ec_waiting_bytes = 0;
+                _ec_cuts++;
+            }
+            if (left > 0) {
+                _ec_waiting++;
+                _ec_waiting_bytes += size;
+            }
+        }
+        sends.push_back(std::move(send));
+        _inflight.push_back(InflightAppend{.append = std::move(front), .offset = _send_offset, .done = false});
+        _pending.pop_front();
+        _send_offset += size;
+        _inflight_bytes += size;
+    }
+    if (!sends.empty()) {
+        chunk = _chunk;
+        ec_chunk = _ec;
+    }
+    // the appends ending in the partial stripe of an EC chunk are acked once it's written, which ends the chunk,
+    // so it's written at once if the chunk is broken or must roll, or if no stripe fills within ec_flush_delay_ms
+    std::shared_ptr<EcChunk> ec;
+    bool schedule_flush = false;
+    uint64_t cuts = _ec_cuts;
+    if (_ec != nullptr && _ec_waiting > 0) {
+        if (_broken || (!_pending.empty() && need_roll(_pending.front()))) {
+            ec = end_ec();
+        } else if (_pending.empty() && !_ec_flush_scheduled) {
+            _ec_flush_scheduled = true;
+            schedule_flush = true;
+        }
+    }
+    lock.unlock();
+
+    for (auto& send : sends) {
+        if (send.ec.valid()) {
+            ec_chunk->write(std::move(send.stripes));
+            send.ec.then([self = shared_from_this(), offset = send.offset](Status status) {
+                if (!status.ok()) {
+                    PLOG_WARN(("desc", "failed to append ec chunk")("offset", offset)("error", status.error_str()));
+                }
+                self->on_append_done(offset, status);
+            });
+            continue;
+        }
+        this->send(chunk, send.offset, send.data, send.direct_io);
+    }
+    if (ec != nullptr) {
+        ec->flush();
+    }
+    if (schedule_flush) {
+        schedule_flush_ec(cuts);
+    }
+    if (start_roll) {
+        roll();
+    }
+}
+
+void ChunkWriter::schedule_flush_ec(uint64_t cuts) {
+    struct Arg {
+        std::shared_ptr<ChunkWriter> self;
+        uint64_t cuts;
+    };
+    auto run = [](void* arg) -> void* {
+        std::unique_ptr<Arg> flush(static_cast<Arg*>(arg));
+        bthread_usleep(static_cast<uint64_t>(flush->self->_options.ec_flush_delay_ms) * 1000);
+        flush->self->flush_ec(flush->cuts);
+        return nullptr;
+    };
+    auto* arg = new Arg{.self = shared_from_this(), .cuts = cuts};
+    bthread_t tid = 0;
+    if (_options.ec_flush_delay_ms == 0 || bthread_start_background(&tid, nullptr, run, arg) != 0) {
+        delete arg;
+        flush_ec(cuts);
+    }
+}
+
+void ChunkWriter::send(const proto::ChunkInfo& chunk, uint64_t offset, const IOBuf& data, bool direct_io) {
+    auto total = static_cast<uint32_t>(chunk.replicas_size());
+    auto needed = _options.quorum ? total / 2 + 1 : total;
+    auto ack = std::make_shared<ReplicaAck>(needed, total);
+    auto self = shared_from_this();
+
+    // the IOBuf of each replica references the same blocks, the data is not copied
+    for (const auto& replica : chunk.replicas()) {
+        UUID chunk_id(replica.chunk_id().high(), replica.chunk_id().low());
+        _client->append_chunk(replica.location().uri(), chunk_id, offset, data, direct_io)
+            .then([self, ack, chunk_uuid = chunk.uuid(), uri = replica.location().uri()](Status status) {
+                if (!status.ok()) {
+                    PLOG_WARN(("desc", "failed to append replica")("location", uri)("error", status.error_str()));
+                    self->on_replica_failed(chunk_uuid);
+                }
+                ack->on_reply(status);
+            });
+    }
+    ack->promise.get_future().then([self, offset](Status status) {
+        self->on_append_done(offset, status);
+    });
+}
+
+void ChunkWriter::on_append_done(uint64_t offset, const Status& status) {
+    std::vector<PendingAppend> acked;
+    std::vector<std::pair<PendingAppend, Status>> failed;
+
+    std::unique_lock lock(_mutex);
+    for (auto& inflight : _inflight) {
+        if (inflight.offset == offset) {
+            inflight.done = true;
+            inflight.status = status;
+            break;
+        }
+    }
+    if (!status.ok()) {
+        _broken = true;
+    }
+
+    // an append is acked only when the ones before it are, the chunk is never sealed across a hole
+    while (!_inflight.empty() && _inflight.front().done && _inflight.front().status.ok()) {
+        auto& front = _inflight.front();
+        auto size = front.append.data.size();
+        _chunk.set_length(front.offset + size);
+        *front.append.offset = _chunk.offset() + front.offset;
+        _inflight_bytes -= size;
+        acked.push_back(std::move(front.append));
+        _inflight.pop_front();
+    }
+
+    // the bytes of the appends left may be on some replicas, they are cut by sealing the chunk at the bytes acked
+    // and the appends are sent again to the next chunk in their order
+    bool drained = std::ranges::all_of(_inflight, [](const auto& inflight) {
+        return inflight.done;
+    });
+    if (_broken && drained) {
+        for (auto it = _inflight.rbegin(); it != _inflight.rend(); ++it) {
+            if (!it->status.ok() && ++it->append.retries > _options.max_retry) {
+                failed.emplace_back(std::move(it->append), it->status);
+                continue;
+            }
+            _pending.push_front(std::move(it->append));
+        }
+        if (!_inflight.empty()) {
+            PLOG_WARN(("desc", "appends failed, retry on a new chunk")("count", _inflight.size()));
+        }
+        _inflight.clear();
+        _inflight_bytes = 0;
+        _ec_waiting = 0;
+        _ec_waiting_bytes = 0;
+        _send_offset = _chunk.length();
+    }
+    lock.unlock();
+
+    for (auto& append : acked) {
+        append.promise.set_value(Status::OK());
+    }
+    for (auto& [append, error] : failed) {
+        append.promise.set_value(error);
+    }
+    kick();
+}
+
+void ChunkWriter::on_replica_failed(const proto::UUID& chunk_id) {
+    std::unique_lock lock(_mutex);
+    // a late reply of a chunk sealed already doesn't matter
+    if (same_uuid(chunk_id, _chunk.uuid())) {
+        _broken = true;
+    }
+}
+
+void ChunkWriter::roll() {
+    proto::ChunkInfo sealed;
+    {
+        std::unique_lock lock(_mutex);
+        // nothing is in flight, so an EC chunk has no partial stripe left
+        sealed = _chunk;
+    }
+    auto next = std::make_shared<proto::ChunkInfo>();
+    auto self = shared_from_this();
+    _roller(sealed, next.get()).then([self, sealed, next](Status status) {
+        std::shared_ptr<EcChunk> ec;
+        if (status.ok() && next->type() == proto::CHUNK_TYPE_EC) {
+            ec = make_ec_chunk(*next, self->_options.ec_cell_size, self->_client);
+            if (ec == nullptr) {
+                status = Status(EINVAL, "invalid ec chunk allocated");
+            }
+        }
+        std::unique_lock lock(self->_mutex);
+        if (!status.ok()) {
+            // the appends can't go anywhere, fail them and try again with the next append
+            PLOG_ERROR(("desc", "failed to roll chunk")("error", status.error_str()));
+            auto pending = std::exchange(self->_pending, {});
+            self->_rolling = false;
+            lock.unlock();
+            for (auto& append : pending) {
+                append.promise.set_value(status);
+            }
+            return;
+        }
+        next->set_offset(sealed.offset() + sealed.length());
+        next->set_length(0);
+        self->_ec = std::move(ec);
+        self->_chunk = std::move(*next);
+        self->_send_offset = 0;
+        self->_broken = false;
+        self->_rolling = false;
+        lock.unlock();
+        self->kick();
+    });
+}
+
+void ChunkWriter::flush_ec(uint64_t cuts) {
+    std::shared_ptr<EcChunk> ec;
+    {
+        std::unique_lock lock(_mutex);
+        if (_ec == nullptr || _ec_waiting == 0) {
+            _ec_flush_scheduled = false;
+            return;
+        }
+        if (_ec_cuts != cuts && _options.ec_flush_delay_ms != 0) {
+            // the stripes are still filling, wait for the appends waiting now
+            cuts = _ec_cuts;
+            lock.unlock();
+            schedule_flush_ec(cuts);
+            return;
+        }
+        _ec_flush_scheduled = false;
+        ec = end_ec();
+    }
+    ec->flush();
+}
+
+// must be called with _mutex held, the appends to the EC chunk are over and the ones waiting are acked by its flush
+std::shared_ptr<EcChunk> ChunkWriter::end_ec() {
+    _broken = true;
+    _ec_waiting = 0;
+    _ec_waiting_bytes = 0;
+    return _ec;
+}
+
+} // namespace pain
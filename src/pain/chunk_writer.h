@@ -0,0 +1,121 @@
+#pragma once
+
+#include <bthread/mutex.h>
+#include <pain/base/future.h>
+#include <pain/base/types.h>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include "pain/ec_chunk.h"
+#include "pain/manusya_client.h"
+#include "pain/proto/common.pb.h"
+
+namespace pain {
+
+struct ChunkWriterOptions {
+    // a chunk is sealed once the next append doesn't fit in it
+    uint64_t chunk_size = 64UL * 1024 * 1024;
+    // ack an append when a majority of the replicas ack it, instead of all of them
+    bool quorum = false;
+    // the times an append is sent again to a new chunk after the replicas fail
+    uint32_t max_retry = 3;
+    // the appends in flight to the chunk, manusya puts the out-of-order ones back in order, see Chunk::async_append
+    uint32_t window_requests = 1;
+    uint64_t window_bytes = 8UL * 1024 * 1024;
+    // the bytes of a cell of the stripes of an EC chunk
+    uint32_t ec_cell_size = 1024 * 1024;
+    // the time the appends ending in the partial stripe of an EC chunk wait for a stripe to fill, after that
+    // the partial stripe is padded and written to ack them, which ends the chunk
+    uint32_t ec_flush_delay_ms = 100;
+};
+
+// ChunkWriter appends the data of a file to its open chunk, each append is sent to all the replicas of the chunk
+// in parallel and the replicas share the blocks of the data. The offsets are assigned here, so up to a window of
+// appends are in flight at once and they are acked in the order of their offsets.
+// When the chunk is full or its replicas fail, the appends in flight are drained and the chunk is sealed at the
+// bytes acked, the roller returns a new one and the appends not acked go on there in their order.
+// A chunk of CHUNK_TYPE_EC is written through an EcChunk over its replicas, the data fragments first and then
+// config.parity_count parity fragments. An append to it is acked once the stripe holding its last byte is on all
+// the fragments, so the bytes acked are never cut when the chunk is sealed. The partial stripe at the end is written
+// padded when the writer is flushed, the chunk must roll, or no append fills it within ec_flush_delay_ms.
+class ChunkWriter : public std::enable_shared_from_this<ChunkWriter> {
+public:
+    // seal the chunk at its length and return the next chunk of the file in chunk, sealed is a sealed chunk
+    // with no replicas when the file has no open chunk
+    using Roller = std::function<Future<Status>(const proto::ChunkInfo& sealed, proto::ChunkInfo* chunk)>;
+
+    // chunk is the open chunk of the file, or a sealed one at the end of the file
+    static std::shared_ptr<ChunkWriter> create(proto::ChunkInfo chunk,
+                                               Roller roller,
+                                               const ChunkWriterOptions& options,
+                                               ManusyaClient* client = &ManusyaClient::instance());
+
+    // offset is set to the offset of data in the file before the future is ready
+    Future<Status> append(IOBuf data, bool direct_io, uint64_t* offset);
+
+    // write the partial stripe of an EC chunk, which can't be appended any more so the next append rolls
+    Future<Status> flush();
+
+    // the bytes of the file acked
+    uint64_t size() const;
+
+private:
+    struct PendingAppend {
+        IOBuf data;
+        bool direct_io = false;
+        uint64_t* offset = nullptr;
+        uint32_t retries = 0;
+        Promise<Status> promise;
+    };
+
+    // an append sent to the chunk, at offset of the chunk
+    struct InflightAppend {
+        PendingAppend append;
+        uint64_t offset = 0;
+        bool done = false;
+        Status status;
+    };
+
+    ChunkWriter(proto::ChunkInfo chunk, Roller roller, const ChunkWriterOptions& options, ManusyaClient* client);
+
+    // send the pending appends while the window allows, or roll the chunk once the appends in flight drain
+    void kick();
+    bool need_roll(const PendingAppend& append) const;
+    bool window_full(const PendingAppend& append) const;
+    void send(const proto::ChunkInfo& chunk, uint64_t offset, const IOBuf& data, bool direct_io);
+    void on_append_done(uint64_t offset, const Status& status);
+    void roll();
+    void on_replica_failed(const proto::UUID& chunk_id);
+    // write the partial stripe of the EC chunk for the appends waiting, unless more stripes are cut than cuts
+    void flush_ec(uint64_t cuts);
+    void schedule_flush_ec(uint64_t cuts);
+    std::shared_ptr<EcChunk> end_ec();
+
+    Roller _roller;
+    ChunkWriterOptions _options;
+    ManusyaClient* _client;
+
+    mutable bthread::Mutex _mutex;
+    // the length of _chunk is the bytes acked in it
+    proto::ChunkInfo _chunk;
+    // the EC chunk of _chunk, null if _chunk is replicated
+    std::shared_ptr<EcChunk> _ec;
+    // the appends in flight ending in the partial stripe of _ec, the last ones of _inflight
+    uint32_t _ec_waiting = 0;
+    uint64_t _ec_waiting_bytes = 0;
+    // the stripes cut from the appends, a flush is scheduled only while they don't fill the stripes
+    uint64_t _ec_cuts = 0;
+    bool _ec_flush_scheduled = false;
+    // the offset of the next append to _chunk
+    uint64_t _send_offset = 0;
+    // a replica of _chunk failed, it's sealed before the next append
+    bool _broken = false;
+    bool _rolling = false;
+    std::deque<PendingAppend> _pending;
+    // in the order of their offsets
+    std::deque<InflightAppend> _inflight;
+    uint64_t _inflight_bytes = 0;
+};
+
+} // namespace pain
@@ -1,5 +1,6 @@
 #include "pain/controller.h"
 #include "pain/controller_impl.h"
+#include <cerrno>
 #include "butil/iobuf.h"
 
 namespace pain {
@@ -10,18 +11,26 @@ Controller::~Controller() {
     delete _impl;
 }
 
-void Controller::Reset() {}
+void Controller::Reset() {
+    _impl->set_error_code(0);
+    _impl->set_error_text("");
+}
 bool Controller::Failed() const {
-    return false;
+    return _impl->error_code() != 0;
 }
 std::string Controller::ErrorText() const {
-    return "";
+    return _impl->error_text();
 }
 
 void Controller::StartCancel() {}
 
 void Controller::SetFailed(const std::string& reason) {
-    std::ignore = reason;
+    SetFailed(EIO, reason);
+}
+
+void Controller::SetFailed(uint32_t error_code, const std::string& reason) {
+    _impl->set_error_code(error_code);
+    _impl->set_error_text(reason);
 }
 bool Controller::IsCanceled() const {
     return false;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <butil/iobuf.h>
+#include <string>
 
 namespace pain {
 
@@ -33,8 +34,17 @@ public:
         return _error_code;
     }
 
+    void set_error_text(const std::string& error_text) {
+        _error_text = error_text;
+    }
+
+    const std::string& error_text() const {
+        return _error_text;
+    }
+
 private:
     uint32_t _error_code = 0;
+    std::string _error_text;
     int _timeout_us = 0;
     bool _direct_io = true;
     butil::IOBuf _request_attachment;
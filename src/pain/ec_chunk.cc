@@ -0,0 +1,312 @@
+#include "pain/ec_chunk.h"
+
+#include <pain/base/macro.h>
+#include <pain/base/plog.h>
+#include <algorithm>
+#include <cstdlib>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <boost/assert.hpp>
+
+namespace pain {
+
+namespace {
+
+// the SIMD kernels of ISA-L run faster on aligned buffers
+constexpr size_t kFragmentAlignment = 64;
+
+Status first_error(const std::vector<Status>& statuses) {
+    for (const auto& status : statuses) {
+        if (!status.ok()) {
+            return status;
+        }
+    }
+    return Status::OK();
+}
+
+// one aligned buffer per fragment for the codec, freed unless handed over to an IOBuf
+class FragmentBuffers {
+public:
+    FragmentBuffers(size_t count, size_t len) : _len(len), _buffers(count, nullptr) {}
+    ~FragmentBuffers() {
+        for (auto* buffer : _buffers) {
+            free(buffer);
+        }
+    }
+
+    FragmentBuffers(const FragmentBuffers&) = delete;
+    FragmentBuffers& operator=(const FragmentBuffers&) = delete;
+
+    bool allocate() {
+        for (auto*& buffer : _buffers) {
+            void* p = nullptr;
+            if (posix_memalign(&p, kFragmentAlignment, _len) != 0) {
+                return false;
+            }
+            buffer = static_cast<uint8_t*>(p);
+        }
+        return true;
+    }
+
+    uint8_t** data() {
+        return _buffers.data();
+    }
+
+    uint8_t* operator[](size_t i) {
+        return _buffers[i];
+    }
+
+    // hand buffer i over to an IOBuf without copying
+    IOBuf release(size_t i) {
+        IOBuf buf;
+        buf.append_user_data(std::exchange(_buffers[i], nullptr), _len, free);
+        return buf;
+    }
+
+private:
+    size_t _len;
+    std::vector<uint8_t*> _buffers;
+};
+
+// the data fragments of the stripes read, fragments[i] holds n cells of fragment i
+struct StripeRead {
+    std::vector<IOBuf> fragments;
+    // the stripes read start at this offset of the chunk
+    uint64_t offset = 0;
+};
+
+// interleave the cells of the data fragments back into the chunk and cut [offset, offset + size) of it
+void assemble(StripeRead* read, uint32_t data_count, uint32_t cell_size, uint64_t offset, uint64_t size, IOBuf* buf) {
+    IOBuf stripes;
+    while (!read->fragments[0].empty()) {
+        for (uint32_t i = 0; i < data_count; i++) {
+            read->fragments[i].cutn(&stripes, cell_size);
+        }
+    }
+    stripes.pop_front(offset - read->offset);
+    buf->clear();
+    stripes.cutn(buf, size);
+}
+
+} // namespace
+
+EcChunk::EcChunk(uint32_t data_count,
+                 uint32_t parity_count,
+                 uint32_t cell_size,
+                 std::vector<EcFragment> fragments,
+                 ManusyaClient* client) :
+    _codec(data_count, parity_count),
+    _cell_size(cell_size),
+    _fragments(std::move(fragments)),
+    _client(client) {
+    BOOST_ASSERT_MSG(_fragments.size() == _codec.fragment_count(), "fragment count mismatch");
+    BOOST_ASSERT_MSG(cell_size > 0, "cell size is 0");
+}
+
+uint64_t EcChunk::size() const {
+    std::unique_lock lock(_mutex);
+    return _size;
+}
+
+uint64_t EcChunk::fragment_size() const {
+    std::unique_lock lock(_mutex);
+    return _stripes * _cell_size;
+}
+
+uint64_t EcChunk::buffered() const {
+    std::unique_lock lock(_mutex);
+    return _buffer.size();
+}
+
+Future<Status> EcChunk::append(IOBuf data) {
+    Stripes stripes;
+    auto future = cut(std::move(data), &stripes);
+    write(std::move(stripes));
+    return future;
+}
+
+Future<Status> EcChunk::cut(IOBuf data, Stripes* stripes) {
+    SPAN("pain", span);
+    std::unique_lock lock(_mutex);
+    if (_flushed) {
+        return make_ready_future(Status(EPERM, "chunk is flushed"));
+    }
+    if (data.empty()) {
+        return make_ready_future(Status::OK());
+    }
+    _size += data.size();
+    _buffer.append(data);
+    Promise<Status> promise;
+    auto future = promise.get_future();
+    auto n = _buffer.size() / stripe_size();
+    if (n == 0) {
+        _waiters.push_back(std::move(promise));
+        return future;
+    }
+    // the appends waiting end in the first stripe cut
+    stripes->acked = std::exchange(_waiters, {});
+    _buffer.cutn(&stripes->data, n * stripe_size());
+    if (_buffer.empty()) {
+        stripes->acked.push_back(std::move(promise));
+    } else {
+        _waiters.push_back(std::move(promise));
+    }
+    stripes->count = n;
+    stripes->offset = _stripes * _cell_size;
+    _stripes += n;
+    _data_end += n * stripe_size();
+    return future;
+}
+
+Future<Status> EcChunk::flush() {
+    SPAN("pain", span);
+    std::unique_lock lock(_mutex);
+    if (_flushed) {
+        return make_ready_future(Status::OK());
+    }
+    _flushed = true;
+    if (_buffer.empty()) {
+        return make_ready_future(Status::OK());
+    }
+    Stripes stripes;
+    stripes.data.swap(_buffer);
+    stripes.data.resize(stripe_size(), '\0');
+    stripes.count = 1;
+    stripes.offset = _stripes * _cell_size;
+    stripes.acked = std::exchange(_waiters, {});
+    _stripes++;
+    _data_end = _size;
+    lock.unlock();
+    return write(std::move(stripes));
+}
+
+Future<Status> EcChunk::write(Stripes stripes) {
+    if (stripes.count == 0) {
+        return make_ready_future(Status::OK());
+    }
+    auto ack = [acked = std::move(stripes.acked)](Status status) mutable {
+        for (auto& promise : acked) {
+            promise.set_value(status);
+        }
+        return status;
+    };
+    auto k = _codec.data_count();
+    auto len = stripes.count * _cell_size;
+    FragmentBuffers buffers(_codec.fragment_count(), len);
+    if (!buffers.allocate()) {
+        return make_ready_future(ack(Status(ENOMEM, "failed to allocate fragments")));
+    }
+    for (uint64_t s = 0; s < stripes.count; s++) {
+        for (uint32_t i = 0; i < k; i++) {
+            stripes.data.cutn(buffers[i] + s * _cell_size, _cell_size);
+        }
+    }
+    _codec.encode(len, buffers.data());
+
+    // all the fragments are written in parallel, the stripes are durable only when all of them ack
+    std::vector<Future<Status>> futures;
+    for (uint32_t i = 0; i < _codec.fragment_count(); i++) {
+        const auto& fragment = _fragments[i];
+        futures.push_back(
+            _client->append_chunk(fragment.location, fragment.chunk_id, stripes.offset, buffers.release(i), false));
+    }
+    return when_all(std::move(futures)).then([ack = std::move(ack)](std::vector<Status> statuses) mutable {
+        return ack(first_error(statuses));
+    });
+}
+
+Future<Status> EcChunk::read(uint64_t offset, uint64_t size, IOBuf* buf) {
+    SPAN("pain", span);
+    if (buf == nullptr) {
+        return make_ready_future(Status(EINVAL, "buf is nullptr"));
+    }
+    uint64_t data_end = 0;
+    {
+        std::unique_lock lock(_mutex);
+        data_end = _data_end;
+    }
+    size = offset < data_end ? std::min(size, data_end - offset) : 0;
+    if (size == 0) {
+        buf->clear();
+        return make_ready_future(Status::OK());
+    }
+
+    auto k = _codec.data_count();
+    auto m = _codec.parity_count();
+    auto first = offset / stripe_size();
+    auto n = (offset + size - 1) / stripe_size() + 1 - first;
+    auto fragment_offset = first * _cell_size;
+    auto len = n * _cell_size;
+    if (len > UINT32_MAX) {
+        return make_ready_future(Status(EINVAL, std::format("read of {} bytes is too large", size)));
+    }
+
+    auto read = std::make_shared<StripeRead>();
+    read->fragments.resize(_codec.fragment_count());
+    read->offset = first * stripe_size();
+    std::vector<Future<Status>> futures;
+    for (uint32_t i = 0; i < k; i++) {
+        const auto& fragment = _fragments[i];
+        futures.push_back(_client->read_chunk(
+            fragment.location, fragment.chunk_id, fragment_offset, len, &read->fragments[i]));
+    }
+
+    auto cell_size = _cell_size;
+    return when_all(std::move(futures))
+        .then([this, read, k, m, cell_size, offset, size, fragment_offset, len, buf](
+                  std::vector<Status> statuses) -> Future<Status> {
+            std::vector<uint32_t> erased;
+            for (uint32_t i = 0; i < k; i++) {
+                if (!statuses[i].ok() || read->fragments[i].size() != len) {
+                    erased.push_back(i);
+                }
+            }
+            if (erased.empty()) {
+                assemble(read.get(), k, cell_size, offset, size, buf);
+                return make_ready_future(Status::OK());
+            }
+            if (erased.size() > m) {
+                return make_ready_future(Status(EIO, std::format("{} data fragments are unavailable", erased.size())));
+            }
+
+            // degraded read, the lost cells are recovered from the parity
+            PLOG_WARN(("desc", "degraded read")("offset", offset)("size", size)("lost", erased.size()));
+            std::vector<Future<Status>> futures;
+            for (uint32_t j = k; j < k + m; j++) {
+                const auto& fragment = _fragments[j];
+                futures.push_back(_client->read_chunk(
+                    fragment.location, fragment.chunk_id, fragment_offset, len, &read->fragments[j]));
+            }
+            return when_all(std::move(futures))
+                .then([read, erased = std::move(erased), this, k, m, cell_size, offset, size, len, buf](
+                          std::vector<Status> statuses) mutable -> Status {
+                    for (uint32_t j = 0; j < m; j++) {
+                        if (!statuses[j].ok() || read->fragments[k + j].size() != len) {
+                            erased.push_back(k + j);
+                        }
+                    }
+                    FragmentBuffers buffers(_codec.fragment_count(), len);
+                    if (!buffers.allocate()) {
+                        return Status(ENOMEM, "failed to allocate fragments");
+                    }
+                    for (uint32_t i = 0; i < _codec.fragment_count(); i++) {
+                        read->fragments[i].copy_to(buffers[i], len);
+                    }
+                    auto status = _codec.decode(len, erased, buffers.data());
+                    if (!status.ok()) {
+                        return Status(EIO, std::format("failed to recover fragments: {}", status.error_str()));
+                    }
+                    for (auto i : erased) {
+                        if (i < k) {
+                            read->fragments[i] = buffers.release(i);
+                        }
+                    }
+                    assemble(read.get(), k, cell_size, offset, size, buf);
+                    return Status::OK();
+                });
+        });
+}
+
+} // namespace pain
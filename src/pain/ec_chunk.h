@@ -0,0 +1,90 @@
+#pragma once
+
+#include <bthread/mutex.h>
+#include <pain/base/future.h>
+#include <pain/base/types.h>
+#include <pain/base/uuid.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "pain/ec_codec.h"
+#include "pain/manusya_client.h"
+
+namespace pain {
+
+// a fragment of an EC chunk is a sub chunk on one manusya
+struct EcFragment {
+    UUID chunk_id;
+    std::string location;
+};
+
+// The layout of an EC chunk of k data fragments and m parity fragments:
+//
+//   chunk           | stripe 0                         | stripe 1                         | ...
+//                   | cell 0 | cell 1 | ... | cell k-1 | cell 0 | cell 1 | ... | cell k-1 | ...
+//   fragment i      | cell i of stripe 0               | cell i of stripe 1               | ...   (i < k)
+//   fragment k + j  | parity j of stripe 0             | parity j of stripe 1             | ...   (j < m)
+//
+// Only whole stripes are written, so the fragments stay append only and a parity cell is never rewritten.
+// As in HDFS EC, the data shorter than a stripe at the end is kept by the writer until flush,
+// which pads it with zeros and ends the chunk. An append is acked only once the stripe holding its last byte
+// is on all the fragments, so the appends ending in that partial stripe wait for it to fill or for flush.
+class EcChunk {
+public:
+    // the whole stripes cut by an append and the appends acked once they are written
+    struct Stripes {
+        IOBuf data;
+        uint64_t count = 0;
+        uint64_t offset = 0;
+        std::vector<Promise<Status>> acked;
+    };
+
+    EcChunk(uint32_t data_count,
+            uint32_t parity_count,
+            uint32_t cell_size,
+            std::vector<EcFragment> fragments,
+            ManusyaClient* client = &ManusyaClient::instance());
+
+    // write the whole stripes of the data buffered so far, the future is ready when the stripe holding
+    // the last byte of data is on all the fragments
+    Future<Status> append(IOBuf data);
+    // the first half of append, cut the whole stripes into stripes, which are written later by write
+    // without the lock of the caller, so the caller can keep the stripes in the order of its appends
+    Future<Status> cut(IOBuf data, Stripes* stripes);
+    Future<Status> write(Stripes stripes);
+    // write the partial stripe at the end and ack the appends waiting for it, the chunk can't be appended any more
+    Future<Status> flush();
+    // read from the stripes written, the cells of the fragments which fail are recovered from the parity
+    Future<Status> read(uint64_t offset, uint64_t size, IOBuf* buf);
+
+    // the bytes appended, including the ones not written yet
+    uint64_t size() const;
+    // the bytes of each fragment
+    uint64_t fragment_size() const;
+    // the bytes of the partial stripe not written yet
+    uint64_t buffered() const;
+
+    uint64_t stripe_size() const {
+        return static_cast<uint64_t>(_cell_size) * _codec.data_count();
+    }
+
+private:
+    EcCodec _codec;
+    uint32_t _cell_size;
+    std::vector<EcFragment> _fragments;
+    ManusyaClient* _client;
+
+    mutable bthread::Mutex _mutex;
+    // the data not making up a stripe yet
+    IOBuf _buffer;
+    // the appends ending in _buffer
+    std::vector<Promise<Status>> _waiters;
+    uint64_t _size = 0;
+    // the stripes sent to the fragments
+    uint64_t _stripes = 0;
+    // the end of the data in the stripes sent, the partial stripe of flush is padded beyond it
+    uint64_t _data_end = 0;
+    bool _flushed = false;
+};
+
+} // namespace pain
@@ -0,0 +1,102 @@
+#include "pain/ec_codec.h"
+
+#include <isa-l/erasure_code.h>
+#include <algorithm>
+#include <format>
+#include <boost/assert.hpp>
+
+namespace pain {
+
+namespace {
+
+// ISA-L expands every coefficient into a 32 bytes table for its SIMD kernels
+constexpr size_t kTableSize = 32;
+// gf_gen_cauchy1_matrix is invertible for any choice of rows while fragment_count() fits in GF(2^8)
+constexpr uint32_t kMaxFragments = 255;
+
+} // namespace
+
+EcCodec::EcCodec(uint32_t data_count, uint32_t parity_count) :
+    _data_count(data_count),
+    _parity_count(parity_count),
+    _encode_matrix(static_cast<size_t>(data_count + parity_count) * data_count),
+    _encode_tables(static_cast<size_t>(data_count) * parity_count * kTableSize) {
+    BOOST_ASSERT_MSG(data_count > 0 && parity_count > 0 && data_count + parity_count <= kMaxFragments,
+                     "invalid ec config");
+    auto k = static_cast<int>(_data_count);
+    auto m = static_cast<int>(fragment_count());
+    gf_gen_cauchy1_matrix(_encode_matrix.data(), m, k);
+    // only the parity rows are computed, the data fragments are the input as they are
+    ec_init_tables(k, m - k, &_encode_matrix[static_cast<size_t>(k) * k], _encode_tables.data());
+}
+
+void EcCodec::encode(size_t len, uint8_t** fragments) const {
+    ec_encode_data(static_cast<int>(len),
+                   static_cast<int>(_data_count),
+                   static_cast<int>(_parity_count),
+                   const_cast<uint8_t*>(_encode_tables.data()),
+                   fragments,
+                   fragments + _data_count);
+}
+
+Status EcCodec::decode(size_t len, const std::vector<uint32_t>& erased, uint8_t** fragments) const {
+    if (erased.empty()) {
+        return Status::OK();
+    }
+    if (erased.size() > _parity_count) {
+        return Status(EINVAL,
+                      std::format("{} fragments are lost, only {} can be recovered", erased.size(), _parity_count));
+    }
+    auto k = _data_count;
+    std::vector<bool> lost(fragment_count(), false);
+    for (auto i : erased) {
+        if (i >= fragment_count()) {
+            return Status(EINVAL, std::format("invalid fragment {}", i));
+        }
+        lost[i] = true;
+    }
+
+    // the rows of the first k fragments still available, and their inverse
+    std::vector<uint8_t*> sources;
+    std::vector<uint8_t> rows(static_cast<size_t>(k) * k);
+    for (uint32_t i = 0; i < fragment_count() && sources.size() < k; i++) {
+        if (!lost[i]) {
+            std::copy_n(&_encode_matrix[i * k], k, &rows[sources.size() * k]);
+            sources.push_back(fragments[i]);
+        }
+    }
+    std::vector<uint8_t> inverse(static_cast<size_t>(k) * k);
+    if (gf_invert_matrix(rows.data(), inverse.data(), static_cast<int>(k)) < 0) {
+        return Status(EINVAL, "the fragments left are not invertible");
+    }
+
+    // a lost data fragment is a row of the inverse, a lost parity fragment is its encode row times the inverse
+    std::vector<uint8_t> decode_matrix(erased.size() * k);
+    std::vector<uint8_t*> outputs;
+    for (size_t e = 0; e < erased.size(); e++) {
+        auto i = erased[e];
+        if (i < k) {
+            std::copy_n(&inverse[i * k], k, &decode_matrix[e * k]);
+        } else {
+            for (uint32_t c = 0; c < k; c++) {
+                uint8_t s = 0;
+                for (uint32_t j = 0; j < k; j++) {
+                    s ^= gf_mul(inverse[j * k + c], _encode_matrix[i * k + j]);
+                }
+                decode_matrix[e * k + c] = s;
+            }
+        }
+        outputs.push_back(fragments[i]);
+    }
+    std::vector<uint8_t> tables(erased.size() * k * kTableSize);
+    ec_init_tables(static_cast<int>(k), static_cast<int>(erased.size()), decode_matrix.data(), tables.data());
+    ec_encode_data(static_cast<int>(len),
+                   static_cast<int>(k),
+                   static_cast<int>(erased.size()),
+                   tables.data(),
+                   sources.data(),
+                   outputs.data());
+    return Status::OK();
+}
+
+} // namespace pain
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <pain/base/types.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace pain {
+
+// EcCodec is a Reed-Solomon code of data_count data fragments and parity_count parity fragments
+// built on the Cauchy matrix of ISA-L, any data_count of the fragments recover the others.
+// The code is applied byte by byte, so fragments of any length can be encoded in one call.
+class EcCodec {
+public:
+    EcCodec(uint32_t data_count, uint32_t parity_count);
+
+    uint32_t data_count() const {
+        return _data_count;
+    }
+
+    uint32_t parity_count() const {
+        return _parity_count;
+    }
+
+    uint32_t fragment_count() const {
+        return _data_count + _parity_count;
+    }
+
+    // fragments are fragment_count() buffers of len bytes, the parity ones are computed from the data ones
+    void encode(size_t len, uint8_t** fragments) const;
+    // recover the fragments listed in erased from the others, EINVAL if more than parity_count are erased
+    Status decode(size_t len, const std::vector<uint32_t>& erased, uint8_t** fragments) const;
+
+private:
+    uint32_t _data_count;
+    uint32_t _parity_count;
+    // fragment_count() rows of data_count, the first data_count rows are the identity
+    std::vector<uint8_t> _encode_matrix;
+    // the expanded tables of the parity rows for ec_encode_data
+    std::vector<uint8_t> _encode_tables;
+};
+
+} // namespace pain
@@ -1,8 +1,13 @@
 #include "pain/file_stream_impl.h"
 #include <brpc/closure_guard.h>
 #include <brpc/controller.h>
+#include <bthread/bthread.h>
+#include <gflags/gflags.h>
 #include <pain/base/macro.h>
 #include <pain/base/plog.h>
+#include <pain/proto/deva.pb.h>
+#include <algorithm>
+#include "deva/sdk/rpc_client.h"
 #include "pain/controller.h"
 
 #define FILE_STREAM_METHOD(name)                                                                                       \
@@ -11,25 +16,174 @@
                               [[maybe_unused]] ::pain::proto::name##Response* response,                                \
                               ::google::protobuf::Closure* done) // NOLINT(readability-non-const-parameter)
 
+DEFINE_uint64(pain_chunk_size, 64UL * 1024 * 1024, "The size a chunk is sealed at");
+DEFINE_bool(pain_append_quorum, false, "Ack an append when a majority of the replicas ack it");
+DEFINE_uint32(pain_append_max_retry, 3, "The times an append is retried on a new chunk");
+DEFINE_uint32(pain_append_window_requests, 1, "The max number of appends in flight of a file, 1 to append one by one");
+DEFINE_uint64(pain_append_window_bytes, 8UL * 1024 * 1024, "The max bytes of the appends in flight of a file");
+DEFINE_uint32(pain_ec_data_count, 0, "The data fragments of an EC chunk, 0 to replicate the chunks");
+DEFINE_uint32(pain_ec_parity_count, 2, "The parity fragments of an EC chunk");
+DEFINE_uint32(pain_ec_cell_size, 1024 * 1024, "The bytes of a cell of the stripes of an EC chunk");
+DEFINE_uint32(pain_ec_flush_delay_ms,
+              100,
+              "The time the appends ending in a partial stripe of an EC chunk wait for the stripe to fill");
+
 namespace pain {
 
+namespace {
+
+struct RollArg {
+    proto::UUID file_id;
+    proto::ChunkInfo sealed;
+    proto::ChunkInfo* chunk;
+    Promise<Status> promise;
+};
+
+// the type and config of the chunks asked from deva, an EC chunk if pain_ec_data_count is set
+template <typename Request>
+void set_chunk_type(Request* request) {
+    if (FLAGS_pain_ec_data_count == 0) {
+        request->set_type(proto::CHUNK_TYPE_NORMAL);
+        return;
+    }
+    request->set_type(proto::CHUNK_TYPE_EC);
+    request->mutable_config()->set_replica_count(FLAGS_pain_ec_data_count);
+    request->mutable_config()->set_parity_count(FLAGS_pain_ec_parity_count);
+}
+
+template <typename Request, typename Response>
+Status to_chunk(const Request& request, const Response& response, proto::ChunkInfo* chunk) {
+    auto uuid = UUID::from_str(response.chunk_id());
+    if (!uuid.has_value() || response.locations_size() == 0) {
+        return Status(EIO, "invalid chunk allocated");
+    }
+    chunk->mutable_uuid()->set_low(uuid->low());
+    chunk->mutable_uuid()->set_high(uuid->high());
+    chunk->set_state(proto::CHUNK_STATE_INIT);
+    chunk->set_type(request.type());
+    if (request.type() == proto::CHUNK_TYPE_EC) {
+        // the locations are the data fragments followed by the parity fragments
+        const auto& config = request.config();
+        if (static_cast<uint32_t>(response.locations_size()) != config.replica_count() + config.parity_count()) {
+            return Status(EIO, "invalid ec chunk allocated");
+        }
+        *chunk->mutable_config() = config;
+    } else {
+        chunk->mutable_config()->set_replica_count(response.locations_size());
+    }
+    for (const auto& location : response.locations()) {
+        auto* replica = chunk->add_replicas();
+        *replica->mutable_chunk_id() = chunk->uuid();
+        *replica->mutable_location() = location;
+    }
+    return Status::OK();
+}
+
+// deva is called synchronously, so the roll runs on its own bthread and never blocks the appends
+void* roll(void* arg) {
+    std::unique_ptr<RollArg> guard(static_cast<RollArg*>(arg));
+    const auto& sealed = guard->sealed;
+    Status status;
+    if (sealed.replicas_size() == 0) {
+        proto::deva::NewChunkRequest request;
+        proto::deva::NewChunkResponse response;
+        *request.mutable_file_id() = guard->file_id;
+        set_chunk_type(&request);
+        status = deva::call_rpc("default", &proto::deva::DevaService::Stub::NewChunk, &request, &response);
+        if (status.ok()) {
+            status = to_chunk(request, response, guard->chunk);
+        }
+    } else {
+        proto::deva::SealAndNewChunkRequest request;
+        proto::deva::SealAndNewChunkResponse response;
+        *request.mutable_file_id() = guard->file_id;
+        *request.mutable_chunk_id() = sealed.uuid();
+        request.set_length(sealed.length());
+        set_chunk_type(&request);
+        status = deva::call_rpc("default", &proto::deva::DevaService::Stub::SealAndNewChunk, &request, &response);
+        if (status.ok()) {
+            status = to_chunk(request, response, guard->chunk);
+        }
+    }
+    guard->promise.set_value(std::move(status));
+    return nullptr;
+}
+
+// deva records the chunk sealed and the new one in the file
+Future<Status> roll_chunk(const proto::UUID& file_id, const proto::ChunkInfo& sealed, proto::ChunkInfo* chunk) {
+    auto* arg = new RollArg{.file_id = file_id, .sealed = sealed, .chunk = chunk, .promise = {}};
+    auto future = arg->promise.get_future();
+    bthread_t tid = 0;
+    if (bthread_start_background(&tid, nullptr, roll, arg) != 0) {
+        arg->promise.set_value(Status(EAGAIN, "failed to start bthread"));
+        delete arg;
+    }
+    return future;
+}
+
+} // namespace
+
+FileStreamImpl::~FileStreamImpl() {
+    if (_writer == nullptr) {
+        return;
+    }
+    // the partial stripe at the end of an EC chunk is written on close
+    auto status = _writer->flush().get();
+    if (!status.ok()) {
+        PLOG_ERROR(("desc", "failed to flush file")("file_id", _file_id)("error", status.error_str()));
+    }
+}
+
+void FileStreamImpl::open_writer() {
+    proto::ChunkInfo chunk;
+    if (_file_info.chunk_infos_size() > 0) {
+        chunk = *_file_info.chunk_infos().rbegin();
+    } else {
+        chunk.set_state(proto::CHUNK_STATE_SEALED);
+        chunk.set_offset(_file_info.size());
+    }
+    ChunkWriterOptions options;
+    options.chunk_size = FLAGS_pain_chunk_size;
+    options.quorum = FLAGS_pain_append_quorum;
+    options.max_retry = FLAGS_pain_append_max_retry;
+    options.window_requests = std::max(FLAGS_pain_append_window_requests, 1U);
+    options.window_bytes = FLAGS_pain_append_window_bytes;
+    options.ec_cell_size = FLAGS_pain_ec_cell_size;
+    options.ec_flush_delay_ms = FLAGS_pain_ec_flush_delay_ms;
+    auto roller = [file_id = _file_info.file_id()](const proto::ChunkInfo& sealed, proto::ChunkInfo* next) {
+        return roll_chunk(file_id, sealed, next);
+    };
+    _writer = ChunkWriter::create(std::move(chunk), std::move(roller), options);
+}
+
 FILE_STREAM_METHOD(Append) {
     SPAN("pain", span);
-    [[maybe_unused]] pain::Controller* cntl = static_cast<pain::Controller*>(controller);
+    pain::Controller* cntl = static_cast<pain::Controller*>(controller);
     PLOG_DEBUG(("desc", __func__)               //
                ("file_id", _file_id)            //
                ("direct_io", cntl->direct_io()) //
                ("data_size", cntl->request_attachment().size()));
 
-    // append to chunk
-    // if _chunks is empty, create a new chunk
-    // if the last chunk is full(64MB), create a new chunk
-    // if append timeout, seal and new chunk
-    // chunk = get_last_chunk();
-    // foreach subchunk in chunk:
-    //   subchunk->append(cntl->request_attachment());
-    //   if timeout, seal and new chunk
-    brpc::ClosureGuard done_guard(done);
+    IOBuf data;
+    data.swap(cntl->request_attachment());
+    auto offset = std::make_shared<uint64_t>(0);
+    auto future =
+        _writer->append(std::move(data), cntl->direct_io(), offset.get()).then([cntl, response, offset](Status status) {
+            if (!status.ok()) {
+                cntl->SetFailed(status.error_code(), status.error_str());
+                response->mutable_header()->set_status(status.error_code());
+                response->mutable_header()->set_message(status.error_str());
+                return;
+            }
+            response->set_offset(*offset);
+        });
+    if (done == nullptr) {
+        future.get();
+        return;
+    }
+    future.then([done]() {
+        done->Run();
+    });
 }
 
 FILE_STREAM_METHOD(Read) {
@@ -2,7 +2,9 @@
 #include <list>
 
 #include <pain/base/uuid.h>
+#include <memory>
 #include "pain/chunk.h"
+#include "pain/chunk_writer.h"
 #include "pain/proto/common.pb.h"
 #include "pain/proto/pain.pb.h"
 
@@ -19,14 +21,20 @@ class Controller;
 // NOLINTNEXTLINE(cppcoreguidelines-virtual-class-destructor)
 class FileStreamImpl : public pain::proto::FileService {
 public:
+    // Append is synchronous without done, with done it returns at once and the appends of the file are pipelined,
+    // up to --pain_append_window_requests of them in flight
     FILE_STREAM_METHOD(Append);
     FILE_STREAM_METHOD(Read);
 
 private:
     friend class FileSystem;
-    ~FileStreamImpl() override = default;
+    ~FileStreamImpl() override;
+    // start writing at the open chunk of _file_info
+    void open_writer();
+
     proto::FileInfo _file_info;
     std::string _file_id;
+    std::shared_ptr<ChunkWriter> _writer;
     friend class FileStream;
 };
 
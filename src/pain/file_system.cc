@@ -105,6 +105,7 @@ Status FileSystem::open(const char* path, int flags, FileStream** file_stream) {
     file_stream_impl->_file_info = file_info;
     UUID uuid(file_info.file_id().high(), file_info.file_id().low());
     file_stream_impl->_file_id = uuid.str();
+    file_stream_impl->open_writer();
 
     auto fs = new FileStream();
     fs->_impl = file_stream_impl;
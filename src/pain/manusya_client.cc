@@ -0,0 +1,140 @@
+#include "pain/manusya_client.h"
+
+#include <brpc/callback.h>
+#include <brpc/channel.h>
+#include <brpc/controller.h>
+#include <gflags/gflags.h>
+#include <pain/base/crc32c.h>
+#include <pain/base/plog.h>
+#include <pain/base/tracer.h>
+#include <format>
+#include <mutex>
+#include "pain/proto/manusya.pb.h"
+
+DEFINE_int32(pain_manusya_timeout_ms, 10000, "The timeout of the chunk requests to manusya");
+DEFINE_int32(pain_manusya_connect_timeout_ms, 2000, "The connect timeout of the chunk requests to manusya");
+
+namespace pain {
+
+namespace {
+
+// the state of an async call, deleted when the call is done
+template <typename Request, typename Response>
+struct Call {
+    brpc::Controller cntl;
+    Request request;
+    Response response;
+    std::shared_ptr<brpc::Channel> channel;
+    Promise<Status> promise;
+};
+
+template <typename Request, typename Response>
+Status call_status(Call<Request, Response>* call) {
+    if (call->cntl.Failed()) {
+        return Status(call->cntl.ErrorCode(), call->cntl.ErrorText());
+    }
+    if (call->response.header().status() != 0) {
+        return Status(static_cast<int>(call->response.header().status()), call->response.header().message());
+    }
+    return Status::OK();
+}
+
+void set_uuid(const UUID& uuid, proto::UUID* out) {
+    out->set_low(uuid.low());
+    out->set_high(uuid.high());
+}
+
+using AppendCall = Call<proto::manusya::AppendChunkRequest, proto::manusya::AppendChunkResponse>;
+using ReadCall = Call<proto::manusya::ReadChunkRequest, proto::manusya::ReadChunkResponse>;
+
+void on_append_done(AppendCall* call) {
+    std::unique_ptr<AppendCall> guard(call);
+    auto status = call_status(call);
+    if (!status.ok()) {
+        PLOG_WARN(("desc", "failed to append chunk")("offset", call->request.offset())("error", status.error_str()));
+    }
+    call->promise.set_value(std::move(status));
+}
+
+void on_read_done(ReadCall* call, IOBuf* data) {
+    std::unique_ptr<ReadCall> guard(call);
+    auto status = call_status(call);
+    if (status.ok() && crc32c(call->cntl.response_attachment()) != call->response.crc32()) {
+        status = Status(EIO, "checksum mismatch");
+    }
+    if (status.ok()) {
+        data->swap(call->cntl.response_attachment());
+    }
+    call->promise.set_value(std::move(status));
+}
+
+} // namespace
+
+ManusyaClient& ManusyaClient::instance() {
+    static ManusyaClient s_client;
+    return s_client;
+}
+
+Status ManusyaClient::channel(const std::string& location, std::shared_ptr<brpc::Channel>* channel) {
+    std::unique_lock lock(_mutex);
+    auto it = _channels.find(location);
+    if (it != _channels.end()) {
+        *channel = it->second;
+        return Status::OK();
+    }
+    brpc::ChannelOptions options;
+    options.timeout_ms = FLAGS_pain_manusya_timeout_ms;
+    options.connect_timeout_ms = FLAGS_pain_manusya_connect_timeout_ms;
+    // a failed append is not retried on the same offset, the writer decides what to do with the chunk
+    options.max_retry = 0;
+    auto new_channel = std::make_shared<brpc::Channel>();
+    if (new_channel->Init(location.c_str(), &options) != 0) {
+        return Status(EINVAL, std::format("failed to init channel to {}", location));
+    }
+    _channels.emplace(location, new_channel);
+    *channel = std::move(new_channel);
+    return Status::OK();
+}
+
+Future<Status> ManusyaClient::append_chunk(
+    const std::string& location, const UUID& chunk_id, uint64_t offset, IOBuf data, bool direct_io) {
+    auto* call = new AppendCall();
+    auto status = channel(location, &call->channel);
+    if (!status.ok()) {
+        delete call;
+        return make_ready_future(std::move(status));
+    }
+    set_uuid(chunk_id, call->request.mutable_chunk_id());
+    call->request.set_offset(offset);
+    call->request.set_length(static_cast<uint32_t>(data.size()));
+    call->request.set_crc32(crc32c(data));
+    call->request.set_direct_io(direct_io);
+    call->cntl.request_attachment().swap(data);
+    inject_tracer(&call->cntl);
+
+    auto future = call->promise.get_future();
+    proto::manusya::ManusyaService_Stub stub(call->channel.get());
+    stub.AppendChunk(&call->cntl, &call->request, &call->response, brpc::NewCallback(on_append_done, call));
+    return future;
+}
+
+Future<Status> ManusyaClient::read_chunk(
+    const std::string& location, const UUID& chunk_id, uint64_t offset, uint32_t length, IOBuf* data) {
+    auto* call = new ReadCall();
+    auto status = channel(location, &call->channel);
+    if (!status.ok()) {
+        delete call;
+        return make_ready_future(std::move(status));
+    }
+    set_uuid(chunk_id, call->request.mutable_chunk_id());
+    call->request.set_offset(offset);
+    call->request.set_length(length);
+    inject_tracer(&call->cntl);
+
+    auto future = call->promise.get_future();
+    proto::manusya::ManusyaService_Stub stub(call->channel.get());
+    stub.ReadChunk(&call->cntl, &call->request, &call->response, brpc::NewCallback(on_read_done, call, data));
+    return future;
+}
+
+} // namespace pain
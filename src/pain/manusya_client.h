@@ -0,0 +1,44 @@
+#pragma once
+
+#include <bthread/mutex.h>
+#include <pain/base/future.h>
+#include <pain/base/types.h>
+#include <pain/base/uuid.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace brpc {
+class Channel;
+}
+
+namespace pain {
+
+// ManusyaClient sends the chunk requests of the sdk to manusya, location is the address of a manusya,
+// e.g. 127.0.0.1:8003. The channels are cached and shared by all the chunks of the process.
+// The methods are virtual so that tests can replace manusya.
+class ManusyaClient {
+public:
+    ManusyaClient() = default;
+    virtual ~ManusyaClient() = default;
+
+    ManusyaClient(const ManusyaClient&) = delete;
+    ManusyaClient& operator=(const ManusyaClient&) = delete;
+
+    static ManusyaClient& instance();
+
+    // the attachment is sent with its crc32c, the future is ready when manusya acks the append
+    virtual Future<Status>
+    append_chunk(const std::string& location, const UUID& chunk_id, uint64_t offset, IOBuf data, bool direct_io);
+    // data is replaced by the bytes read, their crc32c is checked
+    virtual Future<Status>
+    read_chunk(const std::string& location, const UUID& chunk_id, uint64_t offset, uint32_t length, IOBuf* data);
+
+private:
+    Status channel(const std::string& location, std::shared_ptr<brpc::Channel>* channel);
+
+    bthread::Mutex _mutex;
+    std::unordered_map<std::string, std::shared_ptr<brpc::Channel>> _channels;
+};
+
+} // namespace pain
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <pain/base/future.h>
+#include <pain/base/types.h>
+#include <pain/base/uuid.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "pain/manusya_client.h"
+#include "pain/proto/common.pb.h"
+
+namespace pain::test {
+
+// 用内存代替 manusya, 每个 location 上的 chunk 分开保存, 可以让指定的 location 失败或者挂起
+class FakeManusyaClient : public ManusyaClient {
+public:
+    Future<Status> append_chunk(
+        const std::string& location, const UUID& chunk_id, uint64_t offset, IOBuf data, bool direct_io) override {
+        std::ignore = direct_io;
+        if (_failed.contains(location)) {
+            return make_ready_future(Status(EIO, "injected"));
+        }
+        if (_hung.contains(location)) {
+            _hung_promises.emplace_back();
+            return _hung_promises.back().get_future();
+        }
+        auto& chunk = _chunks[key(chunk_id, location)];
+        if (offset != chunk.size()) {
+            return make_ready_future(Status(EINVAL, "offset mismatch"));
+        }
+        chunk.append(data);
+        _appends++;
+        return make_ready_future(Status::OK());
+    }
+
+    Future<Status> read_chunk(
+        const std::string& location, const UUID& chunk_id, uint64_t offset, uint32_t length, IOBuf* data) override {
+        if (_failed.contains(location)) {
+            return make_ready_future(Status(EIO, "injected"));
+        }
+        IOBuf copy = _chunks[key(chunk_id, location)];
+        copy.pop_front(offset);
+        data->clear();
+        copy.cutn(data, length);
+        return make_ready_future(Status::OK());
+    }
+
+    const IOBuf& chunk(const UUID& chunk_id, const std::string& location) {
+        return _chunks[key(chunk_id, location)];
+    }
+
+    const IOBuf& chunk(const proto::UUID& chunk_id, const std::string& location) {
+        return chunk(UUID(chunk_id.high(), chunk_id.low()), location);
+    }
+
+    // 成功写入的次数
+    size_t appends() const {
+        return _appends;
+    }
+
+    std::set<std::string> _failed;
+    std::set<std::string> _hung;
+    std::vector<Promise<Status>> _hung_promises;
+
+private:
+    static std::string key(const UUID& chunk_id, const std::string& location) {
+        return chunk_id.str() + "@" + location;
+    }
+
+    std::map<std::string, IOBuf> _chunks;
+    size_t _appends = 0;
+};
+
+} // namespace pain::test
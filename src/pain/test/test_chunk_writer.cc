@@ -0,0 +1,384 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "pain/chunk_writer.h"
+#include "pain/test/fake_manusya_client.h"
+
+// NOLINTBEGIN(readability-magic-numbers)
+namespace {
+using namespace pain;
+using namespace pain::test;
+
+// 代替 deva 分配 chunk, 记录每次 seal 的长度
+class FakeRoller {
+public:
+    Future<Status> roll(const proto::ChunkInfo& sealed, proto::ChunkInfo* chunk) {
+        if (fail) {
+            return make_ready_future(Status(ENOSPC, "injected"));
+        }
+        if (sealed.replicas_size() > 0) {
+            sealed_lengths.push_back(sealed.length());
+        }
+        auto uuid = UUID::generate();
+        chunk->mutable_uuid()->set_low(uuid.low());
+        chunk->mutable_uuid()->set_high(uuid.high());
+        chunk->set_state(proto::CHUNK_STATE_INIT);
+        if (ec) {
+            // 2 个数据分片, 1 个校验分片
+            chunk->set_type(proto::CHUNK_TYPE_EC);
+            chunk->mutable_config()->set_replica_count(2);
+            chunk->mutable_config()->set_parity_count(1);
+        }
+        for (int i = 0; i < 3; i++) {
+            auto* replica = chunk->add_replicas();
+            *replica->mutable_chunk_id() = chunk->uuid();
+            replica->mutable_location()->set_uri("127.0.0.1:" + std::to_string(8000 + (next++ % 6)));
+        }
+        chunks.push_back(*chunk);
+        return make_ready_future(Status::OK());
+    }
+
+    bool fail = false;
+    bool ec = false;
+    int next = 0;
+    std::vector<uint64_t> sealed_lengths;
+    std::vector<proto::ChunkInfo> chunks;
+};
+
+class TestChunkWriter : public ::testing::Test {
+protected:
+    void open(const ChunkWriterOptions& options) {
+        proto::ChunkInfo chunk;
+        chunk.set_state(proto::CHUNK_STATE_SEALED);
+        _writer = ChunkWriter::create(
+            chunk,
+            [this](const proto::ChunkInfo& sealed, proto::ChunkInfo* next) {
+                return _roller.roll(sealed, next);
+            },
+            options,
+            &_client);
+    }
+
+    Future<Status> async_append(const std::string& data, uint64_t* offset) {
+        IOBuf buf;
+        buf.append(data);
+        return _writer->append(std::move(buf), false, offset);
+    }
+
+    Status append(const std::string& data, uint64_t* offset) {
+        return async_append(data, offset).get();
+    }
+
+    // chunk 的第 i 个副本上的数据
+    std::string replica(const proto::ChunkInfo& chunk, int i) {
+        return _client.chunk(chunk.uuid(), chunk.replicas(i).location().uri()).to_string();
+    }
+
+    FakeManusyaClient _client;
+    FakeRoller _roller;
+    std::shared_ptr<ChunkWriter> _writer;
+};
+
+// 第一次写入时分配 chunk, 所有副本内容一致
+TEST_F(TestChunkWriter, AppendToAllReplicas) {
+    open(ChunkWriterOptions{});
+    uint64_t offset = 0;
+    ASSERT_TRUE(append("hello ", &offset).ok());
+    ASSERT_EQ(offset, 0);
+    ASSERT_TRUE(append("world", &offset).ok());
+    ASSERT_EQ(offset, 6);
+    ASSERT_EQ(_writer->size(), 11);
+
+    ASSERT_EQ(_roller.chunks.size(), 1);
+    const auto& chunk = _roller.chunks[0];
+    for (const auto& replica : chunk.replicas()) {
+        ASSERT_EQ(_client.chunk(chunk.uuid(), replica.location().uri()).to_string(), "hello world");
+    }
+}
+
+// 写满后 seal 并切换到新的 chunk
+TEST_F(TestChunkWriter, RollWhenFull) {
+    open(ChunkWriterOptions{.chunk_size = 10, .quorum = false, .max_retry = 3});
+    uint64_t offset = 0;
+    ASSERT_TRUE(append("12345678", &offset).ok());
+    ASSERT_TRUE(append("abcd", &offset).ok());
+    ASSERT_EQ(offset, 8);
+    // 大于 chunk_size 的写入单独放在一个 chunk
+    ASSERT_TRUE(append(std::string(20, 'x'), &offset).ok());
+    ASSERT_EQ(offset, 12);
+    ASSERT_EQ(_writer->size(), 32);
+    ASSERT_EQ(_roller.chunks.size(), 3);
+    ASSERT_EQ(_roller.sealed_lengths, (std::vector<uint64_t>{8, 4}));
+}
+
+// 副本失败时 seal 当前 chunk, 在新的 chunk 上重试
+TEST_F(TestChunkWriter, RetryOnNewChunk) {
+    open(ChunkWriterOptions{});
+    uint64_t offset = 0;
+    ASSERT_TRUE(append("hello", &offset).ok());
+    _client._failed.insert(_roller.chunks[0].replicas(1).location().uri());
+    _roller.next = 3;
+    ASSERT_TRUE(append("world", &offset).ok());
+    ASSERT_EQ(offset, 5);
+    ASSERT_EQ(_roller.sealed_lengths, (std::vector<uint64_t>{5}));
+    const auto& chunk = _roller.chunks[1];
+    for (const auto& replica : chunk.replicas()) {
+        ASSERT_EQ(_client.chunk(chunk.uuid(), replica.location().uri()).to_string(), "world");
+    }
+}
+
+TEST_F(TestChunkWriter, RetryExhausted) {
+    open(ChunkWriterOptions{.chunk_size = 1024, .quorum = false, .max_retry = 2});
+    for (int i = 0; i < 6; i++) {
+        _client._failed.insert("127.0.0.1:" + std::to_string(8000 + i));
+    }
+    uint64_t offset = 0;
+    ASSERT_EQ(append("hello", &offset).error_code(), EIO);
+    ASSERT_EQ(_roller.chunks.size(), 3);
+    ASSERT_EQ(_writer->size(), 0);
+}
+
+// quorum 模式下多数派成功即返回, 慢副本之后 seal
+TEST_F(TestChunkWriter, QuorumAck) {
+    open(ChunkWriterOptions{.chunk_size = 1024, .quorum = true, .max_retry = 3});
+    uint64_t offset = 0;
+    ASSERT_TRUE(append("hello", &offset).ok());
+    _client._hung.insert(_roller.chunks[0].replicas(2).location().uri());
+    ASSERT_TRUE(append("world", &offset).ok());
+    ASSERT_EQ(offset, 5);
+    ASSERT_EQ(_roller.chunks.size(), 1);
+
+    // 慢副本最终失败, 下一次写入换到新的 chunk
+    _client._hung_promises[0].set_value(Status(ETIMEDOUT, "injected"));
+    ASSERT_TRUE(append("!", &offset).ok());
+    ASSERT_EQ(offset, 10);
+    ASSERT_EQ(_roller.sealed_lengths, (std::vector<uint64_t>{10}));
+}
+
+TEST_F(TestChunkWriter, QuorumLost) {
+    open(ChunkWriterOptions{.chunk_size = 1024, .quorum = true, .max_retry = 0});
+    uint64_t offset = 0;
+    ASSERT_TRUE(append("hello", &offset).ok());
+    _client._failed.insert(_roller.chunks[0].replicas(0).location().uri());
+    _client._failed.insert(_roller.chunks[0].replicas(1).location().uri());
+    ASSERT_EQ(append("world", &offset).error_code(), EIO);
+}
+
+TEST_F(TestChunkWriter, RollFailure) {
+    open(ChunkWriterOptions{});
+    _roller.fail = true;
+    uint64_t offset = 0;
+    ASSERT_EQ(append("hello", &offset).error_code(), ENOSPC);
+    _roller.fail = false;
+    ASSERT_TRUE(append("hello", &offset).ok());
+    ASSERT_EQ(offset, 0);
+}
+
+// 窗口内的多个写入同时在途, 按 offset 顺序确认
+TEST_F(TestChunkWriter, PipelinedAppends) {
+    open(ChunkWriterOptions{
+        .chunk_size = 1024, .quorum = false, .max_retry = 3, .window_requests = 3, .window_bytes = 1024});
+    uint64_t offset = 0;
+    ASSERT_TRUE(append("0", &offset).ok());
+    for (const auto& replica : _roller.chunks[0].replicas()) {
+        _client._hung.insert(replica.location().uri());
+    }
+
+    std::vector<uint64_t> offsets(4);
+    std::vector<Future<Status>> futures;
+    for (int i = 0; i < 4; i++) {
+        IOBuf buf;
+        buf.append(std::string(10, static_cast<char>('a' + i)));
+        futures.push_back(_writer->append(std::move(buf), false, &offsets[i]));
+    }
+    // 窗口只允许 3 个写入在途
+    ASSERT_EQ(_client._hung_promises.size(), 9);
+
+    // 第二个写入先完成, 但要等第一个完成才能确认
+    for (int r = 3; r < 6; r++) {
+        _client._hung_promises[r].set_value(Status::OK());
+    }
+    ASSERT_FALSE(futures[1].is_ready());
+    ASSERT_EQ(_client._hung_promises.size(), 9);
+    for (int r = 0; r < 3; r++) {
+        _client._hung_promises[r].set_value(Status::OK());
+    }
+    ASSERT_TRUE(futures[0].is_ready());
+    ASSERT_TRUE(futures[1].is_ready());
+    // 窗口空出后第四个写入发出
+    ASSERT_EQ(_client._hung_promises.size(), 12);
+    for (int r = 6; r < 12; r++) {
+        _client._hung_promises[r].set_value(Status::OK());
+    }
+    for (int i = 0; i < 4; i++) {
+        ASSERT_TRUE(futures[i].get().ok());
+        ASSERT_EQ(offsets[i], 1 + i * 10);
+    }
+    ASSERT_EQ(_writer->size(), 41);
+}
+
+// 窗口中间的写入失败时, seal 在已确认的位置, 后面的写入按顺序重发到新 chunk
+TEST_F(TestChunkWriter, PipelinedFailure) {
+    open(ChunkWriterOptions{
+        .chunk_size = 1024, .quorum = false, .max_retry = 3, .window_requests = 4, .window_bytes = 1024});
+    uint64_t offset = 0;
+    ASSERT_TRUE(append("0", &offset).ok());
+    for (const auto& replica : _roller.chunks[0].replicas()) {
+        _client._hung.insert(replica.location().uri());
+    }
+
+    std::vector<uint64_t> offsets(3);
+    std::vector<Future<Status>> futures;
+    for (int i = 0; i < 3; i++) {
+        IOBuf buf;
+        buf.append(std::string(10, static_cast<char>('a' + i)));
+        futures.push_back(_writer->append(std::move(buf), false, &offsets[i]));
+    }
+    ASSERT_EQ(_client._hung_promises.size(), 9);
+    _client._hung.clear();
+    _roller.next = 3;
+
+    // 第一个成功, 第二个失败, 第三个成功但在空洞之后
+    for (int r = 0; r < 3; r++) {
+        _client._hung_promises[r].set_value(Status::OK());
+    }
+    _client._hung_promises[3].set_value(Status(ETIMEDOUT, "injected"));
+    for (int r = 4; r < 9; r++) {
+        _client._hung_promises[r].set_value(Status::OK());
+    }
+    for (int i = 0; i < 3; i++) {
+        ASSERT_TRUE(futures[i].get().ok());
+    }
+    ASSERT_EQ(_roller.sealed_lengths, (std::vector<uint64_t>{11}));
+    ASSERT_EQ(offsets, (std::vector<uint64_t>{1, 11, 21}));
+    const auto& chunk = _roller.chunks[1];
+    for (const auto& replica : chunk.replicas()) {
+        ASSERT_EQ(_client.chunk(chunk.uuid(), replica.location().uri()).to_string(),
+                  std::string(10, 'b') + std::string(10, 'c'));
+    }
+}
+
+// EC chunk 只写整条 stripe, 写入在最后一个字节所在的 stripe 写下去后确认, flush 时补齐最后一条
+TEST_F(TestChunkWriter, EcAppendAndFlush) {
+    _roller.ec = true;
+    open(ChunkWriterOptions{
+        .chunk_size = 1024, .quorum = false, .max_retry = 3, .ec_cell_size = 4, .ec_flush_delay_ms = 1000000});
+    uint64_t offset1 = 0;
+    auto future1 = async_append("0123456789", &offset1);
+    ASSERT_FALSE(future1.is_ready());
+    const auto& chunk = _roller.chunks[0];
+    ASSERT_EQ(replica(chunk, 0), "0123");
+    ASSERT_EQ(replica(chunk, 1), "4567");
+    ASSERT_EQ(replica(chunk, 2).size(), 4);
+
+    // 补满 stripe 后两个写入都确认
+    uint64_t offset2 = 0;
+    auto future2 = async_append("abcdef", &offset2);
+    ASSERT_TRUE(future1.get().ok());
+    ASSERT_TRUE(future2.get().ok());
+    ASSERT_EQ(offset1, 0);
+    ASSERT_EQ(offset2, 10);
+
+    uint64_t offset3 = 0;
+    auto future3 = async_append("xy", &offset3);
+    ASSERT_FALSE(future3.is_ready());
+    ASSERT_TRUE(_writer->flush().get().ok());
+    ASSERT_TRUE(future3.get().ok());
+    ASSERT_EQ(offset3, 16);
+    ASSERT_EQ(replica(chunk, 0), std::string("012389abxy\0\0", 12));
+    ASSERT_EQ(replica(chunk, 1), std::string("4567cdef\0\0\0\0", 12));
+    ASSERT_EQ(replica(chunk, 2).size(), 12);
+
+    // flush 之后的写入切换到新的 chunk
+    uint64_t offset = 0;
+    auto future = async_append("z", &offset);
+    ASSERT_EQ(_roller.sealed_lengths, (std::vector<uint64_t>{18}));
+    ASSERT_EQ(_roller.chunks.size(), 2);
+    ASSERT_TRUE(_writer->flush().get().ok());
+    ASSERT_TRUE(future.get().ok());
+    ASSERT_EQ(offset, 18);
+}
+
+// 切换 chunk 前写入最后一条不完整的 stripe, 确认等待它的写入
+TEST_F(TestChunkWriter, EcFlushOnRoll) {
+    _roller.ec = true;
+    open(ChunkWriterOptions{
+        .chunk_size = 10, .quorum = false, .max_retry = 3, .ec_cell_size = 4, .ec_flush_delay_ms = 1000000});
+    uint64_t offset1 = 0;
+    auto future1 = async_append("0123456789", &offset1);
+    ASSERT_FALSE(future1.is_ready());
+    uint64_t offset2 = 0;
+    auto future2 = async_append("abcd", &offset2);
+    ASSERT_TRUE(future1.get().ok());
+    ASSERT_EQ(offset1, 0);
+    ASSERT_EQ(_roller.sealed_lengths, (std::vector<uint64_t>{10}));
+    const auto& chunk = _roller.chunks[0];
+    ASSERT_EQ(replica(chunk, 0), std::string("012389\0\0", 8));
+    ASSERT_EQ(_roller.chunks[1].type(), proto::CHUNK_TYPE_EC);
+
+    ASSERT_FALSE(future2.is_ready());
+    ASSERT_TRUE(_writer->flush().get().ok());
+    ASSERT_TRUE(future2.get().ok());
+    ASSERT_EQ(offset2, 10);
+}
+
+// 最后一条 stripe 写失败时, 等待它的写入没有确认, chunk 在已确认的位置 seal, 写入重发到新 chunk
+TEST_F(TestChunkWriter, EcFlushFailure) {
+    _roller.ec = true;
+    open(ChunkWriterOptions{
+        .chunk_size = 10, .quorum = false, .max_retry = 3, .ec_cell_size = 4, .ec_flush_delay_ms = 1000000});
+    uint64_t offset = 0;
+    auto future = async_append("0123456789", &offset);
+    _client._failed.insert(_roller.chunks[0].replicas(1).location().uri());
+    _roller.next = 3;
+    ASSERT_EQ(_writer->flush().get().error_code(), EIO);
+    ASSERT_EQ(_roller.sealed_lengths, (std::vector<uint64_t>{0}));
+    ASSERT_FALSE(future.is_ready());
+
+    ASSERT_TRUE(_writer->flush().get().ok());
+    ASSERT_TRUE(future.get().ok());
+    ASSERT_EQ(offset, 0);
+    ASSERT_EQ(_writer->size(), 10);
+    ASSERT_EQ(replica(_roller.chunks[1], 0), std::string("012389\0\0", 8));
+}
+
+// 没有写入补满 stripe 时, 等待 ec_flush_delay_ms 后写入最后一条 stripe
+TEST_F(TestChunkWriter, EcFlushAfterDelay) {
+    _roller.ec = true;
+    open(ChunkWriterOptions{
+        .chunk_size = 1024, .quorum = false, .max_retry = 3, .ec_cell_size = 4, .ec_flush_delay_ms = 1});
+    uint64_t offset = 0;
+    ASSERT_TRUE(append("0123456789", &offset).ok());
+    ASSERT_EQ(offset, 0);
+    ASSERT_EQ(replica(_roller.chunks[0], 0), std::string("012389\0\0", 8));
+
+    ASSERT_TRUE(append("ab", &offset).ok());
+    ASSERT_EQ(offset, 10);
+    ASSERT_EQ(_roller.sealed_lengths, (std::vector<uint64_t>{10}));
+}
+
+// 等待 stripe 补满的写入不占窗口, 后面的写入可以发出去补满它
+TEST_F(TestChunkWriter, EcWaitingOutOfWindow) {
+    _roller.ec = true;
+    open(ChunkWriterOptions{.chunk_size = 1024,
+                            .quorum = false,
+                            .max_retry = 3,
+                            .window_requests = 1,
+                            .ec_cell_size = 4,
+                            .ec_flush_delay_ms = 1000000});
+    std::vector<uint64_t> offsets(4);
+    std::vector<Future<Status>> futures;
+    for (int i = 0; i < 4; i++) {
+        futures.push_back(async_append(std::string(2, static_cast<char>('a' + i)), &offsets[i]));
+    }
+    for (int i = 0; i < 4; i++) {
+        ASSERT_TRUE(futures[i].get().ok());
+        ASSERT_EQ(offsets[i], i * 2);
+    }
+    ASSERT_EQ(replica(_roller.chunks[0], 0), "aabb");
+    ASSERT_EQ(replica(_roller.chunks[0], 1), "ccdd");
+}
+
+} // namespace
+// NOLINTEND(readability-magic-numbers)
@@ -0,0 +1,222 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "pain/ec_chunk.h"
+#include "pain/ec_codec.h"
+#include "pain/test/fake_manusya_client.h"
+
+// NOLINTBEGIN(readability-magic-numbers)
+namespace {
+using namespace pain;
+using namespace pain::test;
+
+std::string make_data(size_t size) {
+    std::string data(size, '\0');
+    for (size_t i = 0; i < size; i++) {
+        data[i] = static_cast<char>((i * 131 + i / 7) & 0xff);
+    }
+    return data;
+}
+
+IOBuf make_iobuf(const std::string& data) {
+    IOBuf buf;
+    buf.append(data);
+    return buf;
+}
+
+class TestEcChunk : public ::testing::Test {
+protected:
+    static constexpr uint32_t kDataCount = 4;
+    static constexpr uint32_t kParityCount = 2;
+    static constexpr uint32_t kCellSize = 64;
+
+    void SetUp() override {
+        for (uint32_t i = 0; i < kDataCount + kParityCount; i++) {
+            _fragments.push_back(EcFragment{.chunk_id = UUID::generate(), .location = location(i)});
+        }
+        _chunk = std::make_unique<EcChunk>(kDataCount, kParityCount, kCellSize, _fragments, &_client);
+    }
+
+    static std::string location(uint32_t i) {
+        return "127.0.0.1:" + std::to_string(8000 + i);
+    }
+
+    std::string read(uint64_t offset, uint64_t size) {
+        IOBuf buf;
+        auto status = _chunk->read(offset, size, &buf).get();
+        EXPECT_TRUE(status.ok()) << status.error_str();
+        return buf.to_string();
+    }
+
+    // 分片 i 上保存的数据
+    std::string fragment(uint32_t i) {
+        return _client.chunk(_fragments[i].chunk_id, _fragments[i].location).to_string();
+    }
+
+    FakeManusyaClient _client;
+    std::vector<EcFragment> _fragments;
+    std::unique_ptr<EcChunk> _chunk;
+};
+
+// 编码后任意丢失不超过 m 个分片都能恢复
+TEST(TestEcCodec, DecodeAnyErasures) {
+    EcCodec codec(4, 2);
+    constexpr size_t kLen = 256;
+    std::vector<std::string> origin(codec.fragment_count());
+    std::vector<std::vector<uint8_t>> buffers(codec.fragment_count(), std::vector<uint8_t>(kLen));
+    std::vector<uint8_t*> fragments;
+    for (auto& buffer : buffers) {
+        fragments.push_back(buffer.data());
+    }
+    for (uint32_t i = 0; i < codec.data_count(); i++) {
+        auto data = make_data(kLen * (i + 2));
+        std::memcpy(fragments[i], data.data() + kLen * (i + 1), kLen);
+    }
+    codec.encode(kLen, fragments.data());
+    for (uint32_t i = 0; i < codec.fragment_count(); i++) {
+        origin[i].assign(reinterpret_cast<char*>(fragments[i]), kLen);
+    }
+
+    for (uint32_t a = 0; a < codec.fragment_count(); a++) {
+        for (uint32_t b = a; b < codec.fragment_count(); b++) {
+            std::vector<uint32_t> erased = {a};
+            if (b != a) {
+                erased.push_back(b);
+            }
+            for (auto i : erased) {
+                std::memset(fragments[i], 0, kLen);
+            }
+            auto status = codec.decode(kLen, erased, fragments.data());
+            ASSERT_TRUE(status.ok()) << status.error_str();
+            for (uint32_t i = 0; i < codec.fragment_count(); i++) {
+                ASSERT_EQ(std::string(reinterpret_cast<char*>(fragments[i]), kLen), origin[i])
+                    << "fragment " << i << " erased " << a << "," << b;
+            }
+        }
+    }
+}
+
+TEST(TestEcCodec, TooManyErasures) {
+    EcCodec codec(4, 2);
+    std::vector<std::vector<uint8_t>> buffers(codec.fragment_count(), std::vector<uint8_t>(16));
+    std::vector<uint8_t*> fragments;
+    for (auto& buffer : buffers) {
+        fragments.push_back(buffer.data());
+    }
+    auto status = codec.decode(16, {0, 1, 2}, fragments.data());
+    ASSERT_EQ(status.error_code(), EINVAL);
+}
+
+// 不足一个 stripe 的数据在 flush 之前不会写下去, 写入也不会确认
+TEST_F(TestEcChunk, PartialStripeKeptUntilFlush) {
+    auto data = make_data(_chunk->stripe_size() - 1);
+    auto future = _chunk->append(make_iobuf(data));
+    ASSERT_FALSE(future.is_ready());
+    ASSERT_EQ(_client.appends(), 0);
+    ASSERT_EQ(_chunk->size(), data.size());
+    ASSERT_EQ(read(0, data.size()), "");
+
+    ASSERT_TRUE(_chunk->flush().get().ok());
+    ASSERT_TRUE(future.get().ok());
+    ASSERT_EQ(_client.appends(), kDataCount + kParityCount);
+    ASSERT_EQ(_chunk->fragment_size(), kCellSize);
+    ASSERT_EQ(read(0, data.size() + 100), data);
+}
+
+TEST_F(TestEcChunk, AppendAndRead) {
+    auto data = make_data(_chunk->stripe_size() * 5 + 100);
+    size_t pos = 0;
+    std::vector<Future<Status>> futures;
+    for (size_t len : {1UL, 300UL, 77UL, 700UL, 256UL}) {
+        futures.push_back(_chunk->append(make_iobuf(data.substr(pos, len))));
+        pos += len;
+    }
+    futures.push_back(_chunk->append(make_iobuf(data.substr(pos))));
+    ASSERT_TRUE(_chunk->flush().get().ok());
+    for (auto& future : futures) {
+        ASSERT_TRUE(future.get().ok());
+    }
+    ASSERT_EQ(_chunk->size(), data.size());
+    ASSERT_EQ(_chunk->fragment_size(), kCellSize * 6);
+
+    // 每个数据分片按 cell 交织保存
+    auto fragment1 = fragment(1);
+    ASSERT_EQ(fragment1.substr(0, kCellSize), data.substr(kCellSize, kCellSize));
+    ASSERT_EQ(fragment1.substr(kCellSize, kCellSize), data.substr(_chunk->stripe_size() + kCellSize, kCellSize));
+
+    ASSERT_EQ(read(0, data.size()), data);
+    ASSERT_EQ(read(10, 20), data.substr(10, 20));
+    ASSERT_EQ(read(250, 600), data.substr(250, 600));
+    ASSERT_EQ(read(data.size() - 5, 100), data.substr(data.size() - 5));
+    ASSERT_EQ(read(data.size(), 100), "");
+}
+
+// 丢失两个分片仍然可以读, 丢失三个则失败
+TEST_F(TestEcChunk, DegradedRead) {
+    auto data = make_data(_chunk->stripe_size() * 3 + 10);
+    auto future = _chunk->append(make_iobuf(data));
+    ASSERT_TRUE(_chunk->flush().get().ok());
+    ASSERT_TRUE(future.get().ok());
+
+    _client._failed.insert(location(1));
+    ASSERT_EQ(read(0, data.size()), data);
+    _client._failed.insert(location(3));
+    ASSERT_EQ(read(0, data.size()), data);
+    ASSERT_EQ(read(100, 300), data.substr(100, 300));
+
+    _client._failed.insert(location(4));
+    IOBuf buf;
+    auto status = _chunk->read(0, data.size(), &buf).get();
+    ASSERT_EQ(status.error_code(), EIO);
+}
+
+TEST_F(TestEcChunk, DegradedReadWithParityLost) {
+    auto data = make_data(_chunk->stripe_size() * 2);
+    ASSERT_TRUE(_chunk->append(make_iobuf(data)).get().ok());
+
+    _client._failed.insert(location(0));
+    _client._failed.insert(location(5));
+    ASSERT_EQ(read(0, data.size()), data);
+}
+
+TEST_F(TestEcChunk, AppendFailure) {
+    _client._failed.insert(location(5));
+    auto status = _chunk->append(make_iobuf(make_data(_chunk->stripe_size()))).get();
+    ASSERT_EQ(status.error_code(), EIO);
+}
+
+// 写入在最后一个字节所在的 stripe 写下去之后才确认
+TEST_F(TestEcChunk, AppendAckedWithItsStripe) {
+    auto data = make_data(_chunk->stripe_size() * 2);
+    auto first = _chunk->append(make_iobuf(data.substr(0, 10)));
+    auto second = _chunk->append(make_iobuf(data.substr(10, _chunk->stripe_size())));
+    ASSERT_TRUE(first.get().ok());
+    ASSERT_FALSE(second.is_ready());
+
+    auto third = _chunk->append(make_iobuf(data.substr(10 + _chunk->stripe_size())));
+    ASSERT_TRUE(second.get().ok());
+    ASSERT_TRUE(third.get().ok());
+    ASSERT_EQ(_chunk->fragment_size(), kCellSize * 2);
+}
+
+// stripe 写失败时等待它的写入都失败
+TEST_F(TestEcChunk, FlushFailure) {
+    auto future = _chunk->append(make_iobuf(make_data(10)));
+    _client._failed.insert(location(2));
+    ASSERT_EQ(_chunk->flush().get().error_code(), EIO);
+    ASSERT_EQ(future.get().error_code(), EIO);
+}
+
+TEST_F(TestEcChunk, AppendAfterFlush) {
+    auto future = _chunk->append(make_iobuf(make_data(10)));
+    ASSERT_TRUE(_chunk->flush().get().ok());
+    ASSERT_TRUE(future.get().ok());
+    ASSERT_TRUE(_chunk->flush().get().ok());
+    auto status = _chunk->append(make_iobuf(make_data(10))).get();
+    ASSERT_EQ(status.error_code(), EPERM);
+}
+
+} // namespace
+// NOLINTEND(readability-magic-numbers)
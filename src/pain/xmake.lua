@@ -1,7 +1,9 @@
 target("pain")
     set_kind("static")
-    add_files("**.cc")
+    add_files("**.cc|test/**.cc")
     add_deps("pain_proto")
     add_deps("pain_base")
     add_packages("protobuf-cpp")
     add_packages("uuid_v4")
+    add_packages("brpc")
+    add_packages("spdk")
@@ -97,6 +97,7 @@ REGISTER_MANUSYA_CMD(append_chunk, [](argparse::ArgumentParser& parser) {
     // NOLINTNEXTLINE(modernize-use-nullptr)
     parser.add_argument("-o", "--offset").default_value(0UL).help("offset to append data").scan<'i', uint64_t>();
     parser.add_argument("-d", "--data").required().help("data to append");
+    parser.add_argument("--direct-io").default_value(false).implicit_value(true).help("bypass the page cache");
 });
 COMMAND(append_chunk) {
     SPAN(span);
@@ -104,6 +105,7 @@ COMMAND(append_chunk) {
     auto host = args.get<std::string>("--host");
     auto data = args.get<std::string>("--data");
     auto offset = args.get<uint64_t>("--offset");
+    auto direct_io = args.get<bool>("--direct-io");
 
     if (!UUID::valid(chunk_id)) {
         return Status(EINVAL, "Invalid chunk id");
@@ -126,6 +128,7 @@ COMMAND(append_chunk) {
 
     auto uuid = pain::UUID::from_str_or_die(chunk_id);
     request.set_offset(offset);
+    request.set_direct_io(direct_io);
     request.mutable_chunk_id()->set_low(uuid.low());
     request.mutable_chunk_id()->set_high(uuid.high());
     cntl.request_attachment().append(data);
@@ -199,6 +202,7 @@ REGISTER_MANUSYA_CMD(read_chunk, [](argparse::ArgumentParser& parser) {
     parser.add_argument("--offset").default_value(0UL).help("offset to read data").scan<'i', uint64_t>();
     parser.add_argument("-l", "--length").default_value(1024U).help("length to read data").scan<'i', uint32_t>();
     parser.add_argument("-o", "--output").default_value(std::string("-"));
+    parser.add_argument("--direct-io").default_value(false).implicit_value(true).help("bypass the page cache");
 });
 COMMAND(read_chunk) {
     SPAN(span);
@@ -207,6 +211,7 @@ COMMAND(read_chunk) {
     auto offset = args.get<uint64_t>("--offset");
     auto length = args.get<uint32_t>("--length");
     auto output = args.get<std::string>("--output");
+    auto direct_io = args.get<bool>("--direct-io");
 
     if (!UUID::valid(chunk_id)) {
         return Status(EINVAL, "Invalid chunk id");
@@ -231,6 +236,7 @@ COMMAND(read_chunk) {
 
     request.set_offset(offset);
     request.set_length(length);
+    request.set_direct_io(direct_io);
     request.mutable_chunk_id()->set_low(uuid.low());
     request.mutable_chunk_id()->set_high(uuid.high());
     stub.ReadChunk(&cntl, &request, &response, nullptr);